@@ -0,0 +1,243 @@
+/**
+ *@file app_afc.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief per remote device carrier offset tracking from the RFM69 FEI
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <string.h>
+#include <stdlib.h>
+
+#include "app_afc.h"
+
+//a FEI reading this far off is noise or a different transmitter, not drift
+#define AFC_FEI_MAX_HZ			30000
+//estimate and bound follow new samples with a weight of 1/2^AFC_EMA_SHIFT
+#define AFC_EMA_SHIFT			2
+//above this the estimate can't be trusted to keep the remote inside the rx bandwidth
+#define AFC_RESCAN_BOUND_HZ		8000
+//enough samples this close together and the estimate is the remote's, not still converging
+#define AFC_SETTLED_CNT			8
+#define AFC_SETTLED_BOUND_HZ	2000
+//only write flash when the estimate moved at least this much since the last save
+#define AFC_SAVE_STEP_HZ		1000
+//the current remote has no slot until its first sample
+#define AFC_IDX_NONE			0xFF
+
+static sAfcEntry_t *pAfcTable = NULL;
+static pfnAfcSave_t pfnSave = NULL;
+//what flash holds per slot, 0 (nominal) for a slot never saved
+static int32_t savedOffsetHz[AFC_REMOTE_NUM];
+static uint32_t curRemoteId = AFC_REMOTE_ID_DEFAULT;
+static uint8_t curIdx = AFC_IDX_NONE;
+static uint8_t replaceIdx = 0;
+
+static uint16_t clamp_u16(int32_t val)
+{
+	if(val < 0)
+	{
+		return 0;
+	}
+	return (val > UINT16_MAX) ? UINT16_MAX : (uint16_t)val;
+}
+
+static sAfcEntry_t *cur_entry(void)
+{
+	return (pAfcTable != NULL && curIdx != AFC_IDX_NONE) ? &pAfcTable[curIdx] : NULL;
+}
+
+static uint8_t slot_find(uint32_t remoteId)
+{
+	uint8_t i;
+
+	for(i = 0; i < AFC_REMOTE_NUM; i++)
+	{
+		if(pAfcTable[i].sampleCnt > 0 && pAfcTable[i].remoteId == remoteId)
+		{
+			return i;
+		}
+	}
+	return AFC_IDX_NONE;
+}
+
+/*a free slot or the oldest claimed one*/
+static uint8_t slot_claim(uint32_t remoteId)
+{
+	uint8_t i;
+
+	for(i = 0; i < AFC_REMOTE_NUM; i++)
+	{
+		if(pAfcTable[i].sampleCnt == 0)
+		{
+			break;
+		}
+	}
+
+	if(i == AFC_REMOTE_NUM)
+	{
+		i = replaceIdx;
+		replaceIdx = (replaceIdx + 1) % AFC_REMOTE_NUM;
+	}
+
+	memset(&pAfcTable[i], 0, sizeof(sAfcEntry_t));
+	pAfcTable[i].remoteId = remoteId;
+	savedOffsetHz[i] = 0;
+	return i;
+}
+
+/*
+the first sample alone is not worth a flash write, after that only a move of
+AFC_SAVE_STEP_HZ from what flash holds, nominal for a slot never saved
+*/
+static void save_if_moved(void)
+{
+	sAfcEntry_t *pEntry = &pAfcTable[curIdx];
+
+	if(pEntry->sampleCnt < 2 || abs(pEntry->offsetHz - savedOffsetHz[curIdx]) < AFC_SAVE_STEP_HZ)
+	{
+		return;
+	}
+
+	savedOffsetHz[curIdx] = pEntry->offsetHz;
+	if(pfnSave != NULL)
+	{
+		pfnSave();
+	}
+}
+
+/*
+pTable points to AFC_REMOTE_NUM entries that survive a reset (the config record),
+save is called whenever they changed enough to be worth a flash write. Nothing is
+claimed or evicted here, the default remote uses its slot if it has one.
+*/
+void Afc_Init(sAfcEntry_t *pTable, pfnAfcSave_t save)
+{
+	uint8_t i;
+
+	pAfcTable = pTable;
+	pfnSave = save;
+
+	for(i = 0; i < AFC_REMOTE_NUM; i++)
+	{
+		savedOffsetHz[i] = pAfcTable[i].offsetHz;
+	}
+
+	curRemoteId = AFC_REMOTE_ID_DEFAULT;
+	curIdx = slot_find(curRemoteId);
+}
+
+/*
+pick the slot of a remote. An unknown remote gets one (a free slot or the oldest
+claimed one) with its first sample, so selecting alone never evicts an estimate.
+*/
+void Afc_SelectRemote(uint32_t remoteId)
+{
+	curRemoteId = remoteId;
+	curIdx = (pAfcTable != NULL) ? slot_find(remoteId) : AFC_IDX_NONE;
+}
+
+uint32_t Afc_GetRemote(void)
+{
+	return curRemoteId;
+}
+
+int32_t Afc_GetOffset(void)
+{
+	sAfcEntry_t *pEntry = cur_entry();
+
+	return (pEntry != NULL) ? pEntry->offsetHz : 0;
+}
+
+uint16_t Afc_GetErrBound(void)
+{
+	sAfcEntry_t *pEntry = cur_entry();
+
+	return (pEntry != NULL) ? pEntry->errBoundHz : UINT16_MAX;
+}
+
+/*
+feed one FEI reading taken while the radio was tuned appliedHz away from nominal.
+The remote sits at appliedHz + feiHz, the estimate is an EMA of that and the
+error bound an EMA of how far the readings land from the estimate.
+*/
+void Afc_Update(int32_t appliedHz, int32_t feiHz)
+{
+	sAfcEntry_t *pEntry;
+	int32_t measured;
+	int32_t err;
+
+	if(pAfcTable == NULL || abs(feiHz) > AFC_FEI_MAX_HZ)
+	{
+		return;
+	}
+
+	if(curIdx == AFC_IDX_NONE)
+	{
+		curIdx = slot_claim(curRemoteId);
+	}
+
+	pEntry = &pAfcTable[curIdx];
+	measured = appliedHz + feiHz;
+
+	if(pEntry->sampleCnt == 0)
+	{
+		pEntry->offsetHz = measured;
+		pEntry->errBoundHz = clamp_u16(abs(feiHz));
+	}
+	else
+	{
+		err = measured - pEntry->offsetHz;
+		pEntry->offsetHz += err / (1 << AFC_EMA_SHIFT);
+		pEntry->errBoundHz = clamp_u16(pEntry->errBoundHz + (abs(err) - pEntry->errBoundHz) / (1 << AFC_EMA_SHIFT));
+	}
+
+	if(pEntry->sampleCnt < UINT16_MAX)
+	{
+		pEntry->sampleCnt++;
+	}
+
+	save_if_moved();
+}
+
+/*true when the phone should scan for the remote again instead of trusting the estimate*/
+bool Afc_NeedRescan(void)
+{
+	sAfcEntry_t *pEntry = cur_entry();
+
+	return pEntry != NULL && pEntry->errBoundHz > AFC_RESCAN_BOUND_HZ;
+}
+
+/*the estimate of the current remote is good enough for its FEI to measure our own drift*/
+bool Afc_IsSettled(void)
+{
+	sAfcEntry_t *pEntry = cur_entry();
+
+	return pEntry != NULL && pEntry->sampleCnt >= AFC_SETTLED_CNT && pEntry->errBoundHz <= AFC_SETTLED_BOUND_HZ;
+}
+
+/*drop the estimate of the current remote, e.g. after the phone found it by a scan*/
+void Afc_Forget(void)
+{
+	if(cur_entry() == NULL)
+	{
+		return;
+	}
+
+	//the slot is free again, the next sample claims one
+	memset(&pAfcTable[curIdx], 0, sizeof(sAfcEntry_t));
+	savedOffsetHz[curIdx] = 0;
+	curIdx = AFC_IDX_NONE;
+	if(pfnSave != NULL)
+	{
+		pfnSave();
+	}
+}
+
@@ -0,0 +1,54 @@
+/**
+ *@file app_afc.h
+ *@author Ribin Huang (you@domain.com)
+ *@brief per remote device carrier offset tracking from the RFM69 FEI
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __APP_AFC_H__
+#define __APP_AFC_H__
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AFC_REMOTE_NUM			4
+#define AFC_REMOTE_ID_DEFAULT	0		//used until the caller tells us who we talk to
+
+//persisted as is in rileylink_config, keep it 4-byte aligned and only append fields
+typedef struct
+{
+	uint32_t remoteId;
+	int32_t offsetHz;			//remote carrier - nominal frequency
+	uint16_t errBoundHz;		//smoothed |measured - estimate|
+	uint16_t sampleCnt;			//saturates at UINT16_MAX, 0 = slot unused
+}sAfcEntry_t;
+
+typedef void (*pfnAfcSave_t)(void);
+
+void Afc_Init(sAfcEntry_t *pTable, pfnAfcSave_t save);
+void Afc_SelectRemote(uint32_t remoteId);
+uint32_t Afc_GetRemote(void);
+int32_t Afc_GetOffset(void);
+uint16_t Afc_GetErrBound(void);
+void Afc_Update(int32_t appliedHz, int32_t feiHz);
+bool Afc_NeedRescan(void);
+bool Afc_IsSettled(void);
+void Afc_Forget(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,302 @@
+/**
+ *@file app_bcast.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief background MiniMed broadcast (MySentry, CGM) listener with repeat removal and batching
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <string.h>
+
+#include "app_bcast.h"
+#include "app_capture.h"
+#include "app_codec.h"
+#include "app_minimed.h"
+#include "app_time.h"
+#include "hal.h"
+
+/*
+Pumps and sensors send every broadcast several times in a row. A packet is known
+by a hash of its decoded bytes, which hold the sender's sequence number, so a new
+reading with the same value is not taken for a repeat. The cache is indexed by the
+hash, a few slots are probed and the oldest one is replaced.
+Unique packets fill one of two batch buffers while the other one goes out on the
+capture link.
+*/
+
+#define BCAST_CACHE_SIZE			32		//must be a power of 2
+#define BCAST_CACHE_PROBE			4
+#define BCAST_BATCH_SIZE			512
+#define BCAST_PKT_MAX_LEN			96		//decoded, longest MySentry packet with room to spare
+
+#define TAG "BCS"
+
+typedef struct
+{
+	uint32_t hash;
+	uint32_t seenMs;
+	uint8_t len;					//0 = free
+}sBcastEntry_t;
+
+static sBcastCfg_t bcastCfg;
+static sBcastStats_t bcastStats;
+static sBcastEntry_t cache[BCAST_CACHE_SIZE];
+static uint8_t batch[2][BCAST_BATCH_SIZE];
+static uint16_t batchLen = 0;
+static uint8_t batchIdx = 0;			//buffer being filled
+static uint32_t batchStartMs = 0;		//first record of the batch received at
+static eSubgMode_t bcastMode;
+static uint32_t bcastFreqHz;
+static bool bcastRunning = false;
+static bool bcastHeld = false;
+
+//FNV-1a
+static uint32_t pkt_hash(const uint8_t *pData, uint8_t len)
+{
+	uint32_t hash = 2166136261UL;
+
+	while(len--)
+	{
+		hash ^= *pData++;
+		hash *= 16777619UL;
+	}
+	return hash;
+}
+
+static bool entry_live(const sBcastEntry_t *pEntry, uint32_t nowMs)
+{
+	return pEntry->len != 0 && (uint32_t)(nowMs - pEntry->seenMs) < bcastCfg.dedupMs;
+}
+
+//true for a repeat, a new packet is remembered
+static bool cache_seen(const uint8_t *pData, uint8_t len, uint32_t nowMs)
+{
+	uint32_t hash = pkt_hash(pData, len);
+	sBcastEntry_t *pEntry;
+	sBcastEntry_t *pVictim = NULL;
+	uint8_t i;
+
+	for(i = 0; i < BCAST_CACHE_PROBE; i++)
+	{
+		pEntry = &cache[(hash + i) & (BCAST_CACHE_SIZE - 1)];
+
+		if(!entry_live(pEntry, nowMs))
+		{
+			if(pVictim == NULL || entry_live(pVictim, nowMs))
+			{
+				pVictim = pEntry;
+			}
+			continue;
+		}
+
+		if(pEntry->hash == hash && pEntry->len == len)
+		{
+			//a burst of repeats can outlast the window, it counts from the last one
+			pEntry->seenMs = nowMs;
+			return true;
+		}
+
+		if(pVictim == NULL || (entry_live(pVictim, nowMs) && (int32_t)(pEntry->seenMs - pVictim->seenMs) < 0))
+		{
+			pVictim = pEntry;
+		}
+	}
+
+	pVictim->hash = hash;
+	pVictim->len = len;
+	pVictim->seenMs = nowMs;
+	return false;
+}
+
+static bool batch_flush(void)
+{
+	if(batchLen == 0 || Capture_IsDumping())
+	{
+		return false;
+	}
+	if(!Capture_DumpBlob(CAPTURE_FRAME_TYPE_BCAST, batch[batchIdx], batchLen))
+	{
+		return false;
+	}
+
+	bcastStats.batchCnt++;
+	bcastStats.sentBytes += batchLen;
+	batchIdx ^= 1;
+	batchLen = 0;
+	return true;
+}
+
+static void batch_add(const uint8_t *pData, uint8_t len, int8_t rssi, uint32_t nowMs)
+{
+	uint8_t *pRec;
+
+	if(batchLen + BCAST_REC_HDR_LEN + len > BCAST_BATCH_SIZE && !batch_flush())
+	{
+		//the other buffer is still on its way to the phone
+		bcastStats.dropCnt++;
+		return;
+	}
+
+	if(batchLen == 0)
+	{
+		batchStartMs = nowMs;
+	}
+
+	pRec = batch[batchIdx] + batchLen;
+	pRec[0] = (uint8_t)nowMs;
+	pRec[1] = (uint8_t)(nowMs >> 8);
+	pRec[2] = (uint8_t)(nowMs >> 16);
+	pRec[3] = (uint8_t)(nowMs >> 24);
+	pRec[4] = (uint8_t)rssi;
+	pRec[5] = len;
+	memcpy(pRec + BCAST_REC_HDR_LEN, pData, len);
+	batchLen += BCAST_REC_HDR_LEN + len;
+	bcastStats.uniqueCnt++;
+}
+
+//4b6b decoded, CRC8 (pump) or CRC16 (sensor) over the rest of the packet
+static uint8_t pkt_decode(const uint8_t *pRaw, uint16_t rawLen, uint8_t *pPkt)
+{
+	uint16_t len;
+
+	len = Codec_Decode(CODEC_4B6B, pRaw, rawLen, pPkt, BCAST_PKT_MAX_LEN);
+	if(len < 3)
+	{
+		return 0;
+	}
+	if(Minimed_Crc8(pPkt, len - 1) == pPkt[len - 1])
+	{
+		return (uint8_t)len;
+	}
+	if(Minimed_Crc16(pPkt, len - 2) == (((uint16_t)pPkt[len - 2] << 8) | pPkt[len - 1]))
+	{
+		return (uint8_t)len;
+	}
+	return 0;
+}
+
+bool Bcast_Start(eSubgMode_t mode, uint32_t freqHz, const sBcastCfg_t *pCfg)
+{
+	if(mode == SUBG_MODE_OMNIPOD)
+	{
+		return false;
+	}
+
+	bcastCfg = *pCfg;
+	bcastMode = mode;
+	bcastFreqHz = freqHz;
+	memset(cache, 0, sizeof(cache));
+	batchLen = 0;
+	bcastHeld = false;
+
+	bcastRunning = Listen_Start(mode, freqHz, &bcastCfg.listen);
+	Listen_ClrReport();
+	KIT_LOG(TAG, "Broadcast listen %s, batch %u ms.", bcastRunning ? "start" : "failed", bcastCfg.batchMs);
+	return bcastRunning;
+}
+
+void Bcast_Stop(void)
+{
+	if(!bcastRunning)
+	{
+		return;
+	}
+
+	if(!bcastHeld)
+	{
+		Listen_Stop();
+	}
+	bcastRunning = false;
+	bcastHeld = false;
+	//what is buffered still goes out if the link is free
+	batch_flush();
+}
+
+bool Bcast_IsRunning(void)
+{
+	return bcastRunning;
+}
+
+//give the radio to a command, listening resumes with Bcast_Resume
+void Bcast_Hold(void)
+{
+	if(bcastRunning && !bcastHeld)
+	{
+		Listen_Stop();
+		bcastHeld = true;
+	}
+}
+
+void Bcast_Resume(void)
+{
+	if(bcastRunning && bcastHeld)
+	{
+		bcastHeld = false;
+		bcastRunning = Listen_Start(bcastMode, bcastFreqHz, &bcastCfg.listen);
+	}
+}
+
+/*
+called from the main loop: reads what woke the radio, if anything, and hands
+the batch to the link once its oldest packet waited batchMs
+*/
+void Bcast_Process(void)
+{
+	uint8_t rxBuf[BCAST_PKT_MAX_LEN * 3 / 2 + 2];
+	uint8_t pkt[BCAST_PKT_MAX_LEN];
+	uint16_t rxLen = 0;
+	uint32_t nowMs;
+	uint8_t len;
+
+	if(!bcastRunning || bcastHeld)
+	{
+		return;
+	}
+
+	nowMs = Time_GetMs();
+	if(Listen_Process(rxBuf, sizeof(rxBuf), &rxLen) == SUBG_RX_OK && rxLen > 0)
+	{
+		len = pkt_decode(rxBuf, rxLen, pkt);
+		if(len == 0)
+		{
+			bcastStats.badCnt++;
+		}
+		else
+		{
+			bcastStats.rxCnt++;
+			bcastStats.rawBytes += BCAST_REC_HDR_LEN + len;
+
+			if(cache_seen(pkt, len, nowMs))
+			{
+				bcastStats.dupCnt++;
+			}
+			else
+			{
+				batch_add(pkt, len, (int8_t)Subg_GetRssi(), nowMs);
+			}
+		}
+	}
+
+	if(batchLen > 0 && (uint32_t)(nowMs - batchStartMs) >= bcastCfg.batchMs)
+	{
+		batch_flush();
+	}
+}
+
+const sBcastStats_t *Bcast_GetStats(void)
+{
+	return &bcastStats;
+}
+
+void Bcast_ClrStats(void)
+{
+	memset(&bcastStats, 0, sizeof(bcastStats));
+}
+
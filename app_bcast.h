@@ -0,0 +1,64 @@
+/**
+ *@file app_bcast.h
+ *@author Ribin Huang (you@domain.com)
+ *@brief background MiniMed broadcast (MySentry, CGM) listener with repeat removal and batching
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __APP_BCAST_H__
+#define __APP_BCAST_H__
+#include <stdint.h>
+#include <stdbool.h>
+#include "app_subg.h"
+#include "app_listen.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//batch record: rx time ms(4, LE, uptime) + rssi(1) + len(1) + decoded packet, CRC included
+#define BCAST_REC_HDR_LEN			6
+
+typedef struct
+{
+	sListenCfg_t listen;
+	uint32_t batchMs;			//oldest buffered packet waits at most this long for the phone
+	uint32_t dedupMs;			//same packet again within this window is a repeat
+}sBcastCfg_t;
+
+//rxCnt vs batchCnt and rawBytes vs sentBytes give what batching and repeat removal save on the link
+typedef struct
+{
+	uint32_t rxCnt;				//decoded packets with a good CRC
+	uint32_t badCnt;			//line code or CRC errors
+	uint32_t dupCnt;			//repeats dropped, hit rate = dupCnt / rxCnt
+	uint32_t uniqueCnt;			//buffered for the phone
+	uint32_t dropCnt;			//unique but lost, both batch buffers full
+	uint32_t batchCnt;			//batches handed to the link
+	uint32_t rawBytes;			//records for every good packet, one notification each without this module
+	uint32_t sentBytes;			//records in the batches sent
+}sBcastStats_t;
+
+bool Bcast_Start(eSubgMode_t mode, uint32_t freqHz, const sBcastCfg_t *pCfg);
+void Bcast_Stop(void);
+bool Bcast_IsRunning(void);
+void Bcast_Hold(void);
+void Bcast_Resume(void);
+void Bcast_Process(void);
+const sBcastStats_t *Bcast_GetStats(void);
+void Bcast_ClrStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,338 @@
+/**
+ *@file app_capture.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <string.h>
+
+#include "app_capture.h"
+#include "app_subg.h"
+#include "app_trace.h"
+#include "app_time.h"
+#include "hal.h"
+
+#define CAPTURE_QUEUE_SIZE			8		//must be a power of 2
+#define CAPTURE_PKT_MAX_LEN			233		//a frame fills one 244 byte notification
+#define CAPTURE_RX_SLICE_MS			50		//max time spent in rx before the queue is drained again
+
+//frame: type(1) + timestamp us(8, LE) + rssi(1) + len(1) + data
+#define CAPTURE_FRAME_HDR_LEN		11
+//blob frame (trace, history page): type(1) + offset(2, LE) + total len(2, LE) + bytes, same max size as a packet frame
+#define CAPTURE_BLOB_HDR_LEN		5
+#define CAPTURE_BLOB_CHUNK_LEN		(CAPTURE_FRAME_HDR_LEN + CAPTURE_PKT_MAX_LEN - CAPTURE_BLOB_HDR_LEN)
+
+#define TAG "CAP"
+
+typedef struct
+{
+	uint64_t timestamp;
+	int8_t rssi;
+	uint8_t len;
+	uint8_t data[CAPTURE_PKT_MAX_LEN];
+}sCapturePkt_t;
+
+static sCapturePkt_t pktQueue[CAPTURE_QUEUE_SIZE];
+static uint8_t queueHead = 0;	//next slot to write
+static uint8_t queueTail = 0;	//next slot to notify
+static sCaptureStats_t captureStats;
+static pfnCaptureNotify_t pfnNotify = NULL;
+static volatile bool captureRunning = false;
+static volatile bool captureStopReq = false;	//stopped, the radio is still in rx
+static eSubgMode_t captureMode;
+static uint32_t captureFreqHz;
+static volatile SubgOpHandle_t captureOp = SUBG_OP_NONE;	//rx slice running, commands preempt it
+static bool blobDumping = false;
+static uint8_t blobType;
+static const uint8_t *pBlob = NULL;
+static uint16_t blobLen = 0;
+static uint16_t blobPos = 0;
+
+static uint8_t queue_used(void)
+{
+	return (uint8_t)(queueHead - queueTail);
+}
+
+/*a full queue keeps what it has, the frames already queued go out in order and the new one is counted as lost*/
+static bool queue_push(const uint8_t *pData, uint16_t len, int8_t rssi, uint64_t timestamp)
+{
+	sCapturePkt_t *pPkt;
+	uint8_t used;
+
+	if(queue_used() >= CAPTURE_QUEUE_SIZE)
+	{
+		captureStats.queueDropCnt++;
+		return false;
+	}
+
+	pPkt = &pktQueue[queueHead & (CAPTURE_QUEUE_SIZE - 1)];
+	pPkt->timestamp = timestamp;
+	pPkt->rssi = rssi;
+	pPkt->len = (len > CAPTURE_PKT_MAX_LEN) ? CAPTURE_PKT_MAX_LEN : len;
+	memcpy(pPkt->data, pData, pPkt->len);
+	queueHead++;
+
+	used = queue_used();
+	if(used > captureStats.queueHighWater)
+	{
+		captureStats.queueHighWater = used;
+	}
+	return true;
+}
+
+void Capture_Init(pfnCaptureNotify_t notify)
+{
+	pfnNotify = notify;
+	queueHead = 0;
+	queueTail = 0;
+	blobDumping = false;
+	Capture_ClrStats();
+}
+
+void Capture_Start(eSubgMode_t mode, uint32_t freqHz)
+{
+	KIT_LOG(TAG, "Capture start, mode %d, %u Hz.", mode, freqHz);
+
+	captureMode = mode;
+	captureFreqHz = freqHz;
+	Subg_SetMode(mode);
+	Subg_SetFreq(freqHz);
+	//frames carry us timestamps
+	if(!captureRunning)
+	{
+		Time_Fine(true);
+	}
+	captureStopReq = false;
+	captureRunning = true;
+}
+
+void Capture_Stop(void)
+{
+	if(!captureRunning)
+	{
+		return;
+	}
+
+	captureRunning = false;
+	captureStopReq = true;
+	Time_Fine(false);
+	//kick the rx loop out if we are called from interrupt context while it is waiting
+	Subg_OpCancel(captureOp);
+}
+
+/*give the radio back after a command that may have retuned it*/
+void Capture_Resume(void)
+{
+	if(captureRunning)
+	{
+		Subg_SetMode(captureMode);
+		Subg_SetFreq(captureFreqHz);
+	}
+}
+
+bool Capture_IsRunning(void)
+{
+	return captureRunning;
+}
+
+/*
+receive for at most one slice and queue whatever arrived, then push queued
+frames to the link. Called repeatedly from the main loop while capture is running.
+*/
+void Capture_Process(void)
+{
+	uint8_t rxBuf[CAPTURE_PKT_MAX_LEN];
+	uint16_t rxLen;
+	eSubgRxStatus_t result;
+	SubgOpHandle_t op;
+
+	if(!captureRunning)
+	{
+		//Subg_ListenPkt left the receiver on
+		if(captureStopReq)
+		{
+			captureStopReq = false;
+			Subg_Stop();
+			KIT_LOG(TAG, "Capture stopped.");
+		}
+		//a dump held back by the link still needs pushing
+		if(blobDumping)
+		{
+			Capture_Drain();
+		}
+		return;
+	}
+
+	//rx keeps running while the link is behind: what the full queue can't take is counted in queueDropCnt.
+	//a command arriving over BLE meanwhile cancels the slice (Subg_OpPreempt)
+	op = Subg_OpBegin(SUBG_PRIO_BACKGROUND);
+	if(op != SUBG_OP_NONE)
+	{
+		captureOp = op;
+		rxLen = 0;
+		result = Subg_ListenPkt(rxBuf, sizeof(rxBuf), &rxLen, CAPTURE_RX_SLICE_MS);
+
+		if(result == SUBG_RX_OK && rxLen > 0 && queue_push(rxBuf, rxLen, (int8_t)Subg_GetRssi(), Subg_GetPktTime()))
+		{
+			captureStats.capturedCnt++;
+		}
+		captureOp = SUBG_OP_NONE;
+	}
+	Subg_OpEnd(op);
+
+	Capture_Drain();
+}
+
+static void dump_blob(void)
+{
+	uint8_t frame[CAPTURE_BLOB_HDR_LEN + CAPTURE_BLOB_CHUNK_LEN];
+	uint16_t chunk;
+	eCaptureNotifyResult_t result;
+
+	while(blobDumping && blobPos < blobLen)
+	{
+		chunk = blobLen - blobPos;
+		if(chunk > CAPTURE_BLOB_CHUNK_LEN)
+		{
+			chunk = CAPTURE_BLOB_CHUNK_LEN;
+		}
+
+		frame[0] = blobType;
+		frame[1] = (uint8_t)blobPos;
+		frame[2] = (uint8_t)(blobPos >> 8);
+		frame[3] = (uint8_t)blobLen;
+		frame[4] = (uint8_t)(blobLen >> 8);
+		memcpy(frame + CAPTURE_BLOB_HDR_LEN, pBlob + blobPos, chunk);
+
+		result = (pfnNotify != NULL) ? pfnNotify(frame, CAPTURE_BLOB_HDR_LEN + chunk) : CAPTURE_NOTIFY_FAIL;
+
+		if(result == CAPTURE_NOTIFY_BUSY)
+		{
+			captureStats.busyCnt++;
+			return;
+		}
+
+		if(result != CAPTURE_NOTIFY_OK)
+		{
+			//a partial blob can't be decoded, give up and let the host ask again
+			captureStats.linkDropCnt++;
+			break;
+		}
+
+		captureStats.notifiedCnt++;
+		blobPos += chunk;
+	}
+
+	if(blobDumping)
+	{
+		KIT_LOG(TAG, "Dump 0x%02x %s, %u of %u bytes.", blobType, (blobPos < blobLen) ? "failed" : "done", blobPos, blobLen);
+	}
+	blobDumping = false;
+}
+
+void Capture_Drain(void)
+{
+	uint8_t frame[CAPTURE_FRAME_HDR_LEN + CAPTURE_PKT_MAX_LEN];
+	sCapturePkt_t *pPkt;
+	eCaptureNotifyResult_t result;
+	uint8_t i;
+
+	while(queue_used() > 0)
+	{
+		pPkt = &pktQueue[queueTail & (CAPTURE_QUEUE_SIZE - 1)];
+
+		frame[0] = CAPTURE_FRAME_TYPE_PKT;
+		for(i = 0; i < 8; i++)
+		{
+			frame[1 + i] = (uint8_t)(pPkt->timestamp >> (8 * i));
+		}
+		frame[9] = (uint8_t)pPkt->rssi;
+		frame[10] = pPkt->len;
+		memcpy(frame + CAPTURE_FRAME_HDR_LEN, pPkt->data, pPkt->len);
+
+		result = (pfnNotify != NULL) ? pfnNotify(frame, CAPTURE_FRAME_HDR_LEN + pPkt->len) : CAPTURE_NOTIFY_FAIL;
+
+		if(result == CAPTURE_NOTIFY_BUSY)
+		{
+			//stack tx queue is full, leave the frame at the tail for the next round
+			captureStats.busyCnt++;
+			return;
+		}
+
+		if(result == CAPTURE_NOTIFY_OK)
+		{
+			captureStats.notifiedCnt++;
+		}
+		else
+		{
+			captureStats.linkDropCnt++;
+		}
+		queueTail++;
+	}
+
+	dump_blob();
+}
+
+/*
+send the radio trace over the capture link, after any queued packets. Recording
+stops so the dump is consistent. Progress is made by Capture_Drain.
+*/
+bool Capture_DumpTrace(void)
+{
+	const uint8_t *pTrace;
+	uint16_t len;
+
+	Trace_Stop();
+	pTrace = Trace_Get(&len);
+	if(len <= TRACE_HDR_LEN)
+	{
+		return false;
+	}
+
+	return Capture_DumpBlob(CAPTURE_FRAME_TYPE_TRACE, pTrace, len);
+}
+
+/*
+send len bytes in chunks framed like a trace. pData must stay untouched until
+Capture_IsDumping turns false. One dump at a time.
+*/
+bool Capture_DumpBlob(uint8_t type, const uint8_t *pData, uint16_t len)
+{
+	if(blobDumping || len == 0)
+	{
+		return false;
+	}
+
+	blobType = type;
+	pBlob = pData;
+	blobLen = len;
+	blobPos = 0;
+	blobDumping = true;
+	Capture_Drain();
+	return true;
+}
+
+bool Capture_IsDumping(void)
+{
+	return blobDumping;
+}
+
+const sCaptureStats_t *Capture_GetStats(void)
+{
+	return &captureStats;
+}
+
+void Capture_ClrStats(void)
+{
+	memset(&captureStats, 0, sizeof(captureStats));
+}
+
@@ -0,0 +1,68 @@
+/**
+ *@file app_capture.h
+ *@author Ribin Huang (you@domain.com)
+ *@brief
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __APP_CAPTURE_H__
+#define __APP_CAPTURE_H__
+#include <stdint.h>
+#include <stdbool.h>
+#include "app_subg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAPTURE_FRAME_TYPE_PKT		0x01
+#define CAPTURE_FRAME_TYPE_TRACE	0x02		//chunk of a radio trace, see app_trace.h
+#define CAPTURE_FRAME_TYPE_HISTORY	0x03		//chunk of a MiniMed history page, see app_minimed.h
+#define CAPTURE_FRAME_TYPE_BCAST	0x04		//chunk of a batch of broadcast packets, see app_bcast.h
+
+typedef enum
+{
+	CAPTURE_NOTIFY_OK = 0,
+	CAPTURE_NOTIFY_BUSY,		//link can't take it now, keep the frame and retry
+	CAPTURE_NOTIFY_FAIL			//nobody listening, drop the frame
+}eCaptureNotifyResult_t;
+
+typedef eCaptureNotifyResult_t (*pfnCaptureNotify_t)(const uint8_t *pData, uint16_t len);
+
+typedef struct
+{
+	uint32_t capturedCnt;		//packets received from the radio and queued
+	uint32_t notifiedCnt;		//frames accepted by the BLE stack
+	uint32_t queueDropCnt;		//packets lost because the queue was full
+	uint32_t linkDropCnt;		//frames dropped because nobody was subscribed
+	uint32_t busyCnt;			//notify attempts refused by the stack (backpressure)
+	uint8_t queueHighWater;
+}sCaptureStats_t;
+
+void Capture_Init(pfnCaptureNotify_t notify);
+void Capture_Start(eSubgMode_t mode, uint32_t freqHz);
+void Capture_Stop(void);
+void Capture_Resume(void);
+bool Capture_IsRunning(void);
+void Capture_Process(void);
+void Capture_Drain(void);
+bool Capture_DumpTrace(void);
+bool Capture_DumpBlob(uint8_t type, const uint8_t *pData, uint16_t len);
+bool Capture_IsDumping(void);
+const sCaptureStats_t *Capture_GetStats(void);
+void Capture_ClrStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,156 @@
+/**
+ *@file app_codec.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief line codes of the pump radios: Manchester (Omnipod) and 4b6b (MiniMed)
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <string.h>
+
+#include "app_codec.h"
+
+//4b6b padding of an odd nibble count, the pump ignores it
+#define CODEC_4B6B_PAD			0x05
+
+static const uint8_t enc4b6b[16] =
+{
+	0x15, 0x31, 0x32, 0x23, 0x34, 0x25, 0x26, 0x16,
+	0x1A, 0x19, 0x2A, 0x0B, 0x2C, 0x0D, 0x0E, 0x1C
+};
+
+//nibble + 1 of each 6-bit symbol, 0 = not a code word
+static const uint8_t dec4b6b[64] =
+{
+	[0x15] = 1, [0x31] = 2, [0x32] = 3, [0x23] = 4, [0x34] = 5, [0x25] = 6, [0x26] = 7, [0x16] = 8,
+	[0x1A] = 9, [0x19] = 10, [0x2A] = 11, [0x0B] = 12, [0x2C] = 13, [0x0D] = 14, [0x0E] = 15, [0x1C] = 16
+};
+
+/*
+line code len bytes into pOut, returns the encoded length. The output stops at outSize
+on whole bytes; pad completes the last 4b6b byte, otherwise a half-filled one is left out.
+*/
+uint16_t Codec_Encode(eCodec_t codec, const uint8_t *pIn, uint16_t len, uint8_t *pOut, uint16_t outSize, bool pad)
+{
+	uint32_t acc = 0;
+	uint8_t accBits = 0;
+	uint16_t outLen = 0;
+	uint16_t sym;
+	uint16_t i;
+	int8_t bit;
+
+	if(codec == CODEC_NONE)
+	{
+		outLen = (len < outSize) ? len : outSize;
+		memcpy(pOut, pIn, outLen);
+		return outLen;
+	}
+
+	for(i = 0; i < len && outLen < outSize; i++)
+	{
+		if(codec == CODEC_MANCHESTER)
+		{
+			sym = 0;
+			for(bit = 7; bit >= 0; bit--)
+			{
+				sym = (sym << 2) | (((pIn[i] >> bit) & 0x01) ? 0x02 : 0x01);
+			}
+			acc = (acc << 16) | sym;
+			accBits += 16;
+		}
+		else
+		{
+			acc = (acc << 12) | ((uint32_t)enc4b6b[pIn[i] >> 4] << 6) | enc4b6b[pIn[i] & 0x0F];
+			accBits += 12;
+		}
+
+		while(accBits >= 8 && outLen < outSize)
+		{
+			accBits -= 8;
+			pOut[outLen++] = (uint8_t)(acc >> accBits);
+		}
+	}
+
+	if(pad && accBits > 0 && outLen < outSize)
+	{
+		pOut[outLen++] = (uint8_t)((acc << (8 - accBits)) | (CODEC_4B6B_PAD << (4 - accBits)));
+	}
+
+	return outLen;
+}
+
+/*
+decode until the first invalid symbol (the 4b6b 0x00 trailer, noise after the packet)
+or the end of the input, returns the number of whole bytes decoded
+*/
+uint16_t Codec_Decode(eCodec_t codec, const uint8_t *pIn, uint16_t len, uint8_t *pOut, uint16_t outSize)
+{
+	uint32_t acc = 0;
+	uint8_t accBits = 0;
+	uint8_t nibble = 0;
+	bool half = false;
+	uint16_t outLen = 0;
+	uint8_t sym;
+	uint16_t i;
+	int8_t bit;
+
+	if(codec == CODEC_NONE)
+	{
+		outLen = (len < outSize) ? len : outSize;
+		memcpy(pOut, pIn, outLen);
+		return outLen;
+	}
+
+	if(codec == CODEC_MANCHESTER)
+	{
+		for(i = 0; i + 1 < len && outLen < outSize; i += 2)
+		{
+			if(((pIn[i] ^ (pIn[i] >> 1)) & 0x55) != 0x55 || ((pIn[i + 1] ^ (pIn[i + 1] >> 1)) & 0x55) != 0x55)
+			{
+				break;
+			}
+			sym = 0;
+			for(bit = 14; bit >= 0; bit -= 2)
+			{
+				sym = (uint8_t)((sym << 1) | ((((uint16_t)pIn[i] << 8 | pIn[i + 1]) >> (bit + 1)) & 0x01));
+			}
+			pOut[outLen++] = sym;
+		}
+		return outLen;
+	}
+
+	for(i = 0; i < len && outLen < outSize; i++)
+	{
+		acc = (acc << 8) | pIn[i];
+		accBits += 8;
+
+		while(accBits >= 6)
+		{
+			accBits -= 6;
+			sym = dec4b6b[(acc >> accBits) & 0x3F];
+			if(sym == 0)
+			{
+				return outLen;
+			}
+			if(half)
+			{
+				pOut[outLen++] = (uint8_t)((nibble << 4) | (sym - 1));
+				if(outLen >= outSize)
+				{
+					return outLen;
+				}
+			}
+			nibble = sym - 1;
+			half = !half;
+		}
+	}
+
+	return outLen;
+}
@@ -0,0 +1,41 @@
+/**
+ *@file app_codec.h
+ *@author Ribin Huang (you@domain.com)
+ *@brief line codes of the pump radios: Manchester (Omnipod) and 4b6b (MiniMed)
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __APP_CODEC_H__
+#define __APP_CODEC_H__
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//same values as the subg_rfspy software encoding setting
+typedef enum
+{
+	CODEC_NONE = 0,
+	CODEC_MANCHESTER,			//0 -> 01, 1 -> 10
+	CODEC_4B6B,					//one 6-bit symbol per nibble, MSB first
+	CODEC_NUM
+}eCodec_t;
+
+uint16_t Codec_Encode(eCodec_t codec, const uint8_t *pIn, uint16_t len, uint8_t *pOut, uint16_t outSize, bool pad);
+uint16_t Codec_Decode(eCodec_t codec, const uint8_t *pIn, uint16_t len, uint8_t *pOut, uint16_t outSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,123 @@
+/**
+ *@file app_eop.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief streaming end-of-packet detector for the rx loops
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <string.h>
+
+#include "app_eop.h"
+#include "app_time.h"
+
+/*
+Once the transmitter stops the radio keeps demodulating noise into the fifo, and
+noise breaks the line code within a symbol or two. That is a much earlier end
+than waiting for a terminator byte that may never come, or for the timeout.
+When the noise happens to look like valid code, the RSSI falling off catches it.
+*/
+
+//RSSI this far below the packet's: the carrier is gone
+#define EOP_RSSI_DROP_DB		12
+//RSSI poll interval while the fifo is empty, a couple of byte times at the slowest rate
+#define EOP_RSSI_POLL_US		500
+
+//4b6b code words, indexed by 6-bit symbol
+static const uint8_t valid4b6b[64] =
+{
+	[0x0B] = 1, [0x0D] = 1, [0x0E] = 1, [0x15] = 1, [0x16] = 1, [0x19] = 1, [0x1A] = 1, [0x1C] = 1,
+	[0x23] = 1, [0x25] = 1, [0x26] = 1, [0x2A] = 1, [0x2C] = 1, [0x31] = 1, [0x32] = 1, [0x34] = 1
+};
+
+void Eop_Init(sEopDet_t *pDet, eEopCodec_t codec, int16_t rssiRef)
+{
+	memset(pDet, 0, sizeof(sEopDet_t));
+	pDet->codec = codec;
+	pDet->rssiRef = rssiRef;
+	pDet->validUs = Time_GetUs();
+	pDet->rssiPollUs = pDet->validUs + EOP_RSSI_POLL_US;
+}
+
+/*feed each byte read from the fifo, true once the line code broke: the packet is over*/
+bool Eop_PushByte(sEopDet_t *pDet, uint8_t data)
+{
+	uint8_t sym;
+	uint16_t len;
+
+	pDet->byteCnt++;
+
+	if(pDet->codec == EOP_CODEC_MANCHESTER)
+	{
+		//every bit pair must be 01 or 10
+		if(((data ^ (data >> 1)) & 0x55) != 0x55)
+		{
+			return true;
+		}
+		pDet->validLen = pDet->byteCnt;
+		pDet->validUs = Time_GetUs();
+		return false;
+	}
+
+	pDet->acc = (uint16_t)((pDet->acc << 8) | data);
+	pDet->accBits += 8;
+
+	while(pDet->accBits >= 6)
+	{
+		pDet->accBits -= 6;
+		sym = (pDet->acc >> pDet->accBits) & 0x3F;
+		if(!valid4b6b[sym])
+		{
+			return true;
+		}
+		pDet->symCnt++;
+	}
+
+	//the byte holding the last bit of the last valid symbol is part of the packet
+	len = (uint16_t)((pDet->symCnt * 6 + 7) / 8);
+	if(len != pDet->validLen)
+	{
+		pDet->validLen = len;
+		pDet->validUs = Time_GetUs();
+	}
+	return false;
+}
+
+/*length of the packet, valid once Eop_PushByte returned true*/
+uint16_t Eop_GetLen(const sEopDet_t *pDet)
+{
+	return pDet->validLen;
+}
+
+/*call while the fifo is empty: true when the RSSI should be checked again*/
+bool Eop_RssiDue(sEopDet_t *pDet)
+{
+	uint64_t now = Time_GetUs();
+
+	if(now < pDet->rssiPollUs)
+	{
+		return false;
+	}
+
+	pDet->rssiPollUs = now + EOP_RSSI_POLL_US;
+	return true;
+}
+
+bool Eop_RssiDropped(const sEopDet_t *pDet, int16_t rssi)
+{
+	return pDet->byteCnt > 0 && rssi < pDet->rssiRef - EOP_RSSI_DROP_DB;
+}
+
+/*time from reading the end of the packet until now*/
+uint32_t Eop_GetLatencyUs(const sEopDet_t *pDet)
+{
+	return Time_ElapsedUs(pDet->validUs);
+}
+
@@ -0,0 +1,56 @@
+/**
+ *@file app_eop.h
+ *@author Ribin Huang (you@domain.com)
+ *@brief streaming end-of-packet detector for the rx loops
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __APP_EOP_H__
+#define __APP_EOP_H__
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+	EOP_CODEC_4B6B = 0,			//MiniMed
+	EOP_CODEC_MANCHESTER		//Omnipod
+}eEopCodec_t;
+
+typedef struct
+{
+	eEopCodec_t codec;
+	uint16_t acc;				//4b6b bits not yet making a whole symbol
+	uint8_t accBits;
+	uint16_t symCnt;
+	uint16_t byteCnt;
+	uint16_t validLen;			//bytes up to the end of the last valid symbol
+	uint64_t validUs;			//when the byte completing the last valid symbol was read
+	int16_t rssiRef;			//packet RSSI, taken at the first byte
+	uint64_t rssiPollUs;
+}sEopDet_t;
+
+void Eop_Init(sEopDet_t *pDet, eEopCodec_t codec, int16_t rssiRef);
+bool Eop_PushByte(sEopDet_t *pDet, uint8_t data);
+uint16_t Eop_GetLen(const sEopDet_t *pDet);
+bool Eop_RssiDue(sEopDet_t *pDet);
+bool Eop_RssiDropped(const sEopDet_t *pDet, int16_t rssi);
+uint32_t Eop_GetLatencyUs(const sEopDet_t *pDet);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,212 @@
+/**
+ *@file app_listen.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief duty-cycled background receive on the RFM69 listen sequencer
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <string.h>
+
+#include "app_listen.h"
+#include "app_trace.h"
+#include "app_time.h"
+#include "hal.h"
+
+//time allowed to read the packet once woken, longer than the longest packet on air
+#define LISTEN_PKT_TIMEOUT_MS		100
+
+//SX1231 typical currents for the power model (datasheet 2.5.1)
+#define LISTEN_IDLE_CURRENT_NA		1200		//RC oscillator only
+#define LISTEN_RX_CURRENT_NA		16000000
+#define LISTEN_START_CURRENT_NA		1250000		//crystal and PLL start up, about standby
+//crystal start (TS_OSC) + PLL lock (TS_FS) paid before each rx window
+#define LISTEN_START_US				310
+//nRF52840 typical currents (product specification 5.2): System ON sleep with RAM retained, the RTC
+//time base and DIO0 on a GPIOTE PORT event, and the cpu running from flash (DCDC) while a wake is read
+#define LISTEN_HOST_SLEEP_NA		3000
+#define LISTEN_HOST_RUN_NA			3300000
+
+#define TAG "LSN"
+
+static sListenCfg_t listenCfg;
+static sListenReport_t listenReport;
+static uint8_t wakeRadio = HAL_RADIO_916;
+static volatile bool dioWoken = false;
+static bool listenRunning = false;
+static uint64_t listenSinceUs = 0;		//listening started, for the report
+static uint64_t listenDoneUs = 0;		//time listened before that, since the report was cleared
+
+static void dio_handler(uint8_t radio)
+{
+	Trace_Dio(radio);
+	dioWoken = true;
+}
+
+static void listen_arm(void)
+{
+	uint32_t idleUs = listenCfg.idleUs;
+	uint32_t rxUs = listenCfg.rxUs;
+
+	dioWoken = false;
+	Subg_ListenArm(&idleUs, &rxUs, listenCfg.wake == LISTEN_WAKE_RSSI_SYNC);
+	Hal_DioIrqEnable(wakeRadio, true);
+
+	if(idleUs != listenReport.idleUs || rxUs != listenReport.rxUs)
+	{
+		Listen_Estimate(idleUs, rxUs, &listenReport);
+	}
+}
+
+/*
+keep the radio of a mode in listen mode. The host can sleep, it is woken through
+DIO0 only when the wake criteria matched, Listen_Process then reads the packet.
+*/
+bool Listen_Start(eSubgMode_t mode, uint32_t freqHz, const sListenCfg_t *pCfg)
+{
+	Listen_Stop();
+
+	Subg_SetMode(mode);
+	Subg_SetFreq(freqHz);
+
+	wakeRadio = (mode == SUBG_MODE_OMNIPOD) ? HAL_RADIO_433 : HAL_RADIO_916;
+	if(!Hal_DioIrqInit(wakeRadio, dio_handler))
+	{
+		KIT_LOG(TAG, "Wake pin init failed!");
+		return false;
+	}
+
+	listenCfg = *pCfg;
+	listen_arm();
+	listenRunning = true;
+	listenSinceUs = Time_GetUs();
+
+	KIT_LOG(TAG, "Listen start, idle %u us, rx %u us, %u nA.", listenReport.idleUs, listenReport.rxUs, listenReport.avgCurrentNa);
+	return true;
+}
+
+void Listen_Stop(void)
+{
+	if(!listenRunning)
+	{
+		return;
+	}
+
+	Hal_DioIrqUninit(wakeRadio);
+	Subg_Stop();
+	listenRunning = false;
+	dioWoken = false;
+	listenDoneUs += Time_GetUs() - listenSinceUs;
+}
+
+bool Listen_IsRunning(void)
+{
+	return listenRunning;
+}
+
+bool Listen_IsWoken(void)
+{
+	return dioWoken;
+}
+
+/*
+called from the main loop after waking up. Returns SUBG_RX_TIMEOUT right away if
+DIO0 did not fire, otherwise the result of reading the packet. Listening resumes either way.
+*/
+eSubgRxStatus_t Listen_Process(uint8_t *pRxBuf, uint16_t bufSize, uint16_t *pRxLen)
+{
+	eSubgRxStatus_t result;
+	SubgOpHandle_t op;
+	uint64_t wakeUs;
+
+	if(!listenRunning || !dioWoken)
+	{
+		return SUBG_RX_TIMEOUT;
+	}
+	
+	//background work, a command arriving meanwhile preempts the read
+	op = Subg_OpBegin(SUBG_PRIO_BACKGROUND);
+	if(op == SUBG_OP_NONE)
+	{
+		return SUBG_RX_TIMEOUT;
+	}
+
+	Hal_DioIrqEnable(wakeRadio, false);
+	listenReport.wakeCnt++;
+
+	*pRxLen = 0;
+	wakeUs = Time_GetUs();
+	result = Subg_ListenRead(pRxBuf, bufSize, pRxLen, LISTEN_PKT_TIMEOUT_MS);
+	listenReport.wakeUs += Time_ElapsedUs(wakeUs);
+	Subg_OpEnd(op);
+	if(result == SUBG_RX_OK && *pRxLen > 0)
+	{
+		listenReport.pktCnt++;
+	}
+
+	listen_arm();
+	return result;
+}
+
+/*
+duty cycle and average current of an idle/rx setting, from the typical datasheet
+currents: the radio's sequencer and the nRF52 asleep. Time spent receiving after
+a wakeup is not included, Listen_GetReport adds it.
+*/
+void Listen_Estimate(uint32_t idleUs, uint32_t rxUs, sListenReport_t *pReport)
+{
+	uint64_t periodUs;
+	uint64_t chargeNaUs;
+
+	periodUs = (uint64_t)idleUs + rxUs + LISTEN_START_US;
+	chargeNaUs = (uint64_t)idleUs * LISTEN_IDLE_CURRENT_NA
+		+ (uint64_t)rxUs * LISTEN_RX_CURRENT_NA
+		+ (uint64_t)LISTEN_START_US * LISTEN_START_CURRENT_NA
+		+ periodUs * LISTEN_HOST_SLEEP_NA;
+
+	pReport->idleUs = idleUs;
+	pReport->rxUs = rxUs;
+	pReport->dutyPpm = (uint32_t)(((uint64_t)rxUs + LISTEN_START_US) * 1000000 / periodUs);
+	pReport->avgCurrentNa = (uint32_t)(chargeNaUs / periodUs);
+}
+
+/*
+the estimate over the time listened since Listen_ClrReport, with the wakes in:
+receiver and cpu on while a woken packet is read
+*/
+void Listen_GetReport(sListenReport_t *pReport)
+{
+	uint64_t listenUs;
+	uint64_t chargeNaUs;
+
+	listenUs = listenDoneUs + (listenRunning ? Time_GetUs() - listenSinceUs : 0);
+	*pReport = listenReport;
+	pReport->listenMs = (uint32_t)(listenUs / TIME_US_PER_MS);
+
+	if(listenUs > listenReport.wakeUs)
+	{
+		chargeNaUs = (listenUs - listenReport.wakeUs) * listenReport.avgCurrentNa
+			+ (uint64_t)listenReport.wakeUs * (LISTEN_RX_CURRENT_NA + LISTEN_HOST_RUN_NA);
+		pReport->avgCurrentNa = (uint32_t)(chargeNaUs / listenUs);
+	}
+}
+
+/*report counters start over, the idle/rx setting stays*/
+void Listen_ClrReport(void)
+{
+	uint32_t idleUs = listenReport.idleUs;
+	uint32_t rxUs = listenReport.rxUs;
+
+	memset(&listenReport, 0, sizeof(listenReport));
+	Listen_Estimate(idleUs, rxUs, &listenReport);
+	listenDoneUs = 0;
+	listenSinceUs = Time_GetUs();
+}
+
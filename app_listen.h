@@ -0,0 +1,65 @@
+/**
+ *@file app_listen.h
+ *@author Ribin Huang (you@domain.com)
+ *@brief duty-cycled background receive on the RFM69 listen sequencer
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __APP_LISTEN_H__
+#define __APP_LISTEN_H__
+#include <stdint.h>
+#include <stdbool.h>
+#include "app_subg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+	LISTEN_WAKE_RSSI = 0,		//anything above the RSSI threshold wakes us, cheap but false wakes on noise
+	LISTEN_WAKE_RSSI_SYNC		//RSSI and sync word, rx window must cover preamble + sync
+}eListenWake_t;
+
+typedef struct
+{
+	uint32_t idleUs;
+	uint32_t rxUs;
+	eListenWake_t wake;
+}sListenCfg_t;
+
+typedef struct
+{
+	uint32_t idleUs;			//as programmed, after rounding to the listen timer resolution
+	uint32_t rxUs;
+	uint32_t dutyPpm;			//share of time the receiver is powered by the sequencer, parts per million
+	uint32_t avgCurrentNa;		//modelled average current, radio and nRF52
+	uint32_t wakeCnt;			//DIO0 wakeups of the host
+	uint32_t pktCnt;			//wakeups that delivered a packet
+	uint32_t wakeUs;			//time spent reading after wakeups
+	uint32_t listenMs;			//time listened since the report was cleared
+}sListenReport_t;
+
+bool Listen_Start(eSubgMode_t mode, uint32_t freqHz, const sListenCfg_t *pCfg);
+void Listen_Stop(void);
+bool Listen_IsRunning(void);
+bool Listen_IsWoken(void);
+eSubgRxStatus_t Listen_Process(uint8_t *pRxBuf, uint16_t bufSize, uint16_t *pRxLen);
+void Listen_Estimate(uint32_t idleUs, uint32_t rxUs, sListenReport_t *pReport);
+void Listen_GetReport(sListenReport_t *pReport);
+void Listen_ClrReport(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,482 @@
+/**
+ *@file app_minimed.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief MiniMed pump session: wake-up, commands and history page download
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <string.h>
+
+#include "app_minimed.h"
+#include "app_subg.h"
+#include "app_codec.h"
+#include "app_time.h"
+#include "hal.h"
+
+//message: 0xA7 + pump id(3) + type + body + CRC8, 4b6b coded on air
+#define MM_PKT_TYPE_CARELINK		0xA7
+#define MM_HDR_LEN					(1 + MINIMED_PUMP_ID_LEN + 1)
+#define MM_SHORT_BODY_LEN			1
+#define MM_LONG_BODY_LEN			65
+#define MM_MSG_MAX_LEN				(MM_HDR_LEN + MM_LONG_BODY_LEN + 1)
+
+#define MM_MSG_ACK					0x06
+#define MM_MSG_NAK					0x15
+#define MM_MSG_POWER_ON				0x5D
+#define MM_MSG_READ_HISTORY			0x80
+
+//history frame body: sequence number (bit 7 set on the last one) + 64 page bytes
+#define MM_FRAME_LAST				0x80
+#define MM_FRAME_SEQ_MASK			0x7F
+#define MM_FRAME_DATA_LEN			64
+#define MM_FRAME_NUM				(MINIMED_PAGE_LEN / MM_FRAME_DATA_LEN)
+
+#define MM_RX_TIMEOUT_MS			200
+#define MM_RETRY_CNT				3
+#define MM_WAKE_REPEAT_CNT			255
+#define MM_WAKE_LISTEN_MS			12000		//the pump answers once the burst is over
+#define MM_AWAKE_MIN				10
+//region probe: a short burst on each band in turn, so a pump sampling either one hears us soon
+#define MM_PROBE_ROUNDS				8
+#define MM_PROBE_REPEAT_CNT			20
+#define MM_PROBE_LISTEN_MS			150
+
+#define TAG "MM"
+
+static uint8_t msgBuf[MM_MSG_MAX_LEN];
+static uint8_t txBuf[SUBG_TX_MAX_LEN];
+static uint8_t rxBuf[SUBG_RX_MAX_LEN];
+static uint8_t awakeId[MINIMED_PUMP_ID_LEN];
+static uint32_t awakeUntilMs = 0;
+static bool awake = false;
+static sMinimedStats_t mmStats;
+static sMinimedRegion_t *pRegionTable = NULL;
+static pfnMinimedSave_t pfnSave = NULL;
+static uint8_t regionReplaceIdx = 0;
+
+//CRC-8 polynomial 0x9B, over the whole message
+uint8_t Minimed_Crc8(const uint8_t *pData, uint16_t len)
+{
+	uint8_t crc = 0;
+	uint8_t i;
+
+	while(len--)
+	{
+		crc ^= *pData++;
+		for(i = 0; i < 8; i++)
+		{
+			crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x9B) : (uint8_t)(crc << 1);
+		}
+	}
+	return crc;
+}
+
+//CRC-16/CCITT-FALSE, history pages and sensor packets carry it big endian in their last 2 bytes
+uint16_t Minimed_Crc16(const uint8_t *pData, uint16_t len)
+{
+	uint16_t crc = 0xFFFF;
+	uint8_t i;
+
+	while(len--)
+	{
+		crc ^= (uint16_t)(*pData++) << 8;
+		for(i = 0; i < 8; i++)
+		{
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+		}
+	}
+	return crc;
+}
+
+static sMinimedRegion_t *region_find(const uint8_t *pPumpId)
+{
+	uint8_t i;
+
+	if(pRegionTable == NULL)
+	{
+		return NULL;
+	}
+
+	for(i = 0; i < MINIMED_REGION_NUM; i++)
+	{
+		if(pRegionTable[i].mode != SUBG_MODE_OMNIPOD && memcmp(pRegionTable[i].pumpId, pPumpId, MINIMED_PUMP_ID_LEN) == 0)
+		{
+			return &pRegionTable[i];
+		}
+	}
+	return NULL;
+}
+
+//the pump answered on mode, remember it. Flash is only written on a change.
+static void region_learn(const uint8_t *pPumpId, eSubgMode_t mode)
+{
+	sMinimedRegion_t *pEntry;
+	uint8_t i;
+
+	if(pRegionTable == NULL || mode == SUBG_MODE_OMNIPOD)
+	{
+		return;
+	}
+
+	pEntry = region_find(pPumpId);
+	if(pEntry != NULL && pEntry->mode == mode)
+	{
+		return;
+	}
+
+	if(pEntry == NULL)
+	{
+		for(i = 0; i < MINIMED_REGION_NUM; i++)
+		{
+			if(pRegionTable[i].mode == SUBG_MODE_OMNIPOD)
+			{
+				break;
+			}
+		}
+		if(i == MINIMED_REGION_NUM)
+		{
+			i = regionReplaceIdx;
+			regionReplaceIdx = (regionReplaceIdx + 1) % MINIMED_REGION_NUM;
+		}
+		pEntry = &pRegionTable[i];
+		memcpy(pEntry->pumpId, pPumpId, MINIMED_PUMP_ID_LEN);
+	}
+
+	pEntry->mode = (uint8_t)mode;
+	KIT_LOG(TAG, "Pump %02x%02x%02x on mode %d.", pPumpId[0], pPumpId[1], pPumpId[2], mode);
+	if(pfnSave != NULL)
+	{
+		pfnSave();
+	}
+}
+
+//the pump's carrier offset is tracked under its 3 byte id
+static void remote_select(const uint8_t *pPumpId)
+{
+	Subg_SetRemoteId(((uint32_t)pPumpId[0] << 16) | ((uint32_t)pPumpId[1] << 8) | pPumpId[2]);
+}
+
+static eMinimedStatus_t mm_send(const uint8_t *pPumpId, uint8_t type, const uint8_t *pBody, uint8_t bodyLen, uint8_t repeatCnt)
+{
+	uint16_t len = MM_HDR_LEN + bodyLen;
+	uint16_t txLen;
+
+	msgBuf[0] = MM_PKT_TYPE_CARELINK;
+	memcpy(msgBuf + 1, pPumpId, MINIMED_PUMP_ID_LEN);
+	msgBuf[MM_HDR_LEN - 1] = type;
+	memcpy(msgBuf + MM_HDR_LEN, pBody, bodyLen);
+	msgBuf[len] = Minimed_Crc8(msgBuf, len);
+
+	//4b6b with its nibble padding, app_subg adds the 0x00 trailer
+	txLen = Codec_Encode(CODEC_4B6B, msgBuf, len + 1, txBuf, sizeof(txBuf), true);
+	if(Subg_SendPkt(txBuf, txLen, repeatCnt, 0, 0) == SUBG_TX_ABORT)
+	{
+		return MINIMED_ABORT;
+	}
+	return MINIMED_OK;
+}
+
+/*
+wait for a message from this pump, others and corrupted ones are skipped until
+the timeout. The body stays in msgBuf.
+*/
+static eMinimedStatus_t mm_receive(const uint8_t *pPumpId, uint32_t timeout, uint8_t *pType, uint8_t *pBodyLen)
+{
+	uint64_t deadline = Time_DeadlineMs(timeout);
+	eSubgRxStatus_t result;
+	uint16_t rxLen;
+	uint16_t len;
+	uint32_t leftMs;
+
+	while(!Time_IsExpired(deadline))
+	{
+		leftMs = (uint32_t)((deadline - Time_GetUs()) / 1000);
+		rxLen = 0;
+		result = Subg_GetPkt(rxBuf, sizeof(rxBuf), &rxLen, (leftMs > 0) ? leftMs : 1, false);
+		if(result == SUBG_RX_INT)
+		{
+			return MINIMED_ABORT;
+		}
+		if(result != SUBG_RX_OK)
+		{
+			continue;
+		}
+
+		len = Codec_Decode(CODEC_4B6B, rxBuf, rxLen, msgBuf, sizeof(msgBuf));
+		if(len < MM_HDR_LEN + 1 || msgBuf[0] != MM_PKT_TYPE_CARELINK
+			|| memcmp(msgBuf + 1, pPumpId, MINIMED_PUMP_ID_LEN) != 0
+			|| Minimed_Crc8(msgBuf, len - 1) != msgBuf[len - 1])
+		{
+			continue;
+		}
+
+		*pType = msgBuf[MM_HDR_LEN - 1];
+		*pBodyLen = (uint8_t)(len - MM_HDR_LEN - 1);
+		return MINIMED_OK;
+	}
+	return MINIMED_NO_RESPONSE;
+}
+
+/*
+send and wait for a reply of type expect, the message goes out again on silence.
+Replies feed the TX power control, silence only once this pump is known to be awake:
+a sleeping pump or one on the other band says nothing about the link.
+*/
+static eMinimedStatus_t mm_exchange(const uint8_t *pPumpId, uint8_t type, const uint8_t *pBody, uint8_t bodyLen,
+									uint8_t repeatCnt, uint32_t timeout, uint8_t retryCnt, uint8_t expect, uint8_t *pBodyLen)
+{
+	eMinimedStatus_t status;
+	uint8_t rxType;
+	uint8_t i;
+
+	for(i = 0; i <= retryCnt; i++)
+	{
+		status = mm_send(pPumpId, type, pBody, bodyLen, (i == 0) ? repeatCnt : 0);
+		if(status != MINIMED_OK)
+		{
+			return status;
+		}
+
+		status = mm_receive(pPumpId, timeout, &rxType, pBodyLen);
+		if(status == MINIMED_NO_RESPONSE)
+		{
+			if(awake && memcmp(awakeId, pPumpId, MINIMED_PUMP_ID_LEN) == 0)
+			{
+				Subg_TxFeedback(false);
+			}
+			continue;
+		}
+		if(status != MINIMED_OK)
+		{
+			return status;
+		}
+		Subg_TxFeedback(true);
+		if(rxType == MM_MSG_NAK)
+		{
+			return MINIMED_NAK;
+		}
+		return (rxType == expect) ? MINIMED_OK : MINIMED_BAD_FRAME;
+	}
+	return MINIMED_NO_RESPONSE;
+}
+
+void Minimed_Init(sMinimedRegion_t *pTable, pfnMinimedSave_t save)
+{
+	pRegionTable = pTable;
+	pfnSave = save;
+}
+
+//region the pump was last heard on, SUBG_MODE_NUM if never
+eSubgMode_t Minimed_GetRegion(const uint8_t *pPumpId)
+{
+	sMinimedRegion_t *pEntry = region_find(pPumpId);
+
+	return (pEntry != NULL) ? (eSubgMode_t)pEntry->mode : SUBG_MODE_NUM;
+}
+
+uint32_t Minimed_RegionFreq(eSubgMode_t mode)
+{
+	return (mode == SUBG_MODE_MINIMED_WWL) ? MINIMED_WWL_FREQ_HZ : MINIMED_NAS_FREQ_HZ;
+}
+
+/*
+find out whether the pump is a 916MHz (NAS) or 868MHz (WWL) one. Instead of a full
+wake-up on a guess, short power-on bursts go out on both bands in turn, the band
+remembered for this pump first. Any answer settles it. The radio is left on the
+pump's band.
+*/
+eMinimedStatus_t Minimed_DetectRegion(const uint8_t *pPumpId, eSubgMode_t *pMode)
+{
+	uint8_t shortBody[MM_SHORT_BODY_LEN] = {0x00};
+	eSubgMode_t order[2] = {SUBG_MODE_MINIMED_NAS, SUBG_MODE_MINIMED_WWL};
+	uint32_t startMs = Time_GetMs();
+	eMinimedStatus_t status = MINIMED_NO_RESPONSE;
+	uint8_t bodyLen;
+	uint8_t round;
+	uint8_t i;
+
+	if(Minimed_GetRegion(pPumpId) == SUBG_MODE_MINIMED_WWL)
+	{
+		order[0] = SUBG_MODE_MINIMED_WWL;
+		order[1] = SUBG_MODE_MINIMED_NAS;
+	}
+	remote_select(pPumpId);
+
+	for(round = 0; round < MM_PROBE_ROUNDS && status == MINIMED_NO_RESPONSE; round++)
+	{
+		for(i = 0; i < 2; i++)
+		{
+			Subg_SetMode(order[i]);
+			Subg_SetFreq(Minimed_RegionFreq(order[i]));
+			mmStats.probeCnt++;
+
+			status = mm_exchange(pPumpId, MM_MSG_POWER_ON, shortBody, sizeof(shortBody), MM_PROBE_REPEAT_CNT, MM_PROBE_LISTEN_MS, 0, MM_MSG_ACK, &bodyLen);
+			if(status != MINIMED_NO_RESPONSE)
+			{
+				break;
+			}
+		}
+	}
+	mmStats.lastProbeMs = Time_GetMs() - startMs;
+
+	if(status == MINIMED_ABORT || status == MINIMED_NO_RESPONSE)
+	{
+		return status;
+	}
+
+	//a NAK or an odd reply still came from the pump on this band
+	*pMode = Subg_GetMode();
+	region_learn(pPumpId, *pMode);
+	KIT_LOG(TAG, "Region found in %u ms.", mmStats.lastProbeMs);
+	return MINIMED_OK;
+}
+
+/*
+a pump not spoken to for a while sleeps and only samples the channel now and
+then: a short power-on repeated for seconds catches it, then the long one
+keeps the radio on for minutes. Skipped while the pump is known to be awake.
+*/
+eMinimedStatus_t Minimed_Wakeup(const uint8_t *pPumpId, uint8_t minutes)
+{
+	uint8_t shortBody[MM_SHORT_BODY_LEN] = {0x00};
+	uint8_t longBody[MM_LONG_BODY_LEN] = {0x02, 0x01, minutes};
+	eMinimedStatus_t status;
+	uint8_t bodyLen;
+
+	remote_select(pPumpId);
+	if(awake && memcmp(awakeId, pPumpId, MINIMED_PUMP_ID_LEN) == 0 && (int32_t)(awakeUntilMs - Time_GetMs()) > 0)
+	{
+		return MINIMED_OK;
+	}
+	awake = false;
+
+	//still awake from another session, it answers right away
+	status = mm_exchange(pPumpId, MM_MSG_POWER_ON, shortBody, sizeof(shortBody), 0, MM_RX_TIMEOUT_MS, 0, MM_MSG_ACK, &bodyLen);
+	if(status == MINIMED_NO_RESPONSE)
+	{
+		mmStats.wakeCnt++;
+		KIT_LOG(TAG, "Waking pump %02x%02x%02x.", pPumpId[0], pPumpId[1], pPumpId[2]);
+		status = mm_exchange(pPumpId, MM_MSG_POWER_ON, shortBody, sizeof(shortBody), MM_WAKE_REPEAT_CNT, MM_WAKE_LISTEN_MS, 0, MM_MSG_ACK, &bodyLen);
+	}
+	if(status != MINIMED_OK)
+	{
+		return status;
+	}
+
+	status = mm_exchange(pPumpId, MM_MSG_POWER_ON, longBody, sizeof(longBody), 0, MM_RX_TIMEOUT_MS, MM_RETRY_CNT, MM_MSG_ACK, &bodyLen);
+	if(status == MINIMED_OK)
+	{
+		memcpy(awakeId, pPumpId, MINIMED_PUMP_ID_LEN);
+		region_learn(pPumpId, Subg_GetMode());
+		//a minute short of what was asked, never talk to a pump that just went back to sleep
+		awakeUntilMs = Time_GetMs() + (minutes > 0 ? minutes - 1 : 0) * 60000UL;
+		awake = true;
+	}
+	return status;
+}
+
+/*
+wake-up, read history command (short, then long with the page number), then 16
+frames of 64 bytes, each acked to get the next one. A lost ack is sent again, the
+pump then repeats the frame we already have.
+*/
+eMinimedStatus_t Minimed_ReadHistoryPage(const uint8_t *pPumpId, uint8_t page, uint8_t *pPage)
+{
+	uint8_t shortBody[MM_SHORT_BODY_LEN] = {0x00};
+	uint8_t longBody[MM_LONG_BODY_LEN] = {0x01, page};
+	uint32_t startMs = Time_GetMs();
+	eMinimedStatus_t status;
+	uint8_t bodyLen;
+	uint8_t next = 1;
+	uint8_t seq;
+	bool last = false;
+
+	status = Minimed_Wakeup(pPumpId, MM_AWAKE_MIN);
+	if(status == MINIMED_OK)
+	{
+		status = mm_exchange(pPumpId, MM_MSG_READ_HISTORY, shortBody, sizeof(shortBody), 0, MM_RX_TIMEOUT_MS, MM_RETRY_CNT, MM_MSG_ACK, &bodyLen);
+	}
+	if(status == MINIMED_OK)
+	{
+		status = mm_exchange(pPumpId, MM_MSG_READ_HISTORY, longBody, sizeof(longBody), 0, MM_RX_TIMEOUT_MS, MM_RETRY_CNT, MM_MSG_READ_HISTORY, &bodyLen);
+	}
+
+	while(status == MINIMED_OK)
+	{
+		if(bodyLen < 1 + MM_FRAME_DATA_LEN)
+		{
+			status = MINIMED_BAD_FRAME;
+			break;
+		}
+
+		seq = msgBuf[MM_HDR_LEN] & MM_FRAME_SEQ_MASK;
+		if(seq == next && seq <= MM_FRAME_NUM)
+		{
+			memcpy(pPage + (seq - 1) * MM_FRAME_DATA_LEN, msgBuf + MM_HDR_LEN + 1, MM_FRAME_DATA_LEN);
+			last = (msgBuf[MM_HDR_LEN] & MM_FRAME_LAST) != 0;
+			next++;
+		}
+		else if(seq != next - 1)
+		{
+			status = MINIMED_BAD_FRAME;
+			break;
+		}
+		else
+		{
+			mmStats.frameRetryCnt++;
+		}
+
+		if(last)
+		{
+			//nothing comes back for the final ack
+			status = mm_send(pPumpId, MM_MSG_ACK, shortBody, sizeof(shortBody), 0);
+			break;
+		}
+		status = mm_exchange(pPumpId, MM_MSG_ACK, shortBody, sizeof(shortBody), 0, MM_RX_TIMEOUT_MS, MM_RETRY_CNT, MM_MSG_READ_HISTORY, &bodyLen);
+	}
+
+	if(status != MINIMED_OK)
+	{
+		if(status != MINIMED_ABORT)
+		{
+			//the pump may have dropped the session, wake it properly next time
+			awake = false;
+		}
+		KIT_LOG(TAG, "History page %u failed (%d), %u frames.", page, status, next - 1);
+		return status;
+	}
+	if(next - 1 != MM_FRAME_NUM)
+	{
+		return MINIMED_BAD_FRAME;
+	}
+	if(Minimed_Crc16(pPage, MINIMED_PAGE_LEN - 2) != (((uint16_t)pPage[MINIMED_PAGE_LEN - 2] << 8) | pPage[MINIMED_PAGE_LEN - 1]))
+	{
+		mmStats.crcFailCnt++;
+		return MINIMED_BAD_CRC;
+	}
+
+	mmStats.pageCnt++;
+	mmStats.lastPageMs = Time_GetMs() - startMs;
+	KIT_LOG(TAG, "History page %u in %u ms.", page, mmStats.lastPageMs);
+	return MINIMED_OK;
+}
+
+//forget the pump is awake, e.g. after a reset it may have missed
+void Minimed_Sleep(void)
+{
+	awake = false;
+}
+
+const sMinimedStats_t *Minimed_GetStats(void)
+{
+	return &mmStats;
+}
+
@@ -0,0 +1,82 @@
+/**
+ *@file app_minimed.h
+ *@author Ribin Huang (you@domain.com)
+ *@brief MiniMed pump session: wake-up, commands and history page download
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __APP_MINIMED_H__
+#define __APP_MINIMED_H__
+#include <stdint.h>
+#include <stdbool.h>
+#include "app_subg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MINIMED_PUMP_ID_LEN			3			//serial number, BCD as printed on the pump
+#define MINIMED_PAGE_LEN			1024		//history page, CRC16 in its last 2 bytes
+#define MINIMED_REGION_NUM			4			//pumps whose region is remembered
+#define MINIMED_NAS_FREQ_HZ			916500000
+#define MINIMED_WWL_FREQ_HZ			868350000
+
+typedef enum
+{
+	MINIMED_OK = 0,
+	MINIMED_NO_RESPONSE,		//nothing from the pump, asleep or out of range
+	MINIMED_NAK,				//pump refused the command
+	MINIMED_BAD_FRAME,			//frames out of sequence or page incomplete
+	MINIMED_BAD_CRC,			//page complete, CRC16 mismatch
+	MINIMED_ABORT				//cancelled or preempted
+}eMinimedStatus_t;
+
+typedef struct
+{
+	uint32_t wakeCnt;			//wake-up bursts sent, the pump was asleep
+	uint32_t pageCnt;			//pages downloaded with a good CRC
+	uint32_t frameRetryCnt;		//frames the pump sent twice, our ack got lost
+	uint32_t crcFailCnt;
+	uint32_t lastPageMs;		//wake-up included
+	uint32_t probeCnt;			//region probe bursts sent
+	uint32_t lastProbeMs;		//last region detection, found or not
+}sMinimedStats_t;
+
+//persisted as is in rileylink_config, keep it 4-byte aligned and only append fields
+typedef struct
+{
+	uint8_t pumpId[MINIMED_PUMP_ID_LEN];
+	uint8_t mode;				//SUBG_MODE_MINIMED_NAS or _WWL, SUBG_MODE_OMNIPOD (0) = slot unused
+}sMinimedRegion_t;
+
+typedef void (*pfnMinimedSave_t)(void);
+
+/*
+The caller owns the radio for the whole session: MiniMed mode and frequency set,
+inside Subg_OpBegin/Subg_OpEnd. A cancel of the op ends the session with MINIMED_ABORT.
+*/
+void Minimed_Init(sMinimedRegion_t *pTable, pfnMinimedSave_t save);
+eSubgMode_t Minimed_GetRegion(const uint8_t *pPumpId);
+uint32_t Minimed_RegionFreq(eSubgMode_t mode);
+eMinimedStatus_t Minimed_DetectRegion(const uint8_t *pPumpId, eSubgMode_t *pMode);
+eMinimedStatus_t Minimed_Wakeup(const uint8_t *pPumpId, uint8_t minutes);
+eMinimedStatus_t Minimed_ReadHistoryPage(const uint8_t *pPumpId, uint8_t page, uint8_t *pPage);
+void Minimed_Sleep(void);
+uint8_t Minimed_Crc8(const uint8_t *pData, uint16_t len);
+uint16_t Minimed_Crc16(const uint8_t *pData, uint16_t len);
+const sMinimedStats_t *Minimed_GetStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,244 @@
+/**
+ *@file app_noise.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief noise floor per frequency and the receiver thresholds derived from it
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <string.h>
+#include <stdlib.h>
+
+#include "app_noise.h"
+#include "app_time.h"
+#include "hal.h"
+
+/*
+The floor is what RSSI reads in rx while nothing synced. It follows quieter samples
+quickly and louder ones slowly, so preambles and packets that were not caught by the
+sync detector barely move it. RssiThreshold sits a margin above it: noise no longer
+starts the receiver, and in a quiet place the threshold goes below the fixed default.
+*/
+
+//RSSI poll interval on an idle receiver
+#define NOISE_SAMPLE_US				2000
+//samples on a channel before its floor is trusted
+#define NOISE_MIN_SAMPLES			16
+#define NOISE_FALL_DIV				4
+#define NOISE_RISE_DIV				32
+//a sample this far above the floor is taken for a signal, unless they keep coming
+#define NOISE_OUTLIER_DB			15
+#define NOISE_OUTLIER_RUN			32
+//frequencies this close share a floor
+#define NOISE_CH_SPACING_HZ			50000
+
+//RSSI this far above the floor starts the receiver
+#define NOISE_MARGIN_DB				6
+//value of the config tables, used until the floor is known
+#define NOISE_THRESH_DEFAULT_DBM	-114
+#define NOISE_THRESH_MIN_DBM		-120
+#define NOISE_THRESH_MAX_DBM		-80
+//rewrite the registers once the threshold moved this far
+#define NOISE_APPLY_STEP_DB			2
+
+//OokFixedThresh reset value, right for a floor around NOISE_QUIET_DBM. The peak
+//demodulator's floor has to stay above the noise, it goes up dB for dB with it.
+#define NOISE_OOKFIX_DEFAULT_DB		6
+#define NOISE_OOKFIX_MAX_DB			40
+#define NOISE_QUIET_DBM				-110
+
+#define TAG "NSE"
+
+static sNoiseCh_t noiseCh[NOISE_CH_NUM];
+static sNoiseCh_t *pCurCh[NOISE_DEV_NUM];
+static uint64_t samplePollUs[NOISE_DEV_NUM];
+static int16_t appliedThresh[NOISE_DEV_NUM];
+static uint8_t appliedOokFix[NOISE_DEV_NUM];
+static uint32_t applyCnt[NOISE_DEV_NUM];
+static uint32_t useSeq = 0;
+static bool noiseAdaptive = true;
+
+static bool floor_known(const sNoiseCh_t *pCh)
+{
+	return noiseAdaptive && pCh != NULL && pCh->sampleCnt >= NOISE_MIN_SAMPLES;
+}
+
+static int16_t rssi_thresh(const sNoiseCh_t *pCh)
+{
+	int16_t dbm;
+
+	if(!floor_known(pCh))
+	{
+		return NOISE_THRESH_DEFAULT_DBM;
+	}
+
+	dbm = pCh->floorX16 / 16 + NOISE_MARGIN_DB;
+	if(dbm < NOISE_THRESH_MIN_DBM)
+	{
+		dbm = NOISE_THRESH_MIN_DBM;
+	}
+	if(dbm > NOISE_THRESH_MAX_DBM)
+	{
+		dbm = NOISE_THRESH_MAX_DBM;
+	}
+	return dbm;
+}
+
+static uint8_t ook_fix(const sNoiseCh_t *pCh)
+{
+	int16_t db = NOISE_OOKFIX_DEFAULT_DB;
+
+	if(floor_known(pCh) && pCh->floorX16 / 16 > NOISE_QUIET_DBM)
+	{
+		db += pCh->floorX16 / 16 - NOISE_QUIET_DBM;
+	}
+	return (db > NOISE_OOKFIX_MAX_DB) ? NOISE_OOKFIX_MAX_DB : (uint8_t)db;
+}
+
+void Noise_Init(void)
+{
+	memset(noiseCh, 0, sizeof(noiseCh));
+	memset(pCurCh, 0, sizeof(pCurCh));
+	memset(samplePollUs, 0, sizeof(samplePollUs));
+	memset(appliedThresh, 0, sizeof(appliedThresh));
+	memset(appliedOokFix, 0, sizeof(appliedOokFix));
+	memset(applyCnt, 0, sizeof(applyCnt));
+	useSeq = 0;
+}
+
+/*off: the thresholds of the config tables*/
+void Noise_SetAdaptive(bool onOff)
+{
+	noiseAdaptive = onOff;
+}
+
+/*the radio was tuned to freqHz (nominal), an unknown frequency takes the least recently used slot*/
+void Noise_Select(eRf69Dev_t dev, uint32_t freqHz)
+{
+	sNoiseCh_t *pCh = NULL;
+	uint8_t i;
+
+	for(i = 0; i < NOISE_CH_NUM; i++)
+	{
+		if(noiseCh[i].freqHz != 0 && (uint32_t)abs((int32_t)(noiseCh[i].freqHz - freqHz)) < NOISE_CH_SPACING_HZ)
+		{
+			pCh = &noiseCh[i];
+			break;
+		}
+		if(pCh == NULL || noiseCh[i].useSeq < pCh->useSeq)
+		{
+			pCh = &noiseCh[i];
+		}
+	}
+
+	if(pCh->freqHz == 0 || (uint32_t)abs((int32_t)(pCh->freqHz - freqHz)) >= NOISE_CH_SPACING_HZ)
+	{
+		memset(pCh, 0, sizeof(sNoiseCh_t));
+		pCh->freqHz = freqHz;
+	}
+
+	pCh->useSeq = ++useSeq;
+	pCurCh[dev] = pCh;
+}
+
+bool Noise_SampleDue(eRf69Dev_t dev)
+{
+	uint64_t now = Time_GetUs();
+
+	if(pCurCh[dev] == NULL || now < samplePollUs[dev])
+	{
+		return false;
+	}
+
+	samplePollUs[dev] = now + NOISE_SAMPLE_US;
+	return true;
+}
+
+/*
+RSSI read while the receiver was idle (no sync). True when the thresholds moved far
+enough from the ones in the radio to be worth rewriting with Noise_Apply.
+*/
+bool Noise_Sample(eRf69Dev_t dev, int16_t rssi)
+{
+	sNoiseCh_t *pCh = pCurCh[dev];
+	int16_t diffX16;
+
+	if(pCh == NULL)
+	{
+		return false;
+	}
+
+	if(pCh->sampleCnt == 0)
+	{
+		pCh->floorX16 = rssi * 16;
+	}
+	else
+	{
+		diffX16 = rssi * 16 - pCh->floorX16;
+		if(diffX16 > NOISE_OUTLIER_DB * 16)
+		{
+			//a signal on air, unless it stays: then the noise went up
+			if(++pCh->outlierRun < NOISE_OUTLIER_RUN)
+			{
+				return false;
+			}
+			pCh->floorX16 = rssi * 16;
+		}
+		else
+		{
+			pCh->floorX16 += diffX16 / ((diffX16 < 0) ? NOISE_FALL_DIV : NOISE_RISE_DIV);
+		}
+		pCh->outlierRun = 0;
+	}
+
+	if(pCh->sampleCnt < UINT16_MAX)
+	{
+		pCh->sampleCnt++;
+	}
+
+	return abs(rssi_thresh(pCh) - appliedThresh[dev]) >= NOISE_APPLY_STEP_DB;
+}
+
+/*write the thresholds of the selected frequency to the radio, OokFix only matters for OOK*/
+void Noise_Apply(eRf69Dev_t dev)
+{
+	int16_t thresh;
+
+	thresh = rssi_thresh(pCurCh[dev]);
+	Rf69_SetRssiThresh(dev, thresh);
+	if(dev == RF69_DEV_FREQ916N868)
+	{
+		appliedOokFix[dev] = ook_fix(pCurCh[dev]);
+		Rf69_SetOokFixThresh(dev, appliedOokFix[dev]);
+	}
+
+	if(thresh != appliedThresh[dev])
+	{
+		KIT_LOG(TAG, "Radio %d rssi threshold %d dBm.", dev, thresh);
+		applyCnt[dev]++;
+	}
+	appliedThresh[dev] = thresh;
+}
+
+void Noise_GetState(eRf69Dev_t dev, sNoiseState_t *pState)
+{
+	sNoiseCh_t *pCh = pCurCh[dev];
+
+	memset(pState, 0, sizeof(sNoiseState_t));
+	pState->rssiThreshDbm = appliedThresh[dev];
+	pState->ookFixDb = appliedOokFix[dev];
+	pState->applyCnt = applyCnt[dev];
+	if(pCh != NULL)
+	{
+		pState->floorDbm = pCh->floorX16 / 16;
+		pState->sampleCnt = pCh->sampleCnt;
+	}
+}
+
@@ -0,0 +1,60 @@
+/**
+ *@file app_noise.h
+ *@author Ribin Huang (you@domain.com)
+ *@brief noise floor per frequency and the receiver thresholds derived from it
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __APP_NOISE_H__
+#define __APP_NOISE_H__
+#include <stdint.h>
+#include <stdbool.h>
+#include "rf69.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NOISE_DEV_NUM		2		//one selected channel per eRf69Dev_t
+#define NOISE_CH_NUM		8		//frequencies remembered, the least recently used one is reused
+
+typedef struct
+{
+	uint32_t freqHz;			//0 = free
+	int16_t floorX16;			//noise floor, dBm * 16
+	uint16_t sampleCnt;
+	uint8_t outlierRun;			//samples in a row far above the floor
+	uint32_t useSeq;
+}sNoiseCh_t;
+
+typedef struct
+{
+	int16_t floorDbm;
+	int16_t rssiThreshDbm;		//RegRssiThresh in use
+	uint8_t ookFixDb;			//RegOokFix in use, 916/868 radio only
+	uint16_t sampleCnt;
+	uint32_t applyCnt;			//threshold register updates
+}sNoiseState_t;
+
+void Noise_Init(void);
+void Noise_SetAdaptive(bool onOff);
+void Noise_Select(eRf69Dev_t dev, uint32_t freqHz);
+bool Noise_SampleDue(eRf69Dev_t dev);
+bool Noise_Sample(eRf69Dev_t dev, int16_t rssi);
+void Noise_Apply(eRf69Dev_t dev);
+void Noise_GetState(eRf69Dev_t dev, sNoiseState_t *pState);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,340 @@
+/**
+ *@file app_omnipod.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief Omnipod link layer: messages in and out as packets with acks and retries
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <string.h>
+
+#include "app_omnipod.h"
+#include "app_subg.h"
+#include "app_codec.h"
+#include "app_time.h"
+#include "hal.h"
+
+/*
+Every packet is answered by the other side with sequence number + 1: the PDM
+packet and its CON packets by ACKs, the last one by the pod's reply (POD, then
+CON packets we ack one by one). A final ACK to address 0 closes the exchange.
+A packet not answered in time goes out again; the pod sending its previous
+packet again means it missed ours, which also goes out again.
+*/
+
+#define OMNI_PKT_TIMEOUT_MS			165
+#define OMNI_EXCHANGE_TIMEOUT_MS	3000		//per packet, retransmissions included
+#define OMNI_PREAMBLE_EXT_MS		127			//first packet only, the pod samples the channel
+#define OMNI_QUIET_MS				300			//no repeat from the pod this long after the final ack: done
+#define OMNI_FINAL_ACK_CNT			3
+
+#define TAG "OMN"
+
+static uint8_t txPkt[OMNIPOD_PKT_MAX_LEN];
+static uint8_t rxPkt[OMNIPOD_PKT_MAX_LEN];
+static uint8_t txBuf[OMNIPOD_PKT_MAX_LEN * 2];
+static uint16_t txLen = 0;
+static uint8_t rxBuf[SUBG_RX_MAX_LEN];
+static sOmnipodStats_t omniStats;
+
+//CRC-8 polynomial 0x07, over the whole packet
+uint8_t Omnipod_Crc8(const uint8_t *pData, uint16_t len)
+{
+	uint8_t crc = 0;
+	uint8_t i;
+
+	while(len--)
+	{
+		crc ^= *pData++;
+		for(i = 0; i < 8; i++)
+		{
+			crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+		}
+	}
+	return crc;
+}
+
+//whole message length from its first OMNIPOD_MSG_HDR_LEN bytes
+uint16_t Omnipod_MsgLen(const uint8_t *pHdr)
+{
+	return OMNIPOD_MSG_HDR_LEN + ((((uint16_t)pHdr[4] & 0x03) << 8) | pHdr[5]) + OMNIPOD_MSG_CRC_LEN;
+}
+
+static void put_addr(uint8_t *p, uint32_t address)
+{
+	p[0] = (uint8_t)(address >> 24);
+	p[1] = (uint8_t)(address >> 16);
+	p[2] = (uint8_t)(address >> 8);
+	p[3] = (uint8_t)address;
+}
+
+//build and line code the packet, kept in txBuf for retransmissions
+static void pkt_build(uint32_t address, uint8_t type, uint8_t seq, const uint8_t *pBody, uint8_t bodyLen)
+{
+	uint16_t len = OMNIPOD_PKT_HDR_LEN + bodyLen;
+
+	put_addr(txPkt, address);
+	txPkt[OMNIPOD_ADDR_LEN] = (uint8_t)(type << 5) | (seq & OMNIPOD_SEQ_MASK);
+	memcpy(txPkt + OMNIPOD_PKT_HDR_LEN, pBody, bodyLen);
+	txPkt[len] = Omnipod_Crc8(txPkt, len);
+
+	txLen = Codec_Encode(CODEC_MANCHESTER, txPkt, len + 1, txBuf, sizeof(txBuf), false);
+}
+
+static eOmnipodStatus_t pkt_send(uint16_t preambleExt)
+{
+	if(Subg_SendPkt(txBuf, txLen, 0, 0, preambleExt) == SUBG_TX_ABORT)
+	{
+		return OMNIPOD_ABORT;
+	}
+	return OMNIPOD_OK;
+}
+
+//next good packet to our address before the deadline, in rxPkt
+static eOmnipodStatus_t pkt_receive(uint32_t address, uint64_t deadline, uint8_t *pBodyLen)
+{
+	uint8_t addr[OMNIPOD_ADDR_LEN];
+	eSubgRxStatus_t result;
+	uint16_t rxLen;
+	uint16_t len;
+	uint32_t leftMs;
+
+	put_addr(addr, address);
+
+	while(!Time_IsExpired(deadline))
+	{
+		leftMs = (uint32_t)((deadline - Time_GetUs()) / 1000);
+		rxLen = 0;
+		result = Subg_GetPkt(rxBuf, sizeof(rxBuf), &rxLen, (leftMs > 0) ? leftMs : 1, false);
+		if(result == SUBG_RX_INT)
+		{
+			return OMNIPOD_ABORT;
+		}
+		if(result != SUBG_RX_OK)
+		{
+			continue;
+		}
+
+		len = Codec_Decode(CODEC_MANCHESTER, rxBuf, rxLen, rxPkt, sizeof(rxPkt));
+		if(len < OMNIPOD_PKT_HDR_LEN + 1 || memcmp(rxPkt, addr, OMNIPOD_ADDR_LEN) != 0
+			|| Omnipod_Crc8(rxPkt, len - 1) != rxPkt[len - 1])
+		{
+			continue;
+		}
+
+		*pBodyLen = (uint8_t)(len - OMNIPOD_PKT_HDR_LEN - 1);
+		return OMNIPOD_OK;
+	}
+	return OMNIPOD_NO_RESPONSE;
+}
+
+/*
+send the packet in txBuf until the pod answers it with sequence number seq + 1,
+returns the answer's type. Each answer, repeat or silence tells the TX power
+control whether the pod heard us.
+*/
+static eOmnipodStatus_t pkt_exchange(uint32_t address, uint8_t seq, uint16_t preambleExt, uint8_t *pType, uint8_t *pBodyLen)
+{
+	uint64_t deadline = Time_DeadlineMs(OMNI_EXCHANGE_TIMEOUT_MS);
+	eOmnipodStatus_t status;
+	uint8_t rxSeq;
+
+	status = pkt_send(preambleExt);
+	omniStats.txPktCnt++;
+
+	while(status == OMNIPOD_OK)
+	{
+		status = pkt_receive(address, Time_DeadlineMs(OMNI_PKT_TIMEOUT_MS), pBodyLen);
+		if(status == OMNIPOD_OK)
+		{
+			rxSeq = rxPkt[OMNIPOD_ADDR_LEN] & OMNIPOD_SEQ_MASK;
+			if(rxSeq == ((seq + 1) & OMNIPOD_SEQ_MASK))
+			{
+				Subg_TxFeedback(true);
+				*pType = rxPkt[OMNIPOD_ADDR_LEN] >> 5;
+				return OMNIPOD_OK;
+			}
+			if(rxSeq == ((seq - 1) & OMNIPOD_SEQ_MASK))
+			{
+				//its previous packet again, ours got lost
+				omniStats.dupCnt++;
+				Subg_TxFeedback(false);
+			}
+			else if(!Time_IsExpired(deadline))
+			{
+				//something stale, keep listening
+				continue;
+			}
+		}
+		else if(status != OMNIPOD_NO_RESPONSE)
+		{
+			return status;
+		}
+		else
+		{
+			Subg_TxFeedback(false);
+		}
+
+		if(Time_IsExpired(deadline))
+		{
+			return OMNIPOD_NO_RESPONSE;
+		}
+		omniStats.retxCnt++;
+		status = pkt_send(0);
+	}
+	return status;
+}
+
+/*
+the pod repeats its last packet until it hears the final ack, send it again
+while that happens
+*/
+static eOmnipodStatus_t ack_until_quiet(uint32_t address, uint8_t seq)
+{
+	uint8_t body[OMNIPOD_ADDR_LEN] = {0};
+	eOmnipodStatus_t status;
+	uint8_t bodyLen;
+	uint8_t i;
+
+	pkt_build(address, OMNIPOD_PKT_ACK, seq, body, sizeof(body));
+
+	for(i = 0; i < OMNI_FINAL_ACK_CNT; i++)
+	{
+		status = pkt_send(0);
+		if(status != OMNIPOD_OK)
+		{
+			return status;
+		}
+
+		status = pkt_receive(address, Time_DeadlineMs(OMNI_QUIET_MS), &bodyLen);
+		if(status != OMNIPOD_OK)
+		{
+			return (status == OMNIPOD_NO_RESPONSE) ? OMNIPOD_OK : status;
+		}
+		omniStats.dupCnt++;
+	}
+	//the pod gives up on its own, the reply is ours anyway
+	return OMNIPOD_OK;
+}
+
+static eOmnipodStatus_t exchange(uint32_t address, uint8_t *pSeq, const uint8_t *pMsg, uint16_t len,
+								 uint8_t *pRsp, uint16_t rspSize, uint16_t *pRspLen)
+{
+	uint8_t ackBody[OMNIPOD_ADDR_LEN];
+	eOmnipodStatus_t status = OMNIPOD_OK;
+	uint8_t seq = *pSeq;
+	uint16_t pos = 0;
+	uint16_t rspLen = 0;
+	uint16_t msgLen = 0;
+	uint8_t chunk;
+	uint8_t type;
+	uint8_t bodyLen;
+
+	//command: PDM packet, then CON packets, each but the last one acked
+	while(pos < len)
+	{
+		chunk = (len - pos > OMNIPOD_PKT_BODY_MAX) ? OMNIPOD_PKT_BODY_MAX : (uint8_t)(len - pos);
+		pkt_build(address, (pos == 0) ? OMNIPOD_PKT_PDM : OMNIPOD_PKT_CON, seq, pMsg + pos, chunk);
+
+		status = pkt_exchange(address, seq, (pos == 0) ? OMNI_PREAMBLE_EXT_MS : 0, &type, &bodyLen);
+		if(status != OMNIPOD_OK)
+		{
+			return status;
+		}
+
+		pos += chunk;
+		seq = (seq + 2) & OMNIPOD_SEQ_MASK;
+		if(type != ((pos < len) ? OMNIPOD_PKT_ACK : OMNIPOD_PKT_POD))
+		{
+			return OMNIPOD_BAD_PACKET;
+		}
+	}
+
+	//reply: POD packet, then CON packets we ask for with an ack each
+	put_addr(ackBody, address);
+	while(1)
+	{
+		if(rspLen + bodyLen > rspSize)
+		{
+			return OMNIPOD_MSG_TOO_LONG;
+		}
+		memcpy(pRsp + rspLen, rxPkt + OMNIPOD_PKT_HDR_LEN, bodyLen);
+		rspLen += bodyLen;
+
+		if(msgLen == 0 && rspLen >= OMNIPOD_MSG_HDR_LEN)
+		{
+			msgLen = Omnipod_MsgLen(pRsp);
+		}
+		if(msgLen == 0 || rspLen >= msgLen)
+		{
+			break;
+		}
+
+		pkt_build(address, OMNIPOD_PKT_ACK, seq, ackBody, sizeof(ackBody));
+		status = pkt_exchange(address, seq, 0, &type, &bodyLen);
+		if(status != OMNIPOD_OK)
+		{
+			return status;
+		}
+		seq = (seq + 2) & OMNIPOD_SEQ_MASK;
+		if(type != OMNIPOD_PKT_CON)
+		{
+			return OMNIPOD_BAD_PACKET;
+		}
+	}
+
+	status = ack_until_quiet(address, seq);
+	*pSeq = (seq + 1) & OMNIPOD_SEQ_MASK;
+	*pRspLen = rspLen;
+	return status;
+}
+
+eOmnipodStatus_t Omnipod_Exchange(uint32_t address, uint8_t *pSeq, const uint8_t *pMsg, uint16_t len,
+								  uint8_t *pRsp, uint16_t rspSize, uint16_t *pRspLen)
+{
+	uint32_t startMs = Time_GetMs();
+	eOmnipodStatus_t status;
+
+	*pRspLen = 0;
+	if(len == 0)
+	{
+		return OMNIPOD_OK;
+	}
+
+	//the pod's carrier offset is tracked under its address
+	Subg_SetRemoteId(address);
+	status = exchange(address, pSeq, pMsg, len, pRsp, rspSize, pRspLen);
+	if(status != OMNIPOD_OK)
+	{
+		omniStats.failCnt++;
+		KIT_LOG(TAG, "Exchange failed (%d).", status);
+		return status;
+	}
+
+	omniStats.msgCnt++;
+	omniStats.lastMsgMs = Time_GetMs() - startMs;
+	if(omniStats.lastMsgMs > omniStats.maxMsgMs)
+	{
+		omniStats.maxMsgMs = omniStats.lastMsgMs;
+	}
+	KIT_LOG(TAG, "Exchange done in %u ms, %u bytes back.", omniStats.lastMsgMs, *pRspLen);
+	return OMNIPOD_OK;
+}
+
+const sOmnipodStats_t *Omnipod_GetStats(void)
+{
+	return &omniStats;
+}
+
+void Omnipod_ClrStats(void)
+{
+	memset(&omniStats, 0, sizeof(omniStats));
+}
+
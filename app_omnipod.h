@@ -0,0 +1,79 @@
+/**
+ *@file app_omnipod.h
+ *@author Ribin Huang (you@domain.com)
+ *@brief Omnipod link layer: messages in and out as packets with acks and retries
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __APP_OMNIPOD_H__
+#define __APP_OMNIPOD_H__
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//packet: address(4, BE) + type(3 bits) | sequence(5 bits) + body + CRC8
+#define OMNIPOD_ADDR_LEN			4
+#define OMNIPOD_PKT_HDR_LEN			(OMNIPOD_ADDR_LEN + 1)
+#define OMNIPOD_PKT_BODY_MAX		31
+#define OMNIPOD_PKT_MAX_LEN			(OMNIPOD_PKT_HDR_LEN + OMNIPOD_PKT_BODY_MAX + 1)
+#define OMNIPOD_SEQ_MASK			0x1F
+
+#define OMNIPOD_PKT_ACK				0x02
+#define OMNIPOD_PKT_CON				0x04
+#define OMNIPOD_PKT_PDM				0x05
+#define OMNIPOD_PKT_POD				0x07
+
+//message: address(4) + seq/length(2) + blocks + CRC16, the length counts the blocks only
+#define OMNIPOD_MSG_HDR_LEN			6
+#define OMNIPOD_MSG_CRC_LEN			2
+#define OMNIPOD_MSG_MAX_LEN			216
+
+typedef enum
+{
+	OMNIPOD_OK = 0,
+	OMNIPOD_NO_RESPONSE,		//a packet was never answered, retries exhausted
+	OMNIPOD_BAD_PACKET,			//pod answered with an unexpected packet type
+	OMNIPOD_MSG_TOO_LONG,		//the pod's message does not fit the caller's buffer
+	OMNIPOD_ABORT				//cancelled or preempted
+}eOmnipodStatus_t;
+
+typedef struct
+{
+	uint32_t msgCnt;			//exchanges completed
+	uint32_t failCnt;
+	uint32_t txPktCnt;			//first transmissions
+	uint32_t retxCnt;			//retransmissions on silence or a repeated pod packet
+	uint32_t dupCnt;			//pod packets seen twice, it missed our answer
+	uint32_t lastMsgMs;			//command out to final ack, last exchange
+	uint32_t maxMsgMs;
+}sOmnipodStats_t;
+
+/*
+The caller owns the radio for the whole exchange: Omnipod mode and frequency set,
+inside Subg_OpBegin/Subg_OpEnd. *pSeq is the packet sequence number to start with,
+it comes back as the one to use for the next exchange.
+*/
+eOmnipodStatus_t Omnipod_Exchange(uint32_t address, uint8_t *pSeq, const uint8_t *pMsg, uint16_t len,
+								  uint8_t *pRsp, uint16_t rspSize, uint16_t *pRspLen);
+uint16_t Omnipod_MsgLen(const uint8_t *pHdr);
+uint8_t Omnipod_Crc8(const uint8_t *pData, uint16_t len);
+const sOmnipodStats_t *Omnipod_GetStats(void);
+void Omnipod_ClrStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
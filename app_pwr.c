@@ -0,0 +1,167 @@
+/**
+ *@file app_pwr.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief closed-loop TX power control per RFM69
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <string.h>
+
+#include "app_pwr.h"
+#include "hal.h"
+
+//reply stronger than this: the link has margin to spare, try less power
+#define PWR_RSSI_STRONG_DBM		-80
+//reply weaker than this: close to sensitivity, add power before packets get lost
+#define PWR_RSSI_WEAK_DBM		-95
+//replies in a row needed before stepping down
+#define PWR_GOOD_RUN_DOWN		8
+//reply rate (of 255) needed before stepping down, about 90%
+#define PWR_SUCCESS_MIN			230
+#define PWR_STEP_DOWN_DB		1
+//a lost reply costs a retry, come back up faster than we went down
+#define PWR_STEP_UP_DB			3
+//a weak reply still got through, creep back up
+#define PWR_STEP_UP_WEAK_DB		1
+//lowest level of the PA path the module has: PA0 on a W, PA1 on an HW
+#define PWR_MIN_DBM(isHw)		((isHw) ? -2 : -18)
+
+#define TAG "PWR"
+
+/*
+module type from the board config. The upper bound matches the reset value of
+RegPaLevel (+13dBm) the radios ran with so far, on an HW through PA1.
+*/
+static sPwrBound_t pwrBound[PWR_DEV_NUM] =
+{
+	{ PWR_MIN_DBM(HAL_RADIO_433_IS_HW), 13, HAL_RADIO_433_IS_HW },
+	{ PWR_MIN_DBM(HAL_RADIO_916_IS_HW), 13, HAL_RADIO_916_IS_HW }
+};
+static sPwrState_t pwrState[PWR_DEV_NUM];
+static bool pwrAdaptive = true;
+
+static void step(eRf69Dev_t dev, int8_t db)
+{
+	sPwrState_t *pState = &pwrState[dev];
+	int16_t dbm;
+
+	dbm = pState->dbm + db;
+	if(dbm > pwrBound[dev].maxDbm)
+	{
+		dbm = pwrBound[dev].maxDbm;
+	}
+	if(dbm < pwrBound[dev].minDbm)
+	{
+		dbm = pwrBound[dev].minDbm;
+	}
+
+	if(dbm > pState->dbm)
+	{
+		pState->stepUpCnt++;
+	}
+	else if(dbm < pState->dbm)
+	{
+		pState->stepDownCnt++;
+	}
+
+	pState->dbm = (int8_t)dbm;
+	pState->goodRun = 0;
+}
+
+void Pwr_Init(void)
+{
+	uint8_t i;
+
+	for(i = 0; i < PWR_DEV_NUM; i++)
+	{
+		Pwr_Reset((eRf69Dev_t)i);
+	}
+}
+
+void Pwr_SetBound(eRf69Dev_t dev, const sPwrBound_t *pBound)
+{
+	pwrBound[dev] = *pBound;
+	Pwr_Reset(dev);
+}
+
+void Pwr_GetBound(eRf69Dev_t dev, sPwrBound_t *pBound)
+{
+	*pBound = pwrBound[dev];
+}
+
+/*off: always transmit at the upper bound*/
+void Pwr_SetAdaptive(bool onOff)
+{
+	pwrAdaptive = onOff;
+}
+
+/*write the level for the next transmission to the radio, returns it in dBm*/
+int8_t Pwr_Apply(eRf69Dev_t dev)
+{
+	int8_t dbm;
+
+	dbm = pwrAdaptive ? pwrState[dev].dbm : pwrBound[dev].maxDbm;
+	return Rf69_SetTxPower(dev, dbm, pwrBound[dev].isHw);
+}
+
+/*
+outcome of a transmission that expects an answer. A missed reply steps up at once,
+power only comes down after a run of replies that arrived with RSSI to spare
+(the remote hears us about as well as we hear it).
+*/
+void Pwr_Report(eRf69Dev_t dev, bool replied, int16_t rssi)
+{
+	sPwrState_t *pState = &pwrState[dev];
+
+	pState->successAvg += ((replied ? 255 : 0) - pState->successAvg) / 8;
+
+	if(!replied)
+	{
+		step(dev, PWR_STEP_UP_DB);
+		KIT_LOG(TAG, "No reply, tx power %d dBm.", pState->dbm);
+		return;
+	}
+
+	pState->rssiAvg += (rssi - pState->rssiAvg) / 4;
+
+	if(pState->rssiAvg < PWR_RSSI_WEAK_DBM)
+	{
+		step(dev, PWR_STEP_UP_WEAK_DB);
+		return;
+	}
+
+	if(pState->goodRun < UINT8_MAX)
+	{
+		pState->goodRun++;
+	}
+
+	if(pState->goodRun >= PWR_GOOD_RUN_DOWN && pState->successAvg >= PWR_SUCCESS_MIN
+		&& pState->rssiAvg > PWR_RSSI_STRONG_DBM)
+	{
+		step(dev, -PWR_STEP_DOWN_DB);
+		KIT_LOG(TAG, "Reply at %d dBm, tx power %d dBm.", pState->rssiAvg, pState->dbm);
+	}
+}
+
+/*start over at full power, e.g. when talking to a different remote*/
+void Pwr_Reset(eRf69Dev_t dev)
+{
+	memset(&pwrState[dev], 0, sizeof(sPwrState_t));
+	pwrState[dev].dbm = pwrBound[dev].maxDbm;
+	pwrState[dev].rssiAvg = PWR_RSSI_STRONG_DBM;
+	pwrState[dev].successAvg = 255;
+}
+
+const sPwrState_t *Pwr_GetState(eRf69Dev_t dev)
+{
+	return &pwrState[dev];
+}
+
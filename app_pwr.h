@@ -0,0 +1,59 @@
+/**
+ *@file app_pwr.h
+ *@author Ribin Huang (you@domain.com)
+ *@brief closed-loop TX power control per RFM69
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __APP_PWR_H__
+#define __APP_PWR_H__
+#include <stdint.h>
+#include <stdbool.h>
+#include "rf69.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PWR_DEV_NUM		2		//one state per eRf69Dev_t
+
+typedef struct
+{
+	int8_t minDbm;
+	int8_t maxDbm;
+	bool isHw;					//RFM69HW: PA_BOOST pin, PA1/PA2 up to +20dBm
+}sPwrBound_t;
+
+typedef struct
+{
+	int8_t dbm;					//level used for the next transmission
+	int8_t rssiAvg;				//smoothed RSSI of the replies, dBm
+	uint8_t successAvg;			//smoothed reply rate, 255 = every tx answered
+	uint8_t goodRun;			//replies in a row since the last step
+	uint32_t stepUpCnt;
+	uint32_t stepDownCnt;
+}sPwrState_t;
+
+void Pwr_Init(void);
+void Pwr_SetBound(eRf69Dev_t dev, const sPwrBound_t *pBound);
+void Pwr_GetBound(eRf69Dev_t dev, sPwrBound_t *pBound);
+void Pwr_SetAdaptive(bool onOff);
+int8_t Pwr_Apply(eRf69Dev_t dev);
+void Pwr_Report(eRf69Dev_t dev, bool replied, int16_t rssi);
+void Pwr_Reset(eRf69Dev_t dev);
+const sPwrState_t *Pwr_GetState(eRf69Dev_t dev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -13,106 +13,643 @@
  *published by the Free Software Foundation.
  *
  */
+#include <stdlib.h>
+
 #include "rf69.h"
 #include "app_subg.h"
-#include "app_ble.h"
-#include "kit_delay.h"
-#include "kit_log.h"
-#include "ocp.h"
+#include "app_time.h"
+#include "app_afc.h"
+#include "app_tcomp.h"
+#include "app_pwr.h"
+#include "app_eop.h"
+#include "app_noise.h"
+#include "app_codec.h"
+#include "hal.h"
 
 #define RF_MODULE_FIFO_SIZE			66
 #define WAIT_FIFO_NOT_FULL_TIMEOUT	100//ms
 #define TX_TIMEOUT				 	150
 
+//default rx caps, runtime policy in lenPolicy
 #define RX_PAYLAOD_LEN_MINIMED722 	107
 #define RX_PAYLAOD_LEN_OMNIPOD		80
+//longest frame RegPayloadLength can hold, longer ones run in unlimited length mode
+#define RX_PAYLOAD_LEN_REG_MAX		255
+
+#define TX_BUF_SIZE 				SUBG_TX_MAX_LEN
+
+//time spent in the spi write that flips OPMODE to TX, the scheduled start fires this much early
+#define TX_START_LEAD_US			12
+//leave the critical region this long before the deadline so BLE irqs are only held off briefly
+#define TX_START_SPIN_US			200
+
+//whole-packet restarts after a tx fifo underrun or timeout
+#define TX_RETRY_MAX				2
 
-#define TX_BUF_SIZE 				255
+//standby -> sleep once a radio was left alone this long, a request/response pair
+//of operations stays clear of the crystal start (TS_OSC, 250us) in between
+#define SUBG_IDLE_TIMEOUT_MS		5
+
+//retune only when the offset estimate moved this far from what is applied (FSTEP is 61Hz)
+#define AFC_RETUNE_HZ				500
+
+//die temperature read this often, at the start of an operation while the radio is in standby
+#define SUBG_TEMP_PERIOD_MS			60000
 
 #define TAG "SUB"
 
-static uint16_t rxPktCnt = 0;
-static uint16_t txPktCnt = 0;
+static sSubgStats_t subgStats[SUBG_MODE_NUM];
+static uint16_t txAirRemUs[SUBG_MODE_NUM];		//airtime under a ms, carried to the next packet
+static uint16_t rxAirRemUs[SUBG_MODE_NUM];
 static int rxPktRssi = -140;
-static bool cmdIntFlag = false;
+static uint64_t rxPktTime = 0;
+static volatile bool cancelReq = false;		//checked by every radio loop
+static volatile uint64_t cancelReqUs = 0;	//when the pending cancel was asked for, 0 = measured
+static volatile SubgOpHandle_t opCur = SUBG_OP_NONE;
+static volatile eSubgPrio_t opPrio = SUBG_PRIO_BACKGROUND;
+static SubgOpHandle_t opSeq = SUBG_OP_NONE;
+static sSubgOpStats_t opStats;
 static eSubgMode_t subgMode = SUBG_MODE_MINIMED_NAS;
 static uint8_t txBuf[TX_BUF_SIZE] = {0};
-static uint8_t txBufLen;
+static uint16_t txBufLen;
 
 static uint8_t pktLen;
 uint16_t preambleWord;
 static uint16_t preambleExtendMs;
+static int32_t txStartErrUs = 0;
+static eSubgTxStatus_t txStatus = SUBG_TX_OK;
+static uint32_t subgFreqHz = 0;		//nominal frequency asked for by the phone
+static int32_t freqOffsetHz = 0;	//remote offset currently tuned on top of it
+static int32_t tcompHz = 0;			//crystal drift correction currently tuned on top of that
+static bool listenArmed = false;	//rx registers are set up and the listen sequencer owns the mode
+static bool rxKept = false;			//Subg_ListenPkt left the receiver running, the next rx carries on with it
+static sSubgLenPolicy_t lenPolicy[SUBG_MODE_NUM] =
+{
+	{ SUBG_LEN_CODEC_END, RX_PAYLAOD_LEN_OMNIPOD, 0, 0 },
+	{ SUBG_LEN_CODEC_END, RX_PAYLAOD_LEN_MINIMED722, 0, 0 },
+	{ SUBG_LEN_CODEC_END, RX_PAYLAOD_LEN_MINIMED722, 0, 0 }
+};
+static bool rxUnlimited = false;	//rx payload length register set to 0
+static uint32_t eopLatencyUs = 0;
+static sSubgSyncFilter_t syncFilterRam[SUBG_MODE_NUM];
+static sSubgSyncFilter_t *pSyncFilter = syncFilterRam;	//the config record once Subg_SyncFilterInit ran
+static pfnSubgSave_t pfnSyncSave = NULL;
+static sSubgSyncFilter_t rxSyncFilter;	//what the radio matches right now
+static uint16_t rxFilterLen = 0;		//filter bytes put in front of the frame being read
+static sRf69Chan_t chanTbl[SUBG_CHAN_MAX];
+static uint8_t chanCnt = 0;
+static uint32_t retuneUs = 0;
+static sSubgRadio_t subgRadio[2];		//indexed by eRf69Dev_t
+static uint32_t idleTimeoutMs = SUBG_IDLE_TIMEOUT_MS;
+
+/*the stats count whole ms, the rest of a packet's us goes with the next one*/
+static void airtime_add(uint32_t *pMs, uint16_t *pRemUs, uint32_t us)
+{
+	us += *pRemUs;
+	*pMs += us / TIME_US_PER_MS;
+	*pRemUs = (uint16_t)(us % TIME_US_PER_MS);
+}
+
+static eRf69Dev_t subg_dev(void)
+{
+	return (subgMode == SUBG_MODE_OMNIPOD) ? RF69_DEV_FREQ433 : RF69_DEV_FREQ916N868;
+}
+
+static bool retune(const sRf69Chan_t *pChan)
+{
+	uint64_t startUs;
+	bool locked;
+	
+	startUs = Time_GetUs();
+	locked = Rf69_SetChan(subg_dev(), pChan);
+	retuneUs = Time_ElapsedUs(startUs);
+	
+	subgStats[subgMode].retuneCnt++;
+	if(retuneUs > subgStats[subgMode].retuneMaxUs)
+	{
+		subgStats[subgMode].retuneMaxUs = retuneUs;
+	}
+	if(!locked)
+	{
+		subgStats[subgMode].pllLockFailCnt++;
+	}
+	return locked;
+}
+
+static void freq_apply(void)
+{
+	sRf69Chan_t chan;
+	
+	freqOffsetHz = Afc_GetOffset();
+	tcompHz = Tcomp_GetCorrHz(subg_dev(), subgFreqHz);
+	Rf69_ChanInit(&chan, subgFreqHz + freqOffsetHz + tcompHz);
+	retune(&chan);
+}
+
+/*
+read the die temperature once the period is over, true if the drift correction
+for it moved enough to retune
+*/
+static bool temp_poll(eRf69Dev_t dev)
+{
+	sSubgRadio_t *pRadio = &subgRadio[dev];
+	int8_t tempC;
+	
+	if(pRadio->tempUs != 0 && Time_ElapsedUs(pRadio->tempUs) < SUBG_TEMP_PERIOD_MS * TIME_US_PER_MS)
+	{
+		return false;
+	}
+	
+	Rf69_SetMode(dev, RF69_MODE_STANDBY);
+	rxKept = false;
+	pRadio->tempUs = Time_GetUs();
+	if(!Rf69_ReadTemp(dev, &tempC))
+	{
+		return false;
+	}
+	
+	Tcomp_SetTemp(dev, tempC);
+	return subgFreqHz != 0 && abs(Tcomp_GetCorrHz(dev, subgFreqHz) - tcompHz) >= AFC_RETUNE_HZ;
+}
+
+static eRf69Freq_t mode_cfg(eSubgMode_t mode)
+{
+	switch(mode)
+	{
+		case SUBG_MODE_OMNIPOD:
+			return RF69_FREQ_433;
+			
+		case SUBG_MODE_MINIMED_WWL:
+			return RF69_FREQ_868;
+			
+		default:
+			return RF69_FREQ_916;
+	}
+}
+
+/*
+the radio of the current mode takes the operation. It is programmed on first use
+(or when the mode needs the other table), after that its registers are trusted.
+*/
+static void radio_up(void)
+{
+	eRf69Dev_t dev;
+	sSubgRadio_t *pRadio;
+	
+	if(subgMode >= SUBG_MODE_NUM)
+	{
+		return;
+	}
+	
+	dev = subg_dev();
+	pRadio = &subgRadio[dev];
+	
+	if(pRadio->state == SUBG_RADIO_UNCFG || pRadio->cfg != mode_cfg(subgMode))
+	{
+		KIT_LOG(TAG, "Radio %d config %d.", dev, mode_cfg(subgMode));
+		rxKept = false;
+		pRadio->cfg = mode_cfg(subgMode);
+		Rf69_DevParaCfg(dev, pRadio->cfg);
+		pRadio->cfgCnt++;
+		
+		//the table brought its own frequency
+		if(subgFreqHz != 0)
+		{
+			freq_apply();
+		}
+	}
+	else if(pRadio->state == SUBG_RADIO_SLEEP)
+	{
+		pRadio->wakeCnt++;
+	}
+	
+	if(temp_poll(dev))
+	{
+		KIT_LOG(TAG, "Retune, %d degC.", Tcomp_GetTemp(dev));
+		freq_apply();
+	}
+	
+	pRadio->state = SUBG_RADIO_ACTIVE;
+}
+
+/*operation over: standby until Subg_Poll sees the idle timeout, or sleep right away*/
+static void radio_down(eRf69Dev_t dev)
+{
+	sSubgRadio_t *pRadio = &subgRadio[dev];
+	
+	rxKept = false;
+	if(pRadio->state == SUBG_RADIO_UNCFG)
+	{
+		return;
+	}
+	
+	if(idleTimeoutMs == 0)
+	{
+		Rf69_SetMode(dev, RF69_MODE_SLEEP);
+		pRadio->state = SUBG_RADIO_SLEEP;
+		return;
+	}
+	
+	Rf69_SetMode(dev, RF69_MODE_STANDBY);
+	pRadio->state = SUBG_RADIO_IDLE;
+	pRadio->idleUs = Time_GetUs();
+}
+
+/*FEI of the packet just received, measured against the frequency we are tuned to*/
+static void afc_sample(eRf69Dev_t dev)
+{
+	int32_t feiHz;
+	
+	if(Rf69_ReadFei(dev, &feiHz))
+	{
+		//off the reference temperature what a settled remote leaves is our crystal's drift
+		if(!Afc_IsSettled() || !Tcomp_Update(dev, subgFreqHz, tcompHz, feiHz))
+		{
+			Afc_Update(freqOffsetHz, feiHz);
+		}
+	}
+}
+
+static void afc_track(void)
+{
+	if(subgFreqHz == 0 || (abs(Afc_GetOffset() - freqOffsetHz) < AFC_RETUNE_HZ
+		&& abs(Tcomp_GetCorrHz(subg_dev(), subgFreqHz) - tcompHz) < AFC_RETUNE_HZ))
+	{
+		return;
+	}
+	
+	KIT_LOG(TAG, "Retune, remote offset %d Hz, drift %d Hz.", Afc_GetOffset(), Tcomp_GetCorrHz(subg_dev(), subgFreqHz));
+	freq_apply();
+}
 
-static bool wait_fifo_not_full(eRf69Dev_t dev) 
+/*
+wait for room in the tx fifo. If the fifo ran empty while bytes are still pending
+we were held off (BLE irqs) longer than the fifo lasts on air, the packet on air is
+already broken and topping it up would only finish a corrupt frame.
+*/
+static eSubgTxStatus_t wait_fifo_room(eRf69Dev_t dev) 
 {
-	uint16_t cnt;
+	uint64_t deadline;
+	uint8_t flags;
+	
+	deadline = Time_DeadlineMs(WAIT_FIFO_NOT_FULL_TIMEOUT);
 	
-	for(cnt = 0; cnt < WAIT_FIFO_NOT_FULL_TIMEOUT; cnt++) 
+	while(!Time_IsExpired(deadline)) 
 	{
-		if(!Rf69_IsFifoFull(dev)) 
+		if(cancelReq)
+		{
+			return SUBG_TX_ABORT;
+		}
+		
+		flags = Rf69_GetFifoFlags(dev);
+		if(!(flags & RF69_FIFO_NOT_EMPTY))
+		{
+			return SUBG_TX_UNDERRUN;
+		}
+		if(!(flags & RF69_FIFO_FULL)) 
 		{
-			return true;
+			return SUBG_TX_OK;
 		}
-		Kit_DelayMs(1);
 	}
 	//KIT_LOG(TAG, "Wait fifo not full timeout!");
 	
-	return false;
+	return SUBG_TX_FIFO_TIMEOUT;
+}
+
+/*stop a broken transmission and leave the radio in standby with an empty fifo for the retry*/
+static eSubgTxStatus_t tx_recover(eRf69Dev_t dev, eSubgTxStatus_t status)
+{
+	if(status == SUBG_TX_UNDERRUN)
+	{
+		subgStats[subgMode].fifoUnderrunCnt++;
+	}
+	else if(status == SUBG_TX_FIFO_TIMEOUT)
+	{
+		subgStats[subgMode].txFifoTimeoutCnt++;
+	}
+	
+	Rf69_SetMode(dev, RF69_MODE_STANDBY);
+	Rf69_ClearFifo(dev);
+	
+	return status;
+}
+
+/*
+bytes to take for a frame of the current mode into a buffer of bufSize. usePktLen
+(Subg_SetPktLen) overrides the policy with a fixed length, as before policies existed.
+*/
+static uint16_t rx_cap(uint16_t bufSize, uint8_t usePktLen, sSubgLenPolicy_t *pPolicy)
+{
+	*pPolicy = lenPolicy[subgMode];
+	
+	if(usePktLen && pktLen > 0)
+	{
+		pPolicy->mode = SUBG_LEN_FIXED;
+		pPolicy->maxLen = pktLen;
+	}
+	
+	return (pPolicy->maxLen < bufSize) ? pPolicy->maxLen : bufSize;
+}
+
+/*
+frames the radio can't count itself are streamed in unlimited length mode and ended
+by us. The sync filter bytes are not counted, call after sync_filter_apply.
+*/
+static void rx_payload_len(eRf69Dev_t dev, uint16_t cap)
+{
+	if(cap > rxSyncFilter.len)
+	{
+		cap -= rxSyncFilter.len;
+	}
+	rxUnlimited = cap > RX_PAYLOAD_LEN_REG_MAX;
+	Rf69_SetPayloadLen(dev, rxUnlimited ? 0 : (uint8_t)cap);
+}
+
+/*drop what is in the fifo and wait for the next sync without leaving rx*/
+static void rx_restart(eRf69Dev_t dev)
+{
+	Rf69_ClearFifo(dev);
+	Rf69_RestartRx(dev);
+}
+
+/*
+in unlimited length mode, or when we ended the frame before the radio did, the
+radio keeps filling the fifo with what follows the frame: start over
+*/
+static void rx_frame_done(eRf69Dev_t dev, bool early)
+{
+	if(rxUnlimited || early)
+	{
+		rx_restart(dev);
+	}
+}
+
+/*
+match the filter of the current mode from the next sync on. TX puts the plain sync
+word back (sync_filter_off), MiniMed sends the one of the radio.
+*/
+static void sync_filter_apply(eRf69Dev_t dev)
+{
+	rxSyncFilter = pSyncFilter[subgMode];
+	Rf69_SetSyncExt(dev, rxSyncFilter.bytes, rxSyncFilter.len);
+}
+
+static void sync_filter_off(eRf69Dev_t dev)
+{
+	rxSyncFilter.len = 0;
+	Rf69_SetSyncExt(dev, NULL, 0);
+}
+
+/*
+the filter bytes were eaten by the sync detector and never reach the fifo: put them
+back in front of the frame so the host gets the packet as sent
+*/
+static uint16_t rx_put_filter(uint8_t *pBuf, uint16_t frameLen, sEopDet_t *pEop)
+{
+	uint16_t i;
+	
+	rxFilterLen = (rxSyncFilter.len < frameLen) ? rxSyncFilter.len : 0;
+	for(i = 0; i < rxFilterLen; i++)
+	{
+		pBuf[i] = rxSyncFilter.bytes[i];
+		Eop_PushByte(pEop, pBuf[i]);
+	}
+	
+	return rxFilterLen;
+}
+
+/*line code decoded header bytes as they go on air, whole bytes only*/
+static uint8_t sync_filter_encode(eSubgMode_t mode, const uint8_t *pHdr, uint8_t hdrLen, uint8_t *pOut)
+{
+	return (uint8_t)Codec_Encode((mode == SUBG_MODE_OMNIPOD) ? CODEC_MANCHESTER : CODEC_4B6B, pHdr, hdrLen, pOut, RF69_SYNC_EXT_MAX, false);
+}
+
+/*idle receiver, nothing synced: what RSSI reads is the noise floor*/
+static void noise_sample(eRf69Dev_t dev)
+{
+	if(Noise_Sample(dev, Rf69_ReadNoiseRssi(dev)))
+	{
+		Noise_Apply(dev);
+	}
+}
+
+static void eop_stats(const sEopDet_t *pEop)
+{
+	eopLatencyUs = Eop_GetLatencyUs(pEop);
+	subgStats[subgMode].rxEopCnt++;
+	subgStats[subgMode].eopLatencySumUs += eopLatencyUs;
+	if(eopLatencyUs > subgStats[subgMode].eopLatencyMaxUs)
+	{
+		subgStats[subgMode].eopLatencyMaxUs = eopLatencyUs;
+	}
 }
 
-static void wait_tx_done(eRf69Dev_t dev) 
+/*
+called with each byte added: true once the frame is complete by its length. *pFrameLen
+starts at the cap and is narrowed by a header length field. *pTrunc is set when the
+frame was cut at the cap instead of ending by itself.
+*/
+static bool rx_frame_end(const sSubgLenPolicy_t *pPolicy, const uint8_t *pBuf, uint16_t rxCnt, uint16_t *pFrameLen, bool *pTrunc)
 {
-	uint16_t cnt;
+	int16_t hdrLen;
+	uint16_t hdrCnt;
 	
-	for (cnt = 0; cnt < TX_TIMEOUT; cnt++) 
+	//a length byte inside the sync filter is looked at with the first byte read
+	hdrCnt = (pPolicy->lenOffset < rxFilterLen) ? rxFilterLen + 1 : pPolicy->lenOffset + 1;
+	if(pPolicy->mode == SUBG_LEN_HEADER && rxCnt == hdrCnt)
 	{
-		while(Rf69_IsFifoEmpty(dev))
+		hdrLen = (int16_t)pBuf[pPolicy->lenOffset] + pPolicy->lenAdjust;
+		if(hdrLen < (int16_t)rxCnt)
 		{
-			return;
+			hdrLen = rxCnt;
+		}
+		
+		if(hdrLen <= *pFrameLen)
+		{
+			*pFrameLen = (uint16_t)hdrLen;
+		}
+		else
+		{
+			*pTrunc = true;
+		}
+	}
+	
+	if(rxCnt < *pFrameLen)
+	{
+		return false;
+	}
+	
+	if(pPolicy->mode == SUBG_LEN_CODEC_END)
+	{
+		*pTrunc = true;
+	}
+	return true;
+}
+
+/*a packet lost bytes in the rx fifo: drop it and wait for the next sync without leaving rx*/
+static void rx_recover(eRf69Dev_t dev)
+{
+	subgStats[subgMode].fifoOverrunCnt++;
+	rx_restart(dev);
+}
+
+static void request_cancel(void)
+{
+	if(!cancelReq)
+	{
+		cancelReqUs = Time_GetUs();
+		cancelReq = true;
+	}
+}
+
+/*
+the running operation saw the cancel and left the radio in a known state,
+record how long that took
+*/
+static void op_aborted(void)
+{
+	uint32_t latencyUs;
+	
+	if(cancelReqUs == 0)
+	{
+		return;
+	}
+	
+	latencyUs = Time_ElapsedUs(cancelReqUs);
+	cancelReqUs = 0;
+	
+	opStats.abortCnt++;
+	opStats.abortLatencyLastUs = latencyUs;
+	if(latencyUs > opStats.abortLatencyMaxUs)
+	{
+		opStats.abortLatencyMaxUs = latencyUs;
+	}
+}
+
+/*Time_WaitUntil that gives up when the operation is cancelled*/
+static bool wait_until(uint64_t deadline)
+{
+	while(!Time_IsExpired(deadline))
+	{
+		if(cancelReq)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/*the last bytes left the fifo; a fifo that never drains is a radio stuck in TX*/
+static eSubgTxStatus_t wait_tx_done(eRf69Dev_t dev) 
+{
+	uint64_t deadline;
+	
+	deadline = Time_DeadlineMs(TX_TIMEOUT);
+	
+	while(!Time_IsExpired(deadline)) 
+	{
+		if(Rf69_IsFifoEmpty(dev))
+		{
+			return SUBG_TX_OK;
+		}
+		
+		if(cancelReq)
+		{
+			return SUBG_TX_ABORT;
 		}
-		Kit_DelayMs(1);
 	}
 	//KIT_LOG(TAG, "Wait tx done timeout!");
+	return SUBG_TX_FIFO_TIMEOUT;
+}
+
+/*
+switch a radio with a pre-loaded FIFO to TX. startUs == 0 starts right away,
+otherwise the switch is timed against the time service and the start error is kept.
+Returns false if the operation was cancelled while waiting for the start time.
+*/
+static bool tx_start_at(eRf69Dev_t dev, uint64_t startUs)
+{
+	uint64_t actualUs;
+	
+	if(startUs == 0)
+	{
+		Rf69_SetMode(dev, RF69_MODE_TX);
+		return true;
+	}
+	
+	Rf69_PrepareTx(dev);
+	
+	if(startUs > TX_START_SPIN_US && !wait_until(startUs - TX_START_SPIN_US))
+	{
+		return false;
+	}
+	
+	//the last stretch is spun with app irqs masked, only the SoftDevice can still delay the start
+	CRITICAL_REGION_ENTER();
+	Time_WaitUntil(startUs - TX_START_LEAD_US);
+	Rf69_StartTx(dev);
+	actualUs = Time_GetUs();
+	CRITICAL_REGION_EXIT();
+	
+	//the write that flips OPMODE just completed, the transmitter starts now
+	txStartErrUs = (int32_t)((int64_t)actualUs - (int64_t)startUs);
+	return true;
 }
 
-static void minimed_tx(void)
+static eSubgTxStatus_t minimed_tx(uint64_t startUs)
 {
 	uint16_t txCnt = 0;
 	uint8_t zeroByte = 0x00;
+	eSubgTxStatus_t status;
 	
 	Rf69_SetMode(RF69_DEV_FREQ916N868, RF69_MODE_STANDBY);
 	Rf69_ClearFifo(RF69_DEV_FREQ916N868);
 	
 	txCnt = (txBufLen < RF_MODULE_FIFO_SIZE) ? txBufLen : RF_MODULE_FIFO_SIZE;
 	Rf69_XmitBuf(RF69_DEV_FREQ916N868, txBuf, txCnt);
-	Rf69_SetMode(RF69_DEV_FREQ916N868, RF69_MODE_TX);
+	if(!tx_start_at(RF69_DEV_FREQ916N868, startUs))
+	{
+		return tx_recover(RF69_DEV_FREQ916N868, SUBG_TX_ABORT);
+	}
 		
 	while(txCnt < txBufLen) 
 	{	
-		if(!wait_fifo_not_full(RF69_DEV_FREQ916N868)) 
+		status = wait_fifo_room(RF69_DEV_FREQ916N868);
+		if(status != SUBG_TX_OK) 
 		{
-			return;
+			return tx_recover(RF69_DEV_FREQ916N868, status);
 		}
 		Rf69_XmitByte(RF69_DEV_FREQ916N868, txBuf[txCnt]);
 		txCnt++;
 	}
 	
-	if(wait_fifo_not_full(RF69_DEV_FREQ916N868)) 
+	status = wait_fifo_room(RF69_DEV_FREQ916N868);
+	if(status != SUBG_TX_OK) 
 	{
-		Rf69_XmitByte(RF69_DEV_FREQ916N868, zeroByte);
+		return tx_recover(RF69_DEV_FREQ916N868, status);
 	}
+	Rf69_XmitByte(RF69_DEV_FREQ916N868, zeroByte);
 	
 	//Rely on the sequencer to end Transmit mode after PacketSent is triggered.
-	wait_tx_done(RF69_DEV_FREQ916N868);
+	status = wait_tx_done(RF69_DEV_FREQ916N868);
+	if(status != SUBG_TX_OK)
+	{
+		return tx_recover(RF69_DEV_FREQ916N868, status);
+	}
+	
+	return SUBG_TX_OK;
 }
 
-static void omnipod_tx(void)
+static eSubgTxStatus_t omnipod_tx(uint64_t startUs)
 {
 	bool flag = false;
-	uint8_t timeCnt = 0;
-	uint8_t txCnt = 0;
-	uint8_t txLen = 0;
-	uint8_t txBufTmp[255] = {0};
+	uint64_t preambleEnd = 0;
+	uint64_t drainDeadline;
+	uint8_t flags;
+	eSubgTxStatus_t status;
+	uint16_t txCnt = 0;
+	uint16_t txLen = 0;
+	uint8_t txBufTmp[TX_BUF_SIZE + 3] = {0};		//sync word, packet, 0xff trailer
 	
 	txBufTmp[0] = 0xa5;
 	txBufTmp[1] = 0x5a;
@@ -137,12 +674,28 @@ static void omnipod_tx(void)
 		}
 	}
 	
-	Rf69_SetMode(RF69_DEV_FREQ433, RF69_MODE_TX);
-	timeCnt = Timer_GetCnt();
+	if(!tx_start_at(RF69_DEV_FREQ433, startUs))
+	{
+		return tx_recover(RF69_DEV_FREQ433, SUBG_TX_ABORT);
+	}
+	preambleEnd = Time_DeadlineMs(preambleExtendMs);
+	drainDeadline = Time_DeadlineMs(WAIT_FIFO_NOT_FULL_TIMEOUT);
 	
-	while((Timer_GetCnt() - timeCnt) < preambleExtendMs) 
+	while(!Time_IsExpired(preambleEnd)) 
 	{
-		if(!Rf69_IsFifoOverThreshold(RF69_DEV_FREQ433))
+		//the preamble extension can run for seconds, stay cancellable
+		if(cancelReq)
+		{
+			return tx_recover(RF69_DEV_FREQ433, SUBG_TX_ABORT);
+		}
+		
+		flags = Rf69_GetFifoFlags(RF69_DEV_FREQ433);
+		if(!(flags & RF69_FIFO_NOT_EMPTY))
+		{
+			return tx_recover(RF69_DEV_FREQ433, SUBG_TX_UNDERRUN);
+		}
+		
+		if(!(flags & RF69_FIFO_LEVEL))
 		{
 			while(!Rf69_IsFifoFull(RF69_DEV_FREQ433))
 			{
@@ -157,200 +710,405 @@ static void omnipod_tx(void)
 					flag = false;
 				}
 			}
+			drainDeadline = Time_DeadlineMs(WAIT_FIFO_NOT_FULL_TIMEOUT);
+		}
+		else if(Time_IsExpired(drainDeadline))
+		{
+			return tx_recover(RF69_DEV_FREQ433, SUBG_TX_FIFO_TIMEOUT);
 		}
-		Kit_DelayMs(1);
+		Hal_DelayMs(1);
 	}
 	
 	while (txCnt < txLen) 
 	{
-		if(!Rf69_IsFifoOverThreshold(RF69_DEV_FREQ433))
+		if(cancelReq)
 		{
-			while(!Rf69_IsFifoFull(RF69_DEV_FREQ433))
+			return tx_recover(RF69_DEV_FREQ433, SUBG_TX_ABORT);
+		}
+		
+		flags = Rf69_GetFifoFlags(RF69_DEV_FREQ433);
+		if(!(flags & RF69_FIFO_NOT_EMPTY))
+		{
+			return tx_recover(RF69_DEV_FREQ433, SUBG_TX_UNDERRUN);
+		}
+		
+		if(!(flags & RF69_FIFO_LEVEL))
+		{
+			while(txCnt < txLen && !Rf69_IsFifoFull(RF69_DEV_FREQ433))
 			{
-				if((txCnt == 0) && flag)
+				//complete the preamble pair the extension left half written
+				if(flag)
 				{
 					Rf69_XmitByte(RF69_DEV_FREQ433, 0x65);
+					flag = false;
+					continue;
 				}
 				
 				Rf69_XmitByte(RF69_DEV_FREQ433, txBufTmp[txCnt]);
 				txCnt++;
 			}
+			drainDeadline = Time_DeadlineMs(WAIT_FIFO_NOT_FULL_TIMEOUT);
+		}
+		else if(Time_IsExpired(drainDeadline))
+		{
+			return tx_recover(RF69_DEV_FREQ433, SUBG_TX_FIFO_TIMEOUT);
 		}
-		Kit_DelayMs(1);
+		Hal_DelayMs(1);
 	}
-		
-	while(!Rf69_IsFifoEmpty(RF69_DEV_FREQ433));
+	
+	//unlimited length mode, the packet is out once the fifo ran empty
+	status = wait_tx_done(RF69_DEV_FREQ433);
+	if(status != SUBG_TX_OK)
 	{
-		Kit_DelayUs(200);
+		return tx_recover(RF69_DEV_FREQ433, status);
 	}
+	
+	return SUBG_TX_OK;
 }
 
-static eSubgRxStatus_t minimed_rx(uint8_t *pBuf, uint8_t* pRxLen, uint32_t timeout) 
+/*finishPkt: a packet already coming in when the timeout hits is read to its end*/
+static eSubgRxStatus_t minimed_rx(uint8_t *pBuf, uint16_t bufSize, uint16_t *pRxLen, uint32_t timeout, bool finishPkt) 
 {	
-	uint8_t rxCnt = 0;
+	sSubgLenPolicy_t policy;
+	uint16_t rxCnt = 0;
+	uint16_t frameLen;
 	uint8_t rxByteTmp = 0;
-	uint32_t timeStart = 0;
+	uint8_t flags;
+	bool overrun = false;
+	bool trunc = false;
+	bool eopEnd = false;
+	sEopDet_t eop;
+	uint64_t deadline = 0;
+	
+	frameLen = rx_cap(bufSize, false, &policy);
 	 		
-	Rf69_SetMode(RF69_DEV_FREQ916N868, RF69_MODE_STANDBY);
-	Rf69_SetPayloadLen(RF69_DEV_FREQ916N868, RX_PAYLAOD_LEN_MINIMED722);
-	Rf69_SetMode(RF69_DEV_FREQ916N868, RF69_MODE_RX);
+	//woken from listen mode, or kept in rx by the last Subg_ListenPkt, the radio is already
+	//receiving: a packet on air now is not cut off by a restart
+	if(!listenArmed && !rxKept)
+	{
+		Rf69_SetMode(RF69_DEV_FREQ916N868, RF69_MODE_STANDBY);
+		sync_filter_apply(RF69_DEV_FREQ916N868);
+		Noise_Apply(RF69_DEV_FREQ916N868);
+		rx_payload_len(RF69_DEV_FREQ916N868, frameLen);
+		Rf69_SetMode(RF69_DEV_FREQ916N868, RF69_MODE_RX);
+	}
 	
-	timeStart = Timer_GetCnt();
+	deadline = Time_DeadlineMs(timeout);
 
 	while(1)
 	{
-		if(!Rf69_IsFifoEmpty(RF69_DEV_FREQ916N868))
+		flags = Rf69_GetFifoFlags(RF69_DEV_FREQ916N868);
+		
+		if(flags & RF69_FIFO_OVERRUN)
+		{
+			//bytes were lost while we were held off, what is in pBuf is not what was sent
+			KIT_LOG(TAG, "Rx fifo overrun, restart rx!");
+			rx_recover(RF69_DEV_FREQ916N868);
+			rxCnt = 0;
+			frameLen = rx_cap(bufSize, false, &policy);
+			trunc = false;
+			overrun = true;
+		}
+		else if(flags & RF69_FIFO_NOT_EMPTY)
 		{
 			rxByteTmp = Rf69_RcvByte(RF69_DEV_FREQ916N868);	
 			
-			if (rxByteTmp == 0) 
+			if(rxCnt == 0)
+			{
+				rxPktTime = Time_GetUs();
+				Rf69_StartFei(RF69_DEV_FREQ916N868);
+				//RSSI of the packet, taken while the carrier is surely there
+				Eop_Init(&eop, EOP_CODEC_4B6B, Rf69_ReadRssi(RF69_DEV_FREQ916N868, false));
+				rxCnt = rx_put_filter(pBuf, frameLen, &eop);
+			}
+			
+			if (rxByteTmp == 0 && policy.mode == SUBG_LEN_CODEC_END) 
 			{
 				KIT_LOG(TAG, "Rx byte = 0, break!");
+				eopEnd = true;
 				break;
 			}
 			
 			pBuf[rxCnt++] = rxByteTmp;
+			
+			if(policy.mode == SUBG_LEN_CODEC_END && Eop_PushByte(&eop, rxByteTmp))
+			{
+				rxCnt = Eop_GetLen(&eop);
+				if(rxCnt > rxFilterLen)
+				{
+					KIT_LOG(TAG, "Rx invalid 4b6b symbol, break!");
+					eopEnd = true;
+					break;
+				}
+				//sync matched on noise, nothing valid came after it
+				subgStats[subgMode].rxNoiseCnt++;
+				rx_restart(RF69_DEV_FREQ916N868);
+				rxCnt = 0;
+			}
+			else if(rx_frame_end(&policy, pBuf, rxCnt, &frameLen, &trunc))
+			{
+				break;
+			}
+		}
+		else if(rxCnt > 0 && policy.mode == SUBG_LEN_CODEC_END && Eop_RssiDue(&eop)
+			&& Eop_RssiDropped(&eop, Rf69_ReadRssi(RF69_DEV_FREQ916N868, false)))
+		{
+			KIT_LOG(TAG, "Rx carrier gone, break!");
+			eopEnd = true;
+			break;
+		}
+		else if(rxCnt == 0 && Noise_SampleDue(RF69_DEV_FREQ916N868))
+		{
+			noise_sample(RF69_DEV_FREQ916N868);
 		}
-		
-		if(rxCnt >= RX_PAYLAOD_LEN_MINIMED722)
-		{
-			KIT_LOG(TAG, "Rx len >= max len, break!");
-			break;
-		}
 	
-		if((timeout > 0 && ((Timer_GetCnt() - timeStart) > timeout)) || Ble_GetState() == BLE_STATE_ADV)
+		if((timeout > 0 && (!finishPkt || rxCnt == 0) && Time_IsExpired(deadline)) || Hal_IsBleAdvertising())
 		{
+			if(overrun)
+			{
+				return SUBG_RX_OVERRUN;
+			}
+			subgStats[subgMode].rxTimeoutCnt++;
 			return SUBG_RX_TIMEOUT;
 		}
 
-		if(cmdIntFlag)
+		if(cancelReq)
 		{
+			subgStats[subgMode].rxAbortCnt++;
 			return SUBG_RX_INT;
 		}
 	}
 	
-	if (rxCnt > 0) 
+	rx_frame_done(RF69_DEV_FREQ916N868, eopEnd);
+	
+	if(trunc)
+	{
+		KIT_LOG(TAG, "Rx len >= max len %u, break!", frameLen);
+		subgStats[subgMode].rxTruncCnt++;
+	}
+	
+	if (rxCnt > 0 && policy.mode == SUBG_LEN_CODEC_END) 
 	{
 		// Remove spurious final byte consisting of just one or two high bits.
 		uint8_t b = pBuf[rxCnt - 1];
 		if (b == 0x80 || b == 0xC0) 
 		{
 			KIT_LOG(TAG, "End-of-packet glitch 0x%02x.", b >> 6);
+			subgStats[subgMode].rxGlitchCnt++;
 			rxCnt--;
 		}
 	}
 	
 	if (rxCnt > 0) 
 	{
-		rxPktCnt++;
-		rxPktRssi = Rf69_ReadRssi(RF69_DEV_FREQ916N868, false);
+		subgStats[subgMode].rxPktCnt++;
+		airtime_add(&subgStats[subgMode].rxAirtimeMs, &rxAirRemUs[subgMode], Time_ElapsedUs(rxPktTime));
+		rxPktRssi = eop.rssiRef;
+		afc_sample(RF69_DEV_FREQ916N868);
 		*pRxLen = rxCnt;
+		
+		if(eopEnd)
+		{
+			eop_stats(&eop);
+		}
 	}
 	return SUBG_RX_OK;
 }
 
-static eSubgRxStatus_t omnipod_rx(uint8_t *pBuf, uint8_t* pRxLen, uint32_t timeout, uint8_t usePktLen) 
+static eSubgRxStatus_t omnipod_rx(uint8_t *pBuf, uint16_t bufSize, uint16_t *pRxLen, uint32_t timeout, uint8_t usePktLen,
+								  bool finishPkt) 
 {	
-	uint8_t rxCnt = 0;
+	sSubgLenPolicy_t policy;
+	uint16_t rxCnt = 0;
+	uint16_t frameLen;
 	uint8_t rxByteTmp = 0;
-	uint32_t timeStart = 0;
+	uint8_t flags;
+	bool overrun = false;
+	bool trunc = false;
+	bool eopEnd = false;
+	sEopDet_t eop;
+	uint64_t deadline = 0;
 
-	Rf69_SetMode(RF69_DEV_FREQ433, RF69_MODE_STANDBY);
-	Rf69_SetSyncOnOff(RF69_DEV_FREQ433, true);
-	Rf69_SetPayloadLen(RF69_DEV_FREQ433, RX_PAYLAOD_LEN_OMNIPOD);
-	Rf69_SetMode(RF69_DEV_FREQ433, RF69_MODE_RX);
+	frameLen = rx_cap(bufSize, usePktLen, &policy);
+	
+	if(!listenArmed && !rxKept)
+	{
+		Rf69_SetMode(RF69_DEV_FREQ433, RF69_MODE_STANDBY);
+		Rf69_SetSyncOnOff(RF69_DEV_FREQ433, true);
+		sync_filter_apply(RF69_DEV_FREQ433);
+		Noise_Apply(RF69_DEV_FREQ433);
+		rx_payload_len(RF69_DEV_FREQ433, frameLen);
+		Rf69_SetMode(RF69_DEV_FREQ433, RF69_MODE_RX);
+	}
 	
-	timeStart = Timer_GetCnt();
+	deadline = Time_DeadlineMs(timeout);
 
 	while(1)
 	{
-		if(!Rf69_IsFifoEmpty(RF69_DEV_FREQ433))
+		flags = Rf69_GetFifoFlags(RF69_DEV_FREQ433);
+		
+		if(flags & RF69_FIFO_OVERRUN)
+		{
+			KIT_LOG(TAG, "Rx fifo overrun, restart rx!");
+			rx_recover(RF69_DEV_FREQ433);
+			rxCnt = 0;
+			frameLen = rx_cap(bufSize, usePktLen, &policy);
+			trunc = false;
+			overrun = true;
+		}
+		else if(flags & RF69_FIFO_NOT_EMPTY)
 		{
 			rxByteTmp = Rf69_RcvByte(RF69_DEV_FREQ433);	
 			
-			if ((rxByteTmp >> 6) == 0x03 | (rxByteTmp >> 6) == 0) 
+			if(rxCnt == 0)
 			{
-				KIT_LOG(TAG, "Rx byte = 0xf or 0x0, break!");
-				break;
+				rxPktTime = Time_GetUs();
+				Rf69_StartFei(RF69_DEV_FREQ433);
+				//RSSI of the packet, taken while the carrier is surely there
+				Eop_Init(&eop, EOP_CODEC_MANCHESTER, Rf69_ReadRssi(RF69_DEV_FREQ433, false));
+				rxCnt = rx_put_filter(pBuf, frameLen, &eop);
 			}
 			
 			pBuf[rxCnt++] = rxByteTmp;
+			
+			if(policy.mode == SUBG_LEN_CODEC_END && Eop_PushByte(&eop, rxByteTmp))
+			{
+				rxCnt = Eop_GetLen(&eop);
+				if(rxCnt > rxFilterLen)
+				{
+					KIT_LOG(TAG, "Rx invalid Manchester pair, break!");
+					eopEnd = true;
+					break;
+				}
+				//sync matched on noise, nothing valid came after it
+				subgStats[subgMode].rxNoiseCnt++;
+				rx_restart(RF69_DEV_FREQ433);
+				rxCnt = 0;
+			}
+			// Check for end of packet
+			else if(rx_frame_end(&policy, pBuf, rxCnt, &frameLen, &trunc))
+			{
+				break;
+			}
 		}
-		
-		if(rxCnt >= RX_PAYLAOD_LEN_OMNIPOD)
+		else if(rxCnt > 0 && policy.mode == SUBG_LEN_CODEC_END && Eop_RssiDue(&eop)
+			&& Eop_RssiDropped(&eop, Rf69_ReadRssi(RF69_DEV_FREQ433, false)))
 		{
-			KIT_LOG(TAG, "Rx len >= max len, break!");
+			KIT_LOG(TAG, "Rx carrier gone, break!");
+			eopEnd = true;
 			break;
 		}
-		
-		// Check for end of packet
-		if (usePktLen && rxCnt == pktLen) 
+		else if(rxCnt == 0 && Noise_SampleDue(RF69_DEV_FREQ433))
 		{
-			KIT_LOG(TAG, "Rx len = pkt_len, break!");
-			break;
+			noise_sample(RF69_DEV_FREQ433);
 		}
 				
-		if((timeStart > 0 && ((Timer_GetCnt() - timeStart) > timeout)) || Ble_GetState() == BLE_STATE_ADV)
+		if((timeout > 0 && (!finishPkt || rxCnt == 0) && Time_IsExpired(deadline)) || Hal_IsBleAdvertising())
 		{
+			if(overrun)
+			{
+				return SUBG_RX_OVERRUN;
+			}
+			subgStats[subgMode].rxTimeoutCnt++;
 			return SUBG_RX_TIMEOUT;
 		}
 
-		if(cmdIntFlag)
+		if(cancelReq)
 		{
+			subgStats[subgMode].rxAbortCnt++;
 			return SUBG_RX_INT;
 		}
 	}
 	
+	rx_frame_done(RF69_DEV_FREQ433, eopEnd);
+	
+	if(trunc)
+	{
+		KIT_LOG(TAG, "Rx len >= max len %u, break!", frameLen);
+		subgStats[subgMode].rxTruncCnt++;
+	}
+	
 	if (rxCnt > 0) 
 	{
-		rxPktCnt++;
-		rxPktRssi = Rf69_ReadRssi(RF69_DEV_FREQ433, false);
+		subgStats[subgMode].rxPktCnt++;
+		airtime_add(&subgStats[subgMode].rxAirtimeMs, &rxAirRemUs[subgMode], Time_ElapsedUs(rxPktTime));
+		rxPktRssi = eop.rssiRef;
+		afc_sample(RF69_DEV_FREQ433);
 		*pRxLen = rxCnt;
+		
+		if(eopEnd)
+		{
+			eop_stats(&eop);
+		}
 	}
 
 	return SUBG_RX_OK;
 }
 
-static void rf_tx_start(void)
+static eSubgTxStatus_t rf_tx_start(uint64_t startUs)
 {
-	txPktCnt++;
+	eSubgTxStatus_t status = SUBG_TX_OK;
+	uint64_t txBegin;
+	uint8_t retry;
 	
-	switch(subgMode)
+	subgStats[subgMode].txPktCnt++;
+	txBegin = (startUs > 0) ? startUs : Time_GetUs();
+	
+	for(retry = 0; retry <= TX_RETRY_MAX; retry++)
 	{
-		case SUBG_MODE_OMNIPOD:
-			omnipod_tx();
-			break;
-			
-		case SUBG_MODE_MINIMED_NAS:
-		case SUBG_MODE_MINIMED_WWL:
-			minimed_tx();
+		switch(subgMode)
+		{
+			case SUBG_MODE_OMNIPOD:
+				status = omnipod_tx(startUs);
+				break;
+				
+			case SUBG_MODE_MINIMED_NAS:
+			case SUBG_MODE_MINIMED_WWL:
+				status = minimed_tx(startUs);
+				break;
+				
+			default:
+				break;
+		}
+		
+		if(status == SUBG_TX_OK)
+		{
 			break;
-			
-		default:
+		}
+		
+		if(status == SUBG_TX_ABORT)
+		{
+			subgStats[subgMode].txAbortCnt++;
 			break;
+		}
+		
+		KIT_LOG(TAG, "Tx fifo error %d, restart packet!", status);
+		//the scheduled slot is gone, the retry goes out right away
+		startUs = 0;
 	}
+	
+	airtime_add(&subgStats[subgMode].txAirtimeMs, &txAirRemUs[subgMode], Time_ElapsedUs(txBegin));
+	
+	return status;
 }
 
 static void rf_stop(void)
 {
-	switch(subgMode)
+	Subg_ListenDisarm();
+	
+	if(subgMode < SUBG_MODE_NUM)
 	{
-		case SUBG_MODE_OMNIPOD:
-			Rf69_SetMode(RF69_DEV_FREQ433, RF69_MODE_SLEEP);
-			break;
-			
-		case SUBG_MODE_MINIMED_NAS:
-		case SUBG_MODE_MINIMED_WWL:
-			Rf69_SetMode(RF69_DEV_FREQ916N868, RF69_MODE_SLEEP);
-			break;
-			
-		default:
-			break;
+		radio_down(subg_dev());
 	}
 }
 
 void Subg_SetMode(eSubgMode_t mode) 
 {
+	//nothing stops the radio of the old mode later (e.g. left in rx by Subg_ListenPkt)
+	if(subgMode < SUBG_MODE_NUM && mode != subgMode)
+	{
+		rf_stop();
+	}
 	subgMode = mode;	
 }
 
@@ -359,11 +1117,20 @@ eSubgMode_t Subg_GetMode(void)
 	return subgMode;	
 }
 
-void Subg_SendPkt(uint8_t *pBuf, uint16_t len, uint8_t repeatCnt, uint16_t repeatIntvl, uint16_t preambleExt) 
+/*
+longest packet the current mode can frame: the MiniMed radio runs in fixed length
+mode, its payload length register holds the packet and the 0x00 trailer
+*/
+static uint16_t tx_max_len(void)
 {
-	uint16_t sendCnt = 0;
-	uint16_t totalSendCnt = repeatCnt + 1;
-	
+	return (subgMode == SUBG_MODE_OMNIPOD) ? TX_BUF_SIZE : RX_PAYLOAD_LEN_REG_MAX - 1;
+}
+
+static void tx_setup(uint8_t *pBuf, uint16_t len, uint16_t preambleExt)
+{
+	Subg_ListenDisarm();
+	radio_up();
+	rxKept = false;
 	memcpy(txBuf, pBuf, len);
 	txBufLen = len;
 	preambleExtendMs = preambleExt;
@@ -374,6 +1141,7 @@ void Subg_SendPkt(uint8_t *pBuf, uint16_t len, uint8_t repeatCnt, uint16_t repea
 			KIT_LOG(TAG, "433 tx setup.");
 			Rf69_SetMode(RF69_DEV_FREQ433, RF69_MODE_STANDBY);
 			Rf69_SetSyncOnOff(RF69_DEV_FREQ433, false);
+			sync_filter_off(RF69_DEV_FREQ433);
 			Rf69_SetUnlimitedLenPkt(RF69_DEV_FREQ433);
 			Rf69_SetPreambleSize(RF69_DEV_FREQ433, 0);
 			break;
@@ -382,54 +1150,167 @@ void Subg_SendPkt(uint8_t *pBuf, uint16_t len, uint8_t repeatCnt, uint16_t repea
 			KIT_LOG(TAG, "916 tx setup.");
 			Rf69_SetMode(RF69_DEV_FREQ916N868, RF69_MODE_STANDBY);
 			Rf69_SetOokBw200khz(RF69_DEV_FREQ916N868);
-			Rf69_SetPayloadLen(RF69_DEV_FREQ916N868, len + 1);
+			sync_filter_off(RF69_DEV_FREQ916N868);
+			Rf69_SetPayloadLen(RF69_DEV_FREQ916N868, (uint8_t)(len + 1));
 			break;
 			
 		case SUBG_MODE_MINIMED_WWL:
 			KIT_LOG(TAG, "868 tx setup.");
 			Rf69_SetMode(RF69_DEV_FREQ916N868, RF69_MODE_STANDBY);
 			Rf69_SetOokBw250khz(RF69_DEV_FREQ916N868);
-			Rf69_SetPayloadLen(RF69_DEV_FREQ916N868, len + 1);
+			sync_filter_off(RF69_DEV_FREQ916N868);
+			Rf69_SetPayloadLen(RF69_DEV_FREQ916N868, (uint8_t)(len + 1));
 			break;
 
 		default:
-			break;
+			return;
+	}
+	
+	Pwr_Apply(subg_dev());
+}
+
+/*
+returns the status of the last transmission, the repeats stop at the first
+packet that could not be sent even after restarting it
+*/
+eSubgTxStatus_t Subg_SendPkt(uint8_t *pBuf, uint16_t len, uint8_t repeatCnt, uint16_t repeatIntvl, uint16_t preambleExt) 
+{
+	uint16_t sendCnt = 0;
+	uint16_t totalSendCnt = repeatCnt + 1;
+	uint64_t nextTx = 0;
+	
+	if(len > tx_max_len())
+	{
+		KIT_LOG(TAG, "Tx packet too long, %d bytes!", len);
+		txStatus = SUBG_TX_LEN_ERROR;
+		return txStatus;
 	}
 	
+	tx_setup(pBuf, len, preambleExt);
+	txStatus = SUBG_TX_OK;
+	
 	while(sendCnt < totalSendCnt) 
 	{
-		if(Ble_GetState() == BLE_STATE_ADV)
+		if(Hal_IsBleAdvertising())
 		{
+			txStatus = SUBG_TX_ABORT;
 			break;
 		}
 		
 		if (sendCnt > 0 && repeatIntvl > 0)
 		{
-			Kit_DelayMs(repeatIntvl);
-			wdt_feed(NULL);
+			Hal_WdtFeed();
+			if(!wait_until(nextTx))
+			{
+				subgStats[subgMode].txAbortCnt++;
+				txStatus = SUBG_TX_ABORT;
+				break;
+			}
+		}
+		txStatus = rf_tx_start(0);
+		if(txStatus != SUBG_TX_OK)
+		{
+			break;
 		}
-		rf_tx_start();
+		nextTx = Time_DeadlineMs(repeatIntvl);
 		sendCnt++;
 	}
 	
 	rf_stop();
 	
-	KIT_LOG(TAG, "Tx done!");
+	if(txStatus == SUBG_TX_ABORT)
+	{
+		op_aborted();
+	}
+	
+	KIT_LOG(TAG, "Tx done, status %d!", txStatus);
+	return txStatus;
+}
+
+/*
+transmit once with the first bit going out at startUs (time service timestamp).
+The FIFO is loaded ahead of time so only the OPMODE write is left for the deadline.
+Returns the start error in us (positive = late), INT32_MAX if the start time had already passed.
+Subg_GetTxStatus tells whether the packet went out at all.
+*/
+int32_t Subg_SendPktAt(uint8_t *pBuf, uint16_t len, uint64_t startUs, uint16_t preambleExt) 
+{
+	if(len > tx_max_len())
+	{
+		KIT_LOG(TAG, "Tx packet too long, %d bytes!", len);
+		txStatus = SUBG_TX_LEN_ERROR;
+		txStartErrUs = INT32_MAX;
+		return txStartErrUs;
+	}
+	
+	//us clock for the wait, off again once the packet is out
+	Time_Fine(true);
+	tx_setup(pBuf, len, preambleExt);
+	
+	if(Time_GetUs() + TX_START_LEAD_US >= startUs)
+	{
+		KIT_LOG(TAG, "Tx start time already passed!");
+		txStatus = rf_tx_start(0);
+		txStartErrUs = INT32_MAX;
+	}
+	else
+	{
+		txStatus = rf_tx_start(startUs);
+	}
+	rf_stop();
+	Time_Fine(false);
+	
+	if(txStatus == SUBG_TX_ABORT)
+	{
+		op_aborted();
+	}
+	
+	KIT_LOG(TAG, "Timed tx done, start error %d us.", txStartErrUs);
+	return txStartErrUs;
 }
 
-eSubgRxStatus_t Subg_GetPkt(uint8_t *pRxBuf, uint8_t *pRxLen, uint32_t timeout, uint8_t usePktLen) 
+/*same as Subg_SendPktAt with a start time relative to now*/
+int32_t Subg_SendPktIn(uint8_t *pBuf, uint16_t len, uint32_t delayUs, uint16_t preambleExt) 
+{
+	int32_t startErrUs;
+	
+	//the start time is taken on the us clock already
+	Time_Fine(true);
+	startErrUs = Subg_SendPktAt(pBuf, len, Time_DeadlineUs(delayUs), preambleExt);
+	Time_Fine(false);
+	
+	return startErrUs;
+}
+
+int32_t Subg_GetTxStartErr(void) 
+{
+	return txStartErrUs;
+}
+
+eSubgTxStatus_t Subg_GetTxStatus(void) 
+{
+	return txStatus;
+}
+
+/*pRxBuf holds bufSize bytes, frames longer than that are truncated*/
+eSubgRxStatus_t Subg_GetPkt(uint8_t *pRxBuf, uint16_t bufSize, uint16_t *pRxLen, uint32_t timeout, uint8_t usePktLen) 
 {
 	eSubgRxStatus_t result;
 	
+	Subg_ListenDisarm();
+	radio_up();
+	//set the receiver up for this packet length
+	rxKept = false;
+	
 	switch(subgMode)
 	{
 		case SUBG_MODE_OMNIPOD:
-			result = omnipod_rx(pRxBuf, pRxLen, timeout, usePktLen);
+			result = omnipod_rx(pRxBuf, bufSize, pRxLen, timeout, usePktLen, false);
 			break;
 			
 		case SUBG_MODE_MINIMED_NAS:
 		case SUBG_MODE_MINIMED_WWL:
-			result = minimed_rx(pRxBuf, pRxLen, timeout);
+			result = minimed_rx(pRxBuf, bufSize, pRxLen, timeout, false);
 			break;
 			
 		default:
@@ -438,55 +1319,309 @@ eSubgRxStatus_t Subg_GetPkt(uint8_t *pRxBuf, uint8_t *pRxLen, uint32_t timeout,
 	}
 	rf_stop();
 	
+	if(result == SUBG_RX_OK)
+	{
+		afc_track();
+	}
+	else if(result == SUBG_RX_INT)
+	{
+		op_aborted();
+	}
+	
 	return result;
 }
 
-void Subg_SetFreq(uint32_t freqHz) 
+/*
+same as Subg_GetPkt, but the radio is not put to sleep afterwards so that a
+caller looping on it (capture mode) does not pay the sleep->rx wakeup per packet.
+A packet coming in when the timeout hits is finished, so none is lost between
+two calls. Subg_Stop must be called once the caller is done listening.
+*/
+eSubgRxStatus_t Subg_ListenPkt(uint8_t *pRxBuf, uint16_t bufSize, uint16_t *pRxLen, uint32_t timeout) 
 {
+	eSubgRxStatus_t result;
+	
+	radio_up();
+	
 	switch(subgMode)
 	{
 		case SUBG_MODE_OMNIPOD:
-			Rf69_SetFreq(RF69_DEV_FREQ433, freqHz);
+			result = omnipod_rx(pRxBuf, bufSize, pRxLen, timeout, false, true);
 			break;
 			
 		case SUBG_MODE_MINIMED_NAS:
-			Rf69_SetFreq(RF69_DEV_FREQ916N868, freqHz);
-			break;
-
 		case SUBG_MODE_MINIMED_WWL:
-			Rf69_SetFreq(RF69_DEV_FREQ916N868, freqHz);//868388000
+			result = minimed_rx(pRxBuf, bufSize, pRxLen, timeout, true);
 			break;
 			
 		default:
+			result = SUBG_RX_TIMEOUT;
 			break;
 	}
+	rxKept = subgMode < SUBG_MODE_NUM;
+	
+	if(result == SUBG_RX_OK)
+	{
+		afc_track();
+	}
+	else if(result == SUBG_RX_INT)
+	{
+		//left receiving by design, that is the known state here
+		op_aborted();
+	}
+	
+	return result;
+}
+
+void Subg_Stop(void)
+{
+	rf_stop();
+}
+
+/*
+hand rx over to the SX1231 listen sequencer: it cycles idle/rx on its own RC timer
+and stays in rx once RSSI (or RSSI + sync) matched, signalling that on DIO0.
+The durations are rounded to the listen timer and written back.
+*/
+void Subg_ListenArm(uint32_t *pIdleUs, uint32_t *pRxUs, bool syncWake)
+{
+	eRf69Dev_t dev;
+	
+	if(subgMode >= SUBG_MODE_NUM)
+	{
+		return;
+	}
+	
+	dev = subg_dev();
+	radio_up();
+	Rf69_SetMode(dev, RF69_MODE_STANDBY);
+	rxKept = false;
+	if(subgMode == SUBG_MODE_OMNIPOD)
+	{
+		Rf69_SetSyncOnOff(dev, true);
+	}
+	sync_filter_apply(dev);
+	Noise_Apply(dev);
+	rx_payload_len(dev, lenPolicy[subgMode].maxLen);
+	Rf69_ClearFifo(dev);
+	Rf69_SetListenCfg(dev, pIdleUs, pRxUs, syncWake);
+	Rf69_StartListen(dev, syncWake);
+	listenArmed = true;
+}
+
+/*
+read the packet that woke the radio up (DIO0 fired) without touching the mode,
+then leave listen mode. The caller re-arms when it wants to keep watching.
+*/
+eSubgRxStatus_t Subg_ListenRead(uint8_t *pRxBuf, uint16_t bufSize, uint16_t *pRxLen, uint32_t timeout)
+{
+	eSubgRxStatus_t result;
+	
+	if(!listenArmed)
+	{
+		return SUBG_RX_TIMEOUT;
+	}
+	
+	result = Subg_ListenPkt(pRxBuf, bufSize, pRxLen, timeout);
+	Subg_ListenDisarm();
+	
+	return result;
+}
+
+void Subg_ListenDisarm(void)
+{
+	if(!listenArmed)
+	{
+		return;
+	}
+	
+	Rf69_AbortListen(subg_dev());
+	listenArmed = false;
+	rxKept = false;
+}
+
+/*nominal frequency, the tracked offset of the selected remote is added on top*/
+void Subg_SetFreq(uint32_t freqHz) 
+{
+	if(subgMode >= SUBG_MODE_NUM)
+	{
+		return;
+	}
+	
+	subgFreqHz = freqHz;
+	freq_apply();
+	Noise_Select(subg_dev(), freqHz);
+}
+
+/*
+frequencies to hop between with Subg_SetChan, worked out to register values here
+so a hop is one spi burst
+*/
+bool Subg_SetChanTable(const uint32_t *pFreqHz, uint8_t cnt) 
+{
+	uint8_t i;
+	
+	if(cnt > SUBG_CHAN_MAX)
+	{
+		return false;
+	}
+	
+	for(i = 0; i < cnt; i++)
+	{
+		Rf69_ChanInit(&chanTbl[i], pFreqHz[i]);
+	}
+	chanCnt = cnt;
+	
+	return true;
 }
 
+/*
+tune to entry idx of the channel table, the offset of the selected remote is added
+on top. Returns false if the PLL did not lock.
+*/
+bool Subg_SetChan(uint8_t idx) 
+{
+	sRf69Chan_t chan;
+	
+	if(subgMode >= SUBG_MODE_NUM || idx >= chanCnt)
+	{
+		return false;
+	}
+	
+	chan = chanTbl[idx];
+	subgFreqHz = chan.freqHz;
+	freqOffsetHz = Afc_GetOffset();
+	tcompHz = Tcomp_GetCorrHz(subg_dev(), subgFreqHz);
+	if(freqOffsetHz != 0 || tcompHz != 0)
+	{
+		Rf69_ChanInit(&chan, subgFreqHz + freqOffsetHz + tcompHz);
+	}
+	Noise_Select(subg_dev(), subgFreqHz);
+	
+	return retune(&chan);
+}
+
+/*time the last frequency change took, PLL lock included*/
+uint32_t Subg_GetRetuneUs(void) 
+{
+	return retuneUs;
+}
+
+/*
+select whose carrier offset is tracked and applied (pump/pod id, AFC_REMOTE_ID_DEFAULT
+if unknown). Takes effect immediately if a frequency was already set. The power
+control starts over only for another remote, not again for the same one.
+*/
+void Subg_SetRemoteId(uint32_t remoteId) 
+{
+	if(remoteId == Afc_GetRemote())
+	{
+		return;
+	}
+	
+	Afc_SelectRemote(remoteId);
+	
+	if(subgMode < SUBG_MODE_NUM)
+	{
+		Pwr_Reset(subg_dev());
+	}
+	
+	if(subgFreqHz > 0 && subgMode < SUBG_MODE_NUM)
+	{
+		freq_apply();
+	}
+}
+
+/*
+tell the power control whether the last transmission got its answer,
+the RSSI of the answer is taken from the last received packet
+*/
+void Subg_TxFeedback(bool replied) 
+{
+	if(subgMode >= SUBG_MODE_NUM)
+	{
+		return;
+	}
+	
+	Pwr_Report(subg_dev(), replied, rxPktRssi);
+}
+
+int32_t Subg_GetFreqOffset(void) 
+{
+	return freqOffsetHz;
+}
+
+/*
+the offset estimate of the selected remote, or the drift correction at this
+temperature, is too uncertain: the phone should scan again
+*/
+bool Subg_NeedRescan(void) 
+{
+	return Afc_NeedRescan() || (subgMode < SUBG_MODE_NUM && Tcomp_IsUncertain(subg_dev()));
+}
+
+/*
+write the config table of the current mode now, dropping whatever was changed since.
+Not needed before using a mode, the first operation does it.
+*/
 void Subg_CfgRf(void)
 {	
-	switch(subgMode)
+	if(subgMode >= SUBG_MODE_NUM)
 	{
-		case SUBG_MODE_OMNIPOD:
-			Rf69_DevParaCfg(RF69_DEV_FREQ433, RF69_FREQ_433);
-			break;
-			
-		case SUBG_MODE_MINIMED_NAS:
-			Rf69_DevParaCfg(RF69_DEV_FREQ916N868, RF69_FREQ_916);
-			break;
-
-		case SUBG_MODE_MINIMED_WWL:
-			Rf69_DevParaCfg(RF69_DEV_FREQ916N868, RF69_FREQ_868);
-			break;
-			
-		default:
-			break;
+		return;
 	}
+	
+	Subg_ListenDisarm();
+	subgRadio[subg_dev()].state = SUBG_RADIO_UNCFG;
+	radio_up();
+	radio_down(subg_dev());
 }
 
+/*
+the radios are programmed on first use of their mode, only one of them usually is.
+Out of reset they sit in standby, until then they are held in sleep.
+*/
 void Subg_Init(void)
 {
-	Rf69_DevParaCfg(RF69_DEV_FREQ916N868, RF69_FREQ_916);
-	Rf69_DevParaCfg(RF69_DEV_FREQ433, RF69_FREQ_433);
+	uint8_t i;
+	
+	Pwr_Init();
+	Noise_Init();
+	
+	for(i = 0; i < 2; i++)
+	{
+		memset(&subgRadio[i], 0, sizeof(sSubgRadio_t));
+		Rf69_SetMode((eRf69Dev_t)i, RF69_MODE_SLEEP);
+	}
+}
+
+/*
+call from the main loop: a radio left in standby longer than the idle timeout goes
+to sleep, keeping its registers. Waking it again costs the crystal start only.
+*/
+void Subg_Poll(void)
+{
+	uint8_t i;
+	
+	for(i = 0; i < 2; i++)
+	{
+		if(subgRadio[i].state == SUBG_RADIO_IDLE && Time_ElapsedUs(subgRadio[i].idleUs) >= idleTimeoutMs * TIME_US_PER_MS)
+		{
+			Rf69_SetMode((eRf69Dev_t)i, RF69_MODE_SLEEP);
+			subgRadio[i].state = SUBG_RADIO_SLEEP;
+		}
+	}
+}
+
+/*0: sleep right after each operation*/
+void Subg_SetIdleTimeout(uint32_t ms)
+{
+	idleTimeoutMs = ms;
+}
+
+void Subg_GetRadio(eRf69Dev_t dev, sSubgRadio_t *pRadio)
+{
+	*pRadio = subgRadio[dev];
 }
 
 int Subg_GetRssi(void) 
@@ -495,14 +1630,80 @@ int Subg_GetRssi(void)
 	return rxPktRssi;
 }
 
+uint64_t Subg_GetPktTime(void) 
+{
+	return rxPktTime;
+}
+
 uint16_t Subg_GetRxPktCnt(void) 
 {
-	return rxPktCnt;
+	uint32_t cnt = 0;
+	uint8_t i;
+	
+	for(i = 0; i < SUBG_MODE_NUM; i++)
+	{
+		cnt += subgStats[i].rxPktCnt;
+	}
+	return (uint16_t)cnt;
 }
 
 uint16_t Subg_GetTxPktCnt(void) 
 {
-	return txPktCnt;
+	uint32_t cnt = 0;
+	uint8_t i;
+	
+	for(i = 0; i < SUBG_MODE_NUM; i++)
+	{
+		cnt += subgStats[i].txPktCnt;
+	}
+	return (uint16_t)cnt;
+}
+
+/*
+telemetry block of all radio modes, laid out as sSubgStats_t[SUBG_MODE_NUM]
+with little-endian 32-bit counters so it can be handed to the BLE stack as is.
+*/
+const sSubgStats_t *Subg_GetStats(void) 
+{
+	return subgStats;
+}
+
+uint16_t Subg_GetStatsSize(void) 
+{
+	return sizeof(subgStats);
+}
+
+/*sum of the modes that run on one RFM69 (433: omnipod, 916/868: minimed NAS + WWL)*/
+void Subg_GetDevStats(eRf69Dev_t dev, sSubgStats_t *pStats) 
+{
+	const uint32_t *pSrc;
+	uint32_t *pDst;
+	uint8_t mode;
+	uint8_t i;
+	
+	memset(pStats, 0, sizeof(sSubgStats_t));
+	
+	for(mode = 0; mode < SUBG_MODE_NUM; mode++)
+	{
+		if((dev == RF69_DEV_FREQ433) != (mode == SUBG_MODE_OMNIPOD))
+		{
+			continue;
+		}
+		
+		pSrc = (const uint32_t *)&subgStats[mode];
+		pDst = (uint32_t *)pStats;
+		for(i = 0; i < sizeof(sSubgStats_t) / sizeof(uint32_t); i++)
+		{
+			pDst[i] += pSrc[i];
+		}
+	}
+}
+
+void Subg_ClrStats(void) 
+{
+	memset(subgStats, 0, sizeof(subgStats));
+	memset(txAirRemUs, 0, sizeof(txAirRemUs));
+	memset(rxAirRemUs, 0, sizeof(rxAirRemUs));
 }
 
 void Subg_SetPreamble(uint16_t preamble) 
@@ -510,19 +1711,267 @@ void Subg_SetPreamble(uint16_t preamble)
 	preambleWord = preamble;
 }
 
+/*
+last packet ended by the end-of-packet detector: time from reading its last valid
+byte until the rx call returned
+*/
+uint32_t Subg_GetEopLatency(void) 
+{
+	return eopLatencyUs;
+}
+
 void Subg_SetPktLen(uint8_t len) 
 {
 	pktLen = len;
 }
 
+/*how rx frames of a mode end, maxLen is clamped to SUBG_RX_MAX_LEN*/
+bool Subg_SetLenPolicy(eSubgMode_t mode, const sSubgLenPolicy_t *pPolicy) 
+{
+	if(mode >= SUBG_MODE_NUM || pPolicy->mode >= SUBG_LEN_MODE_NUM || pPolicy->maxLen == 0)
+	{
+		return false;
+	}
+	
+	lenPolicy[mode] = *pPolicy;
+	if(lenPolicy[mode].maxLen > SUBG_RX_MAX_LEN)
+	{
+		lenPolicy[mode].maxLen = SUBG_RX_MAX_LEN;
+	}
+	
+	KIT_LOG(TAG, "Mode %d rx length policy %d, max %u.", mode, lenPolicy[mode].mode, lenPolicy[mode].maxLen);
+	return true;
+}
+
+void Subg_GetLenPolicy(eSubgMode_t mode, sSubgLenPolicy_t *pPolicy) 
+{
+	*pPolicy = lenPolicy[(mode < SUBG_MODE_NUM) ? mode : SUBG_MODE_MINIMED_NAS];
+}
+
+/*
+pTable points to SUBG_MODE_NUM filters that survive a reset (the config record),
+save is called whenever one of them was changed
+*/
+void Subg_SyncFilterInit(sSubgSyncFilter_t *pTable, pfnSubgSave_t save) 
+{
+	uint8_t i;
+	
+	pSyncFilter = pTable;
+	pfnSyncSave = save;
+	
+	for(i = 0; i < SUBG_MODE_NUM; i++)
+	{
+		if(pSyncFilter[i].len > RF69_SYNC_EXT_MAX)
+		{
+			pSyncFilter[i].len = 0;
+		}
+	}
+}
+
+/*
+only take packets of a mode whose first bytes after the sync word are pBytes (as on
+air), len 0 takes everything again. Used from the next rx setup on.
+*/
+bool Subg_SetSyncFilter(eSubgMode_t mode, const uint8_t *pBytes, uint8_t len) 
+{
+	sSubgSyncFilter_t *pFilter;
+	
+	if(mode >= SUBG_MODE_NUM || len > RF69_SYNC_EXT_MAX)
+	{
+		return false;
+	}
+	
+	pFilter = &pSyncFilter[mode];
+	if(pFilter->len == len && memcmp(pFilter->bytes, pBytes, len) == 0)
+	{
+		return true;
+	}
+	
+	memset(pFilter, 0, sizeof(sSubgSyncFilter_t));
+	memcpy(pFilter->bytes, pBytes, len);
+	pFilter->len = len;
+	
+	KIT_LOG(TAG, "Mode %d sync filter %u bytes.", mode, len);
+	if(pfnSyncSave != NULL)
+	{
+		pfnSyncSave();
+	}
+	return true;
+}
+
+/*
+filter on the decoded header of the paired remote, e.g. packet type + pump id for
+MiniMed (3 bytes fill the filter), pod address for Omnipod (first 2 bytes)
+*/
+bool Subg_SetSyncFilterHdr(eSubgMode_t mode, const uint8_t *pHdr, uint8_t hdrLen) 
+{
+	uint8_t bytes[RF69_SYNC_EXT_MAX];
+	
+	return Subg_SetSyncFilter(mode, bytes, sync_filter_encode(mode, pHdr, hdrLen, bytes));
+}
+
+void Subg_GetSyncFilter(eSubgMode_t mode, sSubgSyncFilter_t *pFilter) 
+{
+	*pFilter = pSyncFilter[(mode < SUBG_MODE_NUM) ? mode : SUBG_MODE_MINIMED_NAS];
+}
+
+/*
+written over BLE (Radio Config characteristic), item(1) subg mode(1) then
+SUBG_CFG_LEN_POLICY: length mode(1) max length(2, LE) length offset(1) length adjust(1, signed)
+SUBG_CFG_SYNC_FILTER: filter length(1) filter bytes
+SUBG_CFG_SYNC_HDR: decoded header bytes
+*/
+bool Subg_SetCfgBytes(const uint8_t *pData, uint16_t len) 
+{
+	sSubgLenPolicy_t policy;
+	
+	if(len < 2)
+	{
+		return false;
+	}
+	
+	switch(pData[0])
+	{
+		case SUBG_CFG_LEN_POLICY:
+			if(len < 7)
+			{
+				return false;
+			}
+			policy.mode = (eSubgLenMode_t)pData[2];
+			policy.maxLen = (uint16_t)pData[3] | ((uint16_t)pData[4] << 8);
+			policy.lenOffset = pData[5];
+			policy.lenAdjust = (int8_t)pData[6];
+			return Subg_SetLenPolicy((eSubgMode_t)pData[1], &policy);
+			
+		case SUBG_CFG_SYNC_FILTER:
+			if(len < 3 || len < 3 + pData[2])
+			{
+				return false;
+			}
+			return Subg_SetSyncFilter((eSubgMode_t)pData[1], pData + 3, pData[2]);
+			
+		case SUBG_CFG_SYNC_HDR:
+			return Subg_SetSyncFilterHdr((eSubgMode_t)pData[1], pData + 2, (uint8_t)(len - 2));
+			
+		default:
+			return false;
+	}
+}
+
+/*
+claim the radio for an operation run from this context. Fails with SUBG_OP_NONE
+while another operation holds it, use Subg_OpPreempt to get it released.
+*/
+SubgOpHandle_t Subg_OpBegin(eSubgPrio_t prio)
+{
+	SubgOpHandle_t handle = SUBG_OP_NONE;
+	
+	CRITICAL_REGION_ENTER();
+	if(opCur == SUBG_OP_NONE)
+	{
+		opSeq++;
+		if(opSeq == SUBG_OP_NONE)
+		{
+			opSeq++;
+		}
+		handle = opSeq;
+		opCur = handle;
+		opPrio = prio;
+		cancelReq = false;
+		cancelReqUs = 0;
+	}
+	CRITICAL_REGION_EXIT();
+	
+	return handle;
+}
+
+void Subg_OpEnd(SubgOpHandle_t handle)
+{
+	CRITICAL_REGION_ENTER();
+	if(handle == opCur)
+	{
+		opCur = SUBG_OP_NONE;
+		cancelReq = false;
+	}
+	CRITICAL_REGION_EXIT();
+}
+
+/*
+cancel an operation from any context (BLE event, timer). The TX/RX/repeat loops
+return SUBG_TX_ABORT/SUBG_RX_INT with the radio in standby or sleep.
+*/
+bool Subg_OpCancel(SubgOpHandle_t handle)
+{
+	bool result = false;
+	
+	CRITICAL_REGION_ENTER();
+	if(handle != SUBG_OP_NONE && handle == opCur)
+	{
+		request_cancel();
+		opStats.cancelCnt++;
+		result = true;
+	}
+	CRITICAL_REGION_EXIT();
+	
+	return result;
+}
+
+/*
+make room for an operation of the given priority: a running operation of lower
+priority is cancelled. Returns false if the running one has the same or higher
+priority. The caller begins its operation once the radio is released.
+*/
+bool Subg_OpPreempt(eSubgPrio_t prio)
+{
+	bool result = true;
+	
+	CRITICAL_REGION_ENTER();
+	if(opCur != SUBG_OP_NONE)
+	{
+		if(prio > opPrio)
+		{
+			request_cancel();
+			opStats.preemptCnt++;
+		}
+		else
+		{
+			result = false;
+		}
+	}
+	CRITICAL_REGION_EXIT();
+	
+	return result;
+}
+
+bool Subg_OpIsBusy(void)
+{
+	return opCur != SUBG_OP_NONE;
+}
+
+const sSubgOpStats_t *Subg_GetOpStats(void)
+{
+	return &opStats;
+}
+
+/*
+compatibility with the single abort flag: cancels whatever is running. With nothing
+running there is nothing to cancel, a flag left set would abort the next operation.
+*/
 void Subg_SetIntFlg(void)
 {
-	cmdIntFlag = true;
+	CRITICAL_REGION_ENTER();
+	if(opCur != SUBG_OP_NONE)
+	{
+		request_cancel();
+		opStats.cancelCnt++;
+	}
+	CRITICAL_REGION_EXIT();
 }
 
 void Subg_ClrIntFlg(void)
 {
-	cmdIntFlag = false;
+	cancelReq = false;
+	cancelReqUs = 0;
 }
 
 /*void Subg_Test(void)
@@ -16,6 +16,8 @@
 #ifndef __APP_SUBG_H__
 #define __APP_SUBG_H__
 #include <stdint.h>
+#include <stdbool.h>
+#include "rf69.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -25,28 +27,184 @@ typedef enum
 {
 	SUBG_MODE_OMNIPOD = 0,
 	SUBG_MODE_MINIMED_NAS,
-	SUBG_MODE_MINIMED_WWL
+	SUBG_MODE_MINIMED_WWL,
+	SUBG_MODE_NUM
 }eSubgMode_t;
 
 typedef enum
 {
 	SUBG_RX_OK = 0,
 	SUBG_RX_TIMEOUT,
-	SUBG_RX_INT
+	SUBG_RX_INT,
+	SUBG_RX_OVERRUN				//only overrun-corrupted packets seen before the timeout
 }eSubgRxStatus_t;
 
+//longest frame the rx path takes, past 255 bytes the radio runs in unlimited length mode
+#define SUBG_RX_MAX_LEN			512
+//longest packet Subg_SendPkt sends, as on air
+#define SUBG_TX_MAX_LEN			255
+//frequencies of the channel table, e.g. a region scan
+#define SUBG_CHAN_MAX			16
+
+typedef enum
+{
+	SUBG_LEN_CODEC_END = 0,		//until the codec's end marker (0x00 for 4b6b, invalid Manchester pair)
+	SUBG_LEN_HEADER,			//length byte in the header: len = pBuf[lenOffset] + lenAdjust
+	SUBG_LEN_FIXED,				//always maxLen bytes
+	SUBG_LEN_MODE_NUM
+}eSubgLenMode_t;
+
+//per mode rx framing, a frame never goes past maxLen or the caller's buffer
+typedef struct
+{
+	eSubgLenMode_t mode;
+	uint16_t maxLen;
+	uint8_t lenOffset;			//SUBG_LEN_HEADER only, bytes as read from the fifo
+	int8_t lenAdjust;
+}sSubgLenPolicy_t;
+
+/*
+bytes right after the sync word the radio has to match as well (address/ID of the
+paired remote), as they are on air: line coded
+*/
+typedef struct
+{
+	uint8_t len;					//0 = filter off, up to RF69_SYNC_EXT_MAX
+	uint8_t bytes[RF69_SYNC_EXT_MAX];
+}sSubgSyncFilter_t;
+
+typedef void (*pfnSubgSave_t)(void);
+
+//first byte of a Radio Config characteristic write
+typedef enum
+{
+	SUBG_CFG_LEN_POLICY = 0,
+	SUBG_CFG_SYNC_FILTER,		//filter bytes as on air
+	SUBG_CFG_SYNC_HDR,			//filter from decoded header bytes, line coded here
+	SUBG_CFG_NUM
+}eSubgCfgItem_t;
+
+typedef enum
+{
+	SUBG_TX_OK = 0,
+	SUBG_TX_UNDERRUN,			//fifo ran dry mid-packet, retries exhausted
+	SUBG_TX_FIFO_TIMEOUT,		//fifo never drained, retries exhausted
+	SUBG_TX_ABORT,				//cancelled, preempted or BLE advertising
+	SUBG_TX_LEN_ERROR			//longer than the mode can frame, nothing sent
+}eSubgTxStatus_t;
+
+typedef enum
+{
+	SUBG_PRIO_BACKGROUND = 0,	//capture, listen
+	SUBG_PRIO_NORMAL,			//regular commands
+	SUBG_PRIO_BULK,				//long running ones (history download), regular commands wait for them
+	SUBG_PRIO_URGENT			//reset and pump sends (e.g. suspend), preempt everything below
+}eSubgPrio_t;
+
+typedef enum
+{
+	SUBG_RADIO_UNCFG = 0,		//registers never written since boot, kept asleep
+	SUBG_RADIO_SLEEP,			//configured, the registers hold its config
+	SUBG_RADIO_IDLE,			//standby after an operation until the idle timeout
+	SUBG_RADIO_ACTIVE			//rx, tx or listen
+}eSubgRadioState_t;
+
+typedef struct
+{
+	eSubgRadioState_t state;
+	eRf69Freq_t cfg;			//config table in the registers, once configured
+	uint64_t idleUs;			//went idle at
+	uint32_t cfgCnt;			//full config table writes
+	uint32_t wakeCnt;			//resumed from sleep on the config kept in the radio
+	uint64_t tempUs;			//last die temperature reading, 0 = none yet
+}sSubgRadio_t;
+
+typedef uint16_t SubgOpHandle_t;
+#define SUBG_OP_NONE		0
+
+typedef struct
+{
+	uint32_t cancelCnt;
+	uint32_t preemptCnt;
+	uint32_t abortCnt;				//cancels seen through by a running loop
+	uint32_t abortLatencyLastUs;	//cancel request -> radio in a known state
+	uint32_t abortLatencyMaxUs;
+}sSubgOpStats_t;
+
+//all counters are 32-bit and only ever grow until Subg_ClrStats
+typedef struct
+{
+	uint32_t txPktCnt;
+	uint32_t rxPktCnt;
+	uint32_t rxTimeoutCnt;
+	uint32_t rxAbortCnt;			//rx cancelled
+	uint32_t rxGlitchCnt;			//end-of-packet glitch byte removed
+	uint32_t rxTruncCnt;			//rx stopped at the max payload length
+	uint32_t txFifoTimeoutCnt;		//fifo stayed full, packet restarted
+	uint32_t fifoOverrunCnt;		//rx fifo overflowed, packet dropped and rx restarted
+	uint32_t fifoUnderrunCnt;		//tx fifo ran dry mid-packet, packet restarted
+	uint32_t txAirtimeMs;
+	uint32_t rxAirtimeMs;
+	uint32_t txAbortCnt;			//tx or repeat sequence cancelled
+	uint32_t rxEopCnt;				//packets ended early by the end-of-packet detector
+	uint32_t rxNoiseCnt;			//sync on noise, dropped by the line code check
+	uint32_t eopLatencySumUs;		//last valid byte read -> rx returned, over rxEopCnt packets
+	uint32_t eopLatencyMaxUs;
+	uint32_t retuneCnt;
+	uint32_t retuneMaxUs;			//frequency write -> PLL locked
+	uint32_t pllLockFailCnt;
+}sSubgStats_t;
+
 void Subg_SetMode(eSubgMode_t mode);
 eSubgMode_t Subg_GetMode(void);
-void Subg_SendPkt(uint8_t *pBuf, uint16_t len, uint8_t repeatCnt, uint16_t repeatIntvl, uint16_t preambleExt); 
-eSubgRxStatus_t Subg_GetPkt(uint8_t *pRxBuf, uint8_t *pRxLen, uint32_t timeout, uint8_t usePktLen); 
+eSubgTxStatus_t Subg_SendPkt(uint8_t *pBuf, uint16_t len, uint8_t repeatCnt, uint16_t repeatIntvl, uint16_t preambleExt); 
+int32_t Subg_SendPktAt(uint8_t *pBuf, uint16_t len, uint64_t startUs, uint16_t preambleExt); 
+int32_t Subg_SendPktIn(uint8_t *pBuf, uint16_t len, uint32_t delayUs, uint16_t preambleExt); 
+int32_t Subg_GetTxStartErr(void); 
+eSubgTxStatus_t Subg_GetTxStatus(void); 
+eSubgRxStatus_t Subg_GetPkt(uint8_t *pRxBuf, uint16_t bufSize, uint16_t *pRxLen, uint32_t timeout, uint8_t usePktLen); 
+eSubgRxStatus_t Subg_ListenPkt(uint8_t *pRxBuf, uint16_t bufSize, uint16_t *pRxLen, uint32_t timeout); 
+void Subg_Stop(void);
+void Subg_ListenArm(uint32_t *pIdleUs, uint32_t *pRxUs, bool syncWake);
+eSubgRxStatus_t Subg_ListenRead(uint8_t *pRxBuf, uint16_t bufSize, uint16_t *pRxLen, uint32_t timeout);
+void Subg_ListenDisarm(void);
 void Subg_SetFreq(uint32_t freqHz);
+bool Subg_SetChanTable(const uint32_t *pFreqHz, uint8_t cnt);
+bool Subg_SetChan(uint8_t idx);
+uint32_t Subg_GetRetuneUs(void);
+void Subg_SetRemoteId(uint32_t remoteId);
+int32_t Subg_GetFreqOffset(void);
+bool Subg_NeedRescan(void);
+void Subg_TxFeedback(bool replied);
 void Subg_CfgRf(void);
 void Subg_Init(void);
+void Subg_Poll(void);
+void Subg_SetIdleTimeout(uint32_t ms);
+void Subg_GetRadio(eRf69Dev_t dev, sSubgRadio_t *pRadio);
 int Subg_GetRssi(void); 
+uint64_t Subg_GetPktTime(void); 
 uint16_t Subg_GetRxPktCnt(void); 
 uint16_t Subg_GetTxPktCnt(void); 
+const sSubgStats_t *Subg_GetStats(void); 
+uint16_t Subg_GetStatsSize(void); 
+void Subg_GetDevStats(eRf69Dev_t dev, sSubgStats_t *pStats); 
+void Subg_ClrStats(void); 
 void Subg_SetPreamble(uint16_t preamble); 
+uint32_t Subg_GetEopLatency(void); 
 void Subg_SetPktLen(uint8_t len); 
+bool Subg_SetLenPolicy(eSubgMode_t mode, const sSubgLenPolicy_t *pPolicy); 
+void Subg_GetLenPolicy(eSubgMode_t mode, sSubgLenPolicy_t *pPolicy); 
+void Subg_SyncFilterInit(sSubgSyncFilter_t *pTable, pfnSubgSave_t save); 
+bool Subg_SetSyncFilter(eSubgMode_t mode, const uint8_t *pBytes, uint8_t len); 
+bool Subg_SetSyncFilterHdr(eSubgMode_t mode, const uint8_t *pHdr, uint8_t hdrLen); 
+void Subg_GetSyncFilter(eSubgMode_t mode, sSubgSyncFilter_t *pFilter); 
+bool Subg_SetCfgBytes(const uint8_t *pData, uint16_t len); 
+SubgOpHandle_t Subg_OpBegin(eSubgPrio_t prio);
+void Subg_OpEnd(SubgOpHandle_t handle);
+bool Subg_OpCancel(SubgOpHandle_t handle);
+bool Subg_OpPreempt(eSubgPrio_t prio);
+bool Subg_OpIsBusy(void);
+const sSubgOpStats_t *Subg_GetOpStats(void);
 void Subg_SetIntFlg(void);
 void Subg_ClrIntFlg(void);
 //void Subg_Test(void);
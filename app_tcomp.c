@@ -0,0 +1,295 @@
+/**
+ *@file app_tcomp.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief learned crystal drift vs die temperature of each RFM69
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <string.h>
+#include <stdlib.h>
+
+#include "app_tcomp.h"
+
+/*
+The AFC estimates hold the remote's offset as seen at one temperature of our
+crystal, the reference bin, where the curve is 0 by definition. Away from it
+the curve adds what our crystal drifted, learned from the FEI of packets from
+remotes whose estimate is settled. Between learned bins the correction is
+interpolated, past the last one it is held and only trusted for a few bins.
+*/
+
+//a FEI reading this far off is noise or a different transmitter, not drift
+#define TCOMP_FEI_MAX_HZ		30000
+//bins follow new samples with a weight of 1/2^TCOMP_EMA_SHIFT
+#define TCOMP_EMA_SHIFT			2
+#define TCOMP_PPB_MAX			32000
+//held this many bins past the last learned one, further out a scan is cheaper than a miss
+#define TCOMP_EXTRAP_BINS		2
+#define TCOMP_UNCERTAIN_PPB		4000
+//only write flash when a bin moved at least this much since the last save
+#define TCOMP_SAVE_STEP_PPB		500
+
+static sTcompCurve_t *pTcompCurves = NULL;
+static pfnTcompSave_t pfnSave = NULL;
+static int16_t savedPpb[TCOMP_DEV_NUM][TCOMP_BIN_NUM];
+static int8_t curTempC[TCOMP_DEV_NUM] = {TCOMP_TEMP_NONE, TCOMP_TEMP_NONE};
+
+static int32_t clamp(int32_t val, int32_t max)
+{
+	if(val < -max)
+	{
+		return -max;
+	}
+	return (val > max) ? max : val;
+}
+
+static uint8_t temp_bin(int8_t tempC)
+{
+	int16_t idx;
+
+	if(tempC < TCOMP_TEMP_MIN_C)
+	{
+		return 0;
+	}
+	idx = (tempC - TCOMP_TEMP_MIN_C) / TCOMP_BIN_C;
+	return (idx >= TCOMP_BIN_NUM) ? TCOMP_BIN_NUM - 1 : (uint8_t)idx;
+}
+
+static bool bin_learned(const sTcompCurve_t *pCurve, int16_t idx)
+{
+	return idx + 1 == pCurve->refBin || pCurve->bin[idx].sampleCnt > 0;
+}
+
+static int32_t bin_ppb(const sTcompCurve_t *pCurve, int16_t idx)
+{
+	return (idx + 1 == pCurve->refBin) ? 0 : pCurve->bin[idx].corrPpb;
+}
+
+/*curve usable: a curve and a temperature to look it up with*/
+static sTcompCurve_t *curve_ready(uint8_t dev)
+{
+	if(pTcompCurves == NULL || dev >= TCOMP_DEV_NUM || curTempC[dev] == TCOMP_TEMP_NONE || pTcompCurves[dev].refBin == 0)
+	{
+		return NULL;
+	}
+	return &pTcompCurves[dev];
+}
+
+/*correction at bin idx, *pDist is how many bins away the nearest learned one is*/
+static int32_t corr_ppb(const sTcompCurve_t *pCurve, uint8_t idx, uint8_t *pDist)
+{
+	int16_t lo = idx;
+	int16_t hi = idx;
+
+	while(lo >= 0 && !bin_learned(pCurve, lo))
+	{
+		lo--;
+	}
+	while(hi < TCOMP_BIN_NUM && !bin_learned(pCurve, hi))
+	{
+		hi++;
+	}
+
+	if(lo == idx)
+	{
+		*pDist = 0;
+		return bin_ppb(pCurve, lo);
+	}
+	if(lo >= 0 && hi < TCOMP_BIN_NUM)
+	{
+		*pDist = (uint8_t)(((idx - lo) < (hi - idx)) ? (idx - lo) : (hi - idx));
+		return bin_ppb(pCurve, lo) + (bin_ppb(pCurve, hi) - bin_ppb(pCurve, lo)) * (idx - lo) / (hi - lo);
+	}
+	//the reference bin is always learned, so one side is
+	if(lo >= 0)
+	{
+		*pDist = (uint8_t)(idx - lo);
+		return bin_ppb(pCurve, lo);
+	}
+	*pDist = (uint8_t)(hi - idx);
+	return bin_ppb(pCurve, hi);
+}
+
+static void save_if_moved(uint8_t dev, uint8_t idx)
+{
+	sTcompBin_t *pBin = &pTcompCurves[dev].bin[idx];
+
+	if(pBin->sampleCnt != 1 && abs(pBin->corrPpb - savedPpb[dev][idx]) < TCOMP_SAVE_STEP_PPB)
+	{
+		return;
+	}
+
+	savedPpb[dev][idx] = pBin->corrPpb;
+	if(pfnSave != NULL)
+	{
+		pfnSave();
+	}
+}
+
+/*
+pCurves points to TCOMP_DEV_NUM curves that survive a reset (the config record),
+save is called whenever they changed enough to be worth a flash write
+*/
+void Tcomp_Init(sTcompCurve_t *pCurves, pfnTcompSave_t save)
+{
+	uint8_t dev;
+	uint8_t i;
+
+	pTcompCurves = pCurves;
+	pfnSave = save;
+
+	for(dev = 0; dev < TCOMP_DEV_NUM; dev++)
+	{
+		for(i = 0; i < TCOMP_BIN_NUM; i++)
+		{
+			savedPpb[dev][i] = pTcompCurves[dev].bin[i].corrPpb;
+		}
+	}
+}
+
+/*a new die temperature reading, the first one ever sets the reference*/
+void Tcomp_SetTemp(uint8_t dev, int8_t tempC)
+{
+	if(dev >= TCOMP_DEV_NUM)
+	{
+		return;
+	}
+
+	curTempC[dev] = tempC;
+	if(pTcompCurves != NULL && pTcompCurves[dev].refBin == 0)
+	{
+		pTcompCurves[dev].refBin = temp_bin(tempC) + 1;
+		if(pfnSave != NULL)
+		{
+			pfnSave();
+		}
+	}
+}
+
+int8_t Tcomp_GetTemp(uint8_t dev)
+{
+	return (dev < TCOMP_DEV_NUM) ? curTempC[dev] : TCOMP_TEMP_NONE;
+}
+
+/*to add to the frequency the radio is tuned to, 0 until there is a reading*/
+int32_t Tcomp_GetCorrHz(uint8_t dev, uint32_t freqHz)
+{
+	sTcompCurve_t *pCurve = curve_ready(dev);
+	uint8_t dist;
+
+	if(pCurve == NULL)
+	{
+		return 0;
+	}
+	return (int32_t)((int64_t)corr_ppb(pCurve, temp_bin(curTempC[dev]), &dist) * freqHz / 1000000000);
+}
+
+/*
+feed one FEI reading taken while the correction was appliedHz, from a remote whose
+AFC estimate is settled. Returns false if the reading is not the curve's to learn
+(reference bin, no temperature yet, FEI out of range), the AFC should take it.
+*/
+bool Tcomp_Update(uint8_t dev, uint32_t freqHz, int32_t appliedHz, int32_t feiHz)
+{
+	sTcompCurve_t *pCurve = curve_ready(dev);
+	sTcompBin_t *pBin;
+	uint8_t idx;
+	uint8_t dist;
+	int32_t measured;
+	int32_t err;
+
+	if(pCurve == NULL || freqHz == 0 || abs(feiHz) > TCOMP_FEI_MAX_HZ)
+	{
+		return false;
+	}
+
+	idx = temp_bin(curTempC[dev]);
+	if(idx + 1 == pCurve->refBin)
+	{
+		return false;
+	}
+
+	pBin = &pCurve->bin[idx];
+	measured = clamp((int32_t)((int64_t)(appliedHz + feiHz) * 1000000000 / freqHz), TCOMP_PPB_MAX);
+
+	if(pBin->sampleCnt == 0)
+	{
+		//first reading of the bin, its error is how far off the interpolation was
+		err = abs(measured - corr_ppb(pCurve, idx, &dist)) / TCOMP_ERR_UNIT_PPB;
+		pBin->corrPpb = (int16_t)measured;
+		pBin->errBound = (uint8_t)clamp(err, UINT8_MAX);
+	}
+	else
+	{
+		err = measured - pBin->corrPpb;
+		pBin->corrPpb = (int16_t)(pBin->corrPpb + err / (1 << TCOMP_EMA_SHIFT));
+		err = abs(err) / TCOMP_ERR_UNIT_PPB;
+		pBin->errBound = (uint8_t)clamp(pBin->errBound + (err - pBin->errBound) / (1 << TCOMP_EMA_SHIFT), UINT8_MAX);
+	}
+
+	if(pBin->sampleCnt < UINT8_MAX)
+	{
+		pBin->sampleCnt++;
+	}
+
+	save_if_moved(dev, idx);
+	return true;
+}
+
+/*
+true when the correction at the current temperature is a guess: too far past the
+learned bins, or the bin's own readings scatter
+*/
+bool Tcomp_IsUncertain(uint8_t dev)
+{
+	sTcompCurve_t *pCurve = curve_ready(dev);
+	uint8_t idx;
+	uint8_t dist;
+
+	if(pCurve == NULL)
+	{
+		return false;
+	}
+
+	idx = temp_bin(curTempC[dev]);
+	corr_ppb(pCurve, idx, &dist);
+	if(dist > TCOMP_EXTRAP_BINS)
+	{
+		return true;
+	}
+	return pCurve->bin[idx].sampleCnt > 0 && (uint32_t)pCurve->bin[idx].errBound * TCOMP_ERR_UNIT_PPB > TCOMP_UNCERTAIN_PPB;
+}
+
+const sTcompCurve_t *Tcomp_GetCurve(uint8_t dev)
+{
+	return (pTcompCurves != NULL && dev < TCOMP_DEV_NUM) ? &pTcompCurves[dev] : NULL;
+}
+
+/*drop the curve, the current temperature becomes the reference*/
+void Tcomp_Forget(uint8_t dev)
+{
+	if(pTcompCurves == NULL || dev >= TCOMP_DEV_NUM)
+	{
+		return;
+	}
+
+	memset(&pTcompCurves[dev], 0, sizeof(sTcompCurve_t));
+	memset(savedPpb[dev], 0, sizeof(savedPpb[dev]));
+	if(curTempC[dev] != TCOMP_TEMP_NONE)
+	{
+		pTcompCurves[dev].refBin = temp_bin(curTempC[dev]) + 1;
+	}
+	if(pfnSave != NULL)
+	{
+		pfnSave();
+	}
+}
+
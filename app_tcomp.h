@@ -0,0 +1,63 @@
+/**
+ *@file app_tcomp.h
+ *@author Ribin Huang (you@domain.com)
+ *@brief learned crystal drift vs die temperature of each RFM69
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __APP_TCOMP_H__
+#define __APP_TCOMP_H__
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TCOMP_DEV_NUM			2			//one curve per RFM69, each has its own crystal
+#define TCOMP_BIN_NUM			18
+#define TCOMP_BIN_C				5
+#define TCOMP_TEMP_MIN_C		(-20)		//bin 0 starts here, the last bin ends at 70 degC
+#define TCOMP_ERR_UNIT_PPB		50			//errBound unit
+#define TCOMP_TEMP_NONE			INT8_MIN	//no reading yet
+
+typedef struct
+{
+	int16_t corrPpb;			//tuning correction at this temperature, relative to the reference bin
+	uint8_t sampleCnt;			//saturates at UINT8_MAX, 0 = not learned
+	uint8_t errBound;			//smoothed |measured - estimate| in TCOMP_ERR_UNIT_PPB
+}sTcompBin_t;
+
+//persisted as is in rileylink_config, keep it 4-byte aligned and only append fields
+typedef struct
+{
+	uint8_t refBin;				//bin the curve is 0 at (the AFC estimates' temperature) + 1, 0 = not set yet
+	uint8_t rsv[3];
+	sTcompBin_t bin[TCOMP_BIN_NUM];
+}sTcompCurve_t;
+
+typedef void (*pfnTcompSave_t)(void);
+
+void Tcomp_Init(sTcompCurve_t *pCurves, pfnTcompSave_t save);
+void Tcomp_SetTemp(uint8_t dev, int8_t tempC);
+int8_t Tcomp_GetTemp(uint8_t dev);
+int32_t Tcomp_GetCorrHz(uint8_t dev, uint32_t freqHz);
+bool Tcomp_Update(uint8_t dev, uint32_t freqHz, int32_t appliedHz, int32_t feiHz);
+bool Tcomp_IsUncertain(uint8_t dev);
+const sTcompCurve_t *Tcomp_GetCurve(uint8_t dev);
+void Tcomp_Forget(uint8_t dev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,107 @@
+/**
+ *@file app_time.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief monotonic microsecond timestamp service for radio timing
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include "app_time.h"
+#include "hal.h"
+
+static pfnTimeClock_t pfnClock = NULL;
+static uint8_t fineCnt = 0;
+
+uint64_t Time_GetUs(void)
+{
+	if(pfnClock != NULL)
+	{
+		return pfnClock();
+	}
+
+	return Hal_ClockUs();
+}
+
+uint32_t Time_GetMs(void)
+{
+	return (uint32_t)(Time_GetUs() / TIME_US_PER_MS);
+}
+
+uint64_t Time_DeadlineUs(uint32_t us)
+{
+	return Time_GetUs() + us;
+}
+
+uint64_t Time_DeadlineMs(uint32_t ms)
+{
+	return Time_GetUs() + (uint64_t)ms * TIME_US_PER_MS;
+}
+
+/*64-bit microseconds don't wrap in the lifetime of the device, a plain compare is wrap-safe*/
+bool Time_IsExpired(uint64_t deadline)
+{
+	return Time_GetUs() >= deadline;
+}
+
+/*elapsed time since a timestamp, saturated at UINT32_MAX (~71 minutes)*/
+uint32_t Time_ElapsedUs(uint64_t since)
+{
+	uint64_t now;
+	uint64_t diff;
+
+	now = Time_GetUs();
+	if(now <= since)
+	{
+		return 0;
+	}
+
+	diff = now - since;
+	return (diff > UINT32_MAX) ? UINT32_MAX : (uint32_t)diff;
+}
+
+void Time_WaitUntil(uint64_t deadline)
+{
+	while(!Time_IsExpired(deadline));
+}
+
+/*
+replace the hardware clock, e.g. by a simulated one in host tests.
+NULL switches back to the HAL clock.
+*/
+void Time_SetClock(pfnTimeClock_t clock)
+{
+	pfnClock = clock;
+}
+
+/*
+us resolution for the windows that need it (timed tx, capture), the clock is
+coarser (~30us) otherwise. The hardware behind it costs power: every
+Time_Fine(true) is paired with a Time_Fine(false), they nest.
+*/
+void Time_Fine(bool onOff)
+{
+	if(onOff)
+	{
+		if(fineCnt++ == 0)
+		{
+			Hal_ClockFine(true);
+		}
+	}
+	else if(fineCnt > 0 && --fineCnt == 0)
+	{
+		Hal_ClockFine(false);
+	}
+}
+
+bool Time_IsFine(void)
+{
+	return fineCnt > 0;
+}
+
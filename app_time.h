@@ -0,0 +1,45 @@
+/**
+ *@file app_time.h
+ *@author Ribin Huang (you@domain.com)
+ *@brief monotonic microsecond timestamp service for radio timing
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __APP_TIME_H__
+#define __APP_TIME_H__
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TIME_US_PER_MS		1000UL
+
+typedef uint64_t (*pfnTimeClock_t)(void);
+
+uint64_t Time_GetUs(void);
+uint32_t Time_GetMs(void);
+uint64_t Time_DeadlineUs(uint32_t us);
+uint64_t Time_DeadlineMs(uint32_t ms);
+bool Time_IsExpired(uint64_t deadline);
+uint32_t Time_ElapsedUs(uint64_t since);
+void Time_WaitUntil(uint64_t deadline);
+void Time_SetClock(pfnTimeClock_t clock);
+void Time_Fine(bool onOff);
+bool Time_IsFine(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,140 @@
+/**
+ *@file app_trace.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief compact record of what the radio drivers saw, for replay on the host
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <string.h>
+
+#include "app_trace.h"
+#include "app_time.h"
+#include "hal.h"
+
+//worst case record: header + 5 byte delta + value
+#define TRACE_REC_MAX_LEN		7
+
+#define TAG "TRC"
+
+static uint8_t traceBuf[TRACE_BUF_SIZE];
+static uint16_t traceLen = 0;
+static uint64_t traceLastUs = 0;
+static uint32_t traceDropCnt = 0;
+static volatile bool traceOn = false;
+
+/*
+recording stops when the buffer is full rather than wrapping: the records are
+delta coded, the start of an exchange is needed to replay it
+*/
+static void record(eTraceEvt_t evt, uint8_t radio, bool hasValue, uint8_t value)
+{
+	uint64_t now;
+	uint32_t delta;
+
+	if(!traceOn)
+	{
+		return;
+	}
+
+	CRITICAL_REGION_ENTER();
+	if(traceLen + TRACE_REC_MAX_LEN > TRACE_BUF_SIZE)
+	{
+		traceDropCnt++;
+	}
+	else
+	{
+		now = Time_GetUs();
+		delta = (now - traceLastUs > UINT32_MAX) ? UINT32_MAX : (uint32_t)(now - traceLastUs);
+		traceLastUs = now;
+
+		traceBuf[traceLen++] = (uint8_t)((evt << 4) | (radio & 0x0F));
+		while(delta >= 0x80)
+		{
+			traceBuf[traceLen++] = (uint8_t)(delta | 0x80);
+			delta >>= 7;
+		}
+		traceBuf[traceLen++] = (uint8_t)delta;
+
+		if(hasValue)
+		{
+			traceBuf[traceLen++] = value;
+		}
+	}
+	CRITICAL_REGION_EXIT();
+}
+
+/*start over, the previous trace is discarded*/
+void Trace_Start(void)
+{
+	uint8_t i;
+
+	traceOn = false;
+	traceLastUs = Time_GetUs();
+	traceBuf[0] = TRACE_MAGIC;
+	traceBuf[1] = TRACE_VERSION;
+	for(i = 0; i < 8; i++)
+	{
+		traceBuf[2 + i] = (uint8_t)(traceLastUs >> (8 * i));
+	}
+	traceLen = TRACE_HDR_LEN;
+	traceDropCnt = 0;
+	traceOn = true;
+
+	KIT_LOG(TAG, "Trace start.");
+}
+
+void Trace_Stop(void)
+{
+	if(traceOn)
+	{
+		traceOn = false;
+		KIT_LOG(TAG, "Trace stop, %u bytes, %u records dropped.", traceLen, traceDropCnt);
+	}
+}
+
+bool Trace_IsRecording(void)
+{
+	return traceOn;
+}
+
+void Trace_RxStart(uint8_t radio)
+{
+	record(TRACE_EVT_RX_START, radio, false, 0);
+}
+
+void Trace_Byte(uint8_t radio, uint8_t data)
+{
+	record(TRACE_EVT_BYTE, radio, true, data);
+}
+
+void Trace_Rssi(uint8_t radio, int16_t rssi)
+{
+	record(TRACE_EVT_RSSI, radio, true, (uint8_t)((rssi < -255) ? 255 : (rssi > 0) ? 0 : -rssi));
+}
+
+/*safe from interrupt context*/
+void Trace_Dio(uint8_t radio)
+{
+	record(TRACE_EVT_DIO, radio, false, 0);
+}
+
+/*the trace recorded so far, empty if Trace_Start was never called*/
+const uint8_t *Trace_Get(uint16_t *pLen)
+{
+	*pLen = traceLen;
+	return traceBuf;
+}
+
+uint32_t Trace_GetDropCnt(void)
+{
+	return traceDropCnt;
+}
+
@@ -0,0 +1,58 @@
+/**
+ *@file app_trace.h
+ *@author Ribin Huang (you@domain.com)
+ *@brief compact record of what the radio drivers saw, for replay on the host
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __APP_TRACE_H__
+#define __APP_TRACE_H__
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+trace layout, all little endian:
+  header: magic(1) version(1) start timestamp us(8)
+  record: type << 4 | radio(1), us since the previous record (LEB128, 1-5 bytes), value(0 or 1)
+*/
+#define TRACE_MAGIC				0xA5
+#define TRACE_VERSION			1
+#define TRACE_HDR_LEN			10
+#define TRACE_BUF_SIZE			4096
+
+typedef enum
+{
+	TRACE_EVT_RX_START = 1,		//receiver (re)started: RX mode entered or RXRESTART
+	TRACE_EVT_BYTE,				//byte read from the fifo, value = byte
+	TRACE_EVT_RSSI,				//RSSI read, value = -dBm
+	TRACE_EVT_DIO				//DIO0 interrupt, no value
+}eTraceEvt_t;
+
+void Trace_Start(void);
+void Trace_Stop(void);
+bool Trace_IsRecording(void);
+void Trace_RxStart(uint8_t radio);
+void Trace_Byte(uint8_t radio, uint8_t data);
+void Trace_Rssi(uint8_t radio, int16_t rssi);
+void Trace_Dio(uint8_t radio);
+const uint8_t *Trace_Get(uint16_t *pLen);
+uint32_t Trace_GetDropCnt(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
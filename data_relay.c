@@ -4,28 +4,40 @@
 
 #include "rileylink_service.h"
 #include "led_mode_handlers.h"
-#include "subg_rfspy_spi.h"
+#include "radio_backend.h"
+#include "data_relay.h"
 
 static ble_rileylink_service_t *m_rileylink_service;
+static const radio_backend_t *m_radio_backend;
 
-void data_relay_init(ble_rileylink_service_t * p_rileylink_service) {
+void data_relay_init(ble_rileylink_service_t * p_rileylink_service, const radio_backend_t *p_radio_backend) {
     m_rileylink_service = p_rileylink_service;
+    m_radio_backend = p_radio_backend;
+    NRF_LOG_INFO("Radio backend: %s", m_radio_backend->name);
+    Capture_Init(data_relay_capture_notify);
+    m_radio_backend->init(data_relay_radio_response_handler);
+}
+
+void data_relay_process(void) {
+    if (m_radio_backend->process != NULL) {
+        m_radio_backend->process();
+    }
 }
 
 void data_relay_ble_write_handler(const uint8_t *data, uint16_t length)
 {
     NRF_LOG_INFO("Data received via BLE: %d bytes.", length);
     if (length >= 2) {
-        subg_rfspy_spi_run_command(data+1, length-1);
+        m_radio_backend->run_command(data+1, length-1);
     }
 }
 
-void data_relay_spi_response_handler(const uint8_t *data, uint8_t length) {
+void data_relay_radio_response_handler(const uint8_t *data, uint8_t length) {
     uint32_t   err_code;
 
-    NRF_LOG_INFO("Data received via SPI: %d bytes.", length);
+    NRF_LOG_INFO("Data received from radio: %d bytes.", length);
     if (length > BLE_RILEYLINK_DATA_MAX_LENGTH) {
-        NRF_LOG_ERROR("Data received over SPI (%d) > than DATA attribute maximum length (%d). Truncating.", length, BLE_RILEYLINK_DATA_MAX_LENGTH);
+        NRF_LOG_ERROR("Data received from radio (%d) > than DATA attribute maximum length (%d). Truncating.", length, BLE_RILEYLINK_DATA_MAX_LENGTH);
         length = BLE_RILEYLINK_DATA_MAX_LENGTH;
     }
 
@@ -33,3 +45,17 @@ void data_relay_spi_response_handler(const uint8_t *data, uint8_t length) {
     APP_ERROR_CHECK(err_code);
 }
 
+
+eCaptureNotifyResult_t data_relay_capture_notify(const uint8_t *data, uint16_t length) {
+    uint32_t   err_code;
+
+    err_code = ble_rileylink_service_send_capture(m_rileylink_service, data, length);
+    if (err_code == NRF_SUCCESS) {
+        return CAPTURE_NOTIFY_OK;
+    }
+    if (err_code == NRF_ERROR_RESOURCES) {
+        return CAPTURE_NOTIFY_BUSY;
+    }
+    // Not connected, or client has not subscribed to capture notifications
+    return CAPTURE_NOTIFY_FAIL;
+}
@@ -3,10 +3,14 @@
 
 #include <stdint.h>
 #include "nrf_sdh_ble.h"
+#include "app_capture.h"
+#include "radio_backend.h"
 
-void data_relay_init(ble_rileylink_service_t * p_rileylink_service);
+void data_relay_init(ble_rileylink_service_t * p_rileylink_service, const radio_backend_t *p_radio_backend);
+void data_relay_process(void);
 void data_relay_ble_write_handler(const uint8_t *data, uint16_t data_len);
-void data_relay_spi_response_handler(const uint8_t *data, uint8_t length);
+void data_relay_radio_response_handler(const uint8_t *data, uint8_t length);
+eCaptureNotifyResult_t data_relay_capture_notify(const uint8_t *data, uint16_t length);
 
 #endif // DATA_RELAY_H
 
@@ -0,0 +1,86 @@
+/**
+ *@file hal.h
+ *@author Ribin Huang (you@domain.com)
+ *@brief thin hardware layer under rf69/app_subg: spi, gpio, clock, delay, BLE state
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __HAL_H__
+#define __HAL_H__
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*
+two backends implement this header:
+- hal_nrf52.c: nRF52840 drivers, the firmware build
+- hal_linux.c: host build (define HAL_LINUX), radios are the SX1231 simulator in sx1231_sim.c
+*/
+#ifdef HAL_LINUX
+#include <stdio.h>
+#define KIT_LOG(tag, fmt, ...)		printf("[%s] " fmt "\n", tag, ##__VA_ARGS__)
+#define CRITICAL_REGION_ENTER()
+#define CRITICAL_REGION_EXIT()
+//nRF5 log macros of the subg_rfspy backend code (subg_rfspy_native.c, radio_backend_rfm69.c)
+#define NRF_LOG_INFO(fmt, ...)			printf(fmt "\n", ##__VA_ARGS__)
+#define NRF_LOG_WARNING(fmt, ...)		printf(fmt "\n", ##__VA_ARGS__)
+#define NRF_LOG_HEXDUMP_INFO(p, len)
+#else
+#include "app_util_platform.h"
+#include "nrf_log.h"
+#define KIT_LOG(tag, fmt, ...)		NRF_LOG_DEBUG("[" tag "] " fmt, ##__VA_ARGS__)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//radios on the SPI bus, same numbering as eRf69Dev_t
+#define HAL_RADIO_433		0
+#define HAL_RADIO_916		1
+#define HAL_RADIO_NUM		2
+
+//1 where the board carries an RFM69HW (PA_BOOST only), 0 for an RFM69W (PA0 on RFIO)
+#ifndef HAL_RADIO_433_IS_HW
+#define HAL_RADIO_433_IS_HW	0
+#endif
+#ifndef HAL_RADIO_916_IS_HW
+#define HAL_RADIO_916_IS_HW	0
+#endif
+
+typedef void (*pfnHalDioIrq_t)(uint8_t radio);
+
+void Hal_SpiSelect(uint8_t radio);
+void Hal_SpiUnselect(uint8_t radio);
+void Hal_SpiXfer(const uint8_t *pTx, uint16_t txLen, uint8_t *pRx, uint16_t rxLen);
+void Hal_SpiRelease(void);
+
+bool Hal_DioIrqInit(uint8_t radio, pfnHalDioIrq_t handler);
+void Hal_DioIrqEnable(uint8_t radio, bool onOff);
+void Hal_DioIrqUninit(uint8_t radio);
+
+uint64_t Hal_ClockUs(void);
+void Hal_ClockFine(bool onOff);
+
+void Hal_DelayMs(uint32_t ms);
+void Hal_DelayUs(uint32_t us);
+
+void Hal_SetBleAdvertising(bool onOff);
+bool Hal_IsBleAdvertising(void);
+
+void Hal_WdtFeed(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
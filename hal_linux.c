@@ -0,0 +1,172 @@
+/**
+ *@file hal_linux.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief Linux backend of hal.h, the radios are the SX1231 simulator
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include "hal.h"
+#include "sx1231_sim.h"
+
+/*
+time is the simulator clock, not the wall clock: delays and bus traffic advance it,
+and every clock read costs a little cpu time so that polling loops make progress.
+Stalls (Sim_SetCpuStall) hit right after a clock read, the caller acts on a stale time.
+*/
+#define HAL_SPI_BYTE_US			2		//4MHz SPI
+#define HAL_SPI_XFER_US			3		//driver init/uninit around every access
+#define HAL_CPU_US				1
+
+static pfnHalDioIrq_t pfnDioIrq[HAL_RADIO_NUM];
+static bool dioEnabled[HAL_RADIO_NUM];
+static bool dioLevel[HAL_RADIO_NUM];
+static uint8_t spiRadio = HAL_RADIO_NUM;
+static bool bleAdvertising = false;
+
+/*move the simulator forward and deliver DIO0 rising edges like GPIOTE would*/
+static void advance(uint32_t us)
+{
+	uint8_t radio;
+	bool level;
+
+	Sim_AdvanceUs(us);
+
+	for(radio = 0; radio < HAL_RADIO_NUM; radio++)
+	{
+		level = Sim_GetDio0(radio);
+		if(level && !dioLevel[radio] && dioEnabled[radio] && pfnDioIrq[radio] != NULL)
+		{
+			pfnDioIrq[radio](radio);
+		}
+		dioLevel[radio] = level;
+	}
+}
+
+/*spi*/
+
+void Hal_SpiSelect(uint8_t radio)
+{
+	spiRadio = radio;
+	Sim_SpiBegin(radio);
+}
+
+void Hal_SpiUnselect(uint8_t radio)
+{
+	(void)radio;
+	Sim_SpiEnd();
+	spiRadio = HAL_RADIO_NUM;
+	advance(HAL_SPI_XFER_US);
+}
+
+void Hal_SpiRelease(void)
+{
+}
+
+/*full duplex like the nRF SPIM: max(txLen, rxLen) bytes, 0xFF clocked out past txLen*/
+void Hal_SpiXfer(const uint8_t *pTx, uint16_t txLen, uint8_t *pRx, uint16_t rxLen)
+{
+	uint16_t len;
+	uint16_t i;
+	uint8_t miso;
+
+	len = (txLen > rxLen) ? txLen : rxLen;
+	for(i = 0; i < len; i++)
+	{
+		miso = Sim_SpiByte((i < txLen) ? pTx[i] : 0xFF);
+		if(i < rxLen)
+		{
+			pRx[i] = miso;
+		}
+	}
+
+	//bus time is accounted for once the transaction is over, registers do not move under it
+	if(spiRadio < HAL_RADIO_NUM)
+	{
+		Sim_AdvanceUs(len * HAL_SPI_BYTE_US);
+	}
+}
+
+/*dio*/
+
+bool Hal_DioIrqInit(uint8_t radio, pfnHalDioIrq_t handler)
+{
+	if(radio >= HAL_RADIO_NUM)
+	{
+		return false;
+	}
+
+	pfnDioIrq[radio] = handler;
+	dioEnabled[radio] = false;
+	dioLevel[radio] = Sim_GetDio0(radio);
+	return true;
+}
+
+void Hal_DioIrqEnable(uint8_t radio, bool onOff)
+{
+	dioEnabled[radio] = onOff;
+	dioLevel[radio] = Sim_GetDio0(radio);
+}
+
+void Hal_DioIrqUninit(uint8_t radio)
+{
+	dioEnabled[radio] = false;
+	pfnDioIrq[radio] = NULL;
+}
+
+/*clock*/
+
+uint64_t Hal_ClockUs(void)
+{
+	uint64_t us;
+
+	advance(HAL_CPU_US);
+	us = Sim_GetUs();
+	advance(Sim_CpuStallUs());
+	return us;
+}
+
+/*the simulated clock is us all the time*/
+void Hal_ClockFine(bool onOff)
+{
+	(void)onOff;
+}
+
+/*delay*/
+
+void Hal_DelayMs(uint32_t ms)
+{
+	while(ms--)
+	{
+		advance(1000);
+	}
+}
+
+void Hal_DelayUs(uint32_t us)
+{
+	advance(us);
+}
+
+/*BLE state, set by the test program to exercise the advertising paths*/
+
+void Hal_SetBleAdvertising(bool onOff)
+{
+	bleAdvertising = onOff;
+}
+
+bool Hal_IsBleAdvertising(void)
+{
+	return bleAdvertising;
+}
+
+void Hal_WdtFeed(void)
+{
+}
+
@@ -0,0 +1,415 @@
+/**
+ *@file hal_nrf52.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief nRF52840 backend of hal.h
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include "hal.h"
+#include "nrf.h"
+#include "boards.h"
+#include "nrf_gpio.h"
+#include "nrf_delay.h"
+#include "nrf_timer.h"
+#include "nrf_rtc.h"
+#include "nrf_gpiote.h"
+#include "nrf_drv_gpiote.h"
+#include "nrfx_spim.h"
+#include "nrf_soc.h"
+#include "isr_timing.h"
+#include "radio_backend.h"
+#include "subg_rfspy_spi.h"
+
+/*
+RFM69 modules: their own SPIM instance, bus, chip selects and DIO0 lines, all board
+specific. Define the pins in the board header or the project preprocessor definitions,
+there is no default that fits a board. The CC1110 link keeps its instance and pins
+(subg_rfspy_spi.h), an RFM69 build refuses to share them.
+*/
+#ifndef RF69_SPIM_INSTANCE
+#define RF69_SPIM_INSTANCE			1
+#endif
+
+#if RADIO_BACKEND != RADIO_BACKEND_CC1110
+#if !defined(RF69_SCK_PIN) || !defined(RF69_MOSI_PIN) || !defined(RF69_MISO_PIN) \
+	|| !defined(RF69_433_NSS_PIN) || !defined(RF69_916_NSS_PIN) || !defined(RF69_433_DIO0_PIN) || !defined(RF69_916_DIO0_PIN)
+#error "RFM69 backend: define RF69_SCK_PIN, RF69_MOSI_PIN, RF69_MISO_PIN, RF69_433/916_NSS_PIN and RF69_433/916_DIO0_PIN for this board"
+#endif
+
+#define RF69_PIN_IS_CC1110(pin)		((pin) == CC1110_SPI_SCK_PIN || (pin) == CC1110_SPI_MOSI_PIN || (pin) == CC1110_SPI_MISO_PIN \
+									 || (pin) == CC1110_SPI_SS_PIN || (pin) == CC1110_RESET_PIN || (pin) == SUBG_RFSPY_RECEIVE_INTERRUPT_PIN)
+#if RF69_PIN_IS_CC1110(RF69_SCK_PIN) || RF69_PIN_IS_CC1110(RF69_MOSI_PIN) || RF69_PIN_IS_CC1110(RF69_MISO_PIN) \
+	|| RF69_PIN_IS_CC1110(RF69_433_NSS_PIN) || RF69_PIN_IS_CC1110(RF69_916_NSS_PIN) \
+	|| RF69_PIN_IS_CC1110(RF69_433_DIO0_PIN) || RF69_PIN_IS_CC1110(RF69_916_DIO0_PIN)
+#error "RFM69 pins overlap the CC1110 link pins (subg_rfspy_spi.h)"
+#endif
+#if RF69_SPIM_INSTANCE == CC1110_SPIM_INSTANCE
+#error "RFM69 and CC1110 link on the same SPIM instance"
+#endif
+#else
+//a CC1110 build never brings the RFM69 bus up
+#define RF69_SCK_PIN				NRFX_SPIM_PIN_NOT_USED
+#define RF69_MOSI_PIN				NRFX_SPIM_PIN_NOT_USED
+#define RF69_MISO_PIN				NRFX_SPIM_PIN_NOT_USED
+#define RF69_433_NSS_PIN			NRFX_SPIM_PIN_NOT_USED
+#define RF69_916_NSS_PIN			NRFX_SPIM_PIN_NOT_USED
+#define RF69_433_DIO0_PIN			NRFX_SPIM_PIN_NOT_USED
+#define RF69_916_DIO0_PIN			NRFX_SPIM_PIN_NOT_USED
+#endif
+
+//RTC0 and TIMER0 belong to the SoftDevice, RTC1 to app_timer: RTC2 and TIMER3 are free in this project.
+//The time base is RTC2 at 32768Hz on the LFCLK the SoftDevice keeps running, it costs next to nothing.
+//Its 24-bit counter wraps every 512 s, the upper bits are kept in software and bumped on overflow.
+#define HAL_RTC						NRF_RTC2
+#define HAL_RTC_IRQn				RTC2_IRQn
+#define HAL_RTC_IRQ_PRIORITY		6
+#define HAL_RTC_COUNTER_MASK		0x00FFFFFFUL
+//1000000 / 32768 = 15625 / 512, ~30.5us per tick
+#define HAL_RTC_TICKS_TO_US(t)		(((t) * 15625ULL) >> 9)
+
+//TIMER3 at 1MHz adds the us within a tick, only while Hal_ClockFine is on: it keeps HFCLK running.
+//Every RTC tick clears it over PPI.
+#define HAL_TIMER					NRF_TIMER3
+#define HAL_CC_NOW					NRF_TIMER_CC_CHANNEL0	//software capture for Hal_ClockUs
+//reads of the timer spent waiting for the first tick, a few tick lengths
+#define HAL_FINE_SYNC_SPIN_MAX		200
+
+//PPI channel 0 is application owned when the SoftDevice is enabled
+#define HAL_PPI_CHANNEL				0
+
+static const nrfx_spim_t spiInst = NRFX_SPIM_INSTANCE(RF69_SPIM_INSTANCE);
+
+static const uint32_t nssPin[HAL_RADIO_NUM] = {RF69_433_NSS_PIN, RF69_916_NSS_PIN};
+static const uint32_t dio0Pin[HAL_RADIO_NUM] = {RF69_433_DIO0_PIN, RF69_916_DIO0_PIN};
+static pfnHalDioIrq_t pfnDioIrq[HAL_RADIO_NUM];
+
+static bool spiInit = false;
+static volatile uint32_t rtcOverflow = 0;
+static bool rtcInit = false;
+static volatile bool fineOn = false;
+static uint64_t lastUs = 0;
+static volatile bool bleAdvertising = false;
+
+/*spi*/
+
+/*
+the bus is set up on first use and kept: a register access is a few bytes, an
+init/uninit around each one cost more than the transfer itself
+*/
+static void spi_init(void)
+{
+	nrfx_spim_config_t spiCfg = NRFX_SPIM_DEFAULT_CONFIG;
+	uint8_t i;
+
+	for(i = 0; i < HAL_RADIO_NUM; i++)
+	{
+		nrf_gpio_pin_set(nssPin[i]);
+		nrf_gpio_cfg_output(nssPin[i]);
+	}
+
+	spiCfg.sck_pin = RF69_SCK_PIN;
+	spiCfg.mosi_pin = RF69_MOSI_PIN;
+	spiCfg.miso_pin = RF69_MISO_PIN;
+	spiCfg.ss_pin = NRFX_SPIM_PIN_NOT_USED;
+	spiCfg.frequency = NRF_SPIM_FREQ_4M;
+	spiCfg.mode = NRF_SPIM_MODE_0;
+	spiCfg.bit_order = NRF_SPIM_BIT_ORDER_MSB_FIRST;
+	//no handler: blocking transfers
+	spiInit = (nrfx_spim_init(&spiInst, &spiCfg, NULL, NULL) == NRFX_SUCCESS);
+}
+
+void Hal_SpiSelect(uint8_t radio)
+{
+	if(!spiInit)
+	{
+		spi_init();
+	}
+
+	if(radio < HAL_RADIO_NUM)
+	{
+		nrf_gpio_pin_clear(nssPin[radio]);
+	}
+}
+
+void Hal_SpiUnselect(uint8_t radio)
+{
+	if(radio < HAL_RADIO_NUM)
+	{
+		nrf_gpio_pin_set(nssPin[radio]);
+	}
+}
+
+void Hal_SpiXfer(const uint8_t *pTx, uint16_t txLen, uint8_t *pRx, uint16_t rxLen)
+{
+	nrfx_spim_xfer_desc_t xfer = NRFX_SPIM_XFER_TRX(pTx, txLen, pRx, rxLen);
+
+	nrfx_spim_xfer(&spiInst, &xfer, 0);
+}
+
+/*hand the pins back, e.g. after a probe found no RFM69 on the board*/
+void Hal_SpiRelease(void)
+{
+	uint8_t i;
+
+	if(!spiInit)
+	{
+		return;
+	}
+
+	nrfx_spim_uninit(&spiInst);
+	nrf_gpio_cfg_default(RF69_SCK_PIN);
+	nrf_gpio_cfg_default(RF69_MISO_PIN);
+	nrf_gpio_cfg_default(RF69_MOSI_PIN);
+	for(i = 0; i < HAL_RADIO_NUM; i++)
+	{
+		nrf_gpio_cfg_default(nssPin[i]);
+	}
+	spiInit = false;
+}
+
+/*dio*/
+
+static void dio_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
+{
+	uint32_t start = isr_timing_begin();
+	uint8_t radio;
+
+	for(radio = 0; radio < HAL_RADIO_NUM; radio++)
+	{
+		if(dio0Pin[radio] == pin && pfnDioIrq[radio] != NULL)
+		{
+			pfnDioIrq[radio](radio);
+		}
+	}
+	isr_timing_end(ISR_TIMING_RADIO_DIO, start);
+}
+
+bool Hal_DioIrqInit(uint8_t radio, pfnHalDioIrq_t handler)
+{
+	//PORT event (pin sense, LFCLK domain), an IN channel keeps HFCLK running through sleep
+	nrf_drv_gpiote_in_config_t inCfg = GPIOTE_CONFIG_IN_SENSE_LOTOHI(false);
+
+	if(!nrf_drv_gpiote_is_init() && nrf_drv_gpiote_init() != NRF_SUCCESS)
+	{
+		return false;
+	}
+
+	inCfg.pull = NRF_GPIO_PIN_NOPULL;
+	if(nrf_drv_gpiote_in_init(dio0Pin[radio], &inCfg, dio_handler) != NRF_SUCCESS)
+	{
+		return false;
+	}
+
+	pfnDioIrq[radio] = handler;
+	return true;
+}
+
+void Hal_DioIrqEnable(uint8_t radio, bool onOff)
+{
+	if(onOff)
+	{
+		nrf_drv_gpiote_in_event_enable(dio0Pin[radio], true);
+	}
+	else
+	{
+		nrf_drv_gpiote_in_event_disable(dio0Pin[radio]);
+	}
+}
+
+void Hal_DioIrqUninit(uint8_t radio)
+{
+	nrf_drv_gpiote_in_event_disable(dio0Pin[radio]);
+	nrf_drv_gpiote_in_uninit(dio0Pin[radio]);
+	pfnDioIrq[radio] = NULL;
+}
+
+/*clock*/
+
+void RTC2_IRQHandler(void)
+{
+	if(nrf_rtc_event_pending(HAL_RTC, NRF_RTC_EVENT_OVERFLOW))
+	{
+		nrf_rtc_event_clear(HAL_RTC, NRF_RTC_EVENT_OVERFLOW);
+		rtcOverflow++;
+	}
+}
+
+static void rtc_init(void)
+{
+	nrf_rtc_task_trigger(HAL_RTC, NRF_RTC_TASK_STOP);
+	nrf_rtc_task_trigger(HAL_RTC, NRF_RTC_TASK_CLEAR);
+	nrf_rtc_prescaler_set(HAL_RTC, 0);
+	nrf_rtc_event_clear(HAL_RTC, NRF_RTC_EVENT_OVERFLOW);
+	nrf_rtc_int_enable(HAL_RTC, NRF_RTC_INT_OVERFLOW_MASK);
+
+	NVIC_SetPriority(HAL_RTC_IRQn, HAL_RTC_IRQ_PRIORITY);
+	NVIC_ClearPendingIRQ(HAL_RTC_IRQn);
+	NVIC_EnableIRQ(HAL_RTC_IRQn);
+
+	rtcOverflow = 0;
+	nrf_rtc_task_trigger(HAL_RTC, NRF_RTC_TASK_START);
+	rtcInit = true;
+}
+
+/*RTC ticks since start, called with irqs masked*/
+static uint64_t rtc_ticks(void)
+{
+	uint32_t cnt;
+	uint32_t ovf;
+
+	cnt = nrf_rtc_counter_get(HAL_RTC);
+	ovf = rtcOverflow;
+	//overflow happened but the irq has not run yet (we are masking it)
+	if(nrf_rtc_event_pending(HAL_RTC, NRF_RTC_EVENT_OVERFLOW) && cnt < (HAL_RTC_COUNTER_MASK >> 1))
+	{
+		ovf++;
+	}
+
+	return ((uint64_t)ovf << 24) | cnt;
+}
+
+uint64_t Hal_ClockUs(void)
+{
+	uint64_t ticks;
+	uint64_t us;
+	uint32_t t1;
+	uint32_t t2;
+
+	if(!rtcInit)
+	{
+		rtc_init();
+	}
+
+	CRITICAL_REGION_ENTER();
+	if(fineOn)
+	{
+		nrf_timer_task_trigger(HAL_TIMER, NRF_TIMER_TASK_CAPTURE0);
+		t1 = nrf_timer_cc_read(HAL_TIMER, HAL_CC_NOW);
+		ticks = rtc_ticks();
+		nrf_timer_task_trigger(HAL_TIMER, NRF_TIMER_TASK_CAPTURE0);
+		t2 = nrf_timer_cc_read(HAL_TIMER, HAL_CC_NOW);
+		//a tick cleared the timer in between, the counter read may be from before it
+		if(t2 < t1)
+		{
+			ticks = rtc_ticks();
+		}
+		us = HAL_RTC_TICKS_TO_US(ticks) + t2;
+	}
+	else
+	{
+		us = HAL_RTC_TICKS_TO_US(rtc_ticks());
+	}
+	//switching between the two, or HFCLK a little fast within a tick, never turns the clock back
+	if(us < lastUs)
+	{
+		us = lastUs;
+	}
+	lastUs = us;
+	CRITICAL_REGION_EXIT();
+
+	return us;
+}
+
+/*
+TIMER3 on for us resolution, for the few windows that need it (timed tx, capture),
+off again to let HFCLK go. Started on an RTC tick, so it counts from one.
+*/
+void Hal_ClockFine(bool onOff)
+{
+	uint32_t evtAddr;
+	uint32_t taskAddr;
+	uint32_t t1;
+	uint32_t t2 = 0;
+	uint16_t spin = 0;
+
+	if(!rtcInit)
+	{
+		rtc_init();
+	}
+
+	if(onOff == fineOn)
+	{
+		return;
+	}
+
+	if(!onOff)
+	{
+		CRITICAL_REGION_ENTER();
+		fineOn = false;
+		CRITICAL_REGION_EXIT();
+		nrf_rtc_event_disable(HAL_RTC, RTC_EVTEN_TICK_Msk);
+		sd_ppi_channel_enable_clr(1UL << HAL_PPI_CHANNEL);
+		nrf_timer_task_trigger(HAL_TIMER, NRF_TIMER_TASK_STOP);
+		//STOP alone leaves HFCLK requested (errata 78)
+		nrf_timer_task_trigger(HAL_TIMER, NRF_TIMER_TASK_SHUTDOWN);
+		return;
+	}
+
+	nrf_timer_task_trigger(HAL_TIMER, NRF_TIMER_TASK_STOP);
+	nrf_timer_mode_set(HAL_TIMER, NRF_TIMER_MODE_TIMER);
+	nrf_timer_bit_width_set(HAL_TIMER, NRF_TIMER_BIT_WIDTH_32);
+	nrf_timer_frequency_set(HAL_TIMER, NRF_TIMER_FREQ_1MHz);
+
+	evtAddr = nrf_rtc_event_address_get(HAL_RTC, NRF_RTC_EVENT_TICK);
+	taskAddr = nrf_timer_task_address_get(HAL_TIMER, NRF_TIMER_TASK_CLEAR);
+	if(sd_ppi_channel_assign(HAL_PPI_CHANNEL, (const volatile void *)evtAddr, (const volatile void *)taskAddr) != NRF_SUCCESS)
+	{
+		return;
+	}
+	sd_ppi_channel_enable_set(1UL << HAL_PPI_CHANNEL);
+	nrf_rtc_event_enable(HAL_RTC, RTC_EVTEN_TICK_Msk);
+
+	nrf_timer_task_trigger(HAL_TIMER, NRF_TIMER_TASK_CLEAR);
+	nrf_timer_task_trigger(HAL_TIMER, NRF_TIMER_TASK_START);
+	//the first tick clears it, ~30us at most: until then the count is not from a tick
+	do
+	{
+		t1 = t2;
+		nrf_timer_task_trigger(HAL_TIMER, NRF_TIMER_TASK_CAPTURE0);
+		t2 = nrf_timer_cc_read(HAL_TIMER, HAL_CC_NOW);
+	}while(t2 >= t1 && ++spin < HAL_FINE_SYNC_SPIN_MAX);
+
+	CRITICAL_REGION_ENTER();
+	fineOn = true;
+	CRITICAL_REGION_EXIT();
+}
+
+/*delay*/
+
+void Hal_DelayMs(uint32_t ms)
+{
+	nrf_delay_ms(ms);
+}
+
+void Hal_DelayUs(uint32_t us)
+{
+	nrf_delay_us(us);
+}
+
+/*BLE state, kept up to date by the BLE event handler*/
+
+void Hal_SetBleAdvertising(bool onOff)
+{
+	bleAdvertising = onOff;
+}
+
+bool Hal_IsBleAdvertising(void)
+{
+	return bleAdvertising;
+}
+
+/*watchdog, reloading a channel that is not running is harmless*/
+
+void Hal_WdtFeed(void)
+{
+	NRF_WDT->RR[0] = WDT_RR_RR_Reload;
+}
+
@@ -0,0 +1,61 @@
+#include <string.h>
+
+#include "nrf_log.h"
+#include "app_util_platform.h"
+
+#include "isr_timing.h"
+
+static isr_timing_stats_t m_stats[ISR_TIMING_NUM];
+static volatile bool m_new_max = false;
+
+static uint32_t cycles_to_us(uint32_t cycles)
+{
+    return cycles / (SystemCoreClock / 1000000);
+}
+
+void isr_timing_init(void)
+{
+    memset(m_stats, 0, sizeof(m_stats));
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+// All timed handlers run at APP_IRQ_PRIORITY_LOW and can't preempt each other
+void isr_timing_end(isr_timing_src_t src, uint32_t start)
+{
+    uint32_t cycles = DWT->CYCCNT - start;
+
+    m_stats[src].count++;
+    if (cycles > m_stats[src].max_cycles) {
+        m_stats[src].max_cycles = cycles;
+        m_new_max = true;
+    }
+}
+
+void isr_timing_get(isr_timing_src_t src, isr_timing_stats_t *p_stats)
+{
+    CRITICAL_REGION_ENTER();
+    *p_stats = m_stats[src];
+    CRITICAL_REGION_EXIT();
+}
+
+// Main loop: log every new worst case
+void isr_timing_process(void)
+{
+    isr_timing_stats_t stats[ISR_TIMING_NUM];
+
+    if (!m_new_max) {
+        return;
+    }
+
+    CRITICAL_REGION_ENTER();
+    memcpy(stats, m_stats, sizeof(stats));
+    m_new_max = false;
+    CRITICAL_REGION_EXIT();
+
+    NRF_LOG_INFO("ISR worst case: spim %d us (%d), data ready %d us (%d), dio %d us (%d)",
+                 cycles_to_us(stats[ISR_TIMING_SPIM].max_cycles), stats[ISR_TIMING_SPIM].count,
+                 cycles_to_us(stats[ISR_TIMING_DATA_READY].max_cycles), stats[ISR_TIMING_DATA_READY].count,
+                 cycles_to_us(stats[ISR_TIMING_RADIO_DIO].max_cycles), stats[ISR_TIMING_RADIO_DIO].count);
+}
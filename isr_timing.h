@@ -0,0 +1,32 @@
+#ifndef ISR_TIMING_H
+#define ISR_TIMING_H
+
+#include <stdint.h>
+#include "nrf.h"
+
+// Worst case duration of our own interrupt handlers, counted with the DWT cycle counter.
+// The handlers only hand their event to app_scheduler, the work runs from the main loop.
+
+typedef enum {
+    ISR_TIMING_SPIM,        // CC1110 SPI transfer done
+    ISR_TIMING_DATA_READY,  // CC1110 has a response for us (GPIOTE)
+    ISR_TIMING_RADIO_DIO,   // RFM69 DIO0 (GPIOTE)
+    ISR_TIMING_NUM
+} isr_timing_src_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t max_cycles;
+} isr_timing_stats_t;
+
+void isr_timing_init(void);
+void isr_timing_end(isr_timing_src_t src, uint32_t start);
+void isr_timing_get(isr_timing_src_t src, isr_timing_stats_t *p_stats);
+void isr_timing_process(void);
+
+static inline uint32_t isr_timing_begin(void)
+{
+    return DWT->CYCCNT;
+}
+
+#endif // ISR_TIMING_H
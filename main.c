@@ -24,16 +24,20 @@
 #include "nrf_pwr_mgmt.h"
 #include "nrf_drv_gpiote.h"
 #include "nrf_delay.h"
+#include "app_scheduler.h"
 
 #include "nrf_log.h"
 #include "nrf_log_ctrl.h"
 #include "nrf_log_default_backends.h"
 
 #include "rileylink_service.h"
-#include "subg_rfspy_spi.h"
+#include "radio_backend.h"
 #include "data_relay.h"
+#include "hal.h"
 #include "led_mode_handlers.h"
 #include "rileylink_config.h"
+#include "isr_timing.h"
+#include "subg_rfspy_spi.h"
 
 #define MANUFACTURER_NAME               "Pete Schwamb"                          /**< Manufacturer. Will be passed to Device Information Service. */
 
@@ -63,6 +67,9 @@
 
 #define DEAD_BEEF                       0xDEADBEEF                              /**< Value used as error code on stack dump, can be used to identify stack location on stack unwind. */
 
+#define SCHED_MAX_EVENT_DATA_SIZE       APP_TIMER_SCHED_EVENT_DATA_SIZE         /**< Maximum size of scheduler events. */
+#define SCHED_QUEUE_SIZE                SUBG_RFSPY_SPI_SCHED_EVENTS             /**< The CC1110 SPI pipeline is the only producer (app timers and SoftDevice events don't use the scheduler). */
+
 NRF_BLE_GATT_DEF(m_gatt);                                                       /**< GATT module instance. */
 NRF_BLE_QWR_DEF(m_qwr);                                                         /**< Context for the Queued Write module.*/
 BLE_ADVERTISING_DEF(m_advertising);                                             /**< Advertising module instance. */
@@ -76,6 +83,7 @@ BLE_RILEYLINK_SERVICE_DEF(m_rileylink_service);
 
 
 static uint16_t m_conn_handle = BLE_CONN_HANDLE_INVALID;                        /**< Handle of the current connection. */
+static const radio_backend_t *m_radio_backend;                                  /**< Radio running the subg_rfspy commands. */
 
 /* YOUR_JOB: Declare all services structure your application is using
  *  BLE_XYZ_DEF(m_xyz);
@@ -225,6 +233,8 @@ static void services_init(void)
     nrf_ble_qwr_init_t qwr_init = {0};
     ble_rileylink_service_init_t rileylink_init;
 
+    memset(&rileylink_init, 0, sizeof(rileylink_init));
+
     // Initialize Queued Write Module.
     qwr_init.error_handler = nrf_qwr_error_handler;
 
@@ -234,6 +244,12 @@ static void services_init(void)
     // 1. Initialize the RileyLink service
     rileylink_init.led_mode_write_handler = led_mode_write_handler;
     rileylink_init.data_write_handler = data_relay_ble_write_handler;
+    if (m_radio_backend->get_stats != NULL)
+    {
+        rileylink_init.p_radio_stats = m_radio_backend->get_stats(&rileylink_init.radio_stats_len);
+        rileylink_init.radio_stats_reset_handler = m_radio_backend->reset_stats;
+    }
+    rileylink_init.radio_config_write_handler = m_radio_backend->config_write;
     err_code = ble_rileylink_service_init(&m_rileylink_service, &rileylink_init, name_changed);
     APP_ERROR_CHECK(err_code);
 }
@@ -335,9 +351,11 @@ static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
     {
         case BLE_ADV_EVT_FAST:
             NRF_LOG_INFO("Fast advertising.");
+            Hal_SetBleAdvertising(true);
             break;
 
         case BLE_ADV_EVT_IDLE:
+            Hal_SetBleAdvertising(false);
             sleep_mode_enter();
             break;
 
@@ -365,6 +383,7 @@ static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
 
         case BLE_GAP_EVT_CONNECTED:
             NRF_LOG_INFO("Connected.");
+            Hal_SetBleAdvertising(false);
             m_conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
             err_code = nrf_ble_qwr_conn_handle_assign(&m_qwr, m_conn_handle);
             APP_ERROR_CHECK(err_code);
@@ -517,6 +536,18 @@ static void log_init(void)
 }
 
 
+/**@brief Function for initializing the event scheduler.
+ *
+ * @details Interrupt handlers of our own (SPIM, GPIOTE, RTC2) run at APP_IRQ_PRIORITY_LOW and
+ *          only queue events; SoftDevice events run at their own priority. The work behind both
+ *          runs from the main loop.
+ */
+static void scheduler_init(void)
+{
+    APP_SCHED_INIT(SCHED_MAX_EVENT_DATA_SIZE, SCHED_QUEUE_SIZE);
+}
+
+
 /**@brief Function for initializing power management.
  */
 static void power_management_init(void)
@@ -559,26 +590,13 @@ static void advertising_start(bool erase_bonds)
     }
 }
 
-void in_pin_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
-{
-    subg_rfspy_spi_data_available();
-}
-
 static void gpio_init(void)
 {
     ret_code_t err_code;
 
+    // Pins are set up by the radio backend
     err_code = nrf_drv_gpiote_init();
     APP_ERROR_CHECK(err_code);
-
-    // TODO: Do we need hi_accu?
-    nrf_drv_gpiote_in_config_t in_config = GPIOTE_CONFIG_IN_SENSE_LOTOHI(true);
-    in_config.pull = NRF_GPIO_PIN_NOPULL;
-
-    err_code = nrf_drv_gpiote_in_init(SUBG_RFSPY_RECEIVE_INTERRUPT_PIN, &in_config, in_pin_handler);
-    APP_ERROR_CHECK(err_code);
-
-    nrf_drv_gpiote_in_event_enable(SUBG_RFSPY_RECEIVE_INTERRUPT_PIN, true);
 }
 
 static void name_changed() {
@@ -601,6 +619,10 @@ static void name_changed() {
 static void rileylink_config_ready(bool succeeded) {
     if (succeeded && rileylink_config.custom_name_len > 0) {
         NRF_LOG_INFO("rileylink_config_ready");
+        Afc_Init(rileylink_config.freq_offsets, rileylink_config_save);
+        Subg_SyncFilterInit(rileylink_config.sync_filters, rileylink_config_save);
+        Minimed_Init(rileylink_config.pump_regions, rileylink_config_save);
+        Tcomp_Init(rileylink_config.tcomp_curves, rileylink_config_save);
     } else {
         NRF_LOG_ERROR("Config invalid.");
         app_error_save_and_stop(0x1234, 0, 0);
@@ -615,13 +637,9 @@ int main(void)
 
     // Initialize.
     log_init();
+    isr_timing_init();
     timers_init();
-
-    // Control CC1110 reset
-    nrf_gpio_pin_clear(CC1110_RESET_PIN);
-    nrf_gpio_cfg_output(CC1110_RESET_PIN);
-    nrf_delay_ms(3);
-    nrf_gpio_pin_set(CC1110_RESET_PIN);
+    scheduler_init();
 
     // Turn on blue LED
     nrf_gpio_pin_clear(28);
@@ -630,6 +648,7 @@ int main(void)
 
     rileylink_config_init(rileylink_config_ready);
     gpio_init();
+    m_radio_backend = radio_backend_select();
     power_management_init();
     ble_stack_init();
     gap_params_init();
@@ -638,8 +657,7 @@ int main(void)
     advertising_init();
     conn_params_init();
     peer_manager_init();
-    data_relay_init(&m_rileylink_service);
-    subg_rfspy_spi_init(data_relay_spi_response_handler);
+    data_relay_init(&m_rileylink_service, m_radio_backend);
 
     // Start execution.
     NRF_LOG_INFO("RileyLink 2.0 started.");
@@ -650,6 +668,9 @@ int main(void)
     // Enter main loop.
     for (;;)
     {
+        app_sched_execute();
+        data_relay_process();
+        isr_timing_process();
         idle_state_handle();
     }
 }
@@ -0,0 +1,223 @@
+/**
+ *@file pod_sim.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief Omnipod link layer of a pod, answering on the SX1231 simulator
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <string.h>
+
+#include "pod_sim.h"
+#include "app_omnipod.h"
+#include "app_codec.h"
+
+/*
+Hooks the simulator's transmitter: every frame the 433 radio sends is decoded and
+answered the way a pod does (app_omnipod.c has the sequence rules), the answer is
+injected replyDelayUs later. A packet heard twice gets the last answer again.
+Losses are deterministic, every Nth packet, so runs can be compared.
+*/
+
+#define POD_SIM_RADIO			0			//433MHz
+#define POD_SIM_SEQ_NONE		0xFF
+
+static sPodSimCfg_t podCfg;
+static sPodSimStats_t podStats;
+static uint8_t lastRxSeq = POD_SIM_SEQ_NONE;
+static uint8_t rxMsg[OMNIPOD_MSG_MAX_LEN];
+static uint16_t rxLen = 0;
+static uint8_t rspMsg[OMNIPOD_MSG_MAX_LEN];
+static uint16_t rspLen = 0;
+static uint16_t rspPos = 0;
+static uint8_t lastTx[OMNIPOD_PKT_MAX_LEN * 2 + 1];
+static uint16_t lastTxLen = 0;
+static uint32_t lastCarrierHz = 0;
+
+static void pod_inject(void)
+{
+	if(lastTxLen == 0)
+	{
+		return;
+	}
+
+	podStats.txPktCnt++;
+	if(podCfg.dropTxEvery != 0 && podStats.txPktCnt % podCfg.dropTxEvery == 0)
+	{
+		podStats.txDropCnt++;
+		return;
+	}
+	Sim_InjectPkt(POD_SIM_RADIO, Sim_GetUs() + podCfg.replyDelayUs, lastCarrierHz, podCfg.rssi, lastTx, lastTxLen);
+}
+
+static void pod_send(uint8_t type, uint8_t seq, const uint8_t *pBody, uint8_t bodyLen)
+{
+	uint8_t pkt[OMNIPOD_PKT_MAX_LEN];
+	uint16_t len = OMNIPOD_PKT_HDR_LEN + bodyLen;
+
+	pkt[0] = (uint8_t)(podCfg.address >> 24);
+	pkt[1] = (uint8_t)(podCfg.address >> 16);
+	pkt[2] = (uint8_t)(podCfg.address >> 8);
+	pkt[3] = (uint8_t)podCfg.address;
+	pkt[OMNIPOD_ADDR_LEN] = (uint8_t)(type << 5) | (seq & OMNIPOD_SEQ_MASK);
+	memcpy(pkt + OMNIPOD_PKT_HDR_LEN, pBody, bodyLen);
+	pkt[len] = Omnipod_Crc8(pkt, len);
+
+	//an invalid Manchester pair after the packet, like the radio's end of transmission
+	lastTxLen = Codec_Encode(CODEC_MANCHESTER, pkt, len + 1, lastTx, sizeof(lastTx) - 1, false);
+	lastTx[lastTxLen++] = 0xFF;
+	pod_inject();
+}
+
+static void pod_send_rsp(uint8_t type, uint8_t seq)
+{
+	uint8_t chunk;
+
+	chunk = (rspLen - rspPos > OMNIPOD_PKT_BODY_MAX) ? OMNIPOD_PKT_BODY_MAX : (uint8_t)(rspLen - rspPos);
+	pod_send(type, seq, rspMsg + rspPos, chunk);
+	rspPos += chunk;
+}
+
+static void pod_rx_msg(const uint8_t *pBody, uint8_t bodyLen, uint8_t seq)
+{
+	uint8_t ack[OMNIPOD_ADDR_LEN];
+
+	if(rxLen + bodyLen > sizeof(rxMsg))
+	{
+		rxLen = 0;
+		return;
+	}
+	memcpy(rxMsg + rxLen, pBody, bodyLen);
+	rxLen += bodyLen;
+
+	if(rxLen < OMNIPOD_MSG_HDR_LEN || rxLen < Omnipod_MsgLen(rxMsg))
+	{
+		memcpy(ack, rxMsg, OMNIPOD_ADDR_LEN);
+		pod_send(OMNIPOD_PKT_ACK, seq + 1, ack, sizeof(ack));
+		return;
+	}
+
+	podStats.msgCnt++;
+	if(podCfg.respond != NULL)
+	{
+		rspLen = podCfg.respond(rxMsg, rxLen, rspMsg, sizeof(rspMsg));
+	}
+	else
+	{
+		memcpy(rspMsg, rxMsg, rxLen);
+		rspLen = rxLen;
+	}
+	rspPos = 0;
+	pod_send_rsp(OMNIPOD_PKT_POD, seq + 1);
+}
+
+static void pod_tx_hook(uint8_t radio, uint32_t carrierHz, const uint8_t *pData, uint16_t len)
+{
+	uint8_t pkt[OMNIPOD_PKT_MAX_LEN];
+	uint16_t pktLen;
+	uint16_t i;
+	uint8_t type;
+	uint8_t seq;
+	uint32_t addr;
+
+	if(radio != POD_SIM_RADIO)
+	{
+		return;
+	}
+
+	//preamble, then the 0xA5 0x5A the driver puts in front of the payload
+	for(i = 0; i + 1 < len; i++)
+	{
+		if(pData[i] == 0xA5 && pData[i + 1] == 0x5A)
+		{
+			break;
+		}
+	}
+	if(i + 1 >= len)
+	{
+		return;
+	}
+
+	pktLen = Codec_Decode(CODEC_MANCHESTER, pData + i + 2, len - i - 2, pkt, sizeof(pkt));
+	if(pktLen < OMNIPOD_PKT_HDR_LEN + 1 || Omnipod_Crc8(pkt, pktLen - 1) != pkt[pktLen - 1])
+	{
+		return;
+	}
+	addr = ((uint32_t)pkt[0] << 24) | ((uint32_t)pkt[1] << 16) | ((uint32_t)pkt[2] << 8) | pkt[3];
+	if(addr != podCfg.address)
+	{
+		return;
+	}
+
+	podStats.rxPktCnt++;
+	if(podCfg.dropRxEvery != 0 && podStats.rxPktCnt % podCfg.dropRxEvery == 0)
+	{
+		podStats.rxDropCnt++;
+		return;
+	}
+
+	lastCarrierHz = carrierHz;
+	type = pkt[OMNIPOD_ADDR_LEN] >> 5;
+	seq = pkt[OMNIPOD_ADDR_LEN] & OMNIPOD_SEQ_MASK;
+	pktLen -= OMNIPOD_PKT_HDR_LEN + 1;
+
+	if(seq == lastRxSeq)
+	{
+		podStats.dupCnt++;
+		pod_inject();
+		return;
+	}
+	lastRxSeq = seq;
+
+	switch(type)
+	{
+		case OMNIPOD_PKT_PDM:
+			rxLen = 0;
+			pod_rx_msg(pkt + OMNIPOD_PKT_HDR_LEN, (uint8_t)pktLen, seq);
+			break;
+
+		case OMNIPOD_PKT_CON:
+			pod_rx_msg(pkt + OMNIPOD_PKT_HDR_LEN, (uint8_t)pktLen, seq);
+			break;
+
+		case OMNIPOD_PKT_ACK:
+			//acked to address 0: exchange over, stay quiet
+			if(pktLen >= OMNIPOD_ADDR_LEN && memcmp(pkt + OMNIPOD_PKT_HDR_LEN, "\0\0\0\0", OMNIPOD_ADDR_LEN) == 0)
+			{
+				lastTxLen = 0;
+			}
+			else if(rspPos < rspLen)
+			{
+				pod_send_rsp(OMNIPOD_PKT_CON, seq + 1);
+			}
+			break;
+
+		default:
+			break;
+	}
+}
+
+void PodSim_Init(const sPodSimCfg_t *pCfg)
+{
+	podCfg = *pCfg;
+	memset(&podStats, 0, sizeof(podStats));
+	lastRxSeq = POD_SIM_SEQ_NONE;
+	rxLen = 0;
+	rspLen = 0;
+	rspPos = 0;
+	lastTxLen = 0;
+	Sim_SetTxHook(pod_tx_hook);
+}
+
+void PodSim_GetStats(sPodSimStats_t *pStats)
+{
+	*pStats = podStats;
+}
+
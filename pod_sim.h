@@ -0,0 +1,57 @@
+/**
+ *@file pod_sim.h
+ *@author Ribin Huang (you@domain.com)
+ *@brief Omnipod link layer of a pod, answering on the SX1231 simulator
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __POD_SIM_H__
+#define __POD_SIM_H__
+#include <stdint.h>
+#include <stdbool.h>
+#include "sx1231_sim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//builds the pod's reply to a complete message, returns its length. Echoes the message when not set.
+typedef uint16_t (*pfnPodSimRespond_t)(const uint8_t *pMsg, uint16_t len, uint8_t *pRsp, uint16_t size);
+
+typedef struct
+{
+	uint32_t address;
+	uint32_t replyDelayUs;		//end of the PDM's packet -> start of the pod's answer
+	int16_t rssi;
+	uint16_t dropRxEvery;		//every Nth packet sent to the pod is not heard, 0 = none
+	uint16_t dropTxEvery;		//every Nth packet of the pod never arrives, 0 = none
+	pfnPodSimRespond_t respond;
+}sPodSimCfg_t;
+
+typedef struct
+{
+	uint32_t rxPktCnt;			//packets to our address with a good CRC
+	uint32_t txPktCnt;
+	uint32_t rxDropCnt;
+	uint32_t txDropCnt;
+	uint32_t dupCnt;			//packets heard twice, the last answer went out again
+	uint32_t msgCnt;			//complete messages received
+}sPodSimStats_t;
+
+void PodSim_Init(const sPodSimCfg_t *pCfg);
+void PodSim_GetStats(sPodSimStats_t *pStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
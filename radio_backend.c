@@ -0,0 +1,21 @@
+#include "nrf_log.h"
+
+#include "radio_backend.h"
+#include "hal.h"
+
+const radio_backend_t *radio_backend_select(void)
+{
+#if RADIO_BACKEND == RADIO_BACKEND_RFM69
+    return &radio_backend_rfm69;
+#elif RADIO_BACKEND == RADIO_BACKEND_AUTO
+    if (radio_backend_rfm69.probe()) {
+        NRF_LOG_INFO("RFM69 found, running subg_rfspy natively.");
+        return &radio_backend_rfm69;
+    }
+    // no module on the RFM69 bus, its SPIM instance and pins are not needed
+    Hal_SpiRelease();
+    return &radio_backend_cc1110;
+#else
+    return &radio_backend_cc1110;
+#endif
+}
@@ -0,0 +1,40 @@
+#ifndef RADIO_BACKEND_H
+#define RADIO_BACKEND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// The radio behind the DATA characteristic. Both backends run subg_rfspy commands
+// (subg_rfspy_protocol.h): the CC1110 one relays them over SPI to the CC1110 firmware,
+// the RFM69 one executes them on the nRF52 against app_subg.
+
+#define RADIO_BACKEND_CC1110    0
+#define RADIO_BACKEND_RFM69     1
+#define RADIO_BACKEND_AUTO      2   // RFM69 if one answers on its SPI bus at boot, CC1110 otherwise
+
+// Set in the project preprocessor definitions for boards with RFM69 modules
+#ifndef RADIO_BACKEND
+#define RADIO_BACKEND RADIO_BACKEND_CC1110
+#endif
+
+// Called from the main loop by both backends, never from interrupt context
+typedef void (radio_backend_response_handler_t) (const uint8_t *data, uint8_t len);
+
+typedef struct
+{
+    const char *name;
+    bool (*probe)(void);                                                // NULL: always there
+    void (*init)(radio_backend_response_handler_t *response_handler);
+    void (*run_command)(const uint8_t *data, uint8_t data_len);         // may be called from BLE event context
+    void (*process)(void);                                              // main loop, NULL if not needed
+    const uint8_t *(*get_stats)(uint16_t *p_len);                       // Radio Stats characteristic, NULL to leave it out
+    void (*reset_stats)(void);
+    void (*config_write)(const uint8_t *data, uint16_t length);         // Radio Config characteristic, NULL to leave it out
+} radio_backend_t;
+
+extern const radio_backend_t radio_backend_cc1110;
+extern const radio_backend_t radio_backend_rfm69;
+
+const radio_backend_t *radio_backend_select(void);
+
+#endif // RADIO_BACKEND_H
@@ -0,0 +1,44 @@
+#include "nrf_gpio.h"
+#include "nrf_delay.h"
+#include "nrf_drv_gpiote.h"
+#include "app_error.h"
+
+#include "radio_backend.h"
+#include "subg_rfspy_spi.h"
+#include "isr_timing.h"
+
+static void in_pin_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
+{
+    uint32_t start = isr_timing_begin();
+
+    subg_rfspy_spi_data_available();
+    isr_timing_end(ISR_TIMING_DATA_READY, start);
+}
+
+static void cc1110_init(radio_backend_response_handler_t *response_handler)
+{
+    ret_code_t err_code;
+
+    // Reset the CC1110, this also drops anything a boot time probe left on its SPI
+    nrf_gpio_pin_clear(CC1110_RESET_PIN);
+    nrf_gpio_cfg_output(CC1110_RESET_PIN);
+    nrf_delay_ms(3);
+    nrf_gpio_pin_set(CC1110_RESET_PIN);
+
+    // TODO: Do we need hi_accu?
+    nrf_drv_gpiote_in_config_t in_config = GPIOTE_CONFIG_IN_SENSE_LOTOHI(true);
+    in_config.pull = NRF_GPIO_PIN_NOPULL;
+
+    err_code = nrf_drv_gpiote_in_init(SUBG_RFSPY_RECEIVE_INTERRUPT_PIN, &in_config, in_pin_handler);
+    APP_ERROR_CHECK(err_code);
+
+    nrf_drv_gpiote_in_event_enable(SUBG_RFSPY_RECEIVE_INTERRUPT_PIN, true);
+
+    subg_rfspy_spi_init(response_handler);
+}
+
+const radio_backend_t radio_backend_cc1110 = {
+    .name        = "CC1110",
+    .init        = cc1110_init,
+    .run_command = subg_rfspy_spi_run_command,
+};
@@ -0,0 +1,162 @@
+#include <string.h>
+
+#include "hal.h"
+#include "radio_backend.h"
+#include "subg_rfspy_protocol.h"
+#include "subg_rfspy_native.h"
+#include "app_subg.h"
+#include "app_capture.h"
+#include "app_bcast.h"
+#include "rf69.h"
+
+// Commands run from the main loop, never from the BLE event that delivered them: a
+// get_packet blocks for its whole timeout. A command arriving while another one runs
+// interrupts it, which then answers SUBG_RFSPY_RESPONSE_CMD_INTERRUPTED like the CC1110.
+// One that replaces a command still waiting for the main loop gets the same answer for it.
+// Capture and broadcast listening run as background operations and give way to any
+// command. A history download or a background start is not cut short by a regular
+// command, which waits for it; a send to the pump (e.g. a suspend) and a reset get
+// through everything.
+
+#define RFM69_BUF_LEN           255
+
+static radio_backend_response_handler_t *m_response_handler = NULL;
+
+static uint8_t m_cmd_buf[RFM69_BUF_LEN];
+static uint8_t m_cmd_len;
+static volatile bool m_cmd_pending = false;
+static volatile uint8_t m_cmd_dropped = 0;      // pending commands replaced before they ran
+static volatile eSubgPrio_t m_cmd_prio;
+static volatile SubgOpHandle_t m_op = SUBG_OP_NONE;
+static volatile eSubgPrio_t m_op_prio;
+
+static bool rfm69_probe(void)
+{
+    return Rf69_IsPresent(RF69_DEV_FREQ433) || Rf69_IsPresent(RF69_DEV_FREQ916N868);
+}
+
+static void rfm69_init(radio_backend_response_handler_t *response_handler)
+{
+    m_response_handler = response_handler;
+    Subg_Init();
+    subg_rfspy_native_init(response_handler);
+    NRF_LOG_INFO("RFM69 backend started.");
+}
+
+static eSubgPrio_t cmd_prio(uint8_t opcode)
+{
+    switch (opcode) {
+    case SUBG_RFSPY_CMD_RESET:
+    case SUBG_RFSPY_CMD_SEND_PACKET:
+    case SUBG_RFSPY_CMD_SEND_AND_LISTEN:
+        return SUBG_PRIO_URGENT;
+    case SUBG_RFSPY_CMD_READ_HISTORY_PAGE:
+    case SUBG_RFSPY_CMD_BROADCAST_LISTEN:
+    case SUBG_RFSPY_CMD_CAPTURE:
+        return SUBG_PRIO_BULK;
+    default:
+        return SUBG_PRIO_NORMAL;
+    }
+}
+
+static void rfm69_run_command(const uint8_t *data, uint8_t data_len)
+{
+    SubgOpHandle_t op;
+    eSubgPrio_t op_prio;
+    eSubgPrio_t prio;
+
+    if (data_len == 0) {
+        return;
+    }
+    prio = cmd_prio(data[0]);
+
+    CRITICAL_REGION_ENTER();
+    if (m_cmd_pending) {
+        m_cmd_dropped++;
+    }
+    memcpy(m_cmd_buf, data, data_len);
+    m_cmd_len = data_len;
+    m_cmd_prio = prio;
+    m_cmd_pending = true;
+    op = m_op;
+    op_prio = m_op_prio;
+    CRITICAL_REGION_EXIT();
+
+    // lower priority work is preempted, a command of the same priority is replaced (newest wins),
+    // a higher priority one is left to finish and this one waits for it
+    if (!Subg_OpPreempt(prio) && op != SUBG_OP_NONE && op_prio == prio) {
+        Subg_OpCancel(op);
+    }
+}
+
+static void rfm69_process(void)
+{
+    uint8_t cmd[RFM69_BUF_LEN];
+    uint8_t len;
+    eSubgPrio_t prio;
+    uint8_t dropped;
+    uint8_t code = SUBG_RFSPY_RESPONSE_CMD_INTERRUPTED;
+    SubgOpHandle_t op;
+
+    Subg_Poll();
+    Capture_Process();
+    Bcast_Process();
+
+    if (!m_cmd_pending) {
+        return;
+    }
+
+    CRITICAL_REGION_ENTER();
+    len = m_cmd_len;
+    memcpy(cmd, m_cmd_buf, len);
+    prio = m_cmd_prio;
+    m_cmd_pending = false;
+    dropped = m_cmd_dropped;
+    m_cmd_dropped = 0;
+    CRITICAL_REGION_EXIT();
+
+    // the app gets one answer per command, in order
+    while (dropped > 0) {
+        m_response_handler(&code, 1);
+        dropped--;
+    }
+
+    op = Subg_OpBegin(prio);
+    if (op == SUBG_OP_NONE) {
+        m_response_handler(&code, 1);
+        return;
+    }
+    m_op_prio = prio;
+    m_op = op;
+
+    NRF_LOG_INFO("Running command:");
+    NRF_LOG_HEXDUMP_INFO(cmd, len);
+    subg_rfspy_native_run(cmd, len);
+
+    m_op = SUBG_OP_NONE;
+    Subg_OpEnd(op);
+}
+
+static const uint8_t *rfm69_get_stats(uint16_t *p_len)
+{
+    *p_len = Subg_GetStatsSize();
+    return (const uint8_t *)Subg_GetStats();
+}
+
+static void rfm69_config_write(const uint8_t *data, uint16_t length)
+{
+    if (!Subg_SetCfgBytes(data, length)) {
+        NRF_LOG_WARNING("Radio config rejected.");
+    }
+}
+
+const radio_backend_t radio_backend_rfm69 = {
+    .name         = "RFM69",
+    .probe        = rfm69_probe,
+    .init         = rfm69_init,
+    .run_command  = rfm69_run_command,
+    .process      = rfm69_process,
+    .get_stats    = rfm69_get_stats,
+    .reset_stats  = Subg_ClrStats,
+    .config_write = rfm69_config_write,
+};
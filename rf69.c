@@ -17,30 +17,29 @@
  
 #include "rf69.h"
 #include "rf69_regisers.h"
-#include "nrf_gpio.h"
-#include "boards.h"
-#include "nrf_drv_spi.h"
-
-#define RF69_FSTEP 	61.03515625
+#include "app_trace.h"
+#include "hal.h"
+
+//FSTEP = FXOSC / 2^19 (61.03515625 Hz), kept in integer math
+#define RF69_FXOSC				32000000UL
+#define RF69_FSTEP_SHIFT		19
+//PLL lock after a hop, TS_HOP is 20..80 us depending on the step
+#define RF69_PLL_LOCK_TIMEOUT_US	500
+#define RF69_LISTEN_RESOL_NUM	3
+#define RF69_TEMP_COEF			165		//degC = RF69_TEMP_COEF - RegTemp2, about 1 degC per LSB, uncalibrated
+#define RF69_TEMP_POLL_CNT		50		//the measurement takes < 100us
+
+//RegTestPa1/2, +20dBm settings only while transmitting (SX1231H 3.3.7)
+#define RF69_TESTPA1_NORMAL		0x55
+#define RF69_TESTPA1_BOOST		0x5D
+#define RF69_TESTPA2_NORMAL		0x70
+#define RF69_TESTPA2_BOOST		0x7C
 
 #define TAG	"RFM"
 
-static const nrf_drv_spi_t spiInst = NRF_DRV_SPI_INSTANCE(SPI_INSTANCE);
-static nrf_drv_spi_config_t spiCfg = 
-{                                                            \
-    .sck_pin      = SPI_SCLK_PIN,                            \
-    .mosi_pin     = SPI_MOSI_PIN,                            \
-    .miso_pin     = SPI_MISO_PIN,                            \
-    .ss_pin       = NRF_DRV_SPI_PIN_NOT_USED,                \
-    .irq_priority = SPI_DEFAULT_CONFIG_IRQ_PRIORITY,         \
-    .orc          = 0xFF,                                    \
-    .frequency    = NRF_DRV_SPI_FREQ_4M,                     \
-    .mode         = NRF_DRV_SPI_MODE_0,                      \
-    .bit_order    = NRF_DRV_SPI_BIT_ORDER_MSB_FIRST,         \
-};
-
 static eRf69Mode_t freq433DevMode = RF69_MODE_NONE;
 static eRf69Mode_t freq916n868DevMode = RF69_MODE_NONE;
+static bool paBoost[2] = {false, false};	//indexed by eRf69Dev_t
 
 static uint8_t freq916CfgTbl[][2] =
 {
@@ -175,58 +174,15 @@ static uint8_t freq433CfgTbl[][2] =
 	{255, 0}
 };
 
-static void spi_select(eRf69Dev_t dev)
-{
-    nrf_drv_spi_init(&spiInst, &spiCfg, NULL, NULL);
-
-	switch(dev)
-	{
-		case RF69_DEV_FREQ433:
-			nrf_gpio_cfg_output(SPI_NSS_0_PIN);
-			nrf_gpio_pin_clear(SPI_NSS_0_PIN);
-			break;
-
-		case RF69_DEV_FREQ916N868:
-			nrf_gpio_cfg_output(SPI_NSS_1_PIN);
-			nrf_gpio_pin_clear(SPI_NSS_1_PIN);
-			break;
-
-		default:
-			break;
-	}
-}
-
-static void spi_unselect(eRf69Dev_t dev)
-{
-	switch(dev)
-	{
-		case RF69_DEV_FREQ433:
-			nrf_gpio_cfg_default(SPI_NSS_0_PIN);  
-			break;
-
-		case RF69_DEV_FREQ916N868:
-			nrf_gpio_cfg_default(SPI_NSS_1_PIN);  
-			break;
-
-		default:
-			break;
-	}
-	
-	nrf_drv_spi_uninit(&spiInst);
-	nrf_gpio_cfg_default(SPI_SCLK_PIN);  
-	nrf_gpio_cfg_default(SPI_MISO_PIN);  
-	nrf_gpio_cfg_default(SPI_MOSI_PIN);  
-}
-
 static uint8_t spi_read_reg(eRf69Dev_t dev, uint8_t addr)
 {
 	uint8_t rxData;
 	uint8_t dummy = 0x01;
 	
-	spi_select(dev);
-    nrf_drv_spi_transfer(&spiInst, &addr, 1, NULL, 0);
-    nrf_drv_spi_transfer(&spiInst, &dummy, 1, &rxData, 1);
-	spi_unselect(dev);
+	Hal_SpiSelect(dev);
+	Hal_SpiXfer(&addr, 1, NULL, 0);
+	Hal_SpiXfer(&dummy, 1, &rxData, 1);
+	Hal_SpiUnselect(dev);
 	
 	return rxData;
 }
@@ -237,9 +193,9 @@ static void spi_write_reg(eRf69Dev_t dev, uint8_t addr, uint8_t value)
 
 	txData[0] = addr | 0x80;
 	txData[1] = value;
-	spi_select(dev);
-    nrf_drv_spi_transfer(&spiInst, txData, 2, NULL, 0);
-	spi_unselect(dev);
+	Hal_SpiSelect(dev);
+	Hal_SpiXfer(txData, 2, NULL, 0);
+	Hal_SpiUnselect(dev);
 }
 
 static void spi_write_burst(eRf69Dev_t dev, uint8_t addr, const uint8_t *pData, uint16_t cnt)
@@ -248,9 +204,15 @@ static void spi_write_burst(eRf69Dev_t dev, uint8_t addr, const uint8_t *pData,
 
 	txData[0] = addr | 0x80;
 	memcpy(txData + 1, pData, cnt);
-	spi_select(dev);
-	nrf_drv_spi_transfer(&spiInst, txData, cnt + 1, NULL, 0);
-	spi_unselect(dev);
+	Hal_SpiSelect(dev);
+	Hal_SpiXfer(txData, cnt + 1, NULL, 0);
+	Hal_SpiUnselect(dev);
+}
+
+static void pa_boost_set(eRf69Dev_t dev, bool onOff)
+{
+	spi_write_reg(dev, REG_TESTPA1, onOff ? RF69_TESTPA1_BOOST : RF69_TESTPA1_NORMAL);
+	spi_write_reg(dev, REG_TESTPA2, onOff ? RF69_TESTPA2_BOOST : RF69_TESTPA2_NORMAL);
 }
 
 void Rf69_SetMode(eRf69Dev_t dev, eRf69Mode_t newMode)
@@ -263,6 +225,22 @@ void Rf69_SetMode(eRf69Dev_t dev, eRf69Mode_t newMode)
 	{
 		return;
 	}
+	
+	//high power regs must not stay on outside TX
+	if(paBoost[dev] && (newMode == RF69_MODE_TX || *pOldMode == RF69_MODE_TX))
+	{
+		pa_boost_set(dev, newMode == RF69_MODE_TX);
+	}
+	
+	//the mode writes below keep the ListenOn bit, the sequencer has to be stopped first
+	if(*pOldMode == RF69_MODE_LISTEN)
+	{
+		Rf69_AbortListen(dev);
+		if(newMode == RF69_MODE_STANDBY)
+		{
+			return;
+		}
+	}
 
 	switch(newMode) 
 	{
@@ -295,39 +273,196 @@ void Rf69_SetMode(eRf69Dev_t dev, eRf69Mode_t newMode)
 	//the FIFO may not be immediately available from previous mode
 	while ((spi_read_reg(dev, REG_IRQFLAGS1) & RF_IRQFLAGS1_MODEREADY) == 0x00);//wait for ModeReady
 	*pOldMode = newMode;
+	
+	if(newMode == RF69_MODE_RX)
+	{
+		Trace_RxStart(dev);
+	}
 }
 
+/*
+switch to TX with a single register write and without waiting for ModeReady,
+so the moment the transmitter starts is known to within one SPI transfer.
+Used for timed transmissions, the FIFO must already be loaded.
+*/
+void Rf69_StartTx(eRf69Dev_t dev)
+{
+	spi_write_reg(dev, REG_OPMODE, RF_OPMODE_SEQUENCER_ON | RF_OPMODE_LISTEN_OFF | RF_OPMODE_TRANSMITTER);
+	
+	if(dev == RF69_DEV_FREQ433)
+	{
+		freq433DevMode = RF69_MODE_TX;
+	}
+	else
+	{
+		freq916n868DevMode = RF69_MODE_TX;
+	}
+}
 
-/*return the frequency (in Hz)*/
-uint32_t Rf69_GetFreq(eRf69Dev_t dev)
+/*listen timer resolutions selectable for idle and rx, register value is index + 1*/
+static const uint32_t listenResolUs[RF69_LISTEN_RESOL_NUM] = {64, 4100, 262000};
+
+/*finest resolution that still fits the duration into the 8-bit coefficient*/
+static uint8_t listen_resol(uint32_t us, uint8_t *pCoef)
 {
-	return RF69_FSTEP * (((uint32_t) spi_read_reg(dev, REG_FRFMSB) << 16)
-		+ ((uint16_t) spi_read_reg(dev, REG_FRFMID) << 8) + spi_read_reg(dev, REG_FRFLSB));
+	uint32_t coef = 255;
+	uint8_t i;
+	
+	for(i = 0; i < RF69_LISTEN_RESOL_NUM; i++)
+	{
+		coef = (us + listenResolUs[i] / 2) / listenResolUs[i];
+		if(coef <= 255)
+		{
+			break;
+		}
+	}
+	
+	if(i == RF69_LISTEN_RESOL_NUM)
+	{
+		i = RF69_LISTEN_RESOL_NUM - 1;
+		coef = 255;
+	}
+	
+	*pCoef = (coef == 0) ? 1 : (uint8_t)coef;
+	return i;
 }
 
-/*set the frequency (in Hz)*/
-void Rf69_SetFreq(eRf69Dev_t dev, uint32_t freqHz)
+/*
+program the listen sequencer durations. The requested idle/rx times are rounded
+to what the timer can do and written back. The chip stays in rx and stops the
+sequencer (ListenEnd 00) once the wake criteria match, so the caller can read
+the packet as in normal rx and re-arm afterwards.
+*/
+void Rf69_SetListenCfg(eRf69Dev_t dev, uint32_t *pIdleUs, uint32_t *pRxUs, bool syncCriteria)
 {
-	eRf69Mode_t oldMode;
-		
-	oldMode = (dev == RF69_DEV_FREQ433) ? freq433DevMode : freq916n868DevMode;
+	uint8_t idleResol;
+	uint8_t idleCoef;
+	uint8_t rxResol;
+	uint8_t rxCoef;
+	
+	idleResol = listen_resol(*pIdleUs, &idleCoef);
+	rxResol = listen_resol(*pRxUs, &rxCoef);
+	
+	spi_write_reg(dev, REG_LISTEN1, ((idleResol + 1) << 6) | ((rxResol + 1) << 4) 
+		| (syncCriteria ? RF_LISTEN1_CRITERIA_RSSIANDSYNC : RF_LISTEN1_CRITERIA_RSSI) | RF_LISTEN1_END_00);
+	spi_write_reg(dev, REG_LISTEN2, idleCoef);
+	spi_write_reg(dev, REG_LISTEN3, rxCoef);
+	
+	*pIdleUs = idleCoef * listenResolUs[idleResol];
+	*pRxUs = rxCoef * listenResolUs[rxResol];
+}
+
+/*
+enter listen mode from standby, DIO0 is mapped to the wake criteria
+(SyncAddress or Rssi) so it can wake the host
+*/
+void Rf69_StartListen(eRf69Dev_t dev, bool syncCriteria)
+{
+	Rf69_SetMode(dev, RF69_MODE_STANDBY);
+	spi_write_reg(dev, REG_DIOMAPPING1, syncCriteria ? RF_DIOMAPPING1_DIO0_10 : RF_DIOMAPPING1_DIO0_11);
+	spi_write_reg(dev, REG_OPMODE, RF_OPMODE_SEQUENCER_ON | RF_OPMODE_LISTEN_ON | RF_OPMODE_STANDBY);
+	
+	if(dev == RF69_DEV_FREQ433)
+	{
+		freq433DevMode = RF69_MODE_LISTEN;
+	}
+	else
+	{
+		freq916n868DevMode = RF69_MODE_LISTEN;
+	}
+}
+
+/*leave listen mode to standby, the two writes are the abort sequence from the datasheet*/
+void Rf69_AbortListen(eRf69Dev_t dev)
+{
+	spi_write_reg(dev, REG_OPMODE, RF_OPMODE_SEQUENCER_ON | RF_OPMODE_LISTEN_OFF | RF_OPMODE_LISTENABORT | RF_OPMODE_STANDBY);
+	spi_write_reg(dev, REG_OPMODE, RF_OPMODE_SEQUENCER_ON | RF_OPMODE_LISTEN_OFF | RF_OPMODE_STANDBY);
+	while ((spi_read_reg(dev, REG_IRQFLAGS1) & RF_IRQFLAGS1_MODEREADY) == 0x00);//wait for ModeReady
+	spi_write_reg(dev, REG_DIOMAPPING1, RF_DIOMAPPING1_DIO0_00);
+	
+	if(dev == RF69_DEV_FREQ433)
+	{
+		freq433DevMode = RF69_MODE_STANDBY;
+	}
+	else
+	{
+		freq916n868DevMode = RF69_MODE_STANDBY;
+	}
+}
+
+uint32_t Rf69_FreqToFrf(uint32_t freqHz)
+{
+	return (uint32_t)((((uint64_t)freqHz << RF69_FSTEP_SHIFT) + RF69_FXOSC / 2) / RF69_FXOSC);
+}
+
+uint32_t Rf69_FrfToFreq(uint32_t frf)
+{
+	return (uint32_t)(((uint64_t)frf * RF69_FXOSC) >> RF69_FSTEP_SHIFT);
+}
+
+/*precompute a channel, Rf69_SetChan then only has to burst the 3 bytes*/
+void Rf69_ChanInit(sRf69Chan_t *pChan, uint32_t freqHz)
+{
+	uint32_t frf;
+	
+	frf = Rf69_FreqToFrf(freqHz);
+	pChan->freqHz = freqHz;
+	pChan->frf[0] = (uint8_t)(frf >> 16);
+	pChan->frf[1] = (uint8_t)(frf >> 8);
+	pChan->frf[2] = (uint8_t)frf;
+}
+
+/*
+hop in one burst, the radio takes the new frequency with the FrfLsb write. In RX the
+demodulator is restarted on it. Returns false if the PLL did not lock in time.
+*/
+bool Rf69_SetChan(eRf69Dev_t dev, const sRf69Chan_t *pChan)
+{
+	eRf69Mode_t mode;
+	uint64_t startUs;
+	
+	mode = (dev == RF69_DEV_FREQ433) ? freq433DevMode : freq916n868DevMode;
 	
-	if (oldMode == RF69_MODE_TX) 
+	spi_write_burst(dev, REG_FRFMSB, pChan->frf, 3);
+	
+	//in standby the sequencer locks the PLL on the way to RX/TX
+	if(mode != RF69_MODE_RX && mode != RF69_MODE_TX && mode != RF69_MODE_SYNTH)
 	{
-		Rf69_SetMode(dev, RF69_MODE_RX);
+		return true;
 	}
 	
-	freqHz /= RF69_FSTEP;//divide down by FSTEP to get FRF
-	spi_write_reg(dev, REG_FRFMSB, freqHz >> 16);
-	spi_write_reg(dev, REG_FRFMID, freqHz >> 8);
-	spi_write_reg(dev, REG_FRFLSB, freqHz);
+	if(mode == RF69_MODE_RX)
+	{
+		Rf69_RestartRx(dev);
+	}
 	
-	if (oldMode == RF69_MODE_RX) 
+	startUs = Hal_ClockUs();
+	while((spi_read_reg(dev, REG_IRQFLAGS1) & RF_IRQFLAGS1_PLLLOCK) == 0x00)
 	{
-		Rf69_SetMode(dev, RF69_MODE_SYNTH);
+		if(Hal_ClockUs() - startUs > RF69_PLL_LOCK_TIMEOUT_US)
+		{
+			KIT_LOG(TAG, "Pll lock timeout!");
+			return false;
+		}
 	}
 	
-	Rf69_SetMode(dev, oldMode);
+	return true;
+}
+
+/*return the frequency (in Hz)*/
+uint32_t Rf69_GetFreq(eRf69Dev_t dev)
+{
+	return Rf69_FrfToFreq(((uint32_t) spi_read_reg(dev, REG_FRFMSB) << 16)
+		+ ((uint16_t) spi_read_reg(dev, REG_FRFMID) << 8) + spi_read_reg(dev, REG_FRFLSB));
+}
+
+/*set the frequency (in Hz)*/
+bool Rf69_SetFreq(eRf69Dev_t dev, uint32_t freqHz)
+{
+	sRf69Chan_t chan;
+	
+	Rf69_ChanInit(&chan, freqHz);
+	return Rf69_SetChan(dev, &chan);
 }
 
 /*
@@ -347,6 +482,64 @@ void Rf69_SetPowerLevel(eRf69Dev_t dev, uint8_t powerLevel)
 	spi_write_reg(dev, REG_PALEVEL, (spi_read_reg(dev, REG_PALEVEL) & 0xE0) | powerLevelTmp);
 }
 
+/*
+set TX power in dBm and pick the PA path for it, returns the power actually set.
+- RFM69W, PA0 on RFIO: -18 to 13dBm
+- RFM69HW, PA_BOOST: PA1 -2 to 13dBm, PA1+PA2 14 to 17dBm, PA1+PA2 with the high power regs 18 to 20dBm
+*/
+int8_t Rf69_SetTxPower(eRf69Dev_t dev, int8_t dbm, bool isHw)
+{
+	uint8_t paLevel;
+	bool boost = false;
+	
+	if(!isHw)
+	{
+		dbm = (dbm < -18) ? -18 : ((dbm > 13) ? 13 : dbm);
+		paLevel = RF_PALEVEL_PA0_ON | (uint8_t)(dbm + 18);
+	}
+	else
+	{
+		dbm = (dbm < -2) ? -2 : ((dbm > 20) ? 20 : dbm);
+		if(dbm <= 13)
+		{
+			paLevel = RF_PALEVEL_PA1_ON | (uint8_t)(dbm + 18);
+		}
+		else if(dbm <= 17)
+		{
+			paLevel = RF_PALEVEL_PA1_ON | RF_PALEVEL_PA2_ON | (uint8_t)(dbm + 14);
+		}
+		else
+		{
+			paLevel = RF_PALEVEL_PA1_ON | RF_PALEVEL_PA2_ON | (uint8_t)(dbm + 11);
+			boost = true;
+		}
+	}
+	
+	spi_write_reg(dev, REG_PALEVEL, paLevel);
+	//the boosted PA draws more than the default 95mA limit
+	spi_write_reg(dev, REG_OCP, boost ? RF_OCP_OFF : (RF_OCP_ON | RF_OCP_TRIM_95));
+	
+	if(paBoost[dev] && !boost)
+	{
+		pa_boost_set(dev, false);
+	}
+	paBoost[dev] = boost;
+	
+	return dbm;
+}
+
+/*
+things Rf69_StartTx does not do so it stays a single write: call before the
+timed start when transmitting with the high power regs
+*/
+void Rf69_PrepareTx(eRf69Dev_t dev)
+{
+	if(paBoost[dev])
+	{
+		pa_boost_set(dev, true);
+	}
+}
+
 /*get the received signal strength indicator (RSSI)*/
 int16_t Rf69_ReadRssi(eRf69Dev_t dev, bool forceTrigger) 
 {
@@ -361,10 +554,67 @@ int16_t Rf69_ReadRssi(eRf69Dev_t dev, bool forceTrigger)
 	
 	rssi = -spi_read_reg(dev, REG_RSSIVALUE);
 	rssi >>= 1;
+	Trace_Rssi(dev, rssi);
 	
 	return rssi;
 }
 
+/*continuous RSSI of an idle receiver, polled too often to be worth a trace record*/
+int16_t Rf69_ReadNoiseRssi(eRf69Dev_t dev) 
+{
+	return -(int16_t)spi_read_reg(dev, REG_RSSIVALUE) >> 1;
+}
+
+/*
+start a frequency error measurement, must be called in RX while a signal is
+present (the FEI needs a few bit periods of it, i.e. right after sync match)
+*/
+void Rf69_StartFei(eRf69Dev_t dev)
+{
+	spi_write_reg(dev, REG_AFCFEI, spi_read_reg(dev, REG_AFCFEI) | RF_AFCFEI_FEI_START);
+}
+
+/*
+result of the last Rf69_StartFei in Hz (received carrier - local oscillator),
+false if the measurement has not completed
+*/
+bool Rf69_ReadFei(eRf69Dev_t dev, int32_t *pFeiHz)
+{
+	int16_t fei;
+	
+	if((spi_read_reg(dev, REG_AFCFEI) & RF_AFCFEI_FEI_DONE) == 0x00)
+	{
+		return false;
+	}
+	
+	fei = (int16_t)(((uint16_t)spi_read_reg(dev, REG_FEIMSB) << 8) | spi_read_reg(dev, REG_FEILSB));
+	*pFeiHz = (int32_t)((int64_t)fei * (int64_t)RF69_FXOSC / (1L << RF69_FSTEP_SHIFT));
+	
+	return true;
+}
+
+/*
+die temperature in degC, a few degrees off but monotonic, which is all a drift
+model keyed by it needs. Only measured in standby or FS mode, false if the
+measurement did not finish.
+*/
+bool Rf69_ReadTemp(eRf69Dev_t dev, int8_t *pTempC)
+{
+	uint8_t i;
+	
+	spi_write_reg(dev, REG_TEMP1, RF_TEMP1_MEAS_START);
+	for(i = 0; i < RF69_TEMP_POLL_CNT; i++)
+	{
+		if((spi_read_reg(dev, REG_TEMP1) & RF_TEMP1_MEAS_RUNNING) == 0x00)
+		{
+			*pTempC = (int8_t)(RF69_TEMP_COEF - (int16_t)spi_read_reg(dev, REG_TEMP2));
+			return true;
+		}
+	}
+	
+	return false;
+}
+
 bool Rf69_IsFifoEmpty(eRf69Dev_t dev) 
 {
 	return (spi_read_reg(dev, REG_IRQFLAGS2) & RF_IRQFLAGS2_FIFONOTEMPTY) == 0;
@@ -380,6 +630,27 @@ bool Rf69_IsFifoOverThreshold(eRf69Dev_t dev)
 	return (spi_read_reg(dev, REG_IRQFLAGS2) & RF_IRQFLAGS2_FIFOLEVEL);
 }
 
+/*all fifo status bits with a single spi read, see RF69_FIFO_xxx*/
+uint8_t Rf69_GetFifoFlags(eRf69Dev_t dev) 
+{
+	return spi_read_reg(dev, REG_IRQFLAGS2);
+}
+
+bool Rf69_IsFifoOverrun(eRf69Dev_t dev) 
+{
+	return (spi_read_reg(dev, REG_IRQFLAGS2) & RF_IRQFLAGS2_FIFOOVERRUN);
+}
+
+/*
+drop the packet being received and go back to waiting for preamble/sync
+without leaving RX mode (PLL stays locked)
+*/
+void Rf69_RestartRx(eRf69Dev_t dev) 
+{
+	spi_write_reg(dev, REG_PACKETCONFIG2, (spi_read_reg(dev, REG_PACKETCONFIG2) & 0xFB) | RF_PACKET2_RXRESTART);
+	Trace_RxStart(dev);
+}
+
 void Rf69_ClearFifo(eRf69Dev_t dev) 
 {
 	spi_write_reg(dev, REG_IRQFLAGS2, RF_IRQFLAGS2_FIFOOVERRUN);
@@ -402,7 +673,12 @@ bool Rf69_PacketSeen(eRf69Dev_t dev)
 
 uint8_t Rf69_RcvByte(eRf69Dev_t dev) 
 {
-	return spi_read_reg(dev, REG_FIFO);
+	uint8_t data;
+	
+	data = spi_read_reg(dev, REG_FIFO);
+	Trace_Byte(dev, data);
+	
+	return data;
 }
 
 void Rf69_SetSeqOnOff(eRf69Dev_t dev, bool onOff)
@@ -451,6 +727,52 @@ void Rf69_SetSyncOnOff(eRf69Dev_t dev, bool onOff)
 	spi_write_reg(dev, REG_SYNCCONFIG, tmp);
 }
 
+/*
+match up to RF69_SYNC_EXT_MAX bytes after the 4 byte sync word of the config table
+as part of it, packets that differ there never reach the fifo. extLen 0 = sync word only.
+*/
+void Rf69_SetSyncExt(eRf69Dev_t dev, const uint8_t *pExt, uint8_t extLen)
+{
+	uint8_t tmp;
+	uint8_t i;
+	
+	if(extLen > RF69_SYNC_EXT_MAX)
+	{
+		extLen = RF69_SYNC_EXT_MAX;
+	}
+	
+	for(i = 0; i < extLen; i++)
+	{
+		spi_write_reg(dev, REG_SYNCVALUE5 + i, pExt[i]);
+	}
+	
+	//SyncSize holds the size - 1
+	tmp = spi_read_reg(dev, REG_SYNCCONFIG) & 0xC7;
+	tmp |= (uint8_t)((RF69_SYNC_BASE_LEN + extLen - 1) << 3);
+	spi_write_reg(dev, REG_SYNCCONFIG, tmp);
+}
+
+/*RSSI that starts the receiver (RssiThreshold), -127 .. 0 dBm*/
+void Rf69_SetRssiThresh(eRf69Dev_t dev, int16_t dbm)
+{
+	if(dbm < -127)
+	{
+		dbm = -127;
+	}
+	if(dbm > 0)
+	{
+		dbm = 0;
+	}
+	
+	spi_write_reg(dev, REG_RSSITHRESH, (uint8_t)(-2 * dbm));
+}
+
+/*floor of the OOK peak demodulator threshold in dB (OokFixedThresh), peak mode is kept*/
+void Rf69_SetOokFixThresh(eRf69Dev_t dev, uint8_t db)
+{
+	spi_write_reg(dev, REG_OOKFIX, db);
+}
+
 void Rf69_SetPreambleSize(eRf69Dev_t dev, uint16_t size) 
 {
 	spi_write_reg(dev, REG_PREAMBLEMSB, (uint8_t)(size >> 8));
@@ -516,3 +838,9 @@ void Rf69_DevParaCfg(eRf69Dev_t dev, eRf69Freq_t freq)
 }
 
 
+
+/*a missing module reads back all 0x00 or 0xFF on MISO, the silicon version tells them apart*/
+bool Rf69_IsPresent(eRf69Dev_t dev)
+{
+	return spi_read_reg(dev, REG_VERSION) == RF_VERSION_VER;
+}
@@ -29,7 +29,8 @@ typedef enum
 	RF69_MODE_STANDBY,
 	RF69_MODE_SYNTH,
 	RF69_MODE_RX,
-	RF69_MODE_TX
+	RF69_MODE_TX,
+	RF69_MODE_LISTEN		//listen sequencer cycling idle/rx on its own
 }eRf69Mode_t;
 
 typedef enum
@@ -38,6 +39,23 @@ typedef enum
 	RF69_DEV_FREQ916N868
 }eRf69Dev_t;
 
+//bits returned by Rf69_GetFifoFlags (RegIrqFlags2)
+#define RF69_FIFO_FULL			0x80
+#define RF69_FIFO_NOT_EMPTY		0x40
+#define RF69_FIFO_LEVEL			0x20	//more bytes than FifoThreshold
+#define RF69_FIFO_OVERRUN		0x10
+
+//a frequency with its RegFrf bytes worked out ahead
+typedef struct
+{
+	uint32_t freqHz;
+	uint8_t frf[3];				//RegFrfMsb, Mid, Lsb
+}sRf69Chan_t;
+
+//sync word of the config tables, the radio compares up to 8 bytes
+#define RF69_SYNC_BASE_LEN		4
+#define RF69_SYNC_EXT_MAX		4
+
 typedef enum
 {
 	RF69_FREQ_433 = 0,
@@ -46,13 +64,30 @@ typedef enum
 }eRf69Freq_t;
 
 void Rf69_SetMode(eRf69Dev_t dev, eRf69Mode_t newMode);
+void Rf69_StartTx(eRf69Dev_t dev);
+void Rf69_SetListenCfg(eRf69Dev_t dev, uint32_t *pIdleUs, uint32_t *pRxUs, bool syncCriteria);
+void Rf69_StartListen(eRf69Dev_t dev, bool syncCriteria);
+void Rf69_AbortListen(eRf69Dev_t dev);
+uint32_t Rf69_FreqToFrf(uint32_t freqHz);
+uint32_t Rf69_FrfToFreq(uint32_t frf);
+void Rf69_ChanInit(sRf69Chan_t *pChan, uint32_t freqHz);
+bool Rf69_SetChan(eRf69Dev_t dev, const sRf69Chan_t *pChan);
 uint32_t Rf69_GetFreq(eRf69Dev_t dev);
-void Rf69_SetFreq(eRf69Dev_t dev, uint32_t freqHz);
+bool Rf69_SetFreq(eRf69Dev_t dev, uint32_t freqHz);
 void Rf69_SetPowerLevel(eRf69Dev_t dev, uint8_t powerLevel);
+int8_t Rf69_SetTxPower(eRf69Dev_t dev, int8_t dbm, bool isHw);
+void Rf69_PrepareTx(eRf69Dev_t dev);
 int16_t Rf69_ReadRssi(eRf69Dev_t dev, bool forceTrigger);
+int16_t Rf69_ReadNoiseRssi(eRf69Dev_t dev);
+void Rf69_StartFei(eRf69Dev_t dev);
+bool Rf69_ReadFei(eRf69Dev_t dev, int32_t *pFeiHz);
+bool Rf69_ReadTemp(eRf69Dev_t dev, int8_t *pTempC);
 bool Rf69_IsFifoEmpty(eRf69Dev_t dev);
 bool Rf69_IsFifoFull(eRf69Dev_t dev);
 bool Rf69_IsFifoOverThreshold(eRf69Dev_t dev);
+uint8_t Rf69_GetFifoFlags(eRf69Dev_t dev);
+bool Rf69_IsFifoOverrun(eRf69Dev_t dev);
+void Rf69_RestartRx(eRf69Dev_t dev);
 void Rf69_ClearFifo(eRf69Dev_t dev);
 void Rf69_XmitByte(eRf69Dev_t dev, uint8_t data);
 void Rf69_XmitBuf(eRf69Dev_t dev, const uint8_t* pData, int len);
@@ -61,12 +96,16 @@ uint8_t Rf69_RcvByte(eRf69Dev_t dev);
 void Rf69_SetSeqOnOff(eRf69Dev_t dev, bool onOff);
 void Rf69_SetPayloadLen(eRf69Dev_t dev, uint8_t len);
 void Rf69_SetSyncOnOff(eRf69Dev_t dev, bool onOff);
+void Rf69_SetSyncExt(eRf69Dev_t dev, const uint8_t *pExt, uint8_t extLen);
+void Rf69_SetRssiThresh(eRf69Dev_t dev, int16_t dbm);
+void Rf69_SetOokFixThresh(eRf69Dev_t dev, uint8_t db);
 void Rf69_SetPreambleSize(eRf69Dev_t dev, uint16_t size);
 void Rf69_SetUnlimitedLenPkt(eRf69Dev_t dev);
 void Rf69_SetOokBw250khz(eRf69Dev_t dev);
 void Rf69_SetOokBw200khz(eRf69Dev_t dev);
 void Rf69_SetDioMapping(eRf69Dev_t dev);
 void Rf69_DevParaCfg(eRf69Dev_t dev, eRf69Freq_t freq);
+bool Rf69_IsPresent(eRf69Dev_t dev);
 
 #ifdef __cplusplus
 }
@@ -1,5 +1,6 @@
 
 #include "fds.h"
+#include "nordic_common.h"
 #include "nrf_log.h"
 #include "rileylink_service.h"
 #include "rileylink_config.h"
@@ -69,7 +70,8 @@ void rileylink_config_save()
 }
 
 static void init_default_config() {
-    rileylink_config.version = 1;
+    memset(&rileylink_config, 0, sizeof(rileylink_config));
+    rileylink_config.version = RILEYLINK_CONFIG_VERSION;
     memcpy(rileylink_config.custom_name, DEFAULT_DEVICE_NAME, strlen(DEFAULT_DEVICE_NAME));
     rileylink_config.custom_name_len = strlen(DEFAULT_DEVICE_NAME);
 }
@@ -103,7 +105,15 @@ static ret_code_t read_rileylink_config()
         return err_code;
     }
 
-    memcpy(&rileylink_config, record.p_data, sizeof(rileylink_config));
+    // Records written by older versions are shorter; fields they don't have stay zeroed.
+    uint32_t stored_len = record.p_header->length_words * 4;
+    memset(&rileylink_config, 0, sizeof(rileylink_config));
+    memcpy(&rileylink_config, record.p_data, MIN(stored_len, sizeof(rileylink_config)));
+
+    if (rileylink_config.version < RILEYLINK_CONFIG_VERSION) {
+        NRF_LOG_INFO("Upgrading config from version %d", rileylink_config.version);
+        rileylink_config.version = RILEYLINK_CONFIG_VERSION;
+    }
 
     if(rileylink_config.custom_name_len == 0) {
         strcpy(rileylink_config.custom_name, "RileyLink 2.0");
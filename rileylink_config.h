@@ -1,15 +1,30 @@
 #ifndef RILEYLINK_CONFIG_H
 #define RILEYLINK_CONFIG_H
 
+#include "app_afc.h"
+#include "app_subg.h"
+#include "app_minimed.h"
+#include "app_tcomp.h"
+
 // Persistent config 
 
 #define CUSTOM_RILEYLINK_NAME_MAX_LEN 100
 
+// Version 2 appended freq_offsets
+// Version 3 appended sync_filters
+// Version 4 appended pump_regions
+// Version 5 appended tcomp_curves
+#define RILEYLINK_CONFIG_VERSION 5
+
 typedef struct rileylink_config_s
 {
     uint16_t version;
     uint8_t custom_name_len;
     uint8_t custom_name[CUSTOM_RILEYLINK_NAME_MAX_LEN];
+    sAfcEntry_t freq_offsets[AFC_REMOTE_NUM];
+    sSubgSyncFilter_t sync_filters[SUBG_MODE_NUM];
+    sMinimedRegion_t pump_regions[MINIMED_REGION_NUM];
+    sTcompCurve_t tcomp_curves[TCOMP_DEV_NUM];
 
 } rileylink_config_t;
 
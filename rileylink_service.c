@@ -19,6 +19,9 @@ static const uint8_t ResponseCountCharName[] = "Response Count";
 static const uint8_t VersionCharName[] = "Version";
 static const uint8_t TimerTickCharName[] = "Timer Tick";
 static const uint8_t CustomNameCharName[] = "Custom Name";
+static const uint8_t CaptureCharName[] = "Capture";
+static const uint8_t RadioStatsCharName[] = "Radio Stats";
+static const uint8_t RadioConfigCharName[] = "Radio Config";
 static uint8_t FirmwareVersion[] = "nrf52_rileylink 1.0";
 
 /**@brief Function for handling the Connect event.
@@ -82,12 +85,83 @@ static void on_write(ble_rileylink_service_t * p_rileylink_service, ble_evt_t co
         NRF_LOG_DEBUG("Name update!");
         on_custom_name_update(p_rileylink_service, p_evt_write->data, p_evt_write->len);
     }
+    else if ((p_evt_write->handle == p_rileylink_service->radio_config_char_handles.value_handle)
+          && (p_rileylink_service->radio_config_write_handler != NULL))
+    {
+        p_rileylink_service->radio_config_write_handler(p_evt_write->data, p_evt_write->len);
+    }
     else 
     {
         NRF_LOG_DEBUG("Unhandled write");
     }
 }
 
+/**@brief Function for handling the Read/Write Authorization event of the Radio Stats Characteristic.
+ *
+ * @details A read starting at offset 0 takes a fresh copy of the counters, the reads of the rest
+ *          of a long value are served from that copy so the block stays consistent. A one-byte
+ *          write is the reset command, it never lands in the value.
+ *
+ * @param[in] p_rileylink_service   RileyLink Service structure.
+ * @param[in] p_ble_evt             Event received from the BLE stack.
+ */
+static void on_rw_authorize_request(ble_rileylink_service_t * p_rileylink_service, ble_evt_t const * p_ble_evt)
+{
+    ble_gatts_evt_rw_authorize_request_t const * p_auth_req = &p_ble_evt->evt.gatts_evt.params.authorize_request;
+    ble_gatts_rw_authorize_reply_params_t auth_reply;
+    uint32_t err_code;
+
+    memset(&auth_reply, 0, sizeof(auth_reply));
+
+    if (p_auth_req->type == BLE_GATTS_AUTHORIZE_TYPE_READ)
+    {
+        if (p_auth_req->request.read.handle != p_rileylink_service->radio_stats_char_handles.value_handle)
+        {
+            return;
+        }
+        auth_reply.type                     = BLE_GATTS_AUTHORIZE_TYPE_READ;
+        auth_reply.params.read.gatt_status  = BLE_GATT_STATUS_SUCCESS;
+        if (p_auth_req->request.read.offset == 0)
+        {
+            auth_reply.params.read.update   = 1;
+            auth_reply.params.read.len      = p_rileylink_service->radio_stats_len;
+            auth_reply.params.read.p_data   = p_rileylink_service->p_radio_stats;
+        }
+    }
+    else if (p_auth_req->type == BLE_GATTS_AUTHORIZE_TYPE_WRITE)
+    {
+        if (   (p_auth_req->request.write.handle != p_rileylink_service->radio_stats_char_handles.value_handle)
+            || (p_auth_req->request.write.op != BLE_GATTS_OP_WRITE_REQ))
+        {
+            return;
+        }
+        auth_reply.type = BLE_GATTS_AUTHORIZE_TYPE_WRITE;
+        if (p_auth_req->request.write.len != 1)
+        {
+            auth_reply.params.write.gatt_status = BLE_GATT_STATUS_ATTERR_INVALID_ATT_VAL_LENGTH;
+        }
+        else
+        {
+            auth_reply.params.write.gatt_status = BLE_GATT_STATUS_SUCCESS;
+            NRF_LOG_DEBUG("Radio stats reset!");
+            if (p_rileylink_service->radio_stats_reset_handler != NULL)
+            {
+                p_rileylink_service->radio_stats_reset_handler();
+            }
+        }
+    }
+    else
+    {
+        return;
+    }
+
+    err_code = sd_ble_gatts_rw_authorize_reply(p_ble_evt->evt.gatts_evt.conn_handle, &auth_reply);
+    if (err_code != NRF_SUCCESS)
+    {
+        NRF_LOG_ERROR("Radio stats authorize reply failed: 0x%x", err_code);
+    }
+}
+
 /**@brief Function for adding the LED mode characteristic.
  *
  */
@@ -402,6 +476,139 @@ static uint32_t custom_name_char_add(ble_rileylink_service_t * p_rileylink_servi
     return NRF_SUCCESS;
 }
 
+/**@brief Function for adding the Capture characteristic.
+ *
+ */
+static uint32_t capture_char_add(ble_rileylink_service_t * p_rileylink_service)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_gatts_attr_md_t attr_md;
+    ble_uuid_t          ble_uuid;
+
+    memset(&char_md, 0, sizeof(char_md));
+    memset(&attr_md, 0, sizeof(attr_md));
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    char_md.char_props.notify        = 1;
+    char_md.p_char_user_desc         = CaptureCharName;
+    char_md.char_user_desc_size      = sizeof(CaptureCharName);
+    char_md.char_user_desc_max_size  = sizeof(CaptureCharName);
+
+    // Define the Capture Characteristic UUID
+    ble_uuid.type = p_rileylink_service->uuid_type;
+    ble_uuid.uuid = BLE_UUID_RILEYLINK_CAPTURE_UUID;
+
+    // Set permissions on the Characteristic value
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.write_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+
+    // Attribute Metadata settings
+    attr_md.vloc       = BLE_GATTS_VLOC_STACK;
+    attr_md.vlen       = 1;
+
+    // Attribute Value settings
+    attr_char_value.p_uuid       = &ble_uuid;
+    attr_char_value.p_attr_md    = &attr_md;
+    attr_char_value.max_len      = BLE_RILEYLINK_CAPTURE_MAX_LENGTH;
+    attr_char_value.p_value      = NULL;
+
+    return sd_ble_gatts_characteristic_add(p_rileylink_service->service_handle, &char_md,
+                                           &attr_char_value,
+                                           &p_rileylink_service->capture_char_handles);
+}
+
+/**@brief Function for adding the Radio Stats characteristic.
+ *
+ */
+static uint32_t radio_stats_char_add(ble_rileylink_service_t * p_rileylink_service, const uint8_t *p_radio_stats, uint16_t radio_stats_len)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_gatts_attr_md_t attr_md;
+    ble_uuid_t          ble_uuid;
+
+    memset(&char_md, 0, sizeof(char_md));
+    memset(&attr_md, 0, sizeof(attr_md));
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    char_md.char_props.read          = 1;
+    char_md.char_props.write         = 1;
+    char_md.p_char_user_desc         = RadioStatsCharName;
+    char_md.char_user_desc_size      = sizeof(RadioStatsCharName);
+    char_md.char_user_desc_max_size  = sizeof(RadioStatsCharName);
+
+    // Define the Radio Stats Characteristic UUID
+    ble_uuid.type = p_rileylink_service->uuid_type;
+    ble_uuid.uuid = BLE_UUID_RILEYLINK_RADIO_STATS_UUID;
+
+    // Set permissions on the Characteristic value
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+
+    // Attribute Metadata settings
+    // The stack keeps its own copy, refreshed from the counters on every read (read authorization).
+    // Writes are authorized too: a one-byte write resets the counters and the value is left alone.
+    attr_md.vloc       = BLE_GATTS_VLOC_STACK;
+    attr_md.rd_auth    = 1;
+    attr_md.wr_auth    = 1;
+
+    // Attribute Value settings
+    attr_char_value.p_uuid       = &ble_uuid;
+    attr_char_value.p_attr_md    = &attr_md;
+    attr_char_value.init_len     = radio_stats_len;
+    attr_char_value.max_len      = radio_stats_len;
+    attr_char_value.p_value      = (uint8_t *)p_radio_stats;
+
+    return sd_ble_gatts_characteristic_add(p_rileylink_service->service_handle, &char_md,
+                                           &attr_char_value,
+                                           &p_rileylink_service->radio_stats_char_handles);
+}
+
+/**@brief Function for adding the Radio Config characteristic.
+ *
+ */
+static uint32_t radio_config_char_add(ble_rileylink_service_t * p_rileylink_service)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_gatts_attr_md_t attr_md;
+    ble_uuid_t          ble_uuid;
+
+    memset(&char_md, 0, sizeof(char_md));
+    memset(&attr_md, 0, sizeof(attr_md));
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    char_md.char_props.read          = 1;
+    char_md.char_props.write         = 1;
+    char_md.p_char_user_desc         = RadioConfigCharName;
+    char_md.char_user_desc_size      = sizeof(RadioConfigCharName);
+    char_md.char_user_desc_max_size  = sizeof(RadioConfigCharName);
+
+    // Define the Radio Config Characteristic UUID
+    ble_uuid.type = p_rileylink_service->uuid_type;
+    ble_uuid.uuid = BLE_UUID_RILEYLINK_RADIO_CONFIG_UUID;
+
+    // Set permissions on the Characteristic value
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+
+    // Attribute Metadata settings
+    // Reads return the last setting written, the handler applies it.
+    attr_md.vloc       = BLE_GATTS_VLOC_STACK;
+    attr_md.vlen       = 1;
+
+    // Attribute Value settings
+    attr_char_value.p_uuid       = &ble_uuid;
+    attr_char_value.p_attr_md    = &attr_md;
+    attr_char_value.max_len      = BLE_RILEYLINK_RADIO_CONFIG_MAX_LENGTH;
+    attr_char_value.p_value      = NULL;
+
+    return sd_ble_gatts_characteristic_add(p_rileylink_service->service_handle, &char_md,
+                                           &attr_char_value,
+                                           &p_rileylink_service->radio_config_char_handles);
+}
+
 
 uint32_t ble_rileylink_service_init(ble_rileylink_service_t * p_rileylink_service, const ble_rileylink_service_init_t * p_rileylink_service_init, ble_rileylink_service_name_changed_callback_t named_changed_callback)
 {
@@ -415,6 +622,10 @@ uint32_t ble_rileylink_service_init(ble_rileylink_service_t * p_rileylink_servic
     p_rileylink_service->led_mode_write_handler = p_rileylink_service_init->led_mode_write_handler;
     p_rileylink_service->data_write_handler = p_rileylink_service_init->data_write_handler;
     p_rileylink_service->named_changed_callback = named_changed_callback;
+    p_rileylink_service->radio_stats_reset_handler = p_rileylink_service_init->radio_stats_reset_handler;
+    p_rileylink_service->p_radio_stats = p_rileylink_service_init->p_radio_stats;
+    p_rileylink_service->radio_stats_len = p_rileylink_service_init->radio_stats_len;
+    p_rileylink_service->radio_config_write_handler = p_rileylink_service_init->radio_config_write_handler;
 
     // Add service UUID
     ble_uuid128_t base_uuid = {BLE_UUID_RILEYLINK_SERVICE_BASE_UUID};
@@ -474,6 +685,32 @@ uint32_t ble_rileylink_service_init(ble_rileylink_service_t * p_rileylink_servic
         return err_code;
     }
 
+    err_code = capture_char_add(p_rileylink_service);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    if (p_rileylink_service_init->p_radio_stats != NULL)
+    {
+        err_code = radio_stats_char_add(p_rileylink_service,
+                                        p_rileylink_service_init->p_radio_stats,
+                                        p_rileylink_service_init->radio_stats_len);
+        if (err_code != NRF_SUCCESS)
+        {
+            return err_code;
+        }
+    }
+
+    if (p_rileylink_service_init->radio_config_write_handler != NULL)
+    {
+        err_code = radio_config_char_add(p_rileylink_service);
+        if (err_code != NRF_SUCCESS)
+        {
+            return err_code;
+        }
+    }
+
     return NRF_SUCCESS;
 }
 
@@ -492,6 +729,10 @@ void ble_rileylink_service_on_ble_evt(ble_evt_t const * p_ble_evt, void * p_cont
             on_write(p_rileylink_service, p_ble_evt);
             break;
 
+        case BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST:
+            on_rw_authorize_request(p_rileylink_service, p_ble_evt);
+            break;
+
         case BLE_GAP_EVT_DISCONNECTED:
             on_disconnect(p_rileylink_service, p_ble_evt);
             break;
@@ -538,6 +779,28 @@ uint32_t ble_rileylink_service_send_data(ble_rileylink_service_t * p_rileylink_s
     return NRF_SUCCESS;
 }
 
+uint32_t ble_rileylink_service_send_capture(ble_rileylink_service_t * p_rileylink_service, const uint8_t *data, uint16_t length) {
+    ble_gatts_hvx_params_t hvx_params;
+    uint16_t capture_length = length;
+
+    if (p_rileylink_service->conn_handle == BLE_CONN_HANDLE_INVALID) {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    if (capture_length > BLE_RILEYLINK_CAPTURE_MAX_LENGTH) {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    memset(&hvx_params, 0, sizeof(hvx_params));
+    hvx_params.handle = p_rileylink_service->capture_char_handles.value_handle;
+    hvx_params.p_data = data;
+    hvx_params.p_len = &capture_length;
+    hvx_params.type = BLE_GATT_HVX_NOTIFICATION;
+
+    // NRF_ERROR_RESOURCES means the notification queue is full, caller retries on a later pass
+    return sd_ble_gatts_hvx(p_rileylink_service->conn_handle, &hvx_params);
+}
+
 void ble_rileylink_service_timer_tick(ble_rileylink_service_t * p_rileylink_service) {
     uint32_t err_code;
 
@@ -56,12 +56,27 @@ NRF_SDH_BLE_OBSERVER(_name ## _obs,
                                                0x9c, 0x4f, 0xa7, 0xf1, 0x41, 0x42, 0xd8, 0xc6}
 #define BLE_UUID_RILEYLINK_LED_MODE_UUID 0x4241
 
+// Capture - 0235733d-99c5-4197-b856-69219c2a3845 (service base)
+#define BLE_UUID_RILEYLINK_CAPTURE_UUID 0x733d
+
+#define BLE_RILEYLINK_CAPTURE_MAX_LENGTH 244
+
+// Radio Stats - 0235733e-99c5-4197-b856-69219c2a3845 (service base)
+#define BLE_UUID_RILEYLINK_RADIO_STATS_UUID 0x733e
+
+// Radio Config - 0235733f-99c5-4197-b856-69219c2a3845 (service base)
+#define BLE_UUID_RILEYLINK_RADIO_CONFIG_UUID 0x733f
+
+#define BLE_RILEYLINK_RADIO_CONFIG_MAX_LENGTH 20
+
 // Forward declaration of the custom_service_t type.
 typedef struct ble_rileylink_service_s ble_rileylink_service_t;
 
 typedef void (*ble_rileylink_service_led_mode_write_handler_t) (uint16_t conn_handle, ble_rileylink_service_t * p_rileylink_service, uint8_t new_state);
 typedef void (*ble_rileylink_service_data_write_handler_t) (const uint8_t *data, uint16_t length);
 typedef void (*ble_rileylink_service_name_changed_callback_t)();
+typedef void (*ble_rileylink_service_radio_stats_reset_handler_t) (void);
+typedef void (*ble_rileylink_service_radio_config_write_handler_t) (const uint8_t *data, uint16_t length);
 
 
 /** @brief LED Service init structure. This structure contains all options and data needed for
@@ -70,6 +85,10 @@ typedef struct
 {
     ble_rileylink_service_led_mode_write_handler_t led_mode_write_handler; /**< Event handler to be called when the LED Characteristic is written. */
     ble_rileylink_service_data_write_handler_t data_write_handler; /**< Event handler to be called when the DATA Characteristic is written. */
+    const uint8_t *p_radio_stats;                                  /**< Radio telemetry block read by the Radio Stats Characteristic, NULL to leave it out. */
+    uint16_t radio_stats_len;                                      /**< Size of the radio telemetry block. */
+    ble_rileylink_service_radio_stats_reset_handler_t radio_stats_reset_handler; /**< Event handler to be called when one byte is written to the Radio Stats Characteristic. */
+    ble_rileylink_service_radio_config_write_handler_t radio_config_write_handler; /**< Event handler to be called when the Radio Config Characteristic is written, NULL to leave it out. */
 } ble_rileylink_service_init_t;
 
 /**@brief RileyLink Service structure.
@@ -89,9 +108,16 @@ typedef struct ble_rileylink_service_s
     ble_gatts_char_handles_t            version_char_handles;
     ble_gatts_char_handles_t            timer_tick_char_handles;
     ble_gatts_char_handles_t            custom_name_char_handles;
+    ble_gatts_char_handles_t            capture_char_handles;
+    ble_gatts_char_handles_t            radio_stats_char_handles;
+    ble_gatts_char_handles_t            radio_config_char_handles;
     ble_rileylink_service_led_mode_write_handler_t led_mode_write_handler;
     ble_rileylink_service_data_write_handler_t data_write_handler;
     ble_rileylink_service_name_changed_callback_t named_changed_callback;
+    ble_rileylink_service_radio_stats_reset_handler_t radio_stats_reset_handler;
+    ble_rileylink_service_radio_config_write_handler_t radio_config_write_handler;
+    const uint8_t                       *p_radio_stats;
+    uint16_t                            radio_stats_len;
 
 } ble_rileylink_service_t;
 
@@ -119,6 +145,10 @@ void ble_rileylink_service_on_ble_evt(ble_evt_t const * p_ble_evt, void * p_cont
 /* Send data via BLE DATA characteristic */
 uint32_t ble_rileylink_service_send_data(ble_rileylink_service_t * p_rileylink_service, const uint8_t *data, uint8_t length);
 
+/* Send a capture frame via BLE CAPTURE characteristic notification.
+ * NRF_ERROR_RESOURCES means the stack tx queue is full and the frame should be retried later. */
+uint32_t ble_rileylink_service_send_capture(ble_rileylink_service_t * p_rileylink_service, const uint8_t *data, uint16_t length);
+
 /* Fire the timer tick */
 void ble_rileylink_service_timer_tick(ble_rileylink_service_t * p_rileylink_service);
 
@@ -0,0 +1,1021 @@
+#include <string.h>
+
+#include "hal.h"
+#include "subg_rfspy_native.h"
+#include "subg_rfspy_protocol.h"
+#include "app_subg.h"
+#include "app_codec.h"
+#include "app_capture.h"
+#include "app_minimed.h"
+#include "app_omnipod.h"
+#include "app_bcast.h"
+#include "app_listen.h"
+#include "app_pwr.h"
+#include "app_tcomp.h"
+#include "app_time.h"
+#include "app_trace.h"
+
+// CC1110 registers as numbered by subg_rfspy: offsets in the radio's 0xDF00 xdata page
+#define CC_SYNC1            0x00
+#define CC_SYNC0            0x01
+#define CC_PKTLEN           0x02
+#define CC_PKTCTRL1         0x03
+#define CC_PKTCTRL0         0x04
+#define CC_ADDR             0x05
+#define CC_CHANNR           0x06
+#define CC_FSCTRL1          0x07
+#define CC_FSCTRL0          0x08
+#define CC_FREQ2            0x09
+#define CC_FREQ1            0x0a
+#define CC_FREQ0            0x0b
+#define CC_MDMCFG4          0x0c
+#define CC_MDMCFG3          0x0d
+#define CC_MDMCFG2          0x0e
+#define CC_MDMCFG1          0x0f
+#define CC_MDMCFG0          0x10
+#define CC_DEVIATN          0x11
+#define CC_MCSM2            0x12
+#define CC_MCSM1            0x13
+#define CC_MCSM0            0x14
+#define CC_FOCCFG           0x15
+#define CC_BSCFG            0x16
+#define CC_AGCCTRL2         0x17
+#define CC_AGCCTRL1         0x18
+#define CC_AGCCTRL0         0x19
+#define CC_FREND1           0x1a
+#define CC_FREND0           0x1b
+#define CC_FSCAL3           0x1c
+#define CC_FSCAL2           0x1d
+#define CC_FSCAL1           0x1e
+#define CC_FSCAL0           0x1f
+#define CC_TEST2            0x23
+#define CC_TEST1            0x24
+#define CC_TEST0            0x25
+#define CC_PA_TABLE7        0x27
+#define CC_PA_TABLE0        0x2e
+#define CC_REG_NUM          0x2f
+
+#define CC_FXOSC_HZ         24000000
+#define CC_FREND0_PA_POWER  0x07
+
+#define MODE_REGISTERS_TX   0x01
+#define MODE_REGISTERS_RX   0x02
+#define MODE_REGISTERS_MAX  8
+
+#define TRACE_ACTION_STOP   0x00
+#define TRACE_ACTION_START  0x01
+#define TRACE_ACTION_DUMP   0x02
+
+#define RX_HDR_LEN          3   // response code, rssi, packet number
+#define RESPONSE_LEN        255
+#define STATISTICS_LEN      21  // response code, uptime(4), 8 counters(2)
+#define BROADCAST_DEDUP_MS  60000
+
+typedef struct
+{
+    uint8_t count;
+    uint8_t addr[MODE_REGISTERS_MAX];
+    uint8_t value[MODE_REGISTERS_MAX];
+} mode_registers_t;
+
+// What subg_rfspy programs at boot and on reset_radio_config: 916.5MHz MiniMed OOK
+static const uint8_t cc_reg_default[CC_REG_NUM] = {
+    [CC_SYNC1]    = 0xff, [CC_SYNC0]    = 0x00, [CC_PKTLEN]   = 0xff, [CC_PKTCTRL1] = 0x00,
+    [CC_PKTCTRL0] = 0x00, [CC_ADDR]     = 0x00, [CC_CHANNR]   = 0x02, [CC_FSCTRL1]  = 0x06,
+    [CC_FSCTRL0]  = 0x00, [CC_FREQ2]    = 0x26, [CC_FREQ1]    = 0x30, [CC_FREQ0]    = 0x00,
+    [CC_MDMCFG4]  = 0xb9, [CC_MDMCFG3]  = 0x66, [CC_MDMCFG2]  = 0x33, [CC_MDMCFG1]  = 0x62,
+    [CC_MDMCFG0]  = 0x1a, [CC_DEVIATN]  = 0x13, [CC_MCSM2]    = 0x07, [CC_MCSM1]    = 0x30,
+    [CC_MCSM0]    = 0x18, [CC_FOCCFG]   = 0x17, [CC_BSCFG]    = 0x6c, [CC_AGCCTRL2] = 0x07,
+    [CC_AGCCTRL1] = 0x00, [CC_AGCCTRL0] = 0x91, [CC_FREND1]   = 0xb6, [CC_FREND0]   = 0x11,
+    [CC_FSCAL3]   = 0xe9, [CC_FSCAL2]   = 0x2a, [CC_FSCAL1]   = 0x00, [CC_FSCAL0]   = 0x1f,
+    [CC_TEST2]    = 0x88, [CC_TEST1]    = 0x31, [CC_TEST0]    = 0x09,
+    [CC_PA_TABLE0 - 1] = 0xc0,
+};
+
+// CC1110 PA table settings of the design note tables (433/868/915MHz), approximate output power
+static const struct {
+    uint8_t pa;
+    int8_t dbm;
+} cc_pa_dbm[] = {
+    {0x03, -30}, {0x12, -30}, {0x0e, -20}, {0x1d, -15}, {0x1e, -15}, {0x27, -10}, {0x34, -10},
+    {0x2c, -5}, {0x50, 0}, {0x60, 0}, {0x8e, 0}, {0x84, 5}, {0xcd, 5}, {0xc7, 7}, {0xc8, 7},
+    {0xc6, 8}, {0xc0, 10}, {0xc2, 10},
+};
+
+static radio_backend_response_handler_t *m_response_handler = NULL;
+
+static uint8_t m_regs[CC_REG_NUM];
+static bool m_freq_dirty;
+static bool m_power_dirty;
+static bool m_power_written;     // PA table or FREND0 written since the last reset, the RFM69 keeps its own cap until then
+static mode_registers_t m_tx_registers;
+static mode_registers_t m_rx_registers;
+static eCodec_t m_encoding = CODEC_NONE;
+static uint8_t m_packet_count = 0;
+static uint32_t m_chan_hz[SUBG_CHAN_MAX];
+static uint8_t m_chan_count = 0;   // channel table loaded by the app, CHANNR indexes it instead of the spacing
+
+static uint8_t m_tx_buf[SUBG_TX_MAX_LEN];
+static uint8_t m_rx_buf[SUBG_RX_MAX_LEN];
+static uint8_t m_response[RESPONSE_LEN];
+static uint8_t m_history_page[MINIMED_PAGE_LEN];
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return ((uint16_t)p[0] << 8) | p[1];
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint8_t *put_u16(uint8_t *p, uint16_t value)
+{
+    *p++ = (uint8_t)(value >> 8);
+    *p++ = (uint8_t)value;
+    return p;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t value)
+{
+    p = put_u16(p, (uint16_t)(value >> 16));
+    return put_u16(p, (uint16_t)value);
+}
+
+static void respond(const uint8_t *data, uint8_t len)
+{
+    if (m_response_handler != NULL) {
+        m_response_handler(data, len);
+    }
+}
+
+static void respond_code(uint8_t code)
+{
+    respond(&code, 1);
+}
+
+static uint8_t cc1110_rssi(int dbm)
+{
+    int raw = (dbm + SUBG_RFSPY_RSSI_OFFSET) * 2;
+
+    if (raw > INT8_MAX) {
+        raw = INT8_MAX;
+    } else if (raw < INT8_MIN) {
+        raw = INT8_MIN;
+    }
+    return (uint8_t)(int8_t)raw;
+}
+
+/* Registers */
+
+static bool reg_valid(uint8_t addr)
+{
+    return addr < CC_REG_NUM && (addr <= CC_FSCAL0 || (addr >= CC_TEST2 && addr <= CC_TEST0) || addr >= CC_PA_TABLE7);
+}
+
+static void reg_write(uint8_t addr, uint8_t value)
+{
+    m_regs[addr] = value;
+
+    switch (addr) {
+    case CC_CHANNR:
+    case CC_FREQ2:
+    case CC_FREQ1:
+    case CC_FREQ0:
+    case CC_MDMCFG1:
+    case CC_MDMCFG0:
+        m_freq_dirty = true;
+        break;
+    case CC_FREND0:
+        m_power_dirty = true;
+        m_power_written = true;
+        break;
+    default:
+        if (addr >= CC_PA_TABLE7) {
+            m_power_dirty = true;
+            m_power_written = true;
+        }
+        break;
+    }
+}
+
+static void regs_reset(void)
+{
+    memcpy(m_regs, cc_reg_default, sizeof(m_regs));
+    memset(&m_tx_registers, 0, sizeof(m_tx_registers));
+    memset(&m_rx_registers, 0, sizeof(m_rx_registers));
+    m_encoding = CODEC_NONE;
+    m_chan_count = 0;
+    m_freq_dirty = true;
+    m_power_dirty = false;
+    m_power_written = false;
+}
+
+// f = fxosc / 2^16 * (FREQ + CHANNR * (256 + CHANSPC_M) * 2^(CHANSPC_E - 2))
+static uint32_t cc_freq_hz(void)
+{
+    uint32_t freq = ((uint32_t)m_regs[CC_FREQ2] << 16) | ((uint32_t)m_regs[CC_FREQ1] << 8) | m_regs[CC_FREQ0];
+    uint32_t chan_spacing = (256 + (uint32_t)m_regs[CC_MDMCFG0]) << (m_regs[CC_MDMCFG1] & 0x03);
+    uint64_t quarter_steps = (uint64_t)freq * 4 + (uint64_t)m_regs[CC_CHANNR] * chan_spacing;
+
+    return (uint32_t)((quarter_steps * CC_FXOSC_HZ) >> 18);
+}
+
+// The band picks the protocol, and with it the RFM69 module and its config table
+static eSubgMode_t band_mode(uint32_t freq_hz)
+{
+    if (freq_hz < 600000000) {
+        return SUBG_MODE_OMNIPOD;
+    }
+    if (freq_hz < 900000000) {
+        return SUBG_MODE_MINIMED_WWL;
+    }
+    return SUBG_MODE_MINIMED_NAS;
+}
+
+// TX power is capped at the PA table entry FREND0 selects, codes outside the table keep the current cap.
+// The same cap written again (mode registers do it before every packet) leaves the power control running.
+static void power_apply(void)
+{
+    eRf69Dev_t dev = (Subg_GetMode() == SUBG_MODE_OMNIPOD) ? RF69_DEV_FREQ433 : RF69_DEV_FREQ916N868;
+    uint8_t pa = m_regs[CC_PA_TABLE0 - (m_regs[CC_FREND0] & CC_FREND0_PA_POWER)];
+    sPwrBound_t bound;
+    uint8_t i;
+
+    for (i = 0; i < sizeof(cc_pa_dbm) / sizeof(cc_pa_dbm[0]); i++) {
+        if (cc_pa_dbm[i].pa == pa) {
+            Pwr_GetBound(dev, &bound);
+            if (bound.maxDbm == cc_pa_dbm[i].dbm) {
+                break;
+            }
+            bound.maxDbm = cc_pa_dbm[i].dbm;
+            if (bound.minDbm > bound.maxDbm) {
+                bound.minDbm = bound.maxDbm;
+            }
+            Pwr_SetBound(dev, &bound);
+            break;
+        }
+    }
+}
+
+static void radio_sync(uint8_t channel, const mode_registers_t *p_mode_registers)
+{
+    uint32_t freq_hz;
+    uint8_t i;
+
+    for (i = 0; i < p_mode_registers->count; i++) {
+        reg_write(p_mode_registers->addr[i], p_mode_registers->value[i]);
+    }
+    if (channel != m_regs[CC_CHANNR]) {
+        reg_write(CC_CHANNR, channel);
+    }
+
+    if (m_freq_dirty) {
+        if (m_regs[CC_CHANNR] < m_chan_count) {
+            // a hop within the table is one register burst, worked out when it was loaded
+            Subg_SetMode(band_mode(m_chan_hz[m_regs[CC_CHANNR]]));
+            Subg_SetChan(m_regs[CC_CHANNR]);
+        } else {
+            freq_hz = cc_freq_hz();
+            Subg_SetMode(band_mode(freq_hz));
+            Subg_SetFreq(freq_hz);
+        }
+        m_freq_dirty = false;
+        // the cap is per module, a band change may have switched to the other one
+        m_power_dirty = m_power_written;
+    }
+    if (m_power_dirty) {
+        power_apply();
+        m_power_dirty = false;
+    }
+}
+
+/* Radio */
+
+// Software encode into m_tx_buf, false if it does not fit.
+static bool tx_encode(const uint8_t *data, uint8_t len, uint16_t *p_encoded_len)
+{
+    uint16_t needed;
+
+    switch (m_encoding) {
+    case CODEC_MANCHESTER:
+        needed = (uint16_t)len * 2;
+        break;
+    case CODEC_4B6B:
+        needed = ((uint16_t)len * 3 + 1) / 2;
+        break;
+    default:
+        needed = len;
+        break;
+    }
+    if (needed > sizeof(m_tx_buf)) {
+        return false;
+    }
+
+    *p_encoded_len = Codec_Encode(m_encoding, data, len, m_tx_buf, sizeof(m_tx_buf), true);
+    return true;
+}
+
+// Line coded as the CC1110 sends it, 4b6b with its nibble padding (app_subg adds the 0x00 trailer).
+// SUBG_TX_LEN_ERROR if the coded packet is longer than the mode can frame, nothing is sent then.
+static eSubgTxStatus_t send(uint8_t channel, const uint8_t *data, uint8_t len, uint8_t repeat_count, uint16_t delay_ms, uint16_t preamble_ext_ms)
+{
+    uint16_t encoded_len;
+
+    if (!tx_encode(data, len, &encoded_len)) {
+        return SUBG_TX_LEN_ERROR;
+    }
+
+    radio_sync(channel, &m_tx_registers);
+    return Subg_SendPkt(m_tx_buf, encoded_len, repeat_count, delay_ms, preamble_ext_ms);
+}
+
+static eSubgRxStatus_t receive(uint8_t channel, uint32_t timeout_ms, uint8_t *p_len)
+{
+    eSubgRxStatus_t status;
+    uint16_t raw_len = 0;
+
+    radio_sync(channel, &m_rx_registers);
+    status = Subg_GetPkt(m_rx_buf, sizeof(m_rx_buf), &raw_len, timeout_ms, false);
+    *p_len = 0;
+    if (status == SUBG_RX_OK) {
+        *p_len = (uint8_t)Codec_Decode(m_encoding, m_rx_buf, raw_len, m_response + RX_HDR_LEN, sizeof(m_response) - RX_HDR_LEN);
+    }
+    return status;
+}
+
+static void respond_rx(eSubgRxStatus_t status, uint8_t len)
+{
+    switch (status) {
+    case SUBG_RX_OK:
+        m_response[0] = SUBG_RFSPY_RESPONSE_SUCCESS;
+        m_response[1] = cc1110_rssi(Subg_GetRssi());
+        m_response[2] = m_packet_count++;
+        respond(m_response, len + RX_HDR_LEN);
+        break;
+    case SUBG_RX_INT:
+        respond_code(SUBG_RFSPY_RESPONSE_CMD_INTERRUPTED);
+        break;
+    default:
+        // overrun-corrupted packets are dropped, the CC1110 never reports them either
+        respond_code(SUBG_RFSPY_RESPONSE_RX_TIMEOUT);
+        break;
+    }
+}
+
+/* Commands */
+
+static void cmd_get_packet(const uint8_t *data, uint8_t len)
+{
+    eSubgRxStatus_t status;
+    uint8_t rx_len;
+
+    if (len < 6) {
+        respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+        return;
+    }
+    status = receive(data[1], get_u32(data + 2), &rx_len);
+    respond_rx(status, rx_len);
+}
+
+static void cmd_send_packet(const uint8_t *data, uint8_t len)
+{
+    eSubgTxStatus_t status;
+
+    if (len < 7) {
+        respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+        return;
+    }
+    status = send(data[1], data + 7, len - 7, data[2], get_u16(data + 3), get_u16(data + 5));
+    if (status == SUBG_TX_LEN_ERROR) {
+        respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+        return;
+    }
+    respond_code(status == SUBG_TX_ABORT ? SUBG_RFSPY_RESPONSE_CMD_INTERRUPTED : SUBG_RFSPY_RESPONSE_SUCCESS);
+}
+
+// One packet with its first bit on air delay_us after the command runs. The start error
+// tells the host how far off that was, INT32_MAX when the delay was already over.
+static void cmd_send_packet_at(const uint8_t *data, uint8_t len)
+{
+    uint8_t response[5];
+    uint16_t encoded_len;
+    int32_t start_err_us;
+    uint32_t delay_us;
+
+    if (len < 8 || !tx_encode(data + 8, len - 8, &encoded_len)) {
+        respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+        return;
+    }
+    delay_us = get_u32(data + 2);
+
+    radio_sync(data[1], &m_tx_registers);
+    start_err_us = Subg_SendPktIn(m_tx_buf, encoded_len, delay_us, get_u16(data + 6));
+    switch (Subg_GetTxStatus()) {
+    case SUBG_TX_ABORT:
+        respond_code(SUBG_RFSPY_RESPONSE_CMD_INTERRUPTED);
+        return;
+    case SUBG_TX_LEN_ERROR:
+        respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+        return;
+    default:
+        break;
+    }
+
+    response[0] = SUBG_RFSPY_RESPONSE_SUCCESS;
+    put_u32(response + 1, (uint32_t)start_err_us);
+    respond(response, sizeof(response));
+}
+
+static void cmd_send_and_listen(const uint8_t *data, uint8_t len)
+{
+    eSubgRxStatus_t status;
+    uint8_t rx_len = 0;
+    uint8_t retry_count;
+    uint32_t timeout_ms;
+    uint16_t preamble_ext_ms;
+    eSubgTxStatus_t tx_status;
+
+    if (len < 13) {
+        respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+        return;
+    }
+    timeout_ms = get_u32(data + 6);
+    retry_count = data[10];
+    preamble_ext_ms = get_u16(data + 11);
+
+    tx_status = send(data[1], data + 13, len - 13, data[2], get_u16(data + 3), preamble_ext_ms);
+    if (tx_status == SUBG_TX_ABORT) {
+        respond_code(SUBG_RFSPY_RESPONSE_CMD_INTERRUPTED);
+        return;
+    }
+    if (tx_status == SUBG_TX_LEN_ERROR) {
+        respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+        return;
+    }
+
+    // no answer within the timeout: the packet goes out again, up to retry_count times.
+    // Every answer or silence goes to the TX power control.
+    while (1) {
+        status = receive(data[5], timeout_ms, &rx_len);
+        if (status != SUBG_RX_INT) {
+            Subg_TxFeedback(status == SUBG_RX_OK);
+        }
+        if (status == SUBG_RX_OK || status == SUBG_RX_INT || retry_count == 0) {
+            break;
+        }
+        retry_count--;
+        if (send(data[1], data + 13, len - 13, 0, 0, preamble_ext_ms) == SUBG_TX_ABORT) {
+            status = SUBG_RX_INT;
+            break;
+        }
+    }
+    respond_rx(status, rx_len);
+}
+
+static void cmd_update_register(const uint8_t *data, uint8_t len)
+{
+    if (len < 3 || !reg_valid(data[1])) {
+        respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+        return;
+    }
+    reg_write(data[1], data[2]);
+    respond_code(SUBG_RFSPY_RESPONSE_SUCCESS);
+}
+
+static void cmd_read_register(const uint8_t *data, uint8_t len)
+{
+    uint8_t response[2];
+
+    if (len < 2 || !reg_valid(data[1])) {
+        respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+        return;
+    }
+    response[0] = SUBG_RFSPY_RESPONSE_SUCCESS;
+    response[1] = m_regs[data[1]];
+    respond(response, sizeof(response));
+}
+
+// mode, then address/value pairs applied before every transmission or reception
+static void cmd_set_mode_registers(const uint8_t *data, uint8_t len)
+{
+    mode_registers_t *p_mode_registers;
+    uint8_t count;
+    uint8_t i;
+
+    if (len < 2 || (len - 2) % 2 != 0 || (len - 2) / 2 > MODE_REGISTERS_MAX) {
+        respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+        return;
+    }
+    if (data[1] == MODE_REGISTERS_TX) {
+        p_mode_registers = &m_tx_registers;
+    } else if (data[1] == MODE_REGISTERS_RX) {
+        p_mode_registers = &m_rx_registers;
+    } else {
+        respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+        return;
+    }
+
+    count = (len - 2) / 2;
+    for (i = 0; i < count; i++) {
+        if (!reg_valid(data[2 + i * 2])) {
+            respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+            return;
+        }
+    }
+    for (i = 0; i < count; i++) {
+        p_mode_registers->addr[i] = data[2 + i * 2];
+        p_mode_registers->value[i] = data[3 + i * 2];
+    }
+    p_mode_registers->count = count;
+    respond_code(SUBG_RFSPY_RESPONSE_SUCCESS);
+}
+
+static void cmd_set_sw_encoding(const uint8_t *data, uint8_t len)
+{
+    if (len < 2 || data[1] >= CODEC_NUM) {
+        respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+        return;
+    }
+    m_encoding = (eCodec_t)data[1];
+    respond_code(SUBG_RFSPY_RESPONSE_SUCCESS);
+}
+
+static void cmd_get_statistics(void)
+{
+    const sSubgStats_t *p_stats = Subg_GetStats();
+    uint8_t response[STATISTICS_LEN];
+    uint32_t uptime_ms = Time_GetMs();
+    uint32_t overrun = 0;
+    uint8_t *p = response;
+    uint8_t i;
+
+    for (i = 0; i < SUBG_MODE_NUM; i++) {
+        overrun += p_stats[i].fifoOverrunCnt;
+    }
+
+    *p++ = SUBG_RFSPY_RESPONSE_SUCCESS;
+    *p++ = (uint8_t)(uptime_ms >> 24);
+    *p++ = (uint8_t)(uptime_ms >> 16);
+    *p++ = (uint8_t)(uptime_ms >> 8);
+    *p++ = (uint8_t)uptime_ms;
+    p = put_u16(p, (uint16_t)overrun);      // radio rx overflow
+    p = put_u16(p, 0);                      // rx fifo overflow, there is no fifo between the radio and the host
+    p = put_u16(p, Subg_GetRxPktCnt());
+    p = put_u16(p, Subg_GetTxPktCnt());
+    p = put_u16(p, 0);                      // crc failures
+    p = put_u16(p, 0);                      // spi sync failures, no spi hop
+    p = put_u16(p, 0);
+    p = put_u16(p, 0);
+    respond(response, (uint8_t)(p - response));
+}
+
+// A pump known to be on the other band is spoken to there, not on the app's guess.
+// The app's registers are applied again on the next command.
+static void minimed_use_region(const uint8_t *pump_id)
+{
+    eSubgMode_t region = Minimed_GetRegion(pump_id);
+
+    if (region != SUBG_MODE_NUM && region != Subg_GetMode()) {
+        NRF_LOG_INFO("Pump region cached, switching to mode %d", region);
+        Subg_SetMode(region);
+        Subg_SetFreq(Minimed_RegionFreq(region));
+        m_freq_dirty = true;
+        // the cap is per module, as in radio_sync
+        if (m_power_written) {
+            power_apply();
+        }
+    }
+}
+
+// The whole download runs here, the app gets one answer instead of driving every
+// wake-up, command and ack itself. 1KB does not fit DATA, the page goes out on the
+// Capture characteristic as CAPTURE_FRAME_TYPE_HISTORY chunks after the answer.
+static void cmd_read_history_page(const uint8_t *data, uint8_t len)
+{
+    eMinimedStatus_t status;
+    uint8_t response[2];
+
+    // the last page is still being streamed from m_history_page
+    if (len < 6 || Capture_IsDumping()) {
+        respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+        return;
+    }
+    radio_sync(data[1], &m_tx_registers);
+    if (Subg_GetMode() == SUBG_MODE_OMNIPOD) {
+        respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+        return;
+    }
+    minimed_use_region(data + 2);
+
+    status = Minimed_ReadHistoryPage(data + 2, data[5], m_history_page);
+    switch (status) {
+    case MINIMED_ABORT:
+        respond_code(SUBG_RFSPY_RESPONSE_CMD_INTERRUPTED);
+        break;
+    case MINIMED_NO_RESPONSE:
+        respond_code(SUBG_RFSPY_RESPONSE_RX_TIMEOUT);
+        break;
+    default:
+        response[0] = SUBG_RFSPY_RESPONSE_SUCCESS;
+        response[1] = (uint8_t)status;
+        respond(response, sizeof(response));
+        if (status == MINIMED_OK) {
+            Capture_DumpBlob(CAPTURE_FRAME_TYPE_HISTORY, m_history_page, MINIMED_PAGE_LEN);
+        }
+        break;
+    }
+}
+
+// Cached region of a pump, or with probe set (or nothing cached) found by probing both bands
+static void cmd_minimed_region(const uint8_t *data, uint8_t len)
+{
+    eMinimedStatus_t status = MINIMED_OK;
+    eSubgMode_t region;
+    uint8_t response[7];
+    uint8_t *p = response;
+
+    if (len < 5) {
+        respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+        return;
+    }
+
+    region = Minimed_GetRegion(data + 1);
+    if (data[4] != 0 || region == SUBG_MODE_NUM) {
+        status = Minimed_DetectRegion(data + 1, &region);
+        // the radio was moved around, the app's registers go back on the next command
+        m_freq_dirty = true;
+        m_power_dirty = m_power_written;
+        if (status == MINIMED_ABORT) {
+            respond_code(SUBG_RFSPY_RESPONSE_CMD_INTERRUPTED);
+            return;
+        }
+        if (status != MINIMED_OK) {
+            region = SUBG_MODE_NUM;
+        }
+    }
+
+    *p++ = SUBG_RFSPY_RESPONSE_SUCCESS;
+    *p++ = (uint8_t)status;
+    *p++ = (uint8_t)region;
+    p = put_u32(p, (region == SUBG_MODE_NUM) ? 0 : Minimed_RegionFreq(region));
+    respond(response, (uint8_t)(p - response));
+}
+
+// One pod message out, its reply back: packets, acks and retransmissions stay on the nRF52
+static void cmd_omnipod_exchange(const uint8_t *data, uint8_t len)
+{
+    eOmnipodStatus_t status;
+    uint8_t seq;
+    uint16_t rsp_len;
+
+    if (len < 7 || len - 7 > OMNIPOD_MSG_MAX_LEN) {
+        respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+        return;
+    }
+    radio_sync(data[1], &m_tx_registers);
+    if (Subg_GetMode() != SUBG_MODE_OMNIPOD) {
+        respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+        return;
+    }
+
+    seq = data[6] & OMNIPOD_SEQ_MASK;
+    status = Omnipod_Exchange(get_u32(data + 2), &seq, data + 7, len - 7, m_response + 3, OMNIPOD_MSG_MAX_LEN, &rsp_len);
+    switch (status) {
+    case OMNIPOD_ABORT:
+        respond_code(SUBG_RFSPY_RESPONSE_CMD_INTERRUPTED);
+        break;
+    case OMNIPOD_NO_RESPONSE:
+        respond_code(SUBG_RFSPY_RESPONSE_RX_TIMEOUT);
+        break;
+    default:
+        m_response[0] = SUBG_RFSPY_RESPONSE_SUCCESS;
+        m_response[1] = (uint8_t)status;
+        m_response[2] = seq;
+        respond(m_response, (uint8_t)(3 + rsp_len));
+        break;
+    }
+}
+
+// Background MySentry/CGM listening between commands, repeats dropped and the rest batched
+static void cmd_broadcast_listen(const uint8_t *data, uint8_t len)
+{
+    sBcastCfg_t cfg;
+    uint32_t freq_hz;
+
+    if (len < 8) {
+        respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+        return;
+    }
+    if (get_u16(data + 6) == 0) {
+        Bcast_Stop();
+        respond_code(SUBG_RFSPY_RESPONSE_SUCCESS);
+        return;
+    }
+
+    // one background listener at a time
+    Capture_Stop();
+    radio_sync(data[1], &m_rx_registers);
+    freq_hz = cc_freq_hz();
+    cfg.listen.idleUs = (uint32_t)get_u16(data + 2) * 1000;
+    cfg.listen.rxUs = (uint32_t)get_u16(data + 4) * 1000;
+    cfg.listen.wake = LISTEN_WAKE_RSSI_SYNC;
+    cfg.batchMs = (uint32_t)get_u16(data + 6) * 1000;
+    cfg.dedupMs = BROADCAST_DEDUP_MS;
+    if (cfg.listen.rxUs == 0 || !Bcast_Start(band_mode(freq_hz), freq_hz, &cfg)) {
+        respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+        return;
+    }
+    respond_code(SUBG_RFSPY_RESPONSE_SUCCESS);
+}
+
+static void cmd_broadcast_stats(void)
+{
+    const sBcastStats_t *p_stats = Bcast_GetStats();
+    uint8_t response[1 + 8 * 4];
+    uint8_t *p = response;
+
+    *p++ = SUBG_RFSPY_RESPONSE_SUCCESS;
+    p = put_u32(p, p_stats->rxCnt);
+    p = put_u32(p, p_stats->badCnt);
+    p = put_u32(p, p_stats->dupCnt);
+    p = put_u32(p, p_stats->uniqueCnt);
+    p = put_u32(p, p_stats->dropCnt);
+    p = put_u32(p, p_stats->batchCnt);
+    p = put_u32(p, p_stats->rawBytes);
+    p = put_u32(p, p_stats->sentBytes);
+    respond(response, (uint8_t)(p - response));
+}
+
+// Duty cycle and modelled current of broadcast listening since it was started,
+// the wakes of the host included.
+static void cmd_listen_report(void)
+{
+    sListenReport_t report;
+    uint8_t response[2 + 8 * 4];
+    uint8_t *p = response;
+
+    Listen_GetReport(&report);
+    *p++ = SUBG_RFSPY_RESPONSE_SUCCESS;
+    *p++ = Bcast_IsRunning() ? 1 : 0;
+    p = put_u32(p, report.idleUs);
+    p = put_u32(p, report.rxUs);
+    p = put_u32(p, report.dutyPpm);
+    p = put_u32(p, report.avgCurrentNa);
+    p = put_u32(p, report.wakeCnt);
+    p = put_u32(p, report.pktCnt);
+    p = put_u32(p, report.wakeUs);
+    p = put_u32(p, report.listenMs);
+    respond(response, (uint8_t)(p - response));
+}
+
+// Every packet on the channel streamed on the Capture characteristic with its time and RSSI,
+// between commands. The counters start over with each start and show what the link dropped.
+static void cmd_capture(const uint8_t *data, uint8_t len)
+{
+    const sCaptureStats_t *p_stats = Capture_GetStats();
+    uint8_t response[2 + 5 * 4 + 1];
+    uint8_t *p = response;
+    uint32_t freq_hz;
+
+    if (len < 3) {
+        respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+        return;
+    }
+    if (data[2] == 0) {
+        Capture_Stop();
+    } else {
+        Bcast_Stop();
+        radio_sync(data[1], &m_rx_registers);
+        freq_hz = cc_freq_hz();
+        Capture_ClrStats();
+        Capture_Start(band_mode(freq_hz), freq_hz);
+    }
+
+    *p++ = SUBG_RFSPY_RESPONSE_SUCCESS;
+    *p++ = Capture_IsRunning() ? 1 : 0;
+    p = put_u32(p, p_stats->capturedCnt);
+    p = put_u32(p, p_stats->notifiedCnt);
+    p = put_u32(p, p_stats->queueDropCnt);
+    p = put_u32(p, p_stats->linkDropCnt);
+    p = put_u32(p, p_stats->busyCnt);
+    *p++ = p_stats->queueHighWater;
+    respond(response, (uint8_t)(p - response));
+}
+
+// Radio trace of the rx path (fifo bytes, RSSI, DIO0) for replay on the host simulator.
+// A dump stops recording and streams the trace on Capture as CAPTURE_FRAME_TYPE_TRACE
+// chunks after the answer.
+static void cmd_trace(const uint8_t *data, uint8_t len)
+{
+    uint8_t response[8];
+    uint8_t *p = response;
+    uint16_t trace_len;
+
+    if (len < 2 || data[1] > TRACE_ACTION_DUMP) {
+        respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+        return;
+    }
+
+    switch (data[1]) {
+    case TRACE_ACTION_START:
+        Trace_Start();
+        break;
+    case TRACE_ACTION_DUMP:
+        // the last dump is still being streamed
+        if (Capture_IsDumping()) {
+            respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+            return;
+        }
+        Trace_Stop();
+        break;
+    default:
+        Trace_Stop();
+        break;
+    }
+
+    Trace_Get(&trace_len);
+    *p++ = SUBG_RFSPY_RESPONSE_SUCCESS;
+    *p++ = Trace_IsRecording() ? 1 : 0;
+    p = put_u16(p, trace_len);
+    p = put_u32(p, Trace_GetDropCnt());
+    respond(response, (uint8_t)(p - response));
+
+    if (data[1] == TRACE_ACTION_DUMP) {
+        Capture_DumpTrace();
+    }
+}
+
+// Frequencies the channel byte of the radio commands selects from now on, e.g. for a
+// region scan. Channels past the table still go by the CC1110 channel spacing.
+static void cmd_set_chan_table(const uint8_t *data, uint8_t len)
+{
+    uint8_t count;
+    uint8_t i;
+
+    if (len < 2 || data[1] > SUBG_CHAN_MAX || len < 2 + (uint16_t)data[1] * 4) {
+        respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+        return;
+    }
+    count = data[1];
+    for (i = 0; i < count; i++) {
+        m_chan_hz[i] = get_u32(data + 2 + i * 4);
+    }
+    if (!Subg_SetChanTable(m_chan_hz, count)) {
+        respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+        return;
+    }
+    m_chan_count = count;
+    m_freq_dirty = true;
+    respond_code(SUBG_RFSPY_RESPONSE_SUCCESS);
+}
+
+// Crystal drift curve of one radio as learned so far, bins of TCOMP_BIN_C from TCOMP_TEMP_MIN_C.
+// Forgetting it makes the current temperature the reference.
+static void cmd_temp_curve(const uint8_t *data, uint8_t len)
+{
+    const sTcompCurve_t *p_curve;
+    uint8_t response[4 + TCOMP_BIN_NUM * 4];
+    uint8_t *p = response;
+    uint8_t i;
+
+    if (len < 3 || data[1] >= TCOMP_DEV_NUM) {
+        respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+        return;
+    }
+    if (data[2] != 0) {
+        Tcomp_Forget(data[1]);
+    }
+
+    p_curve = Tcomp_GetCurve(data[1]);
+    if (p_curve == NULL) {
+        respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+        return;
+    }
+
+    *p++ = SUBG_RFSPY_RESPONSE_SUCCESS;
+    *p++ = (uint8_t)Tcomp_GetTemp(data[1]);
+    *p++ = p_curve->refBin;
+    *p++ = Tcomp_IsUncertain(data[1]) ? 1 : 0;
+    for (i = 0; i < TCOMP_BIN_NUM; i++) {
+        p = put_u16(p, (uint16_t)p_curve->bin[i].corrPpb);
+        *p++ = p_curve->bin[i].sampleCnt;
+        *p++ = p_curve->bin[i].errBound;
+    }
+    respond(response, (uint8_t)(p - response));
+}
+
+void subg_rfspy_native_init(radio_backend_response_handler_t *response_handler)
+{
+    m_response_handler = response_handler;
+    regs_reset();
+}
+
+void subg_rfspy_native_run(uint8_t *data, uint8_t len)
+{
+    // the broadcast listener gets the radio back once the command is done
+    Bcast_Hold();
+
+    switch (data[0]) {
+    case SUBG_RFSPY_CMD_GET_STATE:
+        respond((const uint8_t *)SUBG_RFSPY_STATE_OK, sizeof(SUBG_RFSPY_STATE_OK) - 1);
+        break;
+    case SUBG_RFSPY_CMD_GET_VERSION:
+        respond((const uint8_t *)SUBG_RFSPY_VERSION, sizeof(SUBG_RFSPY_VERSION) - 1);
+        break;
+    case SUBG_RFSPY_CMD_GET_PACKET:
+        cmd_get_packet(data, len);
+        break;
+    case SUBG_RFSPY_CMD_SEND_PACKET:
+        cmd_send_packet(data, len);
+        break;
+    case SUBG_RFSPY_CMD_SEND_AND_LISTEN:
+        cmd_send_and_listen(data, len);
+        break;
+    case SUBG_RFSPY_CMD_UPDATE_REGISTER:
+        cmd_update_register(data, len);
+        break;
+    case SUBG_RFSPY_CMD_RESET:
+        // the CC1110 reboots and does not answer
+        Bcast_Stop();
+        Capture_Stop();
+        regs_reset();
+        Subg_CfgRf();
+        Subg_SetPreamble(0);
+        m_packet_count = 0;
+        break;
+    case SUBG_RFSPY_CMD_LED:
+        // the CC1110 LEDs, the nRF52 ones belong to the LED Mode characteristic
+        respond_code(SUBG_RFSPY_RESPONSE_SUCCESS);
+        break;
+    case SUBG_RFSPY_CMD_READ_REGISTER:
+        cmd_read_register(data, len);
+        break;
+    case SUBG_RFSPY_CMD_SET_MODE_REGISTERS:
+        cmd_set_mode_registers(data, len);
+        break;
+    case SUBG_RFSPY_CMD_SET_SW_ENCODING:
+        cmd_set_sw_encoding(data, len);
+        break;
+    case SUBG_RFSPY_CMD_SET_PREAMBLE:
+        if (len < 3) {
+            respond_code(SUBG_RFSPY_RESPONSE_PARAM_ERROR);
+            break;
+        }
+        Subg_SetPreamble(get_u16(data + 1));
+        respond_code(SUBG_RFSPY_RESPONSE_SUCCESS);
+        break;
+    case SUBG_RFSPY_CMD_RESET_RADIO_CONFIG:
+        regs_reset();
+        respond_code(SUBG_RFSPY_RESPONSE_SUCCESS);
+        break;
+    case SUBG_RFSPY_CMD_GET_STATISTICS:
+        cmd_get_statistics();
+        break;
+    case SUBG_RFSPY_CMD_READ_HISTORY_PAGE:
+        cmd_read_history_page(data, len);
+        break;
+    case SUBG_RFSPY_CMD_OMNIPOD_EXCHANGE:
+        cmd_omnipod_exchange(data, len);
+        break;
+    case SUBG_RFSPY_CMD_BROADCAST_LISTEN:
+        cmd_broadcast_listen(data, len);
+        break;
+    case SUBG_RFSPY_CMD_BROADCAST_STATS:
+        cmd_broadcast_stats();
+        break;
+    case SUBG_RFSPY_CMD_MINIMED_REGION:
+        cmd_minimed_region(data, len);
+        break;
+    case SUBG_RFSPY_CMD_TEMP_CURVE:
+        cmd_temp_curve(data, len);
+        break;
+    case SUBG_RFSPY_CMD_CAPTURE:
+        cmd_capture(data, len);
+        break;
+    case SUBG_RFSPY_CMD_TRACE:
+        cmd_trace(data, len);
+        break;
+    case SUBG_RFSPY_CMD_SEND_PACKET_AT:
+        cmd_send_packet_at(data, len);
+        break;
+    case SUBG_RFSPY_CMD_SET_CHAN_TABLE:
+        cmd_set_chan_table(data, len);
+        break;
+    case SUBG_RFSPY_CMD_LISTEN_REPORT:
+        cmd_listen_report();
+        break;
+    default:
+        NRF_LOG_INFO("Unknown command 0x%02x", data[0]);
+        respond_code(SUBG_RFSPY_RESPONSE_UNKNOWN_COMMAND);
+        break;
+    }
+
+    Bcast_Resume();
+    Capture_Resume();
+    // background listening is on its own frequency again, the next command retunes to the app's
+    if (Bcast_IsRunning() || Capture_IsRunning()) {
+        m_freq_dirty = true;
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef SUBG_RFSPY_NATIVE_H
+#define SUBG_RFSPY_NATIVE_H
+
+#include <stdint.h>
+#include "radio_backend.h"
+
+// subg_rfspy commands executed on the nRF52 against app_subg, answered byte for byte
+// like the CC1110 firmware does. CC1110 register writes land in a shadow register file,
+// the ones with an RFM69 counterpart (frequency, channel, PA table) are carried over.
+
+void subg_rfspy_native_init(radio_backend_response_handler_t *response_handler);
+void subg_rfspy_native_run(uint8_t *data, uint8_t len);
+
+#endif // SUBG_RFSPY_NATIVE_H
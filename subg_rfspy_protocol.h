@@ -0,0 +1,47 @@
+#ifndef SUBG_RFSPY_PROTOCOL_H
+#define SUBG_RFSPY_PROTOCOL_H
+
+// subg_rfspy command set, as written by the apps to the DATA characteristic (after
+// the length byte) and run by the radio backend. Multi-byte fields are big endian.
+
+#define SUBG_RFSPY_CMD_GET_STATE            0x01
+#define SUBG_RFSPY_CMD_GET_VERSION          0x02
+#define SUBG_RFSPY_CMD_GET_PACKET           0x03  // channel, timeout_ms(4)
+#define SUBG_RFSPY_CMD_SEND_PACKET          0x04  // channel, repeat_count, delay_ms(2), preamble_ext_ms(2), data
+#define SUBG_RFSPY_CMD_SEND_AND_LISTEN      0x05  // send_channel, repeat_count, delay_ms(2), listen_channel, timeout_ms(4), retry_count, preamble_ext_ms(2), data
+#define SUBG_RFSPY_CMD_UPDATE_REGISTER      0x06
+#define SUBG_RFSPY_CMD_RESET                0x07
+#define SUBG_RFSPY_CMD_LED                  0x08
+#define SUBG_RFSPY_CMD_READ_REGISTER        0x09
+#define SUBG_RFSPY_CMD_SET_MODE_REGISTERS   0x0a
+#define SUBG_RFSPY_CMD_SET_SW_ENCODING      0x0b
+#define SUBG_RFSPY_CMD_SET_PREAMBLE         0x0c  // preamble(2)
+#define SUBG_RFSPY_CMD_RESET_RADIO_CONFIG   0x0d
+#define SUBG_RFSPY_CMD_GET_STATISTICS       0x0e
+
+// nRF52 extensions, RFM69 backend only
+#define SUBG_RFSPY_CMD_READ_HISTORY_PAGE    0x80  // channel, pump id(3), page; answers success, status, page streamed on Capture
+#define SUBG_RFSPY_CMD_OMNIPOD_EXCHANGE     0x81  // channel, packet address(4), sequence, message; answers success, status, next sequence, message
+#define SUBG_RFSPY_CMD_BROADCAST_LISTEN     0x82  // channel, idle_ms(2), rx_ms(2), batch_s(2), batch_s 0 stops; batches streamed on Capture
+#define SUBG_RFSPY_CMD_BROADCAST_STATS      0x83  // answers success, 8 counters(4), see sBcastStats_t
+#define SUBG_RFSPY_CMD_MINIMED_REGION       0x84  // pump id(3), probe; answers success, status, region (1 916MHz, 2 868MHz, 3 unknown), freq_hz(4)
+#define SUBG_RFSPY_CMD_TEMP_CURVE           0x85  // radio (0 433MHz, 1 916/868MHz), forget; answers success, temp_c, ref_bin, uncertain, 18 bins of corr_ppb(2), count, err(x50ppb)
+#define SUBG_RFSPY_CMD_CAPTURE              0x86  // channel, on (0 stops); answers success, running, 5 counters(4), queue high water, see sCaptureStats_t; packets streamed on Capture
+#define SUBG_RFSPY_CMD_TRACE                0x87  // action (0 stop, 1 start, 2 dump); answers success, recording, len(2), dropped(4); dump streamed on Capture
+#define SUBG_RFSPY_CMD_SEND_PACKET_AT       0x88  // channel, delay_us(4), preamble_ext_ms(2), data; answers success, start error us(4, signed, 0x7fffffff too late)
+#define SUBG_RFSPY_CMD_SET_CHAN_TABLE       0x89  // count, freq_hz(4) per channel; while loaded the channel byte of radio commands picks an entry, count 0 unloads
+#define SUBG_RFSPY_CMD_LISTEN_REPORT        0x8a  // answers success, running, idle_us(4), rx_us(4), duty_ppm(4), avg_current_na(4), wakes(4), packets(4), wake_us(4), listen_ms(4), see sListenReport_t
+
+#define SUBG_RFSPY_RESPONSE_PARAM_ERROR     0x11
+#define SUBG_RFSPY_RESPONSE_UNKNOWN_COMMAND 0x22
+#define SUBG_RFSPY_RESPONSE_RX_TIMEOUT      0xaa
+#define SUBG_RFSPY_RESPONSE_CMD_INTERRUPTED 0xbb
+#define SUBG_RFSPY_RESPONSE_SUCCESS         0xdd  // followed by rssi, packet number, data for received packets
+
+#define SUBG_RFSPY_STATE_OK                 "OK"
+#define SUBG_RFSPY_VERSION                  "subg_rfspy 2.2"
+
+// CC1110 RSSI byte: dBm = rssi / 2 - 73, rssi read as signed
+#define SUBG_RFSPY_RSSI_OFFSET              73
+
+#endif // SUBG_RFSPY_PROTOCOL_H
@@ -6,16 +6,18 @@
 #include "nrf_log_default_backends.h"
 #include "nrf_delay.h"
 #include "nrf_drv_gpiote.h"
+#include "app_scheduler.h"
+#include "app_util_platform.h"
 
 #include "subg_rfspy_spi.h"
+#include "isr_timing.h"
 
-#define NRFX_SPIM_SCK_PIN  9
-#define NRFX_SPIM_MOSI_PIN 10
-#define NRFX_SPIM_MISO_PIN 29
-#define NRFX_SPIM_SS_PIN   4
+// The SPIM and GPIOTE interrupts only queue an event for app_scheduler. The transaction
+// steps, their delays, logging and the response handler (which notifies over BLE) all
+// run from app_sched_execute in the main loop. State moves out of Idle in a critical
+// region since commands arrive from BLE event context and data ready from GPIOTE.
 
-#define SPI_INSTANCE 0                                            /**< SPI instance index. */
-static const nrfx_spim_t spi = NRFX_SPIM_INSTANCE(SPI_INSTANCE);  /**< SPI instance. */
+static const nrfx_spim_t spi = NRFX_SPIM_INSTANCE(CC1110_SPIM_INSTANCE);  /**< SPI instance. */
 
 static volatile bool spi_xfer_done;  /**< Flag used to indicate that SPI instance completed the transfer. */
 
@@ -30,6 +32,7 @@ static uint8_t size_rx_buf[2];  /**< Size exchange RX buffer. */
 static subg_rfspy_spi_response_handler_t *m_response_handler = NULL;
 
 static volatile enum State{Size,Xfer,Idle} state;
+static volatile uint32_t m_sched_drop_count = 0;
 
 static void size_exchange();
 static void xfer_data();
@@ -43,43 +46,49 @@ static bool is_response_ready()
 
 static void start_spi_transaction()
 {
-    nrf_gpio_pin_clear(NRFX_SPIM_SS_PIN);
+    nrf_gpio_pin_clear(CC1110_SPI_SS_PIN);
     nrf_delay_ms(1);
     size_exchange();
 }
 
 static void end_spi_transaction()
 {
+    bool restart;
+
     nrf_delay_ms(1);
-    nrf_gpio_pin_set(NRFX_SPIM_SS_PIN);
-    state = Idle;
-    if (is_response_ready())
+    nrf_gpio_pin_set(CC1110_SPI_SS_PIN);
+
+    CRITICAL_REGION_ENTER();
+    restart = is_response_ready();
+    state = restart ? Size : Idle;
+    CRITICAL_REGION_EXIT();
+
+    if (restart)
     {
-        state = Size;
         nrf_delay_ms(1);
         start_spi_transaction();
     }
 }
 
-void spim_event_handler(nrfx_spim_evt_t const * p_event,
-                       void *                  p_context)
+// Interrupt or BLE event context. A full queue is dropped and counted rather than
+// APP_ERROR_CHECKed into a reset; the caller gives the transaction up.
+static bool sched_put(app_sched_event_handler_t handler)
 {
-    if (p_event->type != NRFX_SPIM_EVENT_DONE) {
-      NRF_LOG_INFO("Unknown spi event type %d", p_event->type);
+    if (app_sched_event_put(NULL, 0, handler) != NRF_SUCCESS) {
+        m_sched_drop_count++;
+        NRF_LOG_WARNING("Scheduler queue full, %d dropped", m_sched_drop_count);
+        return false;
     }
-    //else
-    //{
-    //    if (p_event->xfer_desc.tx_length > 0) {
-    //        NRF_LOG_INFO(" Tx: %d", p_event->xfer_desc.tx_length);
-    //        NRF_LOG_HEXDUMP_INFO(p_event->xfer_desc.p_tx_buffer, p_event->xfer_desc.tx_length);
-    //    }
-    //    if (p_event->xfer_desc.rx_length > 0) {
-    //        NRF_LOG_INFO(" Rx: %d", p_event->xfer_desc.rx_length);
-    //        NRF_LOG_HEXDUMP_INFO(p_event->xfer_desc.p_rx_buffer, p_event->xfer_desc.rx_length);
-    //    }
-    //    NRF_LOG_INFO("-----------------");
-    //}
+    return true;
+}
 
+static void spi_start_process(void *p_event_data, uint16_t event_size)
+{
+    start_spi_transaction();
+}
+
+static void spi_done_process(void *p_event_data, uint16_t event_size)
+{
     switch (state) {
     case Size:
       if (subg_rfspy_tx_len > 0 || size_rx_buf[1] > 0) {
@@ -111,58 +120,93 @@ void spim_event_handler(nrfx_spim_evt_t const * p_event,
     case Idle:
       NRF_LOG_INFO("finished spi event during idle???");
     }
-    NRF_LOG_FLUSH();
+}
+
+void spim_event_handler(nrfx_spim_evt_t const * p_event,
+                       void *                  p_context)
+{
+    uint32_t start = isr_timing_begin();
+
+    // DONE is the only event the SPIM driver has. Dropped, the CC1110 is deselected and
+    // the link is idle again, the next command or data ready starts over.
+    if (!sched_put(spi_done_process)) {
+        nrf_gpio_pin_set(CC1110_SPI_SS_PIN);
+        state = Idle;
+    }
+    isr_timing_end(ISR_TIMING_SPIM, start);
+}
+
+// Idle -> Size, false if a transaction is already under way
+static bool claim_spi()
+{
+    bool claimed;
+
+    CRITICAL_REGION_ENTER();
+    claimed = (state == Idle);
+    if (claimed) {
+        state = Size;
+    }
+    CRITICAL_REGION_EXIT();
+    return claimed;
 }
 
 void subg_rfspy_spi_init(subg_rfspy_spi_response_handler_t response_handler) {
     nrfx_spim_config_t spi_config = NRFX_SPIM_DEFAULT_CONFIG;
     spi_config.frequency      = 0x00800000UL; // 0x02000000UL = NRF_SPIM_FREQ_125K;
     spi_config.ss_pin         = NRFX_SPIM_PIN_NOT_USED;
-    spi_config.miso_pin       = NRFX_SPIM_MISO_PIN;
-    spi_config.mosi_pin       = NRFX_SPIM_MOSI_PIN;
-    spi_config.sck_pin        = NRFX_SPIM_SCK_PIN;
+    spi_config.miso_pin       = CC1110_SPI_MISO_PIN;
+    spi_config.mosi_pin       = CC1110_SPI_MOSI_PIN;
+    spi_config.sck_pin        = CC1110_SPI_SCK_PIN;
     spi_config.bit_order      = NRF_SPIM_BIT_ORDER_LSB_FIRST;
     spi_config.mode           = NRF_SPIM_MODE_0;  // SCK active high, sample on leading edge of clock
     spi_config.ss_active_high = false;
+    spi_config.irq_priority   = APP_IRQ_PRIORITY_LOW;
     APP_ERROR_CHECK(nrfx_spim_init(&spi, &spi_config, spim_event_handler, NULL));
 
     m_response_handler = response_handler;
 
     // Drive SS manually
-    nrf_gpio_pin_set(NRFX_SPIM_SS_PIN);
-    nrf_gpio_cfg_output(NRFX_SPIM_SS_PIN);
+    nrf_gpio_pin_set(CC1110_SPI_SS_PIN);
+    nrf_gpio_cfg_output(CC1110_SPI_SS_PIN);
 
     // Start execution.
     NRF_LOG_INFO("RileyLink 2.0 spi started.");
     state = Idle;
 }
 
+// BLE event context: the buffers are ours once the state left Idle
 void subg_rfspy_spi_run_command(const uint8_t *data, uint8_t data_len)
 {
-  if (state != Idle) {
+  if (!claim_spi()) {
     NRF_LOG_INFO("Skipped command: busy");
     return;
   }
 
   NRF_LOG_INFO("Running command:");
   NRF_LOG_HEXDUMP_INFO(data, data_len);
-  state = Size;
   subg_rfspy_tx_len = data_len;
   subg_rfspy_rx_len = 0;
   memcpy(subg_rfspy_tx_buf, data, data_len);
-  start_spi_transaction();
+  if (!sched_put(spi_start_process)) {
+    // the command is lost, the app times out and sends it again
+    state = Idle;
+  }
 }
 
+// GPIOTE interrupt context. While busy, end_spi_transaction sees the pin still high.
 void subg_rfspy_spi_data_available()
 {
-    if (state == Idle) {
-        state = Size;
-        start_spi_transaction();
-    } else {
-        NRF_LOG_INFO("Skipped data interrupt: busy");
+    // dropped, the response stays pending: the end of the next transaction sees the pin high
+    if (claim_spi() && !sched_put(spi_start_process)) {
+        state = Idle;
     }
 }
 
+uint32_t subg_rfspy_spi_sched_drop_count(void)
+{
+    return m_sched_drop_count;
+}
+
 nrfx_spim_xfer_desc_t size_xfer_desc = NRFX_SPIM_XFER_TRX(size_tx_buf, 0, size_rx_buf, 0);
 
 static void size_exchange() {
@@ -12,14 +12,28 @@ NRF_SDH_BLE_OBSERVER(_name ## _obs,
 
 #define SUBG_RFSPY_SPI_BUFFER_LEN 255
 
+// app_scheduler events the transaction has queued at most. A transaction is claimed before
+// its start is queued, so there is one step at a time: start or the done of the transfer
+// under way. app_sched_execute frees an entry only after its handler returned, and each
+// handler ends by starting a transfer whose done may come in before that: 2.
+#define SUBG_RFSPY_SPI_SCHED_EVENTS 2
+
 #define CC1110_RESET_PIN   30
 
+// SPI link to the CC1110, hal_nrf52.c keeps the RFM69 bus off these
+#define CC1110_SPIM_INSTANCE 0
+#define CC1110_SPI_SCK_PIN   9
+#define CC1110_SPI_MOSI_PIN  10
+#define CC1110_SPI_MISO_PIN  29
+#define CC1110_SPI_SS_PIN    4
+
 
 typedef void (subg_rfspy_spi_response_handler_t) (const uint8_t *data, uint8_t len);
 
 void subg_rfspy_spi_init(subg_rfspy_spi_response_handler_t response_handler);
 void subg_rfspy_spi_run_command(const uint8_t *data, uint8_t data_len);
 void subg_rfspy_spi_data_available();
+uint32_t subg_rfspy_spi_sched_drop_count(void);
 
 
 #endif // SPI_H
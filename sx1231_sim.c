@@ -0,0 +1,918 @@
+/**
+ *@file sx1231_sim.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief SX1231/RFM69 register and FIFO simulator behind the Linux HAL
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <string.h>
+#include <stdlib.h>
+
+#include "sx1231_sim.h"
+#include "rf69_regisers.h"
+
+/*
+Byte-level model, good enough to exercise the drivers: the FIFO drains (TX) and
+fills (RX) at the programmed bitrate against a simulated microsecond clock.
+Preamble and sync are accounted for as air time only, injected packets start at
+their first payload byte. Modes switch instantly (ModeReady always set).
+Noise above RssiThreshold starts the receiver, which then finds a false sync in it
+every SIM_NOISE_SYNC_US; packets below it are not heard. OokFix is not modelled.
+A frequency change (FrfLsb write) drops PllLock for the hop time, leaving sleep
+holds ModeReady off for the crystal start.
+*/
+
+#define SIM_FIFO_SIZE			66
+#define SIM_FXOSC				32000000UL
+#define SIM_FSTEP				61.03515625
+#define SIM_RX_QUEUE_SIZE		8
+#define SIM_NOISE_RSSI			-110
+#define SIM_NOISE_JITTER_DB		2		//RSSI of noise reads +-this much
+#define SIM_NOISE_SYNC_US		20000
+#define SIM_NOISE_PKT_LEN		24
+//PLL hop time (TS_HOP), grows with the step
+#define SIM_PLL_HOP_MIN_US		20
+#define SIM_PLL_HOP_MAX_US		80
+#define SIM_PLL_HOP_HZ_PER_US	100000
+//crystal start up out of sleep (TS_OSC)
+#define SIM_OSC_START_US		250
+//listen mode: crystal start and PLL lock before each rx window
+#define SIM_LISTEN_START_US		(SIM_OSC_START_US + SIM_PLL_HOP_MAX_US)
+#define SIM_TEMP_COEF			165		//RegTemp2 = SIM_TEMP_COEF - degC
+
+#define SIM_MODE_SLEEP			0
+#define SIM_MODE_STANDBY		1
+#define SIM_MODE_SYNTH			2
+#define SIM_MODE_TX				3
+#define SIM_MODE_RX				4
+
+typedef struct
+{
+	uint64_t startUs;			//first payload byte starts arriving
+	uint32_t carrierHz;
+	int16_t rssi;
+	bool isNoise;				//false sync, not an injected packet
+	uint16_t len;
+	uint8_t data[SIM_PKT_MAX_LEN];
+}sSimPkt_t;
+
+typedef struct
+{
+	uint8_t regs[0x80];
+	uint8_t fifo[SIM_FIFO_SIZE];
+	uint8_t fifoHead;
+	uint8_t fifoCnt;
+	bool overrun;
+
+	uint64_t txNextUs;			//next byte leaves the fifo, 0 = not transmitting
+	uint16_t txSent;
+	bool txStarved;
+	bool txDone;
+	bool txStall;				//modulator takes nothing from the fifo (Sim_SetTxStall)
+	uint8_t txLog[SIM_TX_LOG_SIZE];
+	uint16_t txLogLen;
+
+	sSimPkt_t rxQueue[SIM_RX_QUEUE_SIZE];
+	uint8_t rxQueueCnt;
+	bool rxLocked;				//receiving rxQueue[0]
+	uint16_t rxIdx;
+	int32_t rxFeiHz;
+	int32_t feiHz;
+	bool feiDone;
+	int16_t noiseRssi;
+	int8_t tempC;
+	int32_t xtalPpb;			//crystal error, the LO and the tx carrier are off by this much
+	uint64_t noiseSyncUs;		//next false sync while noise is above the threshold, 0 = none due
+	uint32_t pllHz;				//frequency the PLL is locked to
+	uint64_t pllLockUs;			//PllLock comes back at this time
+	uint64_t modeReadyUs;		//ModeReady comes back at this time
+	uint64_t modeSinceUs;		//current mode entered, for stats.modeUs
+	uint64_t listenPhaseUs;		//position in the listen period, idle first
+
+	sSimStats_t stats;
+}sSimRadio_t;
+
+static sSimRadio_t simRadio[SIM_RADIO_NUM];
+static uint64_t simNowUs = 0;
+static sSimRadio_t *pSpiRadio = NULL;
+static uint8_t spiAddr;
+static bool spiWrite;
+static bool spiFirst;
+static uint32_t simRand;
+static pfnSimTxHook_t pfnTxHook = NULL;
+static uint32_t cpuRand;				//own sequence, stalls do not move the noise
+static uint32_t cpuStallGapUs = 0;		//mean time between cpu stalls, 0 none (Sim_SetCpuStall)
+static uint32_t cpuStallMaxUs = 0;
+static uint64_t cpuStallNextUs = 0;
+static uint32_t cpuStallCnt = 0;
+
+static uint8_t radio_mode(sSimRadio_t *pRadio)
+{
+	return (pRadio->regs[REG_OPMODE] >> 2) & 0x07;
+}
+
+static bool radio_is_rx(sSimRadio_t *pRadio)
+{
+	return radio_mode(pRadio) == SIM_MODE_RX || (pRadio->regs[REG_OPMODE] & RF_OPMODE_LISTEN_ON);
+}
+
+static uint32_t byte_us(sSimRadio_t *pRadio)
+{
+	uint32_t br;
+
+	//bit time = BitRate / FXOSC, 8 bits per byte -> BitRate / 4 us
+	br = ((uint32_t)pRadio->regs[REG_BITRATEMSB] << 8) | pRadio->regs[REG_BITRATELSB];
+	return (br < 4) ? 1 : br / 4;
+}
+
+static uint32_t tuned_hz(sSimRadio_t *pRadio)
+{
+	uint32_t frf;
+
+	frf = ((uint32_t)pRadio->regs[REG_FRFMSB] << 16) | ((uint32_t)pRadio->regs[REG_FRFMID] << 8) | pRadio->regs[REG_FRFLSB];
+	return (uint32_t)(frf * SIM_FSTEP * (1.0 + pRadio->xtalPpb * 1e-9));
+}
+
+static uint8_t rand_byte(void)
+{
+	simRand = simRand * 1103515245UL + 12345;
+	return (uint8_t)(simRand >> 16);
+}
+
+static uint32_t cpu_rand(void)
+{
+	cpuRand = cpuRand * 1103515245UL + 12345;
+	return cpuRand >> 8;
+}
+
+static int16_t rssi_thresh(sSimRadio_t *pRadio)
+{
+	return -(int16_t)(pRadio->regs[REG_RSSITHRESH] / 2);
+}
+
+/*single side channel filter bandwidth from RegRxBw*/
+static uint32_t rx_bw_hz(sSimRadio_t *pRadio)
+{
+	static const uint8_t mant[4] = {16, 20, 24, 24};
+	uint8_t rxBw;
+	uint8_t shift;
+
+	rxBw = pRadio->regs[REG_RXBW];
+	shift = (rxBw & 0x07) + 2;
+	if(pRadio->regs[REG_DATAMODUL] & RF_DATAMODUL_MODULATIONTYPE_OOK)
+	{
+		shift++;
+	}
+	return SIM_FXOSC / (mant[(rxBw >> 3) & 0x03] << shift);
+}
+
+static void fifo_clear(sSimRadio_t *pRadio)
+{
+	pRadio->fifoHead = 0;
+	pRadio->fifoCnt = 0;
+	pRadio->overrun = false;
+}
+
+static void fifo_push(sSimRadio_t *pRadio, uint8_t data)
+{
+	if(pRadio->fifoCnt >= SIM_FIFO_SIZE)
+	{
+		pRadio->overrun = true;
+		pRadio->stats.rxOverrunCnt++;
+		return;
+	}
+
+	pRadio->fifo[(pRadio->fifoHead + pRadio->fifoCnt) % SIM_FIFO_SIZE] = data;
+	pRadio->fifoCnt++;
+}
+
+static bool fifo_pop(sSimRadio_t *pRadio, uint8_t *pData)
+{
+	if(pRadio->fifoCnt == 0)
+	{
+		return false;
+	}
+
+	*pData = pRadio->fifo[pRadio->fifoHead];
+	pRadio->fifoHead = (pRadio->fifoHead + 1) % SIM_FIFO_SIZE;
+	pRadio->fifoCnt--;
+	return true;
+}
+
+static void rx_drop_head(sSimRadio_t *pRadio)
+{
+	if(pRadio->rxQueueCnt == 0)
+	{
+		return;
+	}
+
+	pRadio->rxQueueCnt--;
+	memmove(&pRadio->rxQueue[0], &pRadio->rxQueue[1], pRadio->rxQueueCnt * sizeof(sSimPkt_t));
+	pRadio->rxLocked = false;
+	pRadio->rxIdx = 0;
+}
+
+/*
+sync words longer than 4 bytes go on into the packet: injected packets carry those
+bytes as their first payload bytes, they are compared and do not reach the fifo
+*/
+static uint8_t sync_ext_len(sSimRadio_t *pRadio, const sSimPkt_t *pPkt)
+{
+	uint8_t extLen;
+	uint8_t i;
+
+	if(!(pRadio->regs[REG_SYNCCONFIG] & RF_SYNC_ON))
+	{
+		return 0;
+	}
+
+	extLen = ((pRadio->regs[REG_SYNCCONFIG] >> 3) & 0x07) + 1;
+	extLen = (extLen > 4) ? extLen - 4 : 0;
+	if(extLen > pPkt->len)
+	{
+		return UINT8_MAX;
+	}
+
+	for(i = 0; i < extLen; i++)
+	{
+		if(pPkt->data[i] != pRadio->regs[REG_SYNCVALUE5 + i])
+		{
+			return UINT8_MAX;
+		}
+	}
+	return extLen;
+}
+
+static void tx_run(sSimRadio_t *pRadio, uint64_t targetUs)
+{
+	uint8_t payloadLen;
+	uint8_t data;
+
+	payloadLen = pRadio->regs[REG_PAYLOADLENGTH];
+
+	//stalled: the byte slots go by, the fifo stays as it is
+	if(pRadio->txStall)
+	{
+		while(pRadio->txNextUs != 0 && pRadio->txNextUs <= targetUs)
+		{
+			pRadio->txNextUs += byte_us(pRadio);
+		}
+		return;
+	}
+
+	while(pRadio->txNextUs != 0 && pRadio->txNextUs <= targetUs && !pRadio->txDone)
+	{
+		if(fifo_pop(pRadio, &data))
+		{
+			if(pRadio->txStarved)
+			{
+				//the modulator had nothing to send in between, the frame on air is broken
+				pRadio->stats.txGapCnt++;
+				pRadio->txStarved = false;
+			}
+
+			//long preambles overflow it, keep the end of the frame
+			if(pRadio->txLogLen >= SIM_TX_LOG_SIZE)
+			{
+				memmove(pRadio->txLog, pRadio->txLog + 1, SIM_TX_LOG_SIZE - 1);
+				pRadio->txLogLen--;
+			}
+			pRadio->txLog[pRadio->txLogLen++] = data;
+			pRadio->stats.txByteCnt++;
+			pRadio->txSent++;
+
+			//payload length 0 is unlimited length, the frame ends when the caller stops
+			if(payloadLen != 0 && pRadio->txSent >= payloadLen)
+			{
+				pRadio->txDone = true;
+				pRadio->stats.txPktCnt++;
+			}
+		}
+		else
+		{
+			pRadio->txStarved = true;
+		}
+
+		pRadio->txNextUs += byte_us(pRadio);
+	}
+}
+
+static void noise_run(sSimRadio_t *pRadio, uint64_t targetUs)
+{
+	sSimPkt_t *pPkt;
+	uint64_t endUs;
+	uint16_t i;
+
+	if(!radio_is_rx(pRadio) || pRadio->noiseRssi < rssi_thresh(pRadio))
+	{
+		pRadio->noiseSyncUs = 0;
+		return;
+	}
+
+	if(pRadio->noiseSyncUs == 0)
+	{
+		pRadio->noiseSyncUs = simNowUs + SIM_NOISE_SYNC_US;
+	}
+
+	for(; pRadio->noiseSyncUs <= targetUs; pRadio->noiseSyncUs += SIM_NOISE_SYNC_US)
+	{
+		//a real packet on air takes the receiver
+		endUs = pRadio->noiseSyncUs + (uint64_t)SIM_NOISE_PKT_LEN * byte_us(pRadio);
+		if(pRadio->rxLocked || pRadio->rxQueueCnt >= SIM_RX_QUEUE_SIZE
+			|| (pRadio->rxQueueCnt > 0 && pRadio->rxQueue[0].startUs <= endUs))
+		{
+			continue;
+		}
+
+		memmove(&pRadio->rxQueue[1], &pRadio->rxQueue[0], pRadio->rxQueueCnt * sizeof(sSimPkt_t));
+		pRadio->rxQueueCnt++;
+		pPkt = &pRadio->rxQueue[0];
+		pPkt->startUs = pRadio->noiseSyncUs;
+		pPkt->carrierHz = tuned_hz(pRadio);
+		pPkt->rssi = pRadio->noiseRssi;
+		pPkt->isNoise = true;
+		pPkt->len = SIM_NOISE_PKT_LEN;
+		for(i = 0; i < SIM_NOISE_PKT_LEN; i++)
+		{
+			pPkt->data[i] = rand_byte();
+		}
+	}
+}
+
+static void rx_run(sSimRadio_t *pRadio, uint64_t targetUs)
+{
+	sSimPkt_t *pPkt;
+	uint32_t byteUs;
+	int32_t feiHz;
+	uint8_t extLen;
+
+	byteUs = byte_us(pRadio);
+
+	while(pRadio->rxQueueCnt > 0)
+	{
+		pPkt = &pRadio->rxQueue[0];
+
+		if(!pRadio->rxLocked)
+		{
+			if(pPkt->startUs > targetUs)
+			{
+				return;
+			}
+
+			feiHz = (int32_t)pPkt->carrierHz - (int32_t)tuned_hz(pRadio);
+			if(!radio_is_rx(pRadio) || (uint32_t)abs(feiHz) > rx_bw_hz(pRadio))
+			{
+				pRadio->stats.rxMissCnt++;
+				rx_drop_head(pRadio);
+				continue;
+			}
+
+			if(pPkt->rssi < rssi_thresh(pRadio))
+			{
+				pRadio->stats.rxWeakCnt++;
+				rx_drop_head(pRadio);
+				continue;
+			}
+
+			extLen = sync_ext_len(pRadio, pPkt);
+			if(extLen == UINT8_MAX)
+			{
+				pRadio->stats.rxFilterCnt++;
+				rx_drop_head(pRadio);
+				continue;
+			}
+
+			pRadio->rxLocked = true;
+			pRadio->rxIdx = extLen;
+			pRadio->rxFeiHz = feiHz;
+			if(pPkt->isNoise)
+			{
+				pRadio->stats.noiseSyncCnt++;
+			}
+			else
+			{
+				pRadio->stats.rxPktCnt++;
+			}
+		}
+
+		while(pRadio->rxIdx < pPkt->len && pPkt->startUs + (uint64_t)(pRadio->rxIdx + 1) * byteUs <= targetUs)
+		{
+			fifo_push(pRadio, pPkt->data[pRadio->rxIdx]);
+			pRadio->rxIdx++;
+		}
+
+		if(pRadio->rxIdx < pPkt->len)
+		{
+			return;
+		}
+		pRadio->stats.rxEndUs = pPkt->startUs + (uint64_t)pPkt->len * byteUs;
+		rx_drop_head(pRadio);
+	}
+}
+
+/*time spent in [fromUs, toUs) of each listen period, over the first atUs of listening*/
+static uint64_t listen_part_us(uint64_t atUs, uint32_t periodUs, uint32_t fromUs, uint32_t toUs)
+{
+	uint64_t pos = atUs % periodUs;
+	uint64_t part = (atUs / periodUs) * (toUs - fromUs);
+
+	if(pos > fromUs)
+	{
+		part += ((pos < toUs) ? pos : toUs) - fromUs;
+	}
+	return part;
+}
+
+/*
+listen mode cycles idle, crystal start + PLL lock and the rx window on its own timer
+(RegListen1..3), from the moment it was entered. The sequencer staying in rx after a
+match is not modelled, packets are heard all through the period.
+*/
+static void listen_account(sSimRadio_t *pRadio, uint64_t us)
+{
+	static const uint32_t resolUs[4] = {0, 64, 4100, 262000};
+	uint32_t idleUs;
+	uint32_t rxUs;
+	uint32_t periodUs;
+	uint64_t toUs;
+	uint64_t rxPartUs;
+	uint64_t startPartUs;
+
+	idleUs = resolUs[(pRadio->regs[REG_LISTEN1] >> 6) & 0x03] * pRadio->regs[REG_LISTEN2];
+	rxUs = resolUs[(pRadio->regs[REG_LISTEN1] >> 4) & 0x03] * pRadio->regs[REG_LISTEN3];
+	periodUs = idleUs + SIM_LISTEN_START_US + rxUs;
+	toUs = pRadio->listenPhaseUs + us;
+
+	startPartUs = listen_part_us(toUs, periodUs, idleUs, idleUs + SIM_LISTEN_START_US)
+		- listen_part_us(pRadio->listenPhaseUs, periodUs, idleUs, idleUs + SIM_LISTEN_START_US);
+	rxPartUs = listen_part_us(toUs, periodUs, idleUs + SIM_LISTEN_START_US, periodUs)
+		- listen_part_us(pRadio->listenPhaseUs, periodUs, idleUs + SIM_LISTEN_START_US, periodUs);
+
+	pRadio->stats.listenStartUs += startPartUs;
+	pRadio->stats.listenRxUs += rxPartUs;
+	pRadio->stats.listenIdleUs += us - startPartUs - rxPartUs;
+	pRadio->listenPhaseUs = toUs % periodUs;
+}
+
+static void mode_account(sSimRadio_t *pRadio)
+{
+	uint8_t mode;
+
+	mode = radio_mode(pRadio);
+	if(pRadio->regs[REG_OPMODE] & RF_OPMODE_LISTEN_ON)
+	{
+		listen_account(pRadio, simNowUs - pRadio->modeSinceUs);
+	}
+	else if(mode < SIM_MODE_NUM)
+	{
+		pRadio->stats.modeUs[mode] += simNowUs - pRadio->modeSinceUs;
+	}
+	pRadio->modeSinceUs = simNowUs;
+}
+
+static void opmode_write(sSimRadio_t *pRadio, uint8_t value)
+{
+	uint8_t oldMode;
+	uint8_t newMode;
+	bool wasRx;
+
+	mode_account(pRadio);
+	oldMode = radio_mode(pRadio);
+	wasRx = radio_is_rx(pRadio);
+	if((value & RF_OPMODE_LISTEN_ON) && !(pRadio->regs[REG_OPMODE] & RF_OPMODE_LISTEN_ON))
+	{
+		pRadio->listenPhaseUs = 0;
+	}
+	pRadio->regs[REG_OPMODE] = value & (uint8_t)~RF_OPMODE_LISTENABORT;
+	newMode = radio_mode(pRadio);
+
+	if(oldMode == SIM_MODE_SLEEP && newMode != SIM_MODE_SLEEP)
+	{
+		pRadio->modeReadyUs = simNowUs + SIM_OSC_START_US;
+	}
+
+	if(newMode == SIM_MODE_TX && oldMode != SIM_MODE_TX)
+	{
+		uint32_t preamble;
+		uint32_t sync;
+
+		preamble = ((uint32_t)pRadio->regs[REG_PREAMBLEMSB] << 8) | pRadio->regs[REG_PREAMBLELSB];
+		sync = (pRadio->regs[REG_SYNCCONFIG] & RF_SYNC_ON) ? ((pRadio->regs[REG_SYNCCONFIG] >> 3) & 0x07) + 1 : 0;
+		pRadio->txNextUs = simNowUs + (preamble + sync + 1) * byte_us(pRadio);
+		pRadio->stats.txStartUs = simNowUs;
+		pRadio->txSent = 0;
+		pRadio->txStarved = false;
+		pRadio->txDone = false;
+		pRadio->txLogLen = 0;
+	}
+	else if(newMode != SIM_MODE_TX)
+	{
+		pRadio->txNextUs = 0;
+
+		//a remote end (see pod_sim.c) may answer what it just heard
+		if(oldMode == SIM_MODE_TX && pRadio->txLogLen > 0 && pfnTxHook != NULL)
+		{
+			pfnTxHook((uint8_t)(pRadio - simRadio), tuned_hz(pRadio), pRadio->txLog, pRadio->txLogLen);
+		}
+	}
+
+	if(wasRx && !radio_is_rx(pRadio) && pRadio->rxLocked)
+	{
+		rx_drop_head(pRadio);
+	}
+}
+
+static uint8_t reg_read(sSimRadio_t *pRadio, uint8_t addr)
+{
+	uint8_t value = 0;
+	uint8_t threshold;
+
+	switch(addr)
+	{
+		case REG_FIFO:
+			fifo_pop(pRadio, &value);
+			return value;
+
+		case REG_IRQFLAGS1:
+			if(simNowUs >= pRadio->modeReadyUs)
+			{
+				value |= RF_IRQFLAGS1_MODEREADY;
+			}
+			if(simNowUs >= pRadio->pllLockUs)
+			{
+				value |= RF_IRQFLAGS1_PLLLOCK;
+			}
+			if(radio_mode(pRadio) == SIM_MODE_TX)
+			{
+				value |= RF_IRQFLAGS1_TXREADY;
+			}
+			if(radio_is_rx(pRadio))
+			{
+				value |= RF_IRQFLAGS1_RXREADY;
+			}
+			if(pRadio->rxLocked)
+			{
+				value |= RF_IRQFLAGS1_SYNCADDRESSMATCH | RF_IRQFLAGS1_RSSI;
+			}
+			return value;
+
+		case REG_IRQFLAGS2:
+			threshold = pRadio->regs[REG_FIFOTHRESH] & 0x7F;
+			if(pRadio->fifoCnt >= SIM_FIFO_SIZE)
+			{
+				value |= RF_IRQFLAGS2_FIFOFULL;
+			}
+			if(pRadio->fifoCnt > 0)
+			{
+				value |= RF_IRQFLAGS2_FIFONOTEMPTY;
+			}
+			if(pRadio->fifoCnt > threshold)
+			{
+				value |= RF_IRQFLAGS2_FIFOLEVEL;
+			}
+			if(pRadio->overrun)
+			{
+				value |= RF_IRQFLAGS2_FIFOOVERRUN;
+			}
+			if(pRadio->txDone)
+			{
+				value |= RF_IRQFLAGS2_PACKETSENT;
+			}
+			return value;
+
+		case REG_RSSIVALUE:
+			//follows the carrier: the packet's while it is on air, noise after it
+			if(pRadio->rxLocked)
+			{
+				return (uint8_t)(-2 * pRadio->rxQueue[0].rssi);
+			}
+			return (uint8_t)(-2 * (pRadio->noiseRssi + (int16_t)(rand_byte() % (2 * SIM_NOISE_JITTER_DB + 1)) - SIM_NOISE_JITTER_DB));
+
+		case REG_RSSICONFIG:
+			return pRadio->regs[addr] | RF_RSSI_DONE;
+
+		case REG_AFCFEI:
+			return pRadio->regs[addr] | (pRadio->feiDone ? RF_AFCFEI_FEI_DONE : 0);
+
+		case REG_FEIMSB:
+			return (uint8_t)((uint16_t)(int16_t)(pRadio->feiHz / SIM_FSTEP) >> 8);
+
+		case REG_FEILSB:
+			return (uint8_t)(int16_t)(pRadio->feiHz / SIM_FSTEP);
+
+		case REG_TEMP1:
+			//done at once, only in standby and FS like the real one
+			return pRadio->regs[addr] & (uint8_t)~RF_TEMP1_MEAS_RUNNING;
+
+		case REG_TEMP2:
+			if(radio_mode(pRadio) != SIM_MODE_STANDBY && radio_mode(pRadio) != SIM_MODE_SYNTH)
+			{
+				return 0;
+			}
+			return (uint8_t)(SIM_TEMP_COEF - pRadio->tempC);
+
+		default:
+			return pRadio->regs[addr & 0x7F];
+	}
+}
+
+/*the new frequency takes effect with the FrfLsb write, the PLL relocks if it is running*/
+static void pll_hop(sSimRadio_t *pRadio)
+{
+	uint32_t hopUs;
+	uint32_t newHz;
+
+	newHz = tuned_hz(pRadio);
+	if(radio_mode(pRadio) >= SIM_MODE_SYNTH)
+	{
+		hopUs = SIM_PLL_HOP_MIN_US + (uint32_t)abs((int32_t)(newHz - pRadio->pllHz)) / SIM_PLL_HOP_HZ_PER_US;
+		pRadio->pllLockUs = simNowUs + ((hopUs > SIM_PLL_HOP_MAX_US) ? SIM_PLL_HOP_MAX_US : hopUs);
+	}
+	pRadio->pllHz = newHz;
+}
+
+static void reg_write(sSimRadio_t *pRadio, uint8_t addr, uint8_t value)
+{
+	switch(addr)
+	{
+		case REG_FIFO:
+			fifo_push(pRadio, value);
+			break;
+
+		case REG_OPMODE:
+			opmode_write(pRadio, value);
+			break;
+
+		case REG_FRFLSB:
+			pRadio->regs[addr] = value;
+			pll_hop(pRadio);
+			break;
+
+		case REG_IRQFLAGS2:
+			if(value & RF_IRQFLAGS2_FIFOOVERRUN)
+			{
+				fifo_clear(pRadio);
+			}
+			break;
+
+		case REG_PACKETCONFIG2:
+			if((value & RF_PACKET2_RXRESTART) && pRadio->rxLocked)
+			{
+				rx_drop_head(pRadio);
+			}
+			pRadio->regs[addr] = value & (uint8_t)~RF_PACKET2_RXRESTART;
+			break;
+
+		case REG_AFCFEI:
+			if(value & RF_AFCFEI_FEI_START)
+			{
+				pRadio->feiDone = true;
+				pRadio->feiHz = pRadio->rxLocked ? pRadio->rxFeiHz : 0;
+			}
+			pRadio->regs[addr] = value & (uint8_t)~(RF_AFCFEI_FEI_START | RF_AFCFEI_AFC_START | RF_AFCFEI_AFC_CLEAR);
+			break;
+
+		case REG_RSSICONFIG:
+			pRadio->regs[addr] = value & (uint8_t)~RF_RSSI_START;
+			break;
+
+		default:
+			pRadio->regs[addr & 0x7F] = value;
+			break;
+	}
+}
+
+/*power-on defaults of the registers the drivers look at*/
+void Sim_Reset(void)
+{
+	uint8_t i;
+
+	memset(simRadio, 0, sizeof(simRadio));
+	simNowUs = 0;
+	simRand = 1;
+	cpuRand = 1;
+	cpuStallGapUs = 0;
+	cpuStallCnt = 0;
+
+	for(i = 0; i < SIM_RADIO_NUM; i++)
+	{
+		simRadio[i].regs[REG_OPMODE] = RF_OPMODE_SEQUENCER_ON | RF_OPMODE_STANDBY;
+		simRadio[i].regs[REG_BITRATEMSB] = 0x1A;
+		simRadio[i].regs[REG_BITRATELSB] = 0x0B;
+		simRadio[i].regs[REG_FRFMSB] = 0xE4;
+		simRadio[i].regs[REG_FRFMID] = 0xC0;
+		simRadio[i].regs[REG_PALEVEL] = 0x9F;
+		simRadio[i].regs[REG_OCP] = 0x1A;
+		simRadio[i].regs[REG_RXBW] = 0x55;
+		simRadio[i].regs[REG_PREAMBLELSB] = 0x03;
+		simRadio[i].regs[REG_RSSITHRESH] = 0xE4;
+		simRadio[i].regs[REG_SYNCCONFIG] = 0x98;
+		simRadio[i].regs[REG_PACKETCONFIG1] = 0x10;
+		simRadio[i].regs[REG_PAYLOADLENGTH] = 0x40;
+		simRadio[i].regs[REG_FIFOTHRESH] = 0x8F;
+		simRadio[i].regs[REG_VERSION] = 0x24;
+		simRadio[i].regs[REG_TESTPA1] = 0x55;
+		simRadio[i].regs[REG_TESTPA2] = 0x70;
+		simRadio[i].noiseRssi = SIM_NOISE_RSSI;
+		simRadio[i].tempC = 25;
+	}
+}
+
+uint64_t Sim_GetUs(void)
+{
+	return simNowUs;
+}
+
+void Sim_AdvanceUs(uint32_t us)
+{
+	uint64_t targetUs;
+	uint8_t i;
+
+	targetUs = simNowUs + us;
+	for(i = 0; i < SIM_RADIO_NUM; i++)
+	{
+		tx_run(&simRadio[i], targetUs);
+		noise_run(&simRadio[i], targetUs);
+		rx_run(&simRadio[i], targetUs);
+	}
+	simNowUs = targetUs;
+}
+
+void Sim_SpiBegin(uint8_t radio)
+{
+	pSpiRadio = (radio < SIM_RADIO_NUM) ? &simRadio[radio] : NULL;
+	spiFirst = true;
+}
+
+/*one byte clocked on the bus, the first one of a transaction is the address*/
+uint8_t Sim_SpiByte(uint8_t mosi)
+{
+	uint8_t miso = 0;
+
+	if(pSpiRadio == NULL)
+	{
+		return 0xFF;
+	}
+
+	if(spiFirst)
+	{
+		spiAddr = mosi & 0x7F;
+		spiWrite = (mosi & 0x80) != 0;
+		spiFirst = false;
+		return 0;
+	}
+
+	if(spiWrite)
+	{
+		reg_write(pSpiRadio, spiAddr, mosi);
+	}
+	else
+	{
+		miso = reg_read(pSpiRadio, spiAddr);
+	}
+
+	//burst access, the FIFO address does not increment
+	if(spiAddr != REG_FIFO)
+	{
+		spiAddr = (spiAddr + 1) & 0x7F;
+	}
+
+	return miso;
+}
+
+void Sim_SpiEnd(void)
+{
+	pSpiRadio = NULL;
+}
+
+/*
+queue a packet on air for a radio: the payload starts at startUs (sync already matched)
+and is heard only if the radio is receiving then, tuned within its bandwidth of carrierHz
+*/
+bool Sim_InjectPkt(uint8_t radio, uint64_t startUs, uint32_t carrierHz, int16_t rssi, const uint8_t *pData, uint16_t len)
+{
+	sSimRadio_t *pRadio;
+	sSimPkt_t *pPkt;
+
+	if(radio >= SIM_RADIO_NUM || len > SIM_PKT_MAX_LEN)
+	{
+		return false;
+	}
+
+	pRadio = &simRadio[radio];
+	if(pRadio->rxQueueCnt >= SIM_RX_QUEUE_SIZE)
+	{
+		return false;
+	}
+
+	pPkt = &pRadio->rxQueue[pRadio->rxQueueCnt++];
+	pPkt->startUs = startUs;
+	pPkt->carrierHz = carrierHz;
+	pPkt->rssi = rssi;
+	pPkt->isNoise = false;
+	pPkt->len = len;
+	memcpy(pPkt->data, pData, len);
+
+	return true;
+}
+
+void Sim_SetNoiseRssi(uint8_t radio, int16_t rssi)
+{
+	simRadio[radio].noiseRssi = rssi;
+}
+
+/*DIO0 level for the mappings the drivers use: PacketSent in TX, SyncAddress/Rssi in RX*/
+bool Sim_GetDio0(uint8_t radio)
+{
+	sSimRadio_t *pRadio = &simRadio[radio];
+	uint8_t mapping;
+
+	mapping = pRadio->regs[REG_DIOMAPPING1] & 0xC0;
+
+	if(radio_mode(pRadio) == SIM_MODE_TX)
+	{
+		return mapping == RF_DIOMAPPING1_DIO0_00 && pRadio->txDone;
+	}
+
+	if(radio_is_rx(pRadio))
+	{
+		return (mapping == RF_DIOMAPPING1_DIO0_10 || mapping == RF_DIOMAPPING1_DIO0_11) && pRadio->rxLocked;
+	}
+
+	return false;
+}
+
+/*bytes that went on air since the last switch to TX, the last SIM_TX_LOG_SIZE of them*/
+uint16_t Sim_GetTxLog(uint8_t radio, uint8_t *pBuf, uint16_t size)
+{
+	uint16_t len;
+
+	len = (simRadio[radio].txLogLen < size) ? simRadio[radio].txLogLen : size;
+	memcpy(pBuf, simRadio[radio].txLog, len);
+	return len;
+}
+
+void Sim_SetTxHook(pfnSimTxHook_t hook)
+{
+	pfnTxHook = hook;
+}
+
+/*die temperature read back by RegTemp2 and the crystal error at that temperature*/
+void Sim_SetTemp(uint8_t radio, int8_t tempC, int32_t xtalPpb)
+{
+	simRadio[radio].tempC = tempC;
+	simRadio[radio].xtalPpb = xtalPpb;
+}
+
+/*the transmitter stops draining the fifo while onOff, the way a radio hung in TX does*/
+void Sim_SetTxStall(uint8_t radio, bool onOff)
+{
+	simRadio[radio].txStall = onOff;
+}
+
+/*
+the SoftDevice taking the cpu away: about every gapUs a stall of 1..maxUs, at random
+points of the cpu's time. gapUs 0 turns it off.
+*/
+void Sim_SetCpuStall(uint32_t gapUs, uint32_t maxUs)
+{
+	cpuStallGapUs = gapUs;
+	cpuStallMaxUs = (maxUs > 0) ? maxUs : 1;
+	cpuStallNextUs = simNowUs + ((gapUs > 0) ? cpu_rand() % (2 * gapUs) : 0);
+}
+
+/*cpu time lost to a stall due by now, the HAL charges it where the cpu runs*/
+uint32_t Sim_CpuStallUs(void)
+{
+	uint32_t us;
+
+	if(cpuStallGapUs == 0 || simNowUs < cpuStallNextUs)
+	{
+		return 0;
+	}
+
+	us = 1 + cpu_rand() % cpuStallMaxUs;
+	cpuStallNextUs = simNowUs + us + cpu_rand() % (2 * cpuStallGapUs);
+	cpuStallCnt++;
+	return us;
+}
+
+uint32_t Sim_GetCpuStallCnt(void)
+{
+	return cpuStallCnt;
+}
+
+void Sim_GetStats(uint8_t radio, sSimStats_t *pStats)
+{
+	mode_account(&simRadio[radio]);
+	*pStats = simRadio[radio].stats;
+}
+
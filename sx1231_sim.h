@@ -0,0 +1,75 @@
+/**
+ *@file sx1231_sim.h
+ *@author Ribin Huang (you@domain.com)
+ *@brief SX1231/RFM69 register and FIFO simulator behind the Linux HAL
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __SX1231_SIM_H__
+#define __SX1231_SIM_H__
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SIM_RADIO_NUM			2
+#define SIM_PKT_MAX_LEN			512
+#define SIM_TX_LOG_SIZE			512
+#define SIM_MODE_NUM			5		//RegOpMode Mode: sleep, standby, fs, tx, rx
+
+typedef struct
+{
+	uint32_t txByteCnt;			//bytes that went on air
+	uint32_t txPktCnt;			//fixed length packets completed (PacketSent)
+	uint32_t txGapCnt;			//fifo ran dry while the packet was still on air
+	uint32_t rxPktCnt;			//injected packets the receiver locked on
+	uint32_t rxMissCnt;			//injected packets not heard (wrong mode or frequency)
+	uint32_t rxOverrunCnt;		//bytes lost to a full fifo
+	uint32_t rxFilterCnt;		//injected packets rejected by sync word bytes past the first 4
+	uint32_t rxWeakCnt;			//injected packets below RssiThreshold, the receiver never started
+	uint32_t noiseSyncCnt;		//false syncs on noise above RssiThreshold
+	uint64_t rxEndUs;			//last bit of the last packet received went off air, for rx latency
+	uint64_t txStartUs;			//last switch to TX, the preamble starts then, for timed tx
+	uint64_t modeUs[SIM_MODE_NUM];	//time spent in each mode, for the power model, listen mode not included
+	uint64_t listenIdleUs;		//listen mode: idle on the RC oscillator
+	uint64_t listenStartUs;		//listen mode: crystal start and PLL lock before each rx window
+	uint64_t listenRxUs;		//listen mode: rx windows
+}sSimStats_t;
+
+//a frame left the antenna: the fifo bytes sent since the switch to TX, preamble and sync not included
+typedef void (*pfnSimTxHook_t)(uint8_t radio, uint32_t carrierHz, const uint8_t *pData, uint16_t len);
+
+void Sim_Reset(void);
+uint64_t Sim_GetUs(void);
+void Sim_AdvanceUs(uint32_t us);
+void Sim_SpiBegin(uint8_t radio);
+uint8_t Sim_SpiByte(uint8_t mosi);
+void Sim_SpiEnd(void);
+bool Sim_InjectPkt(uint8_t radio, uint64_t startUs, uint32_t carrierHz, int16_t rssi, const uint8_t *pData, uint16_t len);
+void Sim_SetNoiseRssi(uint8_t radio, int16_t rssi);
+bool Sim_GetDio0(uint8_t radio);
+uint16_t Sim_GetTxLog(uint8_t radio, uint8_t *pBuf, uint16_t size);
+void Sim_GetStats(uint8_t radio, sSimStats_t *pStats);
+void Sim_SetTxHook(pfnSimTxHook_t hook);
+void Sim_SetTemp(uint8_t radio, int8_t tempC, int32_t xtalPpb);
+void Sim_SetTxStall(uint8_t radio, bool onOff);
+void Sim_SetCpuStall(uint32_t gapUs, uint32_t maxUs);
+uint32_t Sim_CpuStallUs(void);
+uint32_t Sim_GetCpuStallCnt(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
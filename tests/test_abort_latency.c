@@ -0,0 +1,225 @@
+/**
+ *@file test_abort_latency.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief cancel and preempt every blocking radio phase, the radio is released within bounds
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include "test_util.h"
+#include "app_subg.h"
+#include "app_codec.h"
+#include "app_time.h"
+#include "sx1231_sim.h"
+#include "hal.h"
+
+#define MINIMED_FREQ_HZ		916500000
+#define OMNIPOD_FREQ_HZ		433910000
+//loops poll the cancel flag at least every 1 ms, plus the spi traffic to stop the radio
+#define ABORT_LATENCY_MAX_US	1500
+
+typedef enum
+{
+	FIRE_CANCEL = 0,
+	FIRE_PREEMPT,
+	FIRE_INT_FLG
+}eFire_t;
+
+//what the BLE event does fireAtUs into the operation
+static bool fireArmed = false;
+static uint64_t fireAtUs = 0;
+static eFire_t fireType;
+static eSubgPrio_t firePrio;
+static SubgOpHandle_t fireOp;
+static bool fireResult;
+
+static uint64_t test_clock(void)
+{
+	uint64_t now = Hal_ClockUs();
+
+	if(fireArmed && now >= fireAtUs)
+	{
+		fireArmed = false;
+		switch(fireType)
+		{
+			case FIRE_CANCEL:
+				fireResult = Subg_OpCancel(fireOp);
+				break;
+			case FIRE_PREEMPT:
+				fireResult = Subg_OpPreempt(firePrio);
+				break;
+			default:
+				Subg_SetIntFlg();
+				fireResult = true;
+				break;
+		}
+	}
+	return now;
+}
+
+static SubgOpHandle_t op_start(eSubgPrio_t prio, eFire_t type, uint32_t afterUs)
+{
+	SubgOpHandle_t op = Subg_OpBegin(prio);
+
+	TEST_CHECK(op != SUBG_OP_NONE);
+	fireOp = op;
+	fireType = type;
+	firePrio = SUBG_PRIO_NORMAL;
+	fireAtUs = Sim_GetUs() + afterUs;
+	fireResult = false;
+	fireArmed = true;
+	return op;
+}
+
+/*
+the cancel was seen through in time and left the radio out of tx/rx, except after
+Subg_ListenPkt which keeps it in rx between capture slices
+*/
+static void check_aborted(const char *name, eRf69Dev_t dev, uint32_t abortCnt, bool stopped)
+{
+	const sSubgOpStats_t *pStats = Subg_GetOpStats();
+	sSubgRadio_t radio;
+
+	Subg_GetRadio(dev, &radio);
+	printf("%-28s abort latency %u us\n", name, pStats->abortLatencyLastUs);
+	TEST_CHECK(fireResult);
+	TEST_CHECK_INT(pStats->abortCnt, abortCnt);
+	TEST_CHECK(pStats->abortLatencyLastUs <= ABORT_LATENCY_MAX_US);
+	TEST_CHECK(!stopped || radio.state != SUBG_RADIO_ACTIVE);
+}
+
+static void fill(uint8_t *pPkt, uint16_t len)
+{
+	uint16_t i;
+
+	for(i = 0; i < len; i++)
+	{
+		pPkt[i] = (i & 1) ? 0x96 : 0x69;
+	}
+}
+
+static void test_cancel(void)
+{
+	uint8_t pkt[SUBG_TX_MAX_LEN];
+	uint8_t rx[SUBG_RX_MAX_LEN];
+	uint16_t rxLen = 0;
+	uint32_t abortCnt = Subg_GetOpStats()->abortCnt;
+	SubgOpHandle_t op;
+
+	fill(pkt, sizeof(pkt));
+
+	Subg_SetMode(SUBG_MODE_MINIMED_NAS);
+	Subg_SetFreq(MINIMED_FREQ_HZ);
+	op = op_start(SUBG_PRIO_NORMAL, FIRE_CANCEL, 50000);
+	TEST_CHECK_INT(Subg_GetPkt(rx, sizeof(rx), &rxLen, 1000, 0), SUBG_RX_INT);
+	Subg_OpEnd(op);
+	check_aborted("minimed rx wait", RF69_DEV_FREQ916N868, ++abortCnt, true);
+
+	op = op_start(SUBG_PRIO_NORMAL, FIRE_CANCEL, 30000);
+	TEST_CHECK_INT(Subg_SendPkt(pkt, 200, 0, 0, 0), SUBG_TX_ABORT);
+	Subg_OpEnd(op);
+	check_aborted("minimed tx fifo refill", RF69_DEV_FREQ916N868, ++abortCnt, true);
+
+	op = op_start(SUBG_PRIO_NORMAL, FIRE_CANCEL, 300000);
+	TEST_CHECK_INT(Subg_SendPkt(pkt, 20, 5, 500, 0), SUBG_TX_ABORT);
+	Subg_OpEnd(op);
+	check_aborted("minimed repeat interval", RF69_DEV_FREQ916N868, ++abortCnt, true);
+
+	Subg_SetMode(SUBG_MODE_OMNIPOD);
+	Subg_SetFreq(OMNIPOD_FREQ_HZ);
+	op = op_start(SUBG_PRIO_NORMAL, FIRE_CANCEL, 500000);
+	TEST_CHECK_INT(Subg_SendPkt(pkt, 20, 0, 0, 2000), SUBG_TX_ABORT);
+	Subg_OpEnd(op);
+	check_aborted("omnipod preamble extension", RF69_DEV_FREQ433, ++abortCnt, true);
+
+	op = op_start(SUBG_PRIO_NORMAL, FIRE_CANCEL, 30000);
+	TEST_CHECK_INT(Subg_SendPkt(pkt, sizeof(pkt), 0, 0, 0), SUBG_TX_ABORT);
+	Subg_OpEnd(op);
+	check_aborted("omnipod tx fifo refill", RF69_DEV_FREQ433, ++abortCnt, true);
+
+	//cancelled while the last bytes drain from the fifo
+	op = op_start(SUBG_PRIO_NORMAL, FIRE_CANCEL, 20000);
+	TEST_CHECK_INT(Subg_SendPkt(pkt, 40, 0, 0, 0), SUBG_TX_ABORT);
+	Subg_OpEnd(op);
+	check_aborted("omnipod tx drain", RF69_DEV_FREQ433, ++abortCnt, true);
+
+	op = op_start(SUBG_PRIO_NORMAL, FIRE_CANCEL, 50000);
+	TEST_CHECK_INT(Subg_GetPkt(rx, sizeof(rx), &rxLen, 1000, 0), SUBG_RX_INT);
+	Subg_OpEnd(op);
+	check_aborted("omnipod rx wait", RF69_DEV_FREQ433, ++abortCnt, true);
+}
+
+/*a command preempts background work, not one of its own priority or above*/
+static void test_preempt(void)
+{
+	uint8_t rx[SUBG_RX_MAX_LEN];
+	uint16_t rxLen = 0;
+	uint32_t abortCnt = Subg_GetOpStats()->abortCnt;
+	uint32_t preemptCnt = Subg_GetOpStats()->preemptCnt;
+	SubgOpHandle_t op;
+	uint64_t start;
+
+	Subg_SetMode(SUBG_MODE_MINIMED_NAS);
+	op = op_start(SUBG_PRIO_BACKGROUND, FIRE_PREEMPT, 20000);
+	TEST_CHECK_INT(Subg_ListenPkt(rx, sizeof(rx), &rxLen, 1000), SUBG_RX_INT);
+	Subg_OpEnd(op);
+	check_aborted("background rx preempted", RF69_DEV_FREQ916N868, ++abortCnt, false);
+	TEST_CHECK_INT(Subg_GetOpStats()->preemptCnt, preemptCnt + 1);
+
+	op = op_start(SUBG_PRIO_NORMAL, FIRE_PREEMPT, 20000);
+	start = Sim_GetUs();
+	TEST_CHECK_INT(Subg_GetPkt(rx, sizeof(rx), &rxLen, 100, 0), SUBG_RX_TIMEOUT);
+	Subg_OpEnd(op);
+	TEST_CHECK(!fireResult);
+	TEST_CHECK(Sim_GetUs() - start >= 100000);
+	TEST_CHECK_INT(Subg_GetOpStats()->abortCnt, abortCnt);
+}
+
+/*the legacy flag cancels the running operation, and nothing when none runs*/
+static void test_int_flg(void)
+{
+	static const uint8_t raw[] = {0xA7, 0x12, 0x34, 0x56, 0x8D, 0x00};
+	uint8_t air[16];
+	uint8_t rx[SUBG_RX_MAX_LEN];
+	uint16_t airLen;
+	uint16_t rxLen = 0;
+	uint32_t cancelCnt;
+	SubgOpHandle_t op;
+
+	Subg_SetMode(SUBG_MODE_MINIMED_NAS);
+	op = op_start(SUBG_PRIO_NORMAL, FIRE_INT_FLG, 20000);
+	TEST_CHECK_INT(Subg_GetPkt(rx, sizeof(rx), &rxLen, 1000, 0), SUBG_RX_INT);
+	Subg_OpEnd(op);
+	check_aborted("legacy int flag", RF69_DEV_FREQ916N868, Subg_GetOpStats()->abortCnt, true);
+
+	cancelCnt = Subg_GetOpStats()->cancelCnt;
+	Subg_SetIntFlg();
+	TEST_CHECK_INT(Subg_GetOpStats()->cancelCnt, cancelCnt);
+
+	airLen = Codec_Encode(CODEC_4B6B, raw, sizeof(raw), air, sizeof(air), true);
+	Sim_InjectPkt(HAL_RADIO_916, Sim_GetUs() + 10000, MINIMED_FREQ_HZ, -70, air, airLen);
+	op = Subg_OpBegin(SUBG_PRIO_NORMAL);
+	TEST_CHECK_INT(Subg_GetPkt(rx, sizeof(rx), &rxLen, 100, 0), SUBG_RX_OK);
+	Subg_OpEnd(op);
+}
+
+int main(void)
+{
+	Sim_Reset();
+	Subg_Init();
+	Time_SetClock(test_clock);
+
+	test_cancel();
+	test_preempt();
+	test_int_flg();
+
+	printf("worst abort latency %u us\n", Subg_GetOpStats()->abortLatencyMaxUs);
+	return Test_Result("test_abort_latency");
+}
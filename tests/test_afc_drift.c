@@ -0,0 +1,129 @@
+/**
+ *@file test_afc_drift.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief the remote's offset estimate follows our crystal drifting away, flash is written sparingly
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <stdlib.h>
+
+#include "test_util.h"
+#include "app_subg.h"
+#include "app_afc.h"
+#include "app_codec.h"
+#include "sx1231_sim.h"
+#include "hal.h"
+
+#define MINIMED_FREQ_HZ		916500000
+#define PUMP_ID				0x123456
+#define DRIFT_STEP_PPB		500				//~460 Hz per packet at 916 MHz
+#define DRIFT_STEPS			40				//20 ppm in the end, ~18 kHz
+//the estimate trails a ramp by 3 steps with its 1/4 weight, a few more for rounding
+#define TRACK_ERR_MAX_HZ	2000
+#define SAVE_STEP_HZ		1000			//AFC_SAVE_STEP_HZ
+
+static const uint8_t pumpPkt[] = {0xA7, 0x12, 0x34, 0x56, 0x8D, 0x01, 0x02};
+
+static sAfcEntry_t afcTable[AFC_REMOTE_NUM];
+static uint32_t saveCnt = 0;
+
+static void test_save(void)
+{
+	saveCnt++;
+}
+
+/*a table full of other remotes comes back from flash untouched, nothing is claimed yet*/
+static void test_init_keeps_table(void)
+{
+	sAfcEntry_t saved[AFC_REMOTE_NUM];
+	uint8_t i;
+
+	for(i = 0; i < AFC_REMOTE_NUM; i++)
+	{
+		afcTable[i].remoteId = 0x100 + i;
+		afcTable[i].offsetHz = 1000 * (i + 1);
+		afcTable[i].errBoundHz = 500;
+		afcTable[i].sampleCnt = 20;
+	}
+	memcpy(saved, afcTable, sizeof(saved));
+
+	Afc_Init(afcTable, test_save);
+	TEST_CHECK(memcmp(afcTable, saved, sizeof(saved)) == 0);
+	TEST_CHECK_INT(Afc_GetRemote(), AFC_REMOTE_ID_DEFAULT);
+	TEST_CHECK_INT(Afc_GetOffset(), 0);
+	TEST_CHECK(!Afc_NeedRescan());
+
+	//a known remote finds its estimate
+	Afc_SelectRemote(0x102);
+	TEST_CHECK_INT(Afc_GetOffset(), 3000);
+	TEST_CHECK(memcmp(afcTable, saved, sizeof(saved)) == 0);
+
+	memset(afcTable, 0, sizeof(afcTable));
+	Afc_Init(afcTable, test_save);
+	TEST_CHECK_INT(saveCnt, 0);
+}
+
+/*
+our crystal drifts a step per packet while the pump stays put: every packet is heard,
+the estimate follows the drift, flash is not written for the first sample and then
+only per AFC_SAVE_STEP_HZ moved
+*/
+static void test_drift(void)
+{
+	uint8_t air[32];
+	uint8_t rx[SUBG_RX_MAX_LEN];
+	uint16_t airLen;
+	uint16_t rxLen = 0;
+	int32_t driftHz;
+	uint16_t i;
+
+	airLen = Codec_Encode(CODEC_4B6B, pumpPkt, sizeof(pumpPkt), air, sizeof(air), true);
+	air[airLen++] = 0x00;
+
+	Subg_SetMode(SUBG_MODE_MINIMED_NAS);
+	Subg_SetFreq(MINIMED_FREQ_HZ);
+	Subg_SetRemoteId(PUMP_ID);
+	TEST_CHECK_INT(Afc_GetRemote(), PUMP_ID);
+
+	for(i = 0; i <= DRIFT_STEPS; i++)
+	{
+		Sim_SetTemp(HAL_RADIO_916, 25, i * DRIFT_STEP_PPB);
+		Sim_InjectPkt(HAL_RADIO_916, Sim_GetUs() + 5000, MINIMED_FREQ_HZ, -70, air, airLen);
+		TEST_CHECK_INT(Subg_GetPkt(rx, sizeof(rx), &rxLen, 100, 0), SUBG_RX_OK);
+		if(i == 0)
+		{
+			TEST_CHECK_INT(saveCnt, 0);
+		}
+	}
+
+	//we are tuned high by the drift, the pump shows up that far below
+	driftHz = (int32_t)((int64_t)MINIMED_FREQ_HZ * DRIFT_STEPS * DRIFT_STEP_PPB / 1000000000);
+	printf("drift %d Hz, estimate %d Hz, bound %u Hz, %u flash writes\n", driftHz, Afc_GetOffset(), Afc_GetErrBound(), saveCnt);
+	TEST_CHECK(abs(Afc_GetOffset() + driftHz) <= TRACK_ERR_MAX_HZ);
+	TEST_CHECK(!Afc_NeedRescan());
+	TEST_CHECK(saveCnt > 0);
+	TEST_CHECK(saveCnt <= (uint32_t)driftHz / SAVE_STEP_HZ + 1);
+
+	//selecting the same pump again changes nothing
+	Subg_SetRemoteId(PUMP_ID);
+	TEST_CHECK(abs(Afc_GetOffset() + driftHz) <= TRACK_ERR_MAX_HZ);
+}
+
+int main(void)
+{
+	Sim_Reset();
+	Subg_Init();
+
+	test_init_keeps_table();
+	test_drift();
+
+	return Test_Result("test_afc_drift");
+}
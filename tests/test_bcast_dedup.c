@@ -0,0 +1,237 @@
+/**
+ *@file test_bcast_dedup.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief broadcast listening: repeats dropped, unique readings batched to the link at the set cadence
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include "test_util.h"
+#include "radio_backend.h"
+#include "subg_rfspy_protocol.h"
+#include "app_bcast.h"
+#include "app_capture.h"
+#include "app_codec.h"
+#include "app_minimed.h"
+#include "sx1231_sim.h"
+#include "hal.h"
+
+#define MINIMED_FREQ_HZ		916500000		//channel 0 of the CC1110 reset config
+#define READING_NUM			20
+#define READING_GAP_US		10000000		//a sensor reading every 10 s
+#define REPEAT_NUM			4				//each sent 4 times, 150 ms apart
+#define REPEAT_GAP_US		150000
+#define PKT_LEN				15				//MySentry style packet, CRC8 included
+#define PKT_AIR_MS			12				//23 bytes 4b6b at 16 kbps, the record time is the sync word's
+#define PKT_RSSI			-60
+#define BATCH_S				30
+#define MAIN_LOOP_US		10000
+
+static uint8_t batch[512];
+static uint16_t batchLen = 0;
+static bool batchBad = false;
+static uint16_t batchCnt = 0;
+static uint16_t recCnt = 0;
+static int16_t lastSeq = -1;
+static uint32_t batchAgeMaxMs = 0;
+
+static uint8_t reply[64];
+static uint8_t replyLen = 0;
+
+/*records of a whole batch: time, rssi, len, packet. Every reading once, in order.*/
+static void batch_check(void)
+{
+	uint32_t nowMs = (uint32_t)(Sim_GetUs() / 1000);
+	uint32_t stampMs;
+	uint16_t pos = 0;
+
+	while(pos + BCAST_REC_HDR_LEN <= batchLen)
+	{
+		stampMs = batch[pos] | ((uint32_t)batch[pos + 1] << 8) | ((uint32_t)batch[pos + 2] << 16)
+				  | ((uint32_t)batch[pos + 3] << 24);
+		if(pos == 0 && nowMs - stampMs > batchAgeMaxMs)
+		{
+			batchAgeMaxMs = nowMs - stampMs;
+		}
+		if((int8_t)batch[pos + 4] != PKT_RSSI || batch[pos + 5] != PKT_LEN || batch[pos + 6 + 5] != lastSeq + 1)
+		{
+			batchBad = true;
+		}
+		lastSeq = batch[pos + 6 + 5];
+		recCnt++;
+		pos += BCAST_REC_HDR_LEN + batch[pos + 5];
+	}
+	if(pos != batchLen)
+	{
+		batchBad = true;
+	}
+	batchCnt++;
+}
+
+/*blob frames: type, offset(2, LE), total(2, LE), bytes*/
+static eCaptureNotifyResult_t test_notify(const uint8_t *pData, uint16_t len)
+{
+	uint16_t offset;
+	uint16_t total;
+
+	if(len <= 5 || pData[0] != CAPTURE_FRAME_TYPE_BCAST)
+	{
+		batchBad = true;
+		return CAPTURE_NOTIFY_OK;
+	}
+	offset = pData[1] | ((uint16_t)pData[2] << 8);
+	total = pData[3] | ((uint16_t)pData[4] << 8);
+	if(offset == 0)
+	{
+		batchLen = 0;
+	}
+	if(offset != batchLen || offset + len - 5 > total || total > sizeof(batch))
+	{
+		batchBad = true;
+		return CAPTURE_NOTIFY_OK;
+	}
+	memcpy(batch + offset, pData + 5, len - 5);
+	batchLen += len - 5;
+	if(batchLen == total)
+	{
+		batch_check();
+	}
+	return CAPTURE_NOTIFY_OK;
+}
+
+static void on_response(const uint8_t *data, uint8_t len)
+{
+	memcpy(reply, data, len);
+	replyLen = len;
+}
+
+static void run(const uint8_t *pCmd, uint8_t len)
+{
+	replyLen = 0;
+	radio_backend_rfm69.run_command(pCmd, len);
+	radio_backend_rfm69.process();
+}
+
+static uint32_t reply_u32(uint8_t pos)
+{
+	return ((uint32_t)reply[pos] << 24) | ((uint32_t)reply[pos + 1] << 16) | ((uint32_t)reply[pos + 2] << 8) | reply[pos + 3];
+}
+
+/*
+every third reading carries the same value as the one before, only the sequence
+number tells them apart: it must not be taken for a repeat
+*/
+static void inject(uint64_t atUs, uint8_t seq)
+{
+	uint8_t pkt[PKT_LEN] = {0xA2, 0x12, 0x34, 0x56, 0x04, seq, (seq % 3 == 0) ? 0x07 : seq, 1, 2, 3, 4, 5, 6, 7};
+	uint8_t air[32];
+	uint16_t airLen;
+
+	pkt[PKT_LEN - 1] = Minimed_Crc8(pkt, PKT_LEN - 1);
+	airLen = Codec_Encode(CODEC_4B6B, pkt, sizeof(pkt), air, sizeof(air), true);
+	air[airLen++] = 0x00;
+	TEST_CHECK(Sim_InjectPkt(HAL_RADIO_916, atUs, MINIMED_FREQ_HZ, PKT_RSSI, air, airLen));
+}
+
+static void test_listen(void)
+{
+	//channel 0, 50 ms idle, 10 ms rx, batches every 30 s
+	static const uint8_t start[] = {SUBG_RFSPY_CMD_BROADCAST_LISTEN, 0x00, 0x00, 50, 0x00, 10, 0x00, BATCH_S};
+	const sBcastStats_t *pStats = Bcast_GetStats();
+	uint64_t base;
+	uint8_t r;
+	uint8_t k;
+
+	run(start, sizeof(start));
+	TEST_CHECK_INT(reply[0], SUBG_RFSPY_RESPONSE_SUCCESS);
+	TEST_CHECK(Bcast_IsRunning());
+
+	for(r = 0; r < READING_NUM; r++)
+	{
+		base = Sim_GetUs() + 100000;
+		for(k = 0; k < REPEAT_NUM; k++)
+		{
+			inject(base + k * REPEAT_GAP_US, r);
+		}
+		while(Sim_GetUs() < base - 100000 + READING_GAP_US)
+		{
+			radio_backend_rfm69.process();
+			Sim_AdvanceUs(MAIN_LOOP_US);
+		}
+	}
+
+	printf("%u good %u bad, %u repeats, %u unique, %u batches, %u of %u bytes to the link\n", pStats->rxCnt,
+		   pStats->badCnt, pStats->dupCnt, pStats->uniqueCnt, pStats->batchCnt, pStats->sentBytes, pStats->rawBytes);
+	TEST_CHECK_INT(pStats->rxCnt + pStats->badCnt, READING_NUM * REPEAT_NUM);
+	TEST_CHECK_INT(pStats->uniqueCnt, READING_NUM);
+	TEST_CHECK_INT(pStats->dupCnt, pStats->rxCnt - READING_NUM);
+	TEST_CHECK_INT(pStats->dropCnt, 0);
+	TEST_CHECK_INT(pStats->rawBytes, pStats->rxCnt * (BCAST_REC_HDR_LEN + PKT_LEN));
+	TEST_CHECK_INT(pStats->batchCnt, batchCnt);
+	TEST_CHECK_INT(pStats->sentBytes, recCnt * (BCAST_REC_HDR_LEN + PKT_LEN));
+
+	//a batch goes out when its oldest reading is BATCH_S old, not with every reading
+	printf("oldest buffered reading %u ms old at its batch\n", batchAgeMaxMs);
+	TEST_CHECK(batchAgeMaxMs <= BATCH_S * 1000 + PKT_AIR_MS + MAIN_LOOP_US / 1000);
+	TEST_CHECK(batchCnt <= READING_NUM * READING_GAP_US / 1000000 / BATCH_S);
+}
+
+/*the counters over the link, and a command in between leaves the listener running*/
+static void test_stats(void)
+{
+	static const uint8_t stats[] = {SUBG_RFSPY_CMD_BROADCAST_STATS};
+	static const uint8_t version[] = {SUBG_RFSPY_CMD_GET_VERSION};
+	const sBcastStats_t *pStats = Bcast_GetStats();
+
+	run(stats, sizeof(stats));
+	TEST_CHECK_INT(replyLen, 1 + 8 * 4);
+	TEST_CHECK_INT(reply[0], SUBG_RFSPY_RESPONSE_SUCCESS);
+	TEST_CHECK_INT(reply_u32(1), pStats->rxCnt);
+	TEST_CHECK_INT(reply_u32(5), pStats->badCnt);
+	TEST_CHECK_INT(reply_u32(9), pStats->dupCnt);
+	TEST_CHECK_INT(reply_u32(13), pStats->uniqueCnt);
+	TEST_CHECK_INT(reply_u32(17), pStats->dropCnt);
+	TEST_CHECK_INT(reply_u32(21), pStats->batchCnt);
+	TEST_CHECK_INT(reply_u32(25), pStats->rawBytes);
+	TEST_CHECK_INT(reply_u32(29), pStats->sentBytes);
+
+	run(version, sizeof(version));
+	TEST_CHECK(replyLen > 1);
+	TEST_CHECK(Bcast_IsRunning());
+}
+
+/*stopping flushes what is buffered: every reading reached the phone exactly once*/
+static void test_stop(void)
+{
+	static const uint8_t stop[] = {SUBG_RFSPY_CMD_BROADCAST_LISTEN, 0x00, 0x00, 50, 0x00, 10, 0x00, 0x00};
+
+	run(stop, sizeof(stop));
+	TEST_CHECK_INT(reply[0], SUBG_RFSPY_RESPONSE_SUCCESS);
+	radio_backend_rfm69.process();
+	TEST_CHECK(!Bcast_IsRunning());
+	TEST_CHECK(!batchBad);
+	TEST_CHECK_INT(recCnt, READING_NUM);
+	TEST_CHECK_INT(lastSeq, READING_NUM - 1);
+	TEST_CHECK_INT(Bcast_GetStats()->sentBytes, READING_NUM * (BCAST_REC_HDR_LEN + PKT_LEN));
+}
+
+int main(void)
+{
+	Sim_Reset();
+	Capture_Init(test_notify);
+	TEST_CHECK(radio_backend_rfm69.probe());
+	radio_backend_rfm69.init(on_response);
+
+	test_listen();
+	test_stats();
+	test_stop();
+
+	return Test_Result("test_bcast_dedup");
+}
@@ -0,0 +1,240 @@
+/**
+ *@file test_capture_load.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief capture mode under sustained traffic: every packet reaches the link, in order, with its time and RSSI
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include "test_util.h"
+#include "radio_backend.h"
+#include "subg_rfspy_protocol.h"
+#include "app_capture.h"
+#include "app_codec.h"
+#include "app_time.h"
+#include "sx1231_sim.h"
+#include "hal.h"
+
+#define MINIMED_FREQ_HZ		916500000		//channel 0 of the CC1110 reset config
+#define PKT_NUM				250
+#define PKT_LEN				30				//45 bytes 4b6b + trailer, 22 ms on air
+#define PKT_GAP_US			40000			//25 packets/s back to back, a history download's pace
+#define PKT_RSSI			-72
+#define INJECT_AHEAD_US		20000
+//the phone takes 2 notifications per 15 ms connection event
+#define LINK_INTERVAL_US	15000
+#define LINK_PER_INTERVAL	2
+//a frame carries the time of the sync word, decoding it takes a few bytes into the packet
+#define STAMP_MAX_US		5000
+#define MAIN_LOOP_US		100
+
+static uint16_t injectNext = 0;
+static uint64_t injectStartUs = 0;
+
+static uint64_t linkIntervalUs = 0;
+static uint8_t linkUsed = 0;
+static uint64_t linkStallFromUs = 0;
+static uint64_t linkStallUntilUs = 0;
+
+static uint16_t frameCnt = 0;
+static int32_t lastSeq = -1;
+static bool frameBad = false;
+
+static uint8_t reply[64];
+static uint8_t replyLen = 0;
+
+static uint64_t pkt_start(uint16_t seq)
+{
+	return injectStartUs + (uint64_t)seq * PKT_GAP_US;
+}
+
+static void pkt_build(uint16_t seq, uint8_t *pPkt)
+{
+	uint8_t i;
+
+	pPkt[0] = 0xA7;
+	pPkt[1] = (uint8_t)(seq >> 8);
+	pPkt[2] = (uint8_t)seq;
+	for(i = 3; i < PKT_LEN; i++)
+	{
+		pPkt[i] = (uint8_t)(seq + i);
+	}
+}
+
+/*the packets go on air one by one, a little ahead of their time*/
+static uint64_t test_clock(void)
+{
+	uint64_t now = Hal_ClockUs();
+	uint8_t pkt[PKT_LEN];
+	uint8_t air[64];
+	uint16_t airLen;
+
+	while(injectNext < PKT_NUM && pkt_start(injectNext) <= now + INJECT_AHEAD_US)
+	{
+		pkt_build(injectNext, pkt);
+		airLen = Codec_Encode(CODEC_4B6B, pkt, sizeof(pkt), air, sizeof(air), true);
+		air[airLen++] = 0x00;
+		Sim_InjectPkt(HAL_RADIO_916, pkt_start(injectNext), MINIMED_FREQ_HZ, PKT_RSSI, air, airLen);
+		injectNext++;
+	}
+	return now;
+}
+
+/*BLE link: a few notifications per connection event, none while stalled*/
+static eCaptureNotifyResult_t test_notify(const uint8_t *pData, uint16_t len)
+{
+	uint64_t now = Sim_GetUs();
+	uint8_t pkt[PKT_LEN];
+	uint64_t stamp = 0;
+	uint16_t seq;
+	uint8_t i;
+
+	if(now >= linkStallFromUs && now < linkStallUntilUs)
+	{
+		return CAPTURE_NOTIFY_BUSY;
+	}
+	if(now - linkIntervalUs >= LINK_INTERVAL_US)
+	{
+		linkIntervalUs = now - (now % LINK_INTERVAL_US);
+		linkUsed = 0;
+	}
+	if(linkUsed >= LINK_PER_INTERVAL)
+	{
+		return CAPTURE_NOTIFY_BUSY;
+	}
+	linkUsed++;
+
+	//type, timestamp(8, LE), rssi, len, 4b6b packet
+	if(len < 11 || pData[0] != CAPTURE_FRAME_TYPE_PKT
+		|| Codec_Decode(CODEC_4B6B, pData + 11, pData[10], pkt, sizeof(pkt)) != PKT_LEN)
+	{
+		frameBad = true;
+		return CAPTURE_NOTIFY_OK;
+	}
+	for(i = 0; i < 8; i++)
+	{
+		stamp |= (uint64_t)pData[1 + i] << (8 * i);
+	}
+	seq = ((uint16_t)pkt[1] << 8) | pkt[2];
+
+	if((int32_t)seq <= lastSeq || (int8_t)pData[9] != PKT_RSSI
+		|| stamp < pkt_start(seq) || stamp > pkt_start(seq) + STAMP_MAX_US)
+	{
+		printf("frame %u: seq %u after %d, rssi %d, stamp %llu for %llu\n", frameCnt, seq, lastSeq,
+			   (int8_t)pData[9], (unsigned long long)stamp, (unsigned long long)pkt_start(seq));
+		frameBad = true;
+	}
+	lastSeq = seq;
+	frameCnt++;
+	return CAPTURE_NOTIFY_OK;
+}
+
+static void on_response(const uint8_t *data, uint8_t len)
+{
+	memcpy(reply, data, len);
+	replyLen = len;
+}
+
+static void run(const uint8_t *pCmd, uint8_t len)
+{
+	replyLen = 0;
+	radio_backend_rfm69.run_command(pCmd, len);
+	radio_backend_rfm69.process();
+}
+
+static uint32_t reply_u32(uint8_t pos)
+{
+	return ((uint32_t)reply[pos] << 24) | ((uint32_t)reply[pos + 1] << 16) | ((uint32_t)reply[pos + 2] << 8) | reply[pos + 3];
+}
+
+/*start capture on channel 0, run the main loop until the traffic is over, stop it*/
+static void capture_run(uint32_t stallAtUs, uint32_t stallUs)
+{
+	static const uint8_t start[] = {SUBG_RFSPY_CMD_CAPTURE, 0x00, 0x01};
+	static const uint8_t stop[] = {SUBG_RFSPY_CMD_CAPTURE, 0x00, 0x00};
+
+	injectNext = 0;
+	injectStartUs = Sim_GetUs() + 50000;
+	linkStallFromUs = injectStartUs + stallAtUs;
+	linkStallUntilUs = linkStallFromUs + stallUs;
+	frameCnt = 0;
+	lastSeq = -1;
+	frameBad = false;
+
+	run(start, sizeof(start));
+	TEST_CHECK(replyLen == 23 && reply[0] == SUBG_RFSPY_RESPONSE_SUCCESS && reply[1] == 1);
+	TEST_CHECK(Capture_IsRunning());
+	TEST_CHECK(Time_IsFine());
+
+	//the main loop sleeps until the next event when there is nothing to do
+	while(Sim_GetUs() < pkt_start(PKT_NUM) + 200000)
+	{
+		radio_backend_rfm69.process();
+		Sim_AdvanceUs(MAIN_LOOP_US);
+	}
+
+	run(stop, sizeof(stop));
+	TEST_CHECK(replyLen == 23 && reply[0] == SUBG_RFSPY_RESPONSE_SUCCESS && reply[1] == 0);
+	radio_backend_rfm69.process();
+	TEST_CHECK(!Capture_IsRunning());
+	TEST_CHECK(!Time_IsFine());
+	TEST_CHECK(!frameBad);
+
+	printf("%u of %u packets captured, %u notified, %u queue drops, %u busy, queue high water %u\n", reply_u32(2),
+		   PKT_NUM, reply_u32(6), reply_u32(10), reply_u32(18), reply[22]);
+}
+
+/*
+the link keeps up with the traffic: nothing is lost between the receiver and the phone,
+also not the packets on air while one rx slice ends and the next starts
+*/
+static void test_sustained(void)
+{
+	capture_run(0, 0);
+
+	TEST_CHECK_INT(reply_u32(2), PKT_NUM);			//captured
+	TEST_CHECK_INT(reply_u32(6), PKT_NUM);			//notified
+	TEST_CHECK_INT(reply_u32(10), 0);				//queue drops
+	TEST_CHECK_INT(reply_u32(14), 0);				//link drops
+	TEST_CHECK_INT(frameCnt, PKT_NUM);
+	TEST_CHECK_INT(lastSeq, PKT_NUM - 1);
+}
+
+/*
+the link stalls for 600 ms: the queue fills, rx goes on and what doesn't fit is counted
+instead of overwriting, what was queued goes out in order once the link is back
+*/
+static void test_backpressure(void)
+{
+	capture_run(2000000, 600000);
+
+	TEST_CHECK(reply_u32(2) < PKT_NUM);
+	TEST_CHECK(reply_u32(2) >= PKT_NUM - 600000 / PKT_GAP_US);
+	TEST_CHECK_INT(reply_u32(2) + reply_u32(10), PKT_NUM);	//captured + queue drops
+	TEST_CHECK_INT(reply_u32(6), reply_u32(2));
+	TEST_CHECK(reply_u32(18) > 0);					//busy
+	TEST_CHECK_INT(reply[22], 8);					//CAPTURE_QUEUE_SIZE
+	TEST_CHECK_INT(frameCnt, reply_u32(2));
+	TEST_CHECK_INT(lastSeq, PKT_NUM - 1);
+}
+
+int main(void)
+{
+	Sim_Reset();
+	Capture_Init(test_notify);
+	TEST_CHECK(radio_backend_rfm69.probe());
+	radio_backend_rfm69.init(on_response);
+	Time_SetClock(test_clock);
+
+	test_sustained();
+	test_backpressure();
+
+	return Test_Result("test_capture_load");
+}
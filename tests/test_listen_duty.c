@@ -0,0 +1,209 @@
+/**
+ *@file test_listen_duty.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief listen mode power model: the reported duty cycle and current against the simulated mode time
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include "test_util.h"
+#include "radio_backend.h"
+#include "subg_rfspy_protocol.h"
+#include "app_bcast.h"
+#include "app_capture.h"
+#include "app_codec.h"
+#include "app_listen.h"
+#include "app_minimed.h"
+#include "sx1231_sim.h"
+#include "hal.h"
+
+#define MINIMED_FREQ_HZ		916500000		//channel 0 of the CC1110 reset config
+#define IDLE_MS				100
+#define RX_MS				2
+#define QUIET_US			20000000		//no packets for 20 s
+#define PKT_NUM				5
+#define PKT_GAP_US			2000000
+#define PKT_LEN				15
+#define PKT_RSSI			-60
+#define MAIN_LOOP_US		10000
+#define NOISE_RSSI			-125			//well under the rssi threshold, no false syncs wake the host
+//the datasheet currents the model is built on, charged over the simulated mode time
+#define IDLE_NA				1200ULL
+#define RX_NA				16000000ULL
+#define START_NA			1250000ULL
+#define HOST_SLEEP_NA		3000ULL
+#define HOST_RUN_NA			3300000ULL
+#define TOL_PPM				20000			//2 %: the model's 310 us start against the sim's 330 us
+
+static uint8_t reply[64];
+static uint8_t replyLen = 0;
+
+static eCaptureNotifyResult_t test_notify(const uint8_t *pData, uint16_t len)
+{
+	(void)pData;
+	(void)len;
+	return CAPTURE_NOTIFY_OK;
+}
+
+static void on_response(const uint8_t *data, uint8_t len)
+{
+	memcpy(reply, data, len);
+	replyLen = len;
+}
+
+static void run(const uint8_t *pCmd, uint8_t len)
+{
+	replyLen = 0;
+	radio_backend_rfm69.run_command(pCmd, len);
+	radio_backend_rfm69.process();
+}
+
+static uint32_t reply_u32(uint8_t pos)
+{
+	return ((uint32_t)reply[pos] << 24) | ((uint32_t)reply[pos + 1] << 16) | ((uint32_t)reply[pos + 2] << 8) | reply[pos + 3];
+}
+
+static bool near(uint64_t value, uint64_t expect)
+{
+	uint64_t diff = (value > expect) ? value - expect : expect - value;
+
+	return diff * 1000000 <= expect * TOL_PPM;
+}
+
+static void loop_until(uint64_t untilUs)
+{
+	while(Sim_GetUs() < untilUs)
+	{
+		radio_backend_rfm69.process();
+		Sim_AdvanceUs(MAIN_LOOP_US);
+	}
+}
+
+static void report_get(sListenReport_t *pReport)
+{
+	static const uint8_t cmd[] = {SUBG_RFSPY_CMD_LISTEN_REPORT};
+
+	run(cmd, sizeof(cmd));
+	TEST_CHECK_INT(replyLen, 2 + 8 * 4);
+	TEST_CHECK_INT(reply[0], SUBG_RFSPY_RESPONSE_SUCCESS);
+	TEST_CHECK_INT(reply[1], 1);
+	pReport->idleUs = reply_u32(2);
+	pReport->rxUs = reply_u32(6);
+	pReport->dutyPpm = reply_u32(10);
+	pReport->avgCurrentNa = reply_u32(14);
+	pReport->wakeCnt = reply_u32(18);
+	pReport->pktCnt = reply_u32(22);
+	pReport->wakeUs = reply_u32(26);
+	pReport->listenMs = reply_u32(30);
+}
+
+static void inject(uint64_t atUs, uint8_t seq)
+{
+	uint8_t pkt[PKT_LEN] = {0xA2, 0x12, 0x34, 0x56, 0x04, seq, 1, 2, 3, 4, 5, 6, 7, 8};
+	uint8_t air[32];
+	uint16_t airLen;
+
+	pkt[PKT_LEN - 1] = Minimed_Crc8(pkt, PKT_LEN - 1);
+	airLen = Codec_Encode(CODEC_4B6B, pkt, sizeof(pkt), air, sizeof(air), true);
+	air[airLen++] = 0x00;
+	TEST_CHECK(Sim_InjectPkt(HAL_RADIO_916, atUs, MINIMED_FREQ_HZ, PKT_RSSI, air, airLen));
+}
+
+/*
+no packets: the host sleeps all through, the reported duty and current are the
+sequencer's cycle as the radio ran it
+*/
+static void test_quiet(void)
+{
+	//channel 0, IDLE_MS idle, RX_MS rx, batches every 30 s
+	static const uint8_t start[] = {SUBG_RFSPY_CMD_BROADCAST_LISTEN, 0x00, 0x00, IDLE_MS, 0x00, RX_MS, 0x00, 30};
+	sListenReport_t report;
+	sSimStats_t s0;
+	sSimStats_t s1;
+	uint64_t idleUs;
+	uint64_t startUs;
+	uint64_t rxUs;
+	uint64_t totalUs;
+	uint64_t simDutyPpm;
+	uint64_t simCurrentNa;
+
+	Sim_GetStats(HAL_RADIO_916, &s0);
+	run(start, sizeof(start));
+	TEST_CHECK_INT(reply[0], SUBG_RFSPY_RESPONSE_SUCCESS);
+	loop_until(Sim_GetUs() + QUIET_US);
+	report_get(&report);
+	Sim_GetStats(HAL_RADIO_916, &s1);
+
+	idleUs = s1.listenIdleUs - s0.listenIdleUs;
+	startUs = s1.listenStartUs - s0.listenStartUs;
+	rxUs = s1.listenRxUs - s0.listenRxUs;
+	totalUs = idleUs + startUs + rxUs;
+	simDutyPpm = (startUs + rxUs) * 1000000 / totalUs;
+	simCurrentNa = (idleUs * IDLE_NA + startUs * START_NA + rxUs * RX_NA) / totalUs + HOST_SLEEP_NA;
+
+	printf("listen %u ms: duty %u ppm (sim %u), %u nA (sim %u), %u wakes\n", report.listenMs, report.dutyPpm,
+		   (uint32_t)simDutyPpm, report.avgCurrentNa, (uint32_t)simCurrentNa, report.wakeCnt);
+	//rounded to the RegListen resolution
+	TEST_CHECK(report.idleUs <= IDLE_MS * 1000 && report.idleUs > IDLE_MS * 1000 - 4100);
+	TEST_CHECK(report.rxUs <= RX_MS * 1000 && report.rxUs > RX_MS * 1000 - 64);
+	TEST_CHECK_INT(report.wakeCnt, 0);
+	TEST_CHECK_INT(report.wakeUs, 0);
+	TEST_CHECK(report.listenMs <= totalUs / 1000 + 1 && report.listenMs + 1 >= totalUs / 1000);
+	TEST_CHECK(near(report.dutyPpm, simDutyPpm));
+	TEST_CHECK(near(report.avgCurrentNa, simCurrentNa));
+}
+
+/*
+packets wake the host: the time reading them is charged at rx and cpu current on
+top, and the counters carry over the commands in between
+*/
+static void test_wakes(void)
+{
+	sListenReport_t before;
+	sListenReport_t report;
+	uint64_t base;
+	uint64_t chargeNaUs;
+	uint8_t i;
+
+	report_get(&before);
+	base = Sim_GetUs() + 100000;
+	for(i = 0; i < PKT_NUM; i++)
+	{
+		inject(base + i * PKT_GAP_US, i);
+	}
+	loop_until(base + PKT_NUM * PKT_GAP_US);
+	report_get(&report);
+
+	printf("%u wakes, %u packets, %u us awake, %u nA\n", report.wakeCnt, report.pktCnt, report.wakeUs,
+		   report.avgCurrentNa);
+	TEST_CHECK(report.listenMs > before.listenMs);
+	TEST_CHECK_INT(report.pktCnt - before.pktCnt, PKT_NUM);
+	TEST_CHECK(report.wakeCnt - before.wakeCnt >= PKT_NUM);
+	TEST_CHECK(report.wakeUs > before.wakeUs);
+	TEST_CHECK(report.avgCurrentNa > before.avgCurrentNa);
+
+	chargeNaUs = ((uint64_t)report.listenMs * 1000 - report.wakeUs) * before.avgCurrentNa
+		+ (uint64_t)report.wakeUs * (RX_NA + HOST_RUN_NA);
+	TEST_CHECK(near(report.avgCurrentNa, chargeNaUs / ((uint64_t)report.listenMs * 1000)));
+}
+
+int main(void)
+{
+	Sim_Reset();
+	Sim_SetNoiseRssi(HAL_RADIO_916, NOISE_RSSI);
+	Capture_Init(test_notify);
+	TEST_CHECK(radio_backend_rfm69.probe());
+	radio_backend_rfm69.init(on_response);
+
+	test_quiet();
+	test_wakes();
+
+	return Test_Result("test_listen_duty");
+}
@@ -0,0 +1,136 @@
+/**
+ *@file test_noise_floor.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief the adaptive RSSI threshold against the fixed one, on a loud and on a quiet band
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include "test_util.h"
+#include "app_subg.h"
+#include "app_noise.h"
+#include "app_codec.h"
+#include "sx1231_sim.h"
+#include "hal.h"
+
+#define MINIMED_FREQ_HZ		916500000
+#define PKT_NUM				40
+#define PKT_PERIOD_US		200000
+#define WARMUP_MS			200			//the floor is learned from the first rx windows
+
+static const uint8_t pumpPkt[] = {0xA7, 0x12, 0x34, 0x56, 0x8D, 0x01, 0x02, 0x03, 0x04};
+
+typedef struct
+{
+	uint16_t got;				//the packet, whole
+	uint16_t garbage;			//anything else handed up
+	uint32_t falseSyncCnt;		//syncs on noise in the simulator
+	uint32_t weakCnt;			//packets below the threshold, never received
+	sNoiseState_t noise;
+}sNoiseRun_t;
+
+/*PKT_NUM packets at the levels given in turn, received back to back like a scan does*/
+static void noise_run(int16_t noiseDbm, bool adaptive, const int16_t *pLevel, uint8_t levelNum, sNoiseRun_t *pRun)
+{
+	uint8_t air[32];
+	uint8_t rx[SUBG_RX_MAX_LEN];
+	uint16_t airLen;
+	uint16_t rxLen;
+	uint64_t end;
+	sSimStats_t st0;
+	sSimStats_t st;
+	uint16_t i;
+
+	memset(pRun, 0, sizeof(sNoiseRun_t));
+	airLen = Codec_Encode(CODEC_4B6B, pumpPkt, sizeof(pumpPkt), air, sizeof(air), true);
+	air[airLen] = 0x00;
+
+	Sim_Reset();
+	Subg_Init();
+	Noise_SetAdaptive(adaptive);
+	Subg_SetMode(SUBG_MODE_MINIMED_NAS);
+	Subg_CfgRf();
+	Subg_SetFreq(MINIMED_FREQ_HZ);
+	Sim_SetNoiseRssi(HAL_RADIO_916, noiseDbm);
+	Subg_GetPkt(rx, sizeof(rx), &rxLen, WARMUP_MS, 0);
+	Sim_GetStats(HAL_RADIO_916, &st0);
+
+	for(i = 0; i < PKT_NUM; i++)
+	{
+		Sim_InjectPkt(HAL_RADIO_916, Sim_GetUs() + PKT_PERIOD_US / 2, MINIMED_FREQ_HZ, pLevel[i % levelNum], air, airLen + 1);
+		end = Sim_GetUs() + PKT_PERIOD_US;
+		while(Sim_GetUs() < end)
+		{
+			rxLen = 0;
+			if(Subg_GetPkt(rx, sizeof(rx), &rxLen, (uint32_t)((end - Sim_GetUs()) / 1000 + 1), 0) != SUBG_RX_OK || rxLen == 0)
+			{
+				continue;
+			}
+			if(rxLen == airLen && memcmp(rx, air, airLen) == 0)
+			{
+				pRun->got++;
+			}
+			else
+			{
+				pRun->garbage++;
+			}
+		}
+	}
+
+	Sim_GetStats(HAL_RADIO_916, &st);
+	pRun->falseSyncCnt = st.noiseSyncCnt - st0.noiseSyncCnt;
+	pRun->weakCnt = st.rxWeakCnt - st0.rxWeakCnt;
+	Noise_GetState(RF69_DEV_FREQ916N868, &pRun->noise);
+	printf("noise %4d dBm %s: threshold %4d floor %4d | %2u/%u received, %u garbage, %u false syncs, %u too weak\n",
+		   noiseDbm, adaptive ? "adaptive" : "fixed   ", pRun->noise.rssiThreshDbm, pRun->noise.floorDbm,
+		   pRun->got, PKT_NUM, pRun->garbage, pRun->falseSyncCnt, pRun->weakCnt);
+}
+
+/*noise above the fixed threshold syncs all the time, the adaptive one sits above it*/
+static void test_loud_band(int16_t noiseDbm)
+{
+	static const int16_t level[] = {-60, -80, -85};
+	sNoiseRun_t fixed;
+	sNoiseRun_t adaptive;
+
+	noise_run(noiseDbm, false, level, 3, &fixed);
+	noise_run(noiseDbm, true, level, 3, &adaptive);
+
+	TEST_CHECK(fixed.falseSyncCnt > 0);
+	TEST_CHECK_INT(adaptive.got, PKT_NUM);
+	TEST_CHECK_INT(adaptive.garbage, 0);
+	TEST_CHECK_INT(adaptive.falseSyncCnt, 0);
+	TEST_CHECK(adaptive.noise.rssiThreshDbm > noiseDbm);
+}
+
+/*a quiet band: the adaptive threshold goes below the fixed one and hears weak packets*/
+static void test_quiet_band(void)
+{
+	static const int16_t level[] = {-117, -116};
+	sNoiseRun_t fixed;
+	sNoiseRun_t adaptive;
+
+	noise_run(-125, false, level, 2, &fixed);
+	noise_run(-125, true, level, 2, &adaptive);
+
+	TEST_CHECK_INT(fixed.weakCnt, PKT_NUM);
+	TEST_CHECK_INT(adaptive.got, PKT_NUM);
+	TEST_CHECK_INT(adaptive.falseSyncCnt, 0);
+	TEST_CHECK(adaptive.noise.rssiThreshDbm < fixed.noise.rssiThreshDbm);
+}
+
+int main(void)
+{
+	test_loud_band(-100);
+	test_loud_band(-112);
+	test_quiet_band();
+
+	return Test_Result("test_noise_floor");
+}
@@ -0,0 +1,180 @@
+/**
+ *@file test_pod_exchange.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief whole Omnipod messages through the exchange command, against the simulated pod on a lossy link
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include "test_util.h"
+#include "radio_backend.h"
+#include "subg_rfspy_protocol.h"
+#include "app_omnipod.h"
+#include "pod_sim.h"
+#include "sx1231_sim.h"
+
+#define OMNIPOD_FREQ_HZ		433910000
+#define POD_ADDRESS			0x1F0E89F0
+#define POD_REPLY_DELAY_US	3000
+#define POD_RSSI			-60
+#define FIRST_SEQ			4
+//an exchange gives up after OMNI_EXCHANGE_TIMEOUT_MS of silence on one packet
+#define EXCHANGE_TIMEOUT_MS	3000
+
+static uint8_t reply[256];
+static uint16_t replyLen = 0;
+
+static void on_response(const uint8_t *data, uint8_t len)
+{
+	memcpy(reply, data, len);
+	replyLen = len;
+}
+
+static void run(const uint8_t *pCmd, uint8_t len)
+{
+	replyLen = 0;
+	radio_backend_rfm69.run_command(pCmd, len);
+	radio_backend_rfm69.process();
+}
+
+/*message header: address, 3 bits of sequence and 10 bits of block length, then the blocks*/
+static uint8_t msg_build(uint8_t *pMsg, uint8_t len)
+{
+	uint16_t blockLen = len - OMNIPOD_MSG_HDR_LEN - OMNIPOD_MSG_CRC_LEN;
+	uint8_t i;
+
+	pMsg[0] = (uint8_t)(POD_ADDRESS >> 24);
+	pMsg[1] = (uint8_t)(POD_ADDRESS >> 16);
+	pMsg[2] = (uint8_t)(POD_ADDRESS >> 8);
+	pMsg[3] = (uint8_t)POD_ADDRESS;
+	pMsg[4] = (uint8_t)((3 << 2) | (blockLen >> 8));
+	pMsg[5] = (uint8_t)blockLen;
+	for(i = OMNIPOD_MSG_HDR_LEN; i < len; i++)
+	{
+		pMsg[i] = (uint8_t)(i * 11);
+	}
+	return len;
+}
+
+/*
+one exchange with the pod dropping every dropRx-th packet it should hear and losing
+every dropTx-th one it sends, the pod echoes the message back
+*/
+static void exchange(uint8_t msgLen, uint16_t dropRx, uint16_t dropTx)
+{
+	sPodSimCfg_t cfg = {POD_ADDRESS, POD_REPLY_DELAY_US, POD_RSSI, dropRx, dropTx, NULL};
+	uint8_t cmd[7 + OMNIPOD_MSG_MAX_LEN] = {SUBG_RFSPY_CMD_OMNIPOD_EXCHANGE, 0x00,
+											(uint8_t)(POD_ADDRESS >> 24), (uint8_t)(POD_ADDRESS >> 16),
+											(uint8_t)(POD_ADDRESS >> 8), (uint8_t)POD_ADDRESS, FIRST_SEQ};
+	const sOmnipodStats_t *pStats = Omnipod_GetStats();
+	sPodSimStats_t pod;
+	uint8_t pktCnt;
+
+	PodSim_Init(&cfg);
+	Omnipod_ClrStats();
+	msg_build(cmd + 7, msgLen);
+	run(cmd, 7 + msgLen);
+	PodSim_GetStats(&pod);
+
+	printf("%3u byte message, pod drops 1/%u in 1/%u out: %u packets, %u retx, %u dup, %u ms\n", msgLen, dropRx,
+		   dropTx, pStats->txPktCnt, pStats->retxCnt, pStats->dupCnt, pStats->lastMsgMs);
+
+	TEST_CHECK_INT(replyLen, 3 + msgLen);
+	TEST_CHECK_INT(reply[0], SUBG_RFSPY_RESPONSE_SUCCESS);
+	TEST_CHECK_INT(reply[1], OMNIPOD_OK);
+	TEST_CHECK(memcmp(reply + 3, cmd + 7, msgLen) == 0);
+	TEST_CHECK_INT(pStats->msgCnt, 1);
+	TEST_CHECK_INT(pod.msgCnt, 1);
+
+	//PDM and pod take turns on the sequence: our packets and the pod's, plus the final ack
+	pktCnt = pStats->txPktCnt;
+	TEST_CHECK_INT(reply[2], (FIRST_SEQ + 2 * pktCnt + 1) & OMNIPOD_SEQ_MASK);
+	//a lost final ack is covered by the repeats, no retransmission for it
+	TEST_CHECK(pStats->retxCnt <= pod.rxDropCnt + pod.txDropCnt);
+	TEST_CHECK(pStats->lastMsgMs < (pktCnt + pStats->retxCnt) * 200 + 500);
+}
+
+static void test_clean(void)
+{
+	exchange(12, 0, 0);
+	TEST_CHECK_INT(Omnipod_GetStats()->txPktCnt, 1);
+	TEST_CHECK_INT(Omnipod_GetStats()->retxCnt, 0);
+
+	//70 bytes take five packets: the first and four continuations
+	exchange(70, 0, 0);
+	TEST_CHECK_INT(Omnipod_GetStats()->txPktCnt, 5);
+	TEST_CHECK_INT(Omnipod_GetStats()->retxCnt, 0);
+}
+
+/*lost packets either way are sent again, a pod that missed our ack answers twice and is acked once more*/
+static void test_lossy(void)
+{
+	sPodSimStats_t pod;
+
+	exchange(70, 3, 0);
+	TEST_CHECK(Omnipod_GetStats()->retxCnt > 0);
+
+	exchange(70, 0, 3);
+	PodSim_GetStats(&pod);
+	TEST_CHECK(Omnipod_GetStats()->retxCnt > 0);
+	TEST_CHECK(pod.dupCnt > 0);
+
+	exchange(70, 2, 3);
+	exchange(100, 4, 5);
+}
+
+/*a pod that never answers: timeout after the retries of the first packet, within the bound*/
+static void test_silent(void)
+{
+	sPodSimCfg_t cfg = {POD_ADDRESS, POD_REPLY_DELAY_US, POD_RSSI, 1, 0, NULL};
+	uint8_t cmd[7 + 12] = {SUBG_RFSPY_CMD_OMNIPOD_EXCHANGE, 0x00, (uint8_t)(POD_ADDRESS >> 24),
+						   (uint8_t)(POD_ADDRESS >> 16), (uint8_t)(POD_ADDRESS >> 8), (uint8_t)POD_ADDRESS, FIRST_SEQ};
+	uint64_t start;
+	uint64_t elapsedMs;
+
+	PodSim_Init(&cfg);
+	Omnipod_ClrStats();
+	msg_build(cmd + 7, 12);
+	start = Sim_GetUs();
+	run(cmd, sizeof(cmd));
+	elapsedMs = (Sim_GetUs() - start) / 1000;
+
+	printf("silent pod: gave up after %llu ms, %u retx\n", (unsigned long long)elapsedMs,
+		   Omnipod_GetStats()->retxCnt);
+	TEST_CHECK_INT(replyLen, 1);
+	TEST_CHECK_INT(reply[0], SUBG_RFSPY_RESPONSE_RX_TIMEOUT);
+	TEST_CHECK_INT(Omnipod_GetStats()->failCnt, 1);
+	TEST_CHECK(elapsedMs >= EXCHANGE_TIMEOUT_MS && elapsedMs < EXCHANGE_TIMEOUT_MS + 500);
+}
+
+int main(void)
+{
+	uint32_t freq = (uint32_t)(((uint64_t)OMNIPOD_FREQ_HZ << 16) / 24000000);
+	uint8_t freqCmd[3][3] = {{SUBG_RFSPY_CMD_UPDATE_REGISTER, 0x09, (uint8_t)(freq >> 16)},
+							 {SUBG_RFSPY_CMD_UPDATE_REGISTER, 0x0A, (uint8_t)(freq >> 8)},
+							 {SUBG_RFSPY_CMD_UPDATE_REGISTER, 0x0B, (uint8_t)freq}};
+	uint8_t i;
+
+	Sim_Reset();
+	TEST_CHECK(radio_backend_rfm69.probe());
+	radio_backend_rfm69.init(on_response);
+	//FREQ2..0 of the CC1110 config, channel 0 on the pod's frequency
+	for(i = 0; i < 3; i++)
+	{
+		run(freqCmd[i], sizeof(freqCmd[i]));
+		TEST_CHECK_INT(reply[0], SUBG_RFSPY_RESPONSE_SUCCESS);
+	}
+
+	test_clean();
+	test_lossy();
+	test_silent();
+
+	return Test_Result("test_pod_exchange");
+}
@@ -0,0 +1,130 @@
+/**
+ *@file test_radio_power.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief radios are configured on first use only and sleep between operations
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include "test_util.h"
+#include "app_subg.h"
+#include "app_time.h"
+#include "sx1231_sim.h"
+#include "hal.h"
+
+#define MINIMED_FREQ_HZ		916500000
+#define OMNIPOD_FREQ_HZ		433910000
+#define EXCHANGE_NUM		10
+//no register traffic at boot, only putting both radios to sleep
+#define INIT_MAX_US			100
+//idle between exchanges: sleep current and the odd standby until the idle timeout
+#define IDLE_MAX_UA			10
+
+//RFM69 supply current per simulator mode (sleep, standby, fs, tx at 13 dBm, rx), datasheet typicals in uA
+static const uint32_t modeUa[SIM_MODE_NUM] = {0, 1250, 9000, 45000, 16000};
+
+/*average current between two stats snapshots*/
+static uint32_t avg_ua(const sSimStats_t *pFrom, const sSimStats_t *pTo)
+{
+	uint64_t charge = 0;
+	uint64_t us = 0;
+	uint8_t i;
+
+	for(i = 0; i < SIM_MODE_NUM; i++)
+	{
+		charge += (uint64_t)modeUa[i] * (pTo->modeUs[i] - pFrom->modeUs[i]);
+		us += pTo->modeUs[i] - pFrom->modeUs[i];
+	}
+	return (us > 0) ? (uint32_t)(charge / us) : 0;
+}
+
+/*the main loop: Subg_Poll between events*/
+static void poll_for(uint32_t ms)
+{
+	uint64_t end = Time_GetUs() + (uint64_t)ms * TIME_US_PER_MS;
+
+	while(Time_GetUs() < end)
+	{
+		Hal_DelayUs(500);
+		Subg_Poll();
+	}
+}
+
+static void test_boot(void)
+{
+	sSubgRadio_t radio;
+	uint64_t start;
+
+	start = Time_GetUs();
+	Subg_Init();
+	printf("Subg_Init %llu us\n", (unsigned long long)(Time_GetUs() - start));
+	TEST_CHECK(Time_GetUs() - start <= INIT_MAX_US);
+
+	Subg_GetRadio(RF69_DEV_FREQ433, &radio);
+	TEST_CHECK_INT(radio.state, SUBG_RADIO_UNCFG);
+	Subg_GetRadio(RF69_DEV_FREQ916N868, &radio);
+	TEST_CHECK_INT(radio.state, SUBG_RADIO_UNCFG);
+}
+
+/*
+a capture on 916 MHz, then pod exchanges on 433 MHz: each radio is configured once,
+the 433 one wakes on its kept config for every exchange, both sleep in between
+*/
+static void test_session(void)
+{
+	uint8_t tx[] = {0xA9, 0x6C, 0x72, 0x8F, 0x49, 0x66};
+	uint8_t rx[128];
+	uint16_t rxLen;
+	sSubgRadio_t radio;
+	sSimStats_t st0[2];
+	sSimStats_t st[2];
+	uint8_t i;
+
+	Subg_SetMode(SUBG_MODE_MINIMED_NAS);
+	Subg_SetFreq(MINIMED_FREQ_HZ);
+	Subg_ListenPkt(rx, sizeof(rx), &rxLen, 20);
+
+	Subg_SetMode(SUBG_MODE_OMNIPOD);
+	Subg_SetFreq(OMNIPOD_FREQ_HZ);
+	for(i = 0; i < EXCHANGE_NUM; i++)
+	{
+		TEST_CHECK_INT(Subg_SendPkt(tx, sizeof(tx), 0, 0, 0), SUBG_TX_OK);
+		Subg_GetPkt(rx, sizeof(rx), &rxLen, 2, 0);
+		poll_for(1000);
+	}
+
+	Subg_GetRadio(RF69_DEV_FREQ433, &radio);
+	printf("433 MHz radio: %u config writes, %u wake-ups\n", radio.cfgCnt, radio.wakeCnt);
+	TEST_CHECK_INT(radio.cfgCnt, 1);
+	TEST_CHECK(radio.wakeCnt >= EXCHANGE_NUM - 1);
+	TEST_CHECK_INT(radio.state, SUBG_RADIO_SLEEP);
+	Subg_GetRadio(RF69_DEV_FREQ916N868, &radio);
+	TEST_CHECK_INT(radio.cfgCnt, 1);
+	TEST_CHECK_INT(radio.state, SUBG_RADIO_SLEEP);
+
+	Sim_GetStats(HAL_RADIO_433, &st0[0]);
+	Sim_GetStats(HAL_RADIO_916, &st0[1]);
+	poll_for(10000);
+	Sim_GetStats(HAL_RADIO_433, &st[0]);
+	Sim_GetStats(HAL_RADIO_916, &st[1]);
+	printf("idle 10 s: 433 MHz %u uA, 916 MHz %u uA average\n", avg_ua(&st0[0], &st[0]), avg_ua(&st0[1], &st[1]));
+	TEST_CHECK(avg_ua(&st0[0], &st[0]) <= IDLE_MAX_UA);
+	TEST_CHECK(avg_ua(&st0[1], &st[1]) <= IDLE_MAX_UA);
+}
+
+int main(void)
+{
+	Sim_Reset();
+
+	test_boot();
+	test_session();
+
+	return Test_Result("test_radio_power");
+}
@@ -0,0 +1,285 @@
+/**
+ *@file test_region_detect.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief MiniMed region detection against a simulated 868MHz pump, the result cached per pump id
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include "test_util.h"
+#include "radio_backend.h"
+#include "subg_rfspy_protocol.h"
+#include "app_minimed.h"
+#include "app_capture.h"
+#include "app_codec.h"
+#include "sx1231_sim.h"
+#include "hal.h"
+
+#define PUMP_RSSI			-60
+#define PUMP_REPLY_US		3000
+#define PUMP_HEAR_HZ		100000			//what the pump's receiver takes in around its carrier
+//a sleeping pump samples the channel now and then, a probe burst of 20 is long enough to be caught
+#define PUMP_WAKE_PKTS		20
+#define MM_HDR_LEN			5
+#define MM_FRAME_NUM		16
+#define MM_FRAME_LEN		64
+//a probe on one band: a 20 packet power-on burst, ~330 ms, and a 150 ms listen
+#define PROBE_MS			500
+#define PROBE_ROUNDS		8
+
+static const uint8_t pumpId[MINIMED_PUMP_ID_LEN] = {0x12, 0x34, 0x56};
+static const uint8_t otherId[MINIMED_PUMP_ID_LEN] = {0x99, 0x99, 0x99};
+
+//the pump
+static uint8_t pumpPage[MINIMED_PAGE_LEN];
+static uint8_t pumpWakePkts = 0;
+static bool pumpAwake = false;
+static uint8_t pumpFrame = 0;
+static uint32_t nasTxCnt = 0;
+
+static sMinimedRegion_t regionTable[MINIMED_REGION_NUM];
+static uint8_t saveCnt = 0;
+
+static uint8_t page[MINIMED_PAGE_LEN];
+static uint16_t pageLen = 0;
+
+static uint8_t reply[16];
+static uint8_t replyLen = 0;
+
+static void pump_send(uint32_t carrierHz, uint8_t type, const uint8_t *pBody, uint8_t bodyLen)
+{
+	uint8_t msg[MM_HDR_LEN + 1 + MM_FRAME_LEN + 1];
+	uint8_t air[128];
+	uint16_t airLen;
+
+	msg[0] = 0xA7;
+	memcpy(msg + 1, pumpId, MINIMED_PUMP_ID_LEN);
+	msg[4] = type;
+	memcpy(msg + MM_HDR_LEN, pBody, bodyLen);
+	msg[MM_HDR_LEN + bodyLen] = Minimed_Crc8(msg, MM_HDR_LEN + bodyLen);
+	airLen = Codec_Encode(CODEC_4B6B, msg, MM_HDR_LEN + bodyLen + 1, air, sizeof(air), true);
+	air[airLen++] = 0x00;
+	Sim_InjectPkt(HAL_RADIO_916, Sim_GetUs() + PUMP_REPLY_US, carrierHz, PUMP_RSSI, air, airLen);
+}
+
+static void pump_frame(uint32_t carrierHz)
+{
+	uint8_t body[1 + MM_FRAME_LEN];
+
+	body[0] = pumpFrame | ((pumpFrame == MM_FRAME_NUM) ? 0x80 : 0x00);
+	memcpy(body + 1, pumpPage + (pumpFrame - 1) * MM_FRAME_LEN, MM_FRAME_LEN);
+	pump_send(carrierHz, 0x80, body, sizeof(body));
+}
+
+/*an 868MHz pump: power-on, read history and frame acks, nothing heard on the 916MHz band*/
+static void pump_tx_hook(uint8_t radio, uint32_t carrierHz, const uint8_t *pData, uint16_t len)
+{
+	static const uint8_t ack[1] = {0x00};
+	uint8_t msg[MM_HDR_LEN + MM_FRAME_LEN + 2];
+	uint16_t msgLen;
+
+	if(radio != HAL_RADIO_916)
+	{
+		return;
+	}
+	if(carrierHz + PUMP_HEAR_HZ < MINIMED_WWL_FREQ_HZ || carrierHz > MINIMED_WWL_FREQ_HZ + PUMP_HEAR_HZ)
+	{
+		nasTxCnt++;
+		return;
+	}
+	msgLen = Codec_Decode(CODEC_4B6B, pData, len, msg, sizeof(msg));
+	if(msgLen < MM_HDR_LEN + 2 || memcmp(msg + 1, pumpId, MINIMED_PUMP_ID_LEN) != 0
+		|| Minimed_Crc8(msg, msgLen - 1) != msg[msgLen - 1])
+	{
+		return;
+	}
+
+	switch(msg[4])
+	{
+		case 0x5D:
+			if(msgLen == MM_HDR_LEN + 2 && !pumpAwake && ++pumpWakePkts < PUMP_WAKE_PKTS)
+			{
+				break;
+			}
+			pumpAwake = true;
+			pump_send(carrierHz, 0x06, ack, sizeof(ack));
+			break;
+		case 0x80:
+			if(msgLen == MM_HDR_LEN + 2)
+			{
+				pump_send(carrierHz, 0x06, ack, sizeof(ack));
+				break;
+			}
+			pumpFrame = 1;
+			pump_frame(carrierHz);
+			break;
+		case 0x06:
+			if(pumpFrame > 0 && pumpFrame < MM_FRAME_NUM)
+			{
+				pumpFrame++;
+				pump_frame(carrierHz);
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+static void pump_sleep(void)
+{
+	pumpAwake = false;
+	pumpWakePkts = 0;
+	pumpFrame = 0;
+}
+
+static void region_save(void)
+{
+	saveCnt++;
+}
+
+/*history page chunks: type, offset(2, LE), total(2, LE), bytes*/
+static eCaptureNotifyResult_t test_notify(const uint8_t *pData, uint16_t len)
+{
+	uint16_t offset = pData[1] | ((uint16_t)pData[2] << 8);
+
+	if(len > 5 && pData[0] == CAPTURE_FRAME_TYPE_HISTORY && offset == pageLen && (size_t)(offset + len - 5) <= sizeof(page))
+	{
+		memcpy(page + offset, pData + 5, len - 5);
+		pageLen += len - 5;
+	}
+	return CAPTURE_NOTIFY_OK;
+}
+
+static void on_response(const uint8_t *data, uint8_t len)
+{
+	memcpy(reply, data, (len < sizeof(reply)) ? len : sizeof(reply));
+	replyLen = len;
+}
+
+static void run(const uint8_t *pCmd, uint8_t len)
+{
+	replyLen = 0;
+	radio_backend_rfm69.run_command(pCmd, len);
+	radio_backend_rfm69.process();
+	radio_backend_rfm69.process();
+}
+
+static uint32_t reply_u32(uint8_t pos)
+{
+	return ((uint32_t)reply[pos] << 24) | ((uint32_t)reply[pos + 1] << 16) | ((uint32_t)reply[pos + 2] << 8) | reply[pos + 3];
+}
+
+static void region_cmd(const uint8_t *pId, uint8_t probe)
+{
+	uint8_t cmd[] = {SUBG_RFSPY_CMD_MINIMED_REGION, pId[0], pId[1], pId[2], probe};
+
+	run(cmd, sizeof(cmd));
+	TEST_CHECK_INT(replyLen, 7);
+	TEST_CHECK_INT(reply[0], SUBG_RFSPY_RESPONSE_SUCCESS);
+}
+
+/*nothing cached: short probes on both bands find the pump on 868MHz, the answer is stored*/
+static void test_detect(void)
+{
+	const sMinimedStats_t *pStats = Minimed_GetStats();
+
+	region_cmd(pumpId, 0);
+	printf("868MHz pump found in %u ms, %u probe bursts\n", pStats->lastProbeMs, pStats->probeCnt);
+	TEST_CHECK_INT(reply[1], MINIMED_OK);
+	TEST_CHECK_INT(reply[2], SUBG_MODE_MINIMED_WWL);
+	TEST_CHECK_INT(reply_u32(3), MINIMED_WWL_FREQ_HZ);
+	//916MHz first, then the pump's band
+	TEST_CHECK_INT(pStats->probeCnt, 2);
+	TEST_CHECK(pStats->lastProbeMs < 2 * PROBE_MS);
+	TEST_CHECK_INT(saveCnt, 1);
+	TEST_CHECK(memcmp(regionTable[0].pumpId, pumpId, MINIMED_PUMP_ID_LEN) == 0);
+	TEST_CHECK_INT(regionTable[0].mode, SUBG_MODE_MINIMED_WWL);
+}
+
+/*asked again: answered from the cache, nothing goes on air and nothing is written*/
+static void test_cached(void)
+{
+	const sMinimedStats_t *pStats = Minimed_GetStats();
+	uint32_t probeCnt = pStats->probeCnt;
+	uint32_t txCnt = nasTxCnt;
+
+	region_cmd(pumpId, 0);
+	TEST_CHECK_INT(reply[1], MINIMED_OK);
+	TEST_CHECK_INT(reply[2], SUBG_MODE_MINIMED_WWL);
+	TEST_CHECK_INT(pStats->probeCnt, probeCnt);
+	TEST_CHECK_INT(nasTxCnt, txCnt);
+	TEST_CHECK_INT(saveCnt, 1);
+}
+
+/*a later session on the app's 916MHz channel goes straight to the pump's band*/
+static void test_history(void)
+{
+	//channel 0, pump id, page 2
+	uint8_t cmd[] = {SUBG_RFSPY_CMD_READ_HISTORY_PAGE, 0x00, pumpId[0], pumpId[1], pumpId[2], 0x02};
+	uint16_t crc;
+	uint16_t i;
+
+	for(i = 0; i < MINIMED_PAGE_LEN - 2; i++)
+	{
+		pumpPage[i] = (uint8_t)(i * 7 + 3);
+	}
+	crc = Minimed_Crc16(pumpPage, MINIMED_PAGE_LEN - 2);
+	pumpPage[MINIMED_PAGE_LEN - 2] = (uint8_t)(crc >> 8);
+	pumpPage[MINIMED_PAGE_LEN - 1] = (uint8_t)crc;
+
+	pump_sleep();
+	Minimed_Sleep();
+	nasTxCnt = 0;
+	pageLen = 0;
+	run(cmd, sizeof(cmd));
+
+	printf("history page in %u ms, %u packets on the 916MHz band\n", Minimed_GetStats()->lastPageMs, nasTxCnt);
+	TEST_CHECK_INT(replyLen, 2);
+	TEST_CHECK_INT(reply[0], SUBG_RFSPY_RESPONSE_SUCCESS);
+	TEST_CHECK_INT(reply[1], MINIMED_OK);
+	TEST_CHECK_INT(Minimed_GetStats()->pageCnt, 1);
+	TEST_CHECK_INT(nasTxCnt, 0);
+	TEST_CHECK_INT(pageLen, MINIMED_PAGE_LEN);
+	TEST_CHECK(memcmp(page, pumpPage, MINIMED_PAGE_LEN) == 0);
+}
+
+/*a pump on neither band: all rounds are used, bounded, and nothing is stored*/
+static void test_unknown(void)
+{
+	const sMinimedStats_t *pStats = Minimed_GetStats();
+	uint32_t probeCnt = pStats->probeCnt;
+
+	region_cmd(otherId, 1);
+	printf("no pump: gave up after %u ms, %u probe bursts\n", pStats->lastProbeMs, pStats->probeCnt - probeCnt);
+	TEST_CHECK_INT(reply[1], MINIMED_NO_RESPONSE);
+	TEST_CHECK_INT(reply[2], SUBG_MODE_NUM);
+	TEST_CHECK_INT(reply_u32(3), 0);
+	TEST_CHECK_INT(pStats->probeCnt - probeCnt, PROBE_ROUNDS * 2);
+	TEST_CHECK(pStats->lastProbeMs < PROBE_ROUNDS * 2 * PROBE_MS);
+	TEST_CHECK_INT(saveCnt, 1);
+	TEST_CHECK_INT(Minimed_GetRegion(otherId), SUBG_MODE_NUM);
+}
+
+int main(void)
+{
+	Sim_Reset();
+	Sim_SetTxHook(pump_tx_hook);
+	Minimed_Init(regionTable, region_save);
+	Capture_Init(test_notify);
+	TEST_CHECK(radio_backend_rfm69.probe());
+	radio_backend_rfm69.init(on_response);
+
+	test_detect();
+	test_cached();
+	test_history();
+	test_unknown();
+
+	return Test_Result("test_region_detect");
+}
@@ -0,0 +1,108 @@
+/**
+ *@file test_retune.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief frequency hop cost, Subg_SetFreq against a hop through the channel table
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include "test_util.h"
+#include "app_subg.h"
+#include "app_time.h"
+#include "rf69.h"
+#include "sx1231_sim.h"
+#include "hal.h"
+
+#define HOP_ROUNDS			10
+
+//a region scan: around 916.5 MHz, two 868 MHz channels, back to the start
+static const uint32_t hopFreqHz[] = {916450000, 916550000, 916650000, 868250000, 868350000, 916500000};
+#define HOP_NUM				(sizeof(hopFreqHz) / sizeof(hopFreqHz[0]))
+
+typedef struct
+{
+	uint64_t sumUs;
+	uint64_t maxUs;
+	uint32_t cnt;
+}sHopTime_t;
+
+static void hop_add(sHopTime_t *pTime, uint64_t us)
+{
+	pTime->sumUs += us;
+	pTime->cnt++;
+	if(us > pTime->maxUs)
+	{
+		pTime->maxUs = us;
+	}
+}
+
+/*
+each hop is timed from the call to the PLL being locked again, in rx like a scan.
+The table has the register values worked out already, a hop skips the conversion.
+The simulator charges spi traffic and PLL lock only, not cpu time: on the host both
+come out the same, the table must never be slower.
+*/
+static void test_hop(void)
+{
+	sHopTime_t byFreq = {0};
+	sHopTime_t byChan = {0};
+	uint64_t start;
+	uint8_t round;
+	uint8_t i;
+
+	Subg_SetMode(SUBG_MODE_MINIMED_NAS);
+	Subg_CfgRf();
+	Subg_SetFreq(hopFreqHz[HOP_NUM - 1]);
+	Rf69_SetMode(RF69_DEV_FREQ916N868, RF69_MODE_RX);
+	Subg_ClrStats();
+
+	for(round = 0; round < HOP_ROUNDS; round++)
+	{
+		for(i = 0; i < HOP_NUM; i++)
+		{
+			start = Time_GetUs();
+			Subg_SetFreq(hopFreqHz[i]);
+			hop_add(&byFreq, Time_GetUs() - start);
+		}
+	}
+
+	TEST_CHECK(Subg_SetChanTable(hopFreqHz, HOP_NUM));
+	for(round = 0; round < HOP_ROUNDS; round++)
+	{
+		for(i = 0; i < HOP_NUM; i++)
+		{
+			start = Time_GetUs();
+			TEST_CHECK(Subg_SetChan(i));
+			hop_add(&byChan, Time_GetUs() - start);
+		}
+	}
+
+	printf("SetFreq: avg %llu us, max %llu us\n", (unsigned long long)(byFreq.sumUs / byFreq.cnt), (unsigned long long)byFreq.maxUs);
+	printf("SetChan: avg %llu us, max %llu us\n", (unsigned long long)(byChan.sumUs / byChan.cnt), (unsigned long long)byChan.maxUs);
+	printf("PLL lock max %u us, %u lock failures\n", Subg_GetStats()[SUBG_MODE_MINIMED_NAS].retuneMaxUs,
+		   Subg_GetStats()[SUBG_MODE_MINIMED_NAS].pllLockFailCnt);
+
+	TEST_CHECK(byChan.sumUs / byChan.cnt <= byFreq.sumUs / byFreq.cnt);
+	TEST_CHECK(byChan.maxUs <= byFreq.maxUs);
+	TEST_CHECK_INT(Subg_GetStats()[SUBG_MODE_MINIMED_NAS].pllLockFailCnt, 0);
+
+	TEST_CHECK(!Subg_SetChan(HOP_NUM));
+	TEST_CHECK(!Subg_SetChanTable(hopFreqHz, SUBG_CHAN_MAX + 1));
+}
+
+int main(void)
+{
+	Sim_Reset();
+	Subg_Init();
+
+	test_hop();
+
+	return Test_Result("test_retune");
+}
@@ -0,0 +1,555 @@
+/**
+ *@file test_rfspy_conformance.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief the RFM69 backend answers subg_rfspy commands byte for byte like the CC1110
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <stdlib.h>
+
+#include "test_util.h"
+#include "radio_backend.h"
+#include "subg_rfspy_protocol.h"
+#include "app_codec.h"
+#include "app_pwr.h"
+#include "app_subg.h"
+#include "app_capture.h"
+#include "app_trace.h"
+#include "trace_replay.h"
+#include "app_time.h"
+#include "sx1231_sim.h"
+#include "hal.h"
+
+#define REPLY_MAX			8
+#define REPLY_LEN			255
+#define MINIMED_FREQ_HZ		916500000
+//timed tx: the OPMODE write lands this close to the deadline, a retune may come before the delay starts
+#define TX_START_ERR_MAX_US	50
+#define TX_RETUNE_MAX_US	1000
+//SoftDevice load for timed tx: a stall of up to CPU_STALL_MAX_US about every CPU_STALL_GAP_US
+#define CPU_STALL_GAP_US	300
+#define CPU_STALL_MAX_US	150
+#define TX_LOADED_NUM		50
+//the start error is read back once the OPMODE write is over: SPI bytes, driver uninit, clock read
+#define TX_START_WRITE_US	12
+
+typedef struct
+{
+	const char *name;
+	uint8_t cmd[16];
+	uint8_t cmdLen;
+	uint8_t reply[16];
+	uint8_t replyLen;		//0 = no answer
+}sExchange_t;
+
+/*
+what a CC1110 running subg_rfspy 2.2 sends back for the same commands, taken from
+its command handlers: the radio is quiet, nothing is received
+*/
+static const sExchange_t cc1110Replies[] =
+{
+	{"get_state", {0x01}, 1, {'O', 'K'}, 2},
+	{"get_version", {0x02}, 1, {'s', 'u', 'b', 'g', '_', 'r', 'f', 's', 'p', 'y', ' ', '2', '.', '2'}, 14},
+	{"read FREQ2", {0x09, 0x09}, 2, {0xdd, 0x26}, 2},
+	{"read FREQ1", {0x09, 0x0a}, 2, {0xdd, 0x30}, 2},
+	{"read unmapped", {0x09, 0x20}, 2, {0x11}, 1},
+	{"read short", {0x09}, 1, {0x11}, 1},
+	{"update FREQ0", {0x06, 0x0b, 0x5b}, 3, {0xdd}, 1},
+	{"read FREQ0", {0x09, 0x0b}, 2, {0xdd, 0x5b}, 2},
+	{"update unmapped", {0x06, 0x21, 0x00}, 3, {0x11}, 1},
+	{"reset radio config", {0x0d}, 1, {0xdd}, 1},
+	{"read FREQ0 default", {0x09, 0x0b}, 2, {0xdd, 0x00}, 2},
+	{"read PA_TABLE1", {0x09, 0x2d}, 2, {0xdd, 0xc0}, 2},
+	{"read PA_TABLE0", {0x09, 0x2e}, 2, {0xdd, 0x00}, 2},
+	{"sw encoding 4b6b", {0x0b, 0x02}, 2, {0xdd}, 1},
+	{"sw encoding bad", {0x0b, 0x07}, 2, {0x11}, 1},
+	{"tx mode registers", {0x0a, 0x01, 0x2d, 0xc0}, 4, {0xdd}, 1},
+	{"mode registers bad", {0x0a, 0x03}, 2, {0x11}, 1},
+	{"mode registers odd", {0x0a, 0x01, 0x2e}, 3, {0x11}, 1},
+	{"preamble", {0x0c, 0x00, 0x18}, 3, {0xdd}, 1},
+	{"led", {0x08, 0x00, 0x01}, 3, {0xdd}, 1},
+	{"get_packet timeout", {0x03, 0x00, 0x00, 0x00, 0x00, 0x32}, 6, {0xaa}, 1},
+	{"get_packet short", {0x03, 0x00}, 2, {0x11}, 1},
+	{"send_packet short", {0x04, 0x00, 0x00}, 3, {0x11}, 1},
+	{"send_and_listen short", {0x05, 0x00, 0x00, 0x00, 0x00, 0x00}, 6, {0x11}, 1},
+	{"unknown", {0x55}, 1, {0x22}, 1},
+	{"reset", {0x07}, 1, {0}, 0},
+	{"read FREQ0 after reset", {0x09, 0x0b}, 2, {0xdd, 0x00}, 2},
+};
+
+//trace chunks as they come in over the capture link
+static uint8_t traceDump[TRACE_BUF_SIZE];
+static uint16_t traceDumpLen = 0;
+static bool traceDumpBad = false;
+
+static uint8_t replies[REPLY_MAX][REPLY_LEN];
+static uint8_t replyLens[REPLY_MAX];
+static uint8_t replyCnt = 0;
+
+//a command that arrives over BLE while the main loop is busy with another one
+static const uint8_t *pLateCmd = NULL;
+static uint8_t lateCmdLen = 0;
+static uint64_t lateCmdUs = 0;
+
+static void on_response(const uint8_t *data, uint8_t len)
+{
+	if(replyCnt < REPLY_MAX)
+	{
+		memcpy(replies[replyCnt], data, len);
+		replyLens[replyCnt] = len;
+	}
+	replyCnt++;
+}
+
+/*time service clock that delivers pLateCmd at lateCmdUs, like the BLE event would*/
+static uint64_t test_clock(void)
+{
+	uint64_t now = Hal_ClockUs();
+	const uint8_t *pCmd = pLateCmd;
+
+	if(pCmd != NULL && now >= lateCmdUs)
+	{
+		pLateCmd = NULL;
+		radio_backend_rfm69.run_command(pCmd, lateCmdLen);
+	}
+	return now;
+}
+
+/*blob frame: type, offset(2, LE), total len(2, LE), bytes*/
+static eCaptureNotifyResult_t test_notify(const uint8_t *pData, uint16_t len)
+{
+	uint16_t offset;
+	uint16_t total;
+
+	if(len <= 5 || pData[0] != CAPTURE_FRAME_TYPE_TRACE)
+	{
+		traceDumpBad = true;
+		return CAPTURE_NOTIFY_OK;
+	}
+	offset = pData[1] | ((uint16_t)pData[2] << 8);
+	total = pData[3] | ((uint16_t)pData[4] << 8);
+	if(offset != traceDumpLen || offset + len - 5 > total || total > sizeof(traceDump))
+	{
+		traceDumpBad = true;
+		return CAPTURE_NOTIFY_OK;
+	}
+	memcpy(traceDump + offset, pData + 5, len - 5);
+	traceDumpLen += len - 5;
+	return CAPTURE_NOTIFY_OK;
+}
+
+static void run(const uint8_t *pCmd, uint8_t len)
+{
+	replyCnt = 0;
+	radio_backend_rfm69.run_command(pCmd, len);
+	radio_backend_rfm69.process();
+}
+
+static bool reply_is(uint8_t idx, const uint8_t *pExpect, uint8_t len)
+{
+	return idx < replyCnt && replyLens[idx] == len && memcmp(replies[idx], pExpect, len) == 0;
+}
+
+static void test_transcript(void)
+{
+	uint8_t i;
+	const sExchange_t *pEx;
+
+	for(i = 0; i < sizeof(cc1110Replies) / sizeof(cc1110Replies[0]); i++)
+	{
+		pEx = &cc1110Replies[i];
+		run(pEx->cmd, pEx->cmdLen);
+		if(pEx->replyLen == 0 ? (replyCnt != 0) : !(replyCnt == 1 && reply_is(0, pEx->reply, pEx->replyLen)))
+		{
+			printf("%s: %u replies, first %u bytes %02x\n", pEx->name, replyCnt, replyLens[0], replies[0][0]);
+			testFailCnt++;
+		}
+	}
+}
+
+/*success, CC1110 rssi ((dBm + 73) * 2), packet counter, decoded payload*/
+static void test_get_packet(void)
+{
+	static const uint8_t pumpPkt[] = {0xA7, 0x12, 0x34, 0x56, 0x8D, 0x01, 0x02};
+	static const uint8_t encoding[] = {SUBG_RFSPY_CMD_SET_SW_ENCODING, CODEC_4B6B};
+	static const uint8_t getPacket[] = {SUBG_RFSPY_CMD_GET_PACKET, 0x00, 0x00, 0x00, 0x00, 0xc8};
+	uint8_t air[32];
+	uint16_t airLen;
+
+	run(encoding, sizeof(encoding));
+	airLen = Codec_Encode(CODEC_4B6B, pumpPkt, sizeof(pumpPkt), air, sizeof(air), true);
+	air[airLen++] = 0x00;
+
+	Sim_InjectPkt(HAL_RADIO_916, Sim_GetUs() + 20000, MINIMED_FREQ_HZ, -70, air, airLen);
+	run(getPacket, sizeof(getPacket));
+	TEST_CHECK_INT(replyCnt, 1);
+	TEST_CHECK_INT(replyLens[0], 3 + sizeof(pumpPkt));
+	TEST_CHECK_INT(replies[0][0], SUBG_RFSPY_RESPONSE_SUCCESS);
+	TEST_CHECK_INT(replies[0][1], 6);
+	TEST_CHECK_INT(replies[0][2], 0);
+	TEST_CHECK(memcmp(replies[0] + 3, pumpPkt, sizeof(pumpPkt)) == 0);
+
+	Sim_InjectPkt(HAL_RADIO_916, Sim_GetUs() + 20000, MINIMED_FREQ_HZ, -90, air, airLen);
+	run(getPacket, sizeof(getPacket));
+	TEST_CHECK_INT(replies[0][1], (uint8_t)-34);
+	TEST_CHECK_INT(replies[0][2], 1);
+}
+
+/*the packet goes out 4b6b coded with the 0x00 trailer, the answer is a bare success*/
+static void test_send_packet(void)
+{
+	static const uint8_t sendPacket[] = {SUBG_RFSPY_CMD_SEND_PACKET, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xA7, 0x12, 0x34};
+	uint8_t air[SIM_TX_LOG_SIZE];
+	uint8_t expect[8];
+	uint8_t longPacket[7 + 170];
+	uint16_t len;
+
+	run(sendPacket, sizeof(sendPacket));
+	TEST_CHECK(replyCnt == 1 && reply_is(0, (const uint8_t *)"\xdd", 1));
+
+	len = Codec_Encode(CODEC_4B6B, sendPacket + 7, 3, expect, sizeof(expect), true);
+	expect[len++] = 0x00;
+	TEST_CHECK_INT(Sim_GetTxLog(HAL_RADIO_916, air, sizeof(air)), len);
+	TEST_CHECK(memcmp(air, expect, len) == 0);
+
+	//170 bytes code to 255, one more than a MiniMed frame holds next to its trailer
+	memset(longPacket, 0xA7, sizeof(longPacket));
+	memcpy(longPacket, sendPacket, 7);
+	run(longPacket, 7 + 170);
+	TEST_CHECK(replyCnt == 1 && reply_is(0, (const uint8_t *)"\x11", 1));
+	run(longPacket, 7 + 169);
+	TEST_CHECK(replyCnt == 1 && reply_is(0, (const uint8_t *)"\xdd", 1));
+}
+
+/*
+send_and_listen feeds the TX power control: a run of strong replies takes a step down,
+silence goes back up, the PA table rewritten before each packet does not restart it
+*/
+static void test_power_feedback(void)
+{
+	static const uint8_t reply[] = {0xA7, 0x12, 0x34, 0x56, 0x06, 0x00};
+	//channel 0, no repeat, listen 100 ms, no retry, 4b6b 0xA7
+	static const uint8_t sendAndListen[] = {SUBG_RFSPY_CMD_SEND_AND_LISTEN, 0x00, 0x00, 0x00, 0x00, 0x00,
+											0x00, 0x00, 0x00, 0x64, 0x00, 0x00, 0x00, 0xA7};
+	uint8_t air[16];
+	uint16_t airLen;
+	const sPwrState_t *pState = Pwr_GetState(RF69_DEV_FREQ916N868);
+	uint32_t stepDownCnt;
+	uint32_t stepUpCnt;
+	int8_t dbm;
+	uint8_t i;
+
+	airLen = Codec_Encode(CODEC_4B6B, reply, sizeof(reply), air, sizeof(air), true);
+	air[airLen++] = 0x00;
+
+	run(sendAndListen, sizeof(sendAndListen));
+	stepDownCnt = pState->stepDownCnt;
+	stepUpCnt = pState->stepUpCnt;
+	dbm = pState->dbm;
+
+	for(i = 0; i < 8; i++)
+	{
+		Sim_InjectPkt(HAL_RADIO_916, Sim_GetUs() + 30000, MINIMED_FREQ_HZ, -55, air, airLen);
+		run(sendAndListen, sizeof(sendAndListen));
+		TEST_CHECK(replyCnt == 1 && replies[0][0] == SUBG_RFSPY_RESPONSE_SUCCESS);
+	}
+	TEST_CHECK_INT(pState->stepDownCnt, stepDownCnt + 1);
+	TEST_CHECK_INT(pState->dbm, dbm - 1);
+
+	run(sendAndListen, sizeof(sendAndListen));
+	TEST_CHECK(replyCnt == 1 && reply_is(0, (const uint8_t *)"\xaa", 1));
+	TEST_CHECK_INT(pState->stepUpCnt, stepUpCnt + 1);
+	TEST_CHECK_INT(pState->dbm, dbm);
+}
+
+/*
+a timed packet starts delay_us after the command ran, what the answer tells of the
+start error is where the simulated transmitter switched on. A delay already over
+still sends, flagged too late.
+*/
+static void test_send_packet_at(void)
+{
+	static const uint8_t sendAt[] = {SUBG_RFSPY_CMD_SEND_PACKET_AT, 0x00, 0x00, 0x00, 0x4e, 0x20, 0x00, 0x00, 0xA7, 0x12, 0x34};
+	static const uint8_t sendNow[] = {SUBG_RFSPY_CMD_SEND_PACKET_AT, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xA7, 0x12, 0x34};
+	static const uint8_t sendShort[] = {SUBG_RFSPY_CMD_SEND_PACKET_AT, 0x00, 0x00, 0x00};
+	uint64_t cmdUs;
+	int32_t startErrUs;
+	sSimStats_t st;
+	uint32_t txPktCnt;
+
+	run(sendShort, sizeof(sendShort));
+	TEST_CHECK(reply_is(0, (const uint8_t *)"\x11", 1));
+
+	cmdUs = Sim_GetUs();
+	run(sendAt, sizeof(sendAt));
+	TEST_CHECK(replyCnt == 1 && replyLens[0] == 5 && replies[0][0] == SUBG_RFSPY_RESPONSE_SUCCESS);
+	startErrUs = (int32_t)(((uint32_t)replies[0][1] << 24) | ((uint32_t)replies[0][2] << 16) | ((uint32_t)replies[0][3] << 8) | replies[0][4]);
+	Sim_GetStats(HAL_RADIO_916, &st);
+	printf("timed tx: start error %d us, on air %llu us after the command\n", startErrUs, (unsigned long long)(st.txStartUs - cmdUs));
+	TEST_CHECK(abs(startErrUs) <= TX_START_ERR_MAX_US);
+	//the delay counts from when the command ran, the retune before it is not included
+	TEST_CHECK(st.txStartUs + TX_START_ERR_MAX_US >= cmdUs + 20000);
+	TEST_CHECK(st.txStartUs <= cmdUs + 20000 + TX_RETUNE_MAX_US + TX_START_ERR_MAX_US);
+	//the us clock was on for the wait only
+	TEST_CHECK(!Time_IsFine());
+	txPktCnt = st.txPktCnt;
+
+	run(sendNow, sizeof(sendNow));
+	TEST_CHECK(reply_is(0, (const uint8_t *)"\xdd\x7f\xff\xff\xff", 5));
+	Sim_GetStats(HAL_RADIO_916, &st);
+	TEST_CHECK_INT(st.txPktCnt, txPktCnt + 1);
+}
+
+/*
+the cpu taken away at random like the SoftDevice does: a start can be late then,
+but the error reported is the one the radio saw, and never off by more than a stall
+*/
+static void test_send_packet_at_loaded(void)
+{
+	uint8_t pkt[] = {0xA7, 0x12, 0x34, 0x56, 0x8D, 0x01, 0x02};
+	uint64_t deadline;
+	int32_t simErrUs;
+	int32_t errMaxUs = INT32_MIN;
+	int32_t diffMaxUs = 0;
+	sSimStats_t st;
+	uint8_t i;
+
+	Sim_SetCpuStall(CPU_STALL_GAP_US, CPU_STALL_MAX_US);
+	for(i = 0; i < TX_LOADED_NUM; i++)
+	{
+		deadline = Time_GetUs() + 5000 + i * 37;
+		Subg_SendPktAt(pkt, sizeof(pkt), deadline, 0);
+		TEST_CHECK_INT(Subg_GetTxStatus(), SUBG_TX_OK);
+		Sim_GetStats(HAL_RADIO_916, &st);
+		simErrUs = (int32_t)((int64_t)st.txStartUs - (int64_t)deadline);
+		TEST_CHECK(Subg_GetTxStartErr() >= simErrUs && Subg_GetTxStartErr() <= simErrUs + TX_START_WRITE_US);
+		TEST_CHECK(abs(simErrUs) <= TX_START_ERR_MAX_US + CPU_STALL_MAX_US);
+		if(simErrUs > errMaxUs)
+		{
+			errMaxUs = simErrUs;
+		}
+		if(Subg_GetTxStartErr() - simErrUs > diffMaxUs)
+		{
+			diffMaxUs = Subg_GetTxStartErr() - simErrUs;
+		}
+	}
+	Sim_SetCpuStall(0, 0);
+
+	printf("timed tx under load: %u stalls, worst start error %d us, reported at most %d us over\n",
+		   Sim_GetCpuStallCnt(), errMaxUs, diffMaxUs);
+	TEST_CHECK(Sim_GetCpuStallCnt() > TX_LOADED_NUM);
+}
+
+/*
+with a channel table loaded the channel byte picks its frequency, across bands too,
+unloaded it goes by the CC1110 channel spacing again
+*/
+static void test_chan_table(void)
+{
+	static const uint8_t pumpPkt[] = {0xA7, 0x12, 0x34, 0x56, 0x8D, 0x01, 0x02};
+	static const uint8_t table[] = {SUBG_RFSPY_CMD_SET_CHAN_TABLE, 3,
+		0x36, 0x9F, 0xEA, 0xD0,			//916450000
+		0x36, 0xA1, 0x71, 0x70,			//916550000
+		0x33, 0xC1, 0x34, 0xE0};		//868300000
+	static const uint8_t tableShort[] = {SUBG_RFSPY_CMD_SET_CHAN_TABLE, 3, 0x36, 0x9F, 0xEA, 0xD0};
+	static const uint8_t tableOff[] = {SUBG_RFSPY_CMD_SET_CHAN_TABLE, 0};
+	static const uint8_t encoding[] = {SUBG_RFSPY_CMD_SET_SW_ENCODING, CODEC_4B6B};
+	uint8_t getPacket[] = {SUBG_RFSPY_CMD_GET_PACKET, 0x00, 0x00, 0x00, 0x00, 0xc8};
+	uint8_t air[32];
+	uint16_t airLen;
+
+	run(tableShort, sizeof(tableShort));
+	TEST_CHECK(reply_is(0, (const uint8_t *)"\x11", 1));
+	run(encoding, sizeof(encoding));
+	run(table, sizeof(table));
+	TEST_CHECK(reply_is(0, (const uint8_t *)"\xdd", 1));
+
+	airLen = Codec_Encode(CODEC_4B6B, pumpPkt, sizeof(pumpPkt), air, sizeof(air), true);
+	air[airLen++] = 0x00;
+
+	getPacket[1] = 1;
+	Sim_InjectPkt(HAL_RADIO_916, Sim_GetUs() + 20000, 916550000, -70, air, airLen);
+	run(getPacket, sizeof(getPacket));
+	TEST_CHECK(replyCnt == 1 && replies[0][0] == SUBG_RFSPY_RESPONSE_SUCCESS);
+
+	getPacket[1] = 2;
+	Sim_InjectPkt(HAL_RADIO_916, Sim_GetUs() + 20000, 868300000, -70, air, airLen);
+	run(getPacket, sizeof(getPacket));
+	TEST_CHECK(replyCnt == 1 && replies[0][0] == SUBG_RFSPY_RESPONSE_SUCCESS);
+	TEST_CHECK_INT(Subg_GetMode(), SUBG_MODE_MINIMED_WWL);
+
+	//unloaded, channel 2 is 2 CC1110 channel spacings above 916.5MHz, not 868.3MHz
+	run(tableOff, sizeof(tableOff));
+	Sim_InjectPkt(HAL_RADIO_916, Sim_GetUs() + 20000, 868300000, -70, air, airLen);
+	run(getPacket, sizeof(getPacket));
+	TEST_CHECK(reply_is(0, (const uint8_t *)"\xaa", 1));
+	TEST_CHECK_INT(Subg_GetMode(), SUBG_MODE_MINIMED_NAS);
+}
+
+/*
+a packet received while the trace records comes out of the dump, and the dump
+replayed into the simulator is received again the same
+*/
+static void test_trace(void)
+{
+	static const uint8_t pumpPkt[] = {0xA7, 0x12, 0x34, 0x56, 0x8D, 0x01, 0x02};
+	static const uint8_t encoding[] = {SUBG_RFSPY_CMD_SET_SW_ENCODING, CODEC_4B6B};
+	static const uint8_t getPacket[] = {SUBG_RFSPY_CMD_GET_PACKET, 0x00, 0x00, 0x00, 0x00, 0xc8};
+	static const uint8_t traceStart[] = {SUBG_RFSPY_CMD_TRACE, 0x01};
+	static const uint8_t traceDumpCmd[] = {SUBG_RFSPY_CMD_TRACE, 0x02};
+	static const uint8_t traceBad[] = {SUBG_RFSPY_CMD_TRACE, 0x03};
+	uint8_t air[32];
+	uint16_t airLen;
+	uint16_t len;
+	sReplay_t replay;
+	uint8_t radio = 0xFF;
+
+	run(traceBad, sizeof(traceBad));
+	TEST_CHECK(reply_is(0, (const uint8_t *)"\x11", 1));
+
+	run(encoding, sizeof(encoding));
+	run(traceStart, sizeof(traceStart));
+	TEST_CHECK(replyCnt == 1 && replyLens[0] == 8 && replies[0][0] == SUBG_RFSPY_RESPONSE_SUCCESS);
+	TEST_CHECK_INT(replies[0][1], 1);
+	TEST_CHECK(Trace_IsRecording());
+
+	airLen = Codec_Encode(CODEC_4B6B, pumpPkt, sizeof(pumpPkt), air, sizeof(air), true);
+	air[airLen++] = 0x00;
+	Sim_InjectPkt(HAL_RADIO_916, Sim_GetUs() + 20000, MINIMED_FREQ_HZ, -70, air, airLen);
+	run(getPacket, sizeof(getPacket));
+	TEST_CHECK_INT(replies[0][0], SUBG_RFSPY_RESPONSE_SUCCESS);
+
+	//the answer carries what is dumped, the chunks follow it
+	traceDumpLen = 0;
+	traceDumpBad = false;
+	run(traceDumpCmd, sizeof(traceDumpCmd));
+	TEST_CHECK(replyCnt == 1 && replyLens[0] == 8 && replies[0][0] == SUBG_RFSPY_RESPONSE_SUCCESS);
+	TEST_CHECK_INT(replies[0][1], 0);
+	len = ((uint16_t)replies[0][2] << 8) | replies[0][3];
+	TEST_CHECK(len > TRACE_HDR_LEN + airLen);
+	TEST_CHECK(!Capture_IsDumping());
+	TEST_CHECK(!traceDumpBad);
+	TEST_CHECK_INT(traceDumpLen, len);
+	TEST_CHECK_INT(traceDump[0], TRACE_MAGIC);
+
+	TEST_CHECK(Replay_Init(&replay, traceDump, traceDumpLen, 433910000, MINIMED_FREQ_HZ));
+	TEST_CHECK(Replay_Next(&replay, &radio) > 0);
+	TEST_CHECK_INT(radio, HAL_RADIO_916);
+	run(getPacket, sizeof(getPacket));
+	TEST_CHECK(replyCnt == 1 && replyLens[0] == 3 + sizeof(pumpPkt));
+	TEST_CHECK(memcmp(replies[0] + 3, pumpPkt, sizeof(pumpPkt)) == 0);
+}
+
+/*
+a command arriving while another one runs: the running one answers interrupted, a
+pending one it replaces as well, then the new one runs
+*/
+static void test_interrupt(void)
+{
+	static const uint8_t getPacket[] = {SUBG_RFSPY_CMD_GET_PACKET, 0x00, 0x00, 0x00, 0x03, 0xe8};
+	static const uint8_t getState[] = {SUBG_RFSPY_CMD_GET_STATE};
+	static const uint8_t getVersion[] = {SUBG_RFSPY_CMD_GET_VERSION};
+	uint64_t start;
+
+	Time_SetClock(test_clock);
+	pLateCmd = getState;
+	lateCmdLen = sizeof(getState);
+	lateCmdUs = Sim_GetUs() + 100000;
+	start = Sim_GetUs();
+
+	run(getPacket, sizeof(getPacket));
+	TEST_CHECK(reply_is(0, (const uint8_t *)"\xbb", 1));
+	TEST_CHECK(Sim_GetUs() - start < 150000);
+	radio_backend_rfm69.process();
+	TEST_CHECK(reply_is(1, (const uint8_t *)SUBG_RFSPY_STATE_OK, 2));
+	TEST_CHECK_INT(replyCnt, 2);
+	Time_SetClock(NULL);
+
+	//two commands before the main loop got to the first one
+	replyCnt = 0;
+	radio_backend_rfm69.run_command(getVersion, sizeof(getVersion));
+	radio_backend_rfm69.run_command(getState, sizeof(getState));
+	radio_backend_rfm69.process();
+	TEST_CHECK_INT(replyCnt, 2);
+	TEST_CHECK(reply_is(0, (const uint8_t *)"\xbb", 1));
+	TEST_CHECK(reply_is(1, (const uint8_t *)SUBG_RFSPY_STATE_OK, 2));
+}
+
+/*
+a regular command arriving during a history download waits for it, a send to the
+pump (an urgent suspend) cuts it short and goes out right away
+*/
+static void test_preempt_history(void)
+{
+	static const uint8_t history[] = {SUBG_RFSPY_CMD_READ_HISTORY_PAGE, 0x00, 0x12, 0x34, 0x56, 0x00};
+	static const uint8_t getState[] = {SUBG_RFSPY_CMD_GET_STATE};
+	static const uint8_t suspend[] = {SUBG_RFSPY_CMD_SEND_PACKET, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xA7, 0x12, 0x34};
+	uint64_t start;
+	uint64_t fullUs;
+	sSimStats_t st;
+	uint32_t txPktCnt;
+
+	Time_SetClock(test_clock);
+	pLateCmd = getState;
+	lateCmdLen = sizeof(getState);
+	lateCmdUs = Sim_GetUs() + 200000;
+	start = Sim_GetUs();
+
+	//no pump around: the download runs to its end and times out, the state request after it
+	run(history, sizeof(history));
+	fullUs = Sim_GetUs() - start;
+	TEST_CHECK(pLateCmd == NULL);
+	TEST_CHECK_INT(replyCnt, 1);
+	TEST_CHECK(reply_is(0, (const uint8_t *)"\xaa", 1));
+	radio_backend_rfm69.process();
+	TEST_CHECK_INT(replyCnt, 2);
+	TEST_CHECK(reply_is(1, (const uint8_t *)SUBG_RFSPY_STATE_OK, 2));
+
+	pLateCmd = suspend;
+	lateCmdLen = sizeof(suspend);
+	lateCmdUs = Sim_GetUs() + 200000;
+	start = Sim_GetUs();
+
+	run(history, sizeof(history));
+	printf("history download %llu us on its own, %llu us until a send preempted it\n", (unsigned long long)fullUs,
+		   (unsigned long long)(Sim_GetUs() - start));
+	TEST_CHECK(reply_is(0, (const uint8_t *)"\xbb", 1));
+	TEST_CHECK(Sim_GetUs() - start < 300000);
+	Sim_GetStats(HAL_RADIO_916, &st);
+	txPktCnt = st.txPktCnt;
+	radio_backend_rfm69.process();
+	TEST_CHECK_INT(replyCnt, 2);
+	TEST_CHECK(reply_is(1, (const uint8_t *)"\xdd", 1));
+	Sim_GetStats(HAL_RADIO_916, &st);
+	TEST_CHECK_INT(st.txPktCnt, txPktCnt + 1);
+	Time_SetClock(NULL);
+}
+
+int main(void)
+{
+	Sim_Reset();
+	TEST_CHECK(radio_backend_rfm69.probe());
+	radio_backend_rfm69.init(on_response);
+	Capture_Init(test_notify);
+
+	test_transcript();
+	test_get_packet();
+	test_send_packet();
+	test_power_feedback();
+	test_trace();
+	test_send_packet_at();
+	test_send_packet_at_loaded();
+	test_chan_table();
+	test_preempt_history();
+	test_interrupt();
+
+	return Test_Result("test_rfspy_conformance");
+}
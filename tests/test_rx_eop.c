@@ -0,0 +1,103 @@
+/**
+ *@file test_rx_eop.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief MiniMed packets without their 0x00 terminator end early, on the line code or the RSSI drop
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include "test_util.h"
+#include "app_subg.h"
+#include "app_codec.h"
+#include "sx1231_sim.h"
+#include "hal.h"
+
+#define MINIMED_FREQ_HZ		916500000
+//a byte is 500 us at 16 kbps: the end is seen within two of them, not at the rx timeout
+#define EOP_LATENCY_MAX_US	1000
+
+static const uint8_t pumpPkt[] = {0xA7, 0x12, 0x34, 0x56, 0x8D, 0x01, 0x02, 0x03, 0x04};
+
+static uint16_t pkt_encode(uint8_t *pAir, uint16_t size)
+{
+	return Codec_Encode(CODEC_4B6B, pumpPkt, sizeof(pumpPkt), pAir, size, true);
+}
+
+static void check_early(const char *name, uint16_t airLen, uint32_t rxEopCnt)
+{
+	uint8_t rx[SUBG_RX_MAX_LEN];
+	uint16_t rxLen = 0;
+
+	TEST_CHECK_INT(Subg_GetPkt(rx, sizeof(rx), &rxLen, 200, 0), SUBG_RX_OK);
+	printf("%s: %u bytes, eop latency %u us\n", name, rxLen, Subg_GetEopLatency());
+	TEST_CHECK_INT(rxLen, airLen);
+	TEST_CHECK_INT(Subg_GetRssi(), -60);
+	TEST_CHECK(Subg_GetEopLatency() <= EOP_LATENCY_MAX_US);
+	TEST_CHECK_INT(Subg_GetStats()[SUBG_MODE_MINIMED_NAS].rxEopCnt, rxEopCnt);
+}
+
+/*bytes that break the 4b6b code follow the packet: the first one ends it*/
+static void test_code_break(void)
+{
+	uint8_t air[32];
+	uint16_t airLen = pkt_encode(air, sizeof(air));
+
+	air[airLen] = 0xFF;
+	air[airLen + 1] = 0xFF;
+	Sim_InjectPkt(HAL_RADIO_916, Sim_GetUs() + 5000, MINIMED_FREQ_HZ, -60, air, airLen + 2);
+	check_early("code break", airLen, Subg_GetStats()[SUBG_MODE_MINIMED_NAS].rxEopCnt + 1);
+}
+
+/*nothing after the packet: the carrier is gone, the RSSI drop ends it*/
+static void test_rssi_drop(void)
+{
+	uint8_t air[32];
+	uint16_t airLen = pkt_encode(air, sizeof(air));
+	sSimStats_t st;
+
+	Sim_InjectPkt(HAL_RADIO_916, Sim_GetUs() + 5000, MINIMED_FREQ_HZ, -60, air, airLen);
+	check_early("rssi drop", airLen, Subg_GetStats()[SUBG_MODE_MINIMED_NAS].rxEopCnt + 1);
+	Sim_GetStats(HAL_RADIO_916, &st);
+	printf("rssi drop: off air -> returned %llu us\n", (unsigned long long)(Sim_GetUs() - st.rxEndUs));
+	TEST_CHECK(Sim_GetUs() - st.rxEndUs <= EOP_LATENCY_MAX_US);
+}
+
+/*a sync on noise is dropped on its first bytes, the packet behind it is still heard*/
+static void test_noise_sync(void)
+{
+	static const uint8_t noise[] = {0xFF, 0xFF, 0xFF, 0xFF};
+	uint8_t air[32];
+	uint8_t rx[SUBG_RX_MAX_LEN];
+	uint16_t airLen = pkt_encode(air, sizeof(air));
+	uint16_t rxLen = 0;
+	uint32_t noiseCnt = Subg_GetStats()[SUBG_MODE_MINIMED_NAS].rxNoiseCnt;
+
+	air[airLen] = 0x00;
+	Sim_InjectPkt(HAL_RADIO_916, Sim_GetUs() + 5000, MINIMED_FREQ_HZ, -60, noise, sizeof(noise));
+	Sim_InjectPkt(HAL_RADIO_916, Sim_GetUs() + 15000, MINIMED_FREQ_HZ, -60, air, airLen + 1);
+	TEST_CHECK_INT(Subg_GetPkt(rx, sizeof(rx), &rxLen, 200, 0), SUBG_RX_OK);
+	TEST_CHECK_INT(rxLen, airLen);
+	TEST_CHECK(memcmp(rx, air, airLen) == 0);
+	TEST_CHECK_INT(Subg_GetStats()[SUBG_MODE_MINIMED_NAS].rxNoiseCnt, noiseCnt + 1);
+}
+
+int main(void)
+{
+	Sim_Reset();
+	Subg_Init();
+	Subg_SetMode(SUBG_MODE_MINIMED_NAS);
+	Subg_SetFreq(MINIMED_FREQ_HZ);
+
+	test_code_break();
+	test_rssi_drop();
+	test_noise_sync();
+
+	return Test_Result("test_rx_eop");
+}
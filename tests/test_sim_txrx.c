@@ -0,0 +1,250 @@
+/**
+ *@file test_sim_txrx.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief MiniMed and Omnipod packets through app_subg, rf69 and the SX1231 simulator
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include "test_util.h"
+#include "app_subg.h"
+#include "app_codec.h"
+#include "sx1231_sim.h"
+#include "hal.h"
+
+#define MINIMED_FREQ_HZ		916500000
+#define OMNIPOD_FREQ_HZ		433910000
+#define AIRTIME_PKT_NUM		20
+#define SIM_TX_MODE			3			//sSimStats_t.modeUs: sleep, standby, fs, tx, rx
+
+static const uint8_t pumpPkt[] = {0xA7, 0x12, 0x34, 0x56, 0x8D, 0x01, 0x02};
+
+/*what went on air comes back in through the receiver, 3 kHz off*/
+static void test_minimed(void)
+{
+	uint8_t enc[32];
+	uint8_t air[SIM_TX_LOG_SIZE];
+	uint8_t rx[SUBG_RX_MAX_LEN];
+	uint16_t encLen;
+	uint16_t airLen;
+	uint16_t rxLen = 0;
+	sSimStats_t st;
+
+	encLen = Codec_Encode(CODEC_4B6B, pumpPkt, sizeof(pumpPkt), enc, sizeof(enc), true);
+
+	Subg_SetMode(SUBG_MODE_MINIMED_NAS);
+	Subg_SetFreq(MINIMED_FREQ_HZ);
+	TEST_CHECK_INT(Subg_SendPkt(enc, encLen, 0, 0, 0), SUBG_TX_OK);
+
+	//the 4b6b frame and the 0x00 terminator the tx path appends
+	airLen = Sim_GetTxLog(HAL_RADIO_916, air, sizeof(air));
+	TEST_CHECK_INT(airLen, encLen + 1);
+	TEST_CHECK(memcmp(air, enc, encLen) == 0);
+	TEST_CHECK_INT(air[encLen], 0x00);
+	Sim_GetStats(HAL_RADIO_916, &st);
+	TEST_CHECK_INT(st.txPktCnt, 1);
+	TEST_CHECK_INT(st.txGapCnt, 0);
+
+	Sim_InjectPkt(HAL_RADIO_916, Sim_GetUs() + 5000, MINIMED_FREQ_HZ + 3000, -70, air, airLen);
+	TEST_CHECK_INT(Subg_GetPkt(rx, sizeof(rx), &rxLen, 100, 0), SUBG_RX_OK);
+	TEST_CHECK_INT(rxLen, encLen);
+	TEST_CHECK(memcmp(rx, enc, encLen) == 0);
+	TEST_CHECK_INT(Subg_GetRssi(), -70);
+
+	//nothing on air: timeout, and a packet on another channel is not heard
+	rxLen = 0;
+	TEST_CHECK_INT(Subg_GetPkt(rx, sizeof(rx), &rxLen, 20, 0), SUBG_RX_TIMEOUT);
+	Sim_InjectPkt(HAL_RADIO_916, Sim_GetUs() + 5000, MINIMED_FREQ_HZ + 500000, -70, air, airLen);
+	TEST_CHECK_INT(Subg_GetPkt(rx, sizeof(rx), &rxLen, 50, 0), SUBG_RX_TIMEOUT);
+	Sim_GetStats(HAL_RADIO_916, &st);
+	TEST_CHECK_INT(st.rxPktCnt, 1);
+	TEST_CHECK_INT(st.rxMissCnt, 1);
+}
+
+/*the pod frame goes out behind the 0x66/0x65 preamble and the a5 5a sync*/
+static void test_omnipod(void)
+{
+	uint8_t enc[32];
+	uint8_t air[SIM_TX_LOG_SIZE];
+	uint8_t rx[SUBG_RX_MAX_LEN];
+	uint16_t encLen;
+	uint16_t airLen;
+	uint16_t rxLen = 0;
+	uint16_t i;
+
+	encLen = Codec_Encode(CODEC_MANCHESTER, pumpPkt, sizeof(pumpPkt), enc, sizeof(enc), false);
+
+	Subg_SetMode(SUBG_MODE_OMNIPOD);
+	Subg_SetFreq(OMNIPOD_FREQ_HZ);
+	TEST_CHECK_INT(Subg_SendPkt(enc, encLen, 0, 0, 0), SUBG_TX_OK);
+
+	airLen = Sim_GetTxLog(HAL_RADIO_433, air, sizeof(air));
+	for(i = 0; i + 1 < airLen && !(air[i] == 0xA5 && air[i + 1] == 0x5A); i++)
+	{
+		TEST_CHECK(air[i] == 0x66 || air[i] == 0x65);
+	}
+	TEST_CHECK(i + 2 + encLen < airLen);
+	TEST_CHECK(memcmp(air + i + 2, enc, encLen) == 0);
+	TEST_CHECK_INT(air[i + 2 + encLen], 0xFF);
+
+	Sim_InjectPkt(HAL_RADIO_433, Sim_GetUs() + 5000, OMNIPOD_FREQ_HZ - 2000, -85, enc, encLen);
+	TEST_CHECK_INT(Subg_GetPkt(rx, sizeof(rx), &rxLen, 100, 0), SUBG_RX_OK);
+	TEST_CHECK_INT(rxLen, encLen);
+	TEST_CHECK(memcmp(rx, enc, encLen) == 0);
+	TEST_CHECK_INT(Subg_GetRssi(), -85);
+}
+
+/*the longest packet of each mode goes out whole, one byte more is refused without going on air*/
+static void test_tx_len(void)
+{
+	uint8_t pkt[SUBG_TX_MAX_LEN + 1];
+	uint8_t air[SIM_TX_LOG_SIZE];
+	uint16_t airLen;
+	uint16_t i;
+	sSimStats_t st;
+	sSimStats_t st2;
+
+	for(i = 0; i < sizeof(pkt); i++)
+	{
+		pkt[i] = (i & 1) ? 0x69 : 0x96;
+	}
+
+	Subg_SetMode(SUBG_MODE_OMNIPOD);
+	TEST_CHECK_INT(Subg_SendPkt(pkt, SUBG_TX_MAX_LEN, 0, 0, 0), SUBG_TX_OK);
+	airLen = Sim_GetTxLog(HAL_RADIO_433, air, sizeof(air));
+	for(i = 0; i + 1 < airLen && !(air[i] == 0xA5 && air[i + 1] == 0x5A); i++)
+	{
+	}
+	TEST_CHECK(i + 2 + SUBG_TX_MAX_LEN < airLen);
+	TEST_CHECK(memcmp(air + i + 2, pkt, SUBG_TX_MAX_LEN) == 0);
+	TEST_CHECK_INT(air[i + 2 + SUBG_TX_MAX_LEN], 0xFF);
+
+	Sim_GetStats(HAL_RADIO_433, &st);
+	TEST_CHECK_INT(Subg_SendPkt(pkt, SUBG_TX_MAX_LEN + 1, 0, 0, 0), SUBG_TX_LEN_ERROR);
+	TEST_CHECK_INT(Subg_GetTxStatus(), SUBG_TX_LEN_ERROR);
+	Sim_GetStats(HAL_RADIO_433, &st2);
+	TEST_CHECK_INT(st2.txByteCnt, st.txByteCnt);
+
+	//fixed length mode, the payload length register takes the packet and its trailer
+	Subg_SetMode(SUBG_MODE_MINIMED_NAS);
+	TEST_CHECK_INT(Subg_SendPkt(pkt, SUBG_TX_MAX_LEN - 1, 0, 0, 0), SUBG_TX_OK);
+	TEST_CHECK_INT(Sim_GetTxLog(HAL_RADIO_916, air, sizeof(air)), SUBG_TX_MAX_LEN);
+	TEST_CHECK(memcmp(air, pkt, SUBG_TX_MAX_LEN - 1) == 0);
+	Sim_GetStats(HAL_RADIO_916, &st);
+	TEST_CHECK_INT(Subg_SendPkt(pkt, SUBG_TX_MAX_LEN, 0, 0, 0), SUBG_TX_LEN_ERROR);
+	Sim_GetStats(HAL_RADIO_916, &st2);
+	TEST_CHECK_INT(st2.txByteCnt, st.txByteCnt);
+}
+
+/*
+a packet starting near the end of the window: Subg_GetPkt keeps to its deadline,
+Subg_ListenPkt reads it to its end
+*/
+static void test_rx_deadline(void)
+{
+	uint8_t pkt[64];
+	uint8_t air[100];
+	uint8_t rx[SUBG_RX_MAX_LEN];
+	uint16_t airLen;
+	uint16_t rxLen = 0;
+	uint16_t i;
+	uint64_t start;
+	uint64_t elapsed;
+
+	for(i = 0; i < sizeof(pkt); i++)
+	{
+		pkt[i] = (uint8_t)(i * 5);
+	}
+	airLen = Codec_Encode(CODEC_4B6B, pkt, sizeof(pkt), air, sizeof(air), true);
+	air[airLen++] = 0x00;
+	Subg_SetMode(SUBG_MODE_MINIMED_NAS);
+	Subg_SetFreq(MINIMED_FREQ_HZ);
+
+	start = Sim_GetUs();
+	Sim_InjectPkt(HAL_RADIO_916, start + 10000, MINIMED_FREQ_HZ, -70, air, airLen);
+	TEST_CHECK_INT(Subg_GetPkt(rx, sizeof(rx), &rxLen, 20, 0), SUBG_RX_TIMEOUT);
+	elapsed = Sim_GetUs() - start;
+	TEST_CHECK(elapsed >= 20000 && elapsed < 22000);
+	Sim_AdvanceUs(200000);
+
+	start = Sim_GetUs();
+	Sim_InjectPkt(HAL_RADIO_916, start + 10000, MINIMED_FREQ_HZ, -70, air, airLen);
+	TEST_CHECK_INT(Subg_ListenPkt(rx, sizeof(rx), &rxLen, 20), SUBG_RX_OK);
+	Subg_Stop();
+	TEST_CHECK_INT(rxLen, airLen - 1);
+	TEST_CHECK(memcmp(rx, air, airLen - 1) == 0);
+	printf("%u byte packet 10 ms into a 20 ms window: get %llu us, listen %llu us\n", airLen, (unsigned long long)elapsed,
+		   (unsigned long long)(Sim_GetUs() - start));
+}
+
+/*
+short packets, a few ms each: the airtime stats add up to the time in TX and on air,
+the parts under a ms are not lost per packet
+*/
+static void test_airtime(void)
+{
+	uint8_t enc[32];
+	uint8_t air[32];
+	uint8_t rx[SUBG_RX_MAX_LEN];
+	uint16_t encLen;
+	uint16_t airLen;
+	uint16_t rxLen = 0;
+	uint64_t txUs;
+	uint64_t rxUs = 0;
+	uint64_t start;
+	sSimStats_t st0;
+	sSimStats_t st1;
+	uint8_t i;
+
+	encLen = Codec_Encode(CODEC_4B6B, pumpPkt, sizeof(pumpPkt), enc, sizeof(enc), true);
+	memcpy(air, enc, encLen);
+	air[encLen] = 0x00;
+	airLen = encLen + 1;
+	Subg_SetMode(SUBG_MODE_MINIMED_NAS);
+	Subg_SetFreq(MINIMED_FREQ_HZ);
+	Subg_ClrStats();
+
+	Sim_GetStats(HAL_RADIO_916, &st0);
+	for(i = 0; i < AIRTIME_PKT_NUM; i++)
+	{
+		TEST_CHECK_INT(Subg_SendPkt(enc, encLen, 0, 0, 0), SUBG_TX_OK);
+	}
+	Sim_GetStats(HAL_RADIO_916, &st1);
+	txUs = st1.modeUs[SIM_TX_MODE] - st0.modeUs[SIM_TX_MODE];
+
+	for(i = 0; i < AIRTIME_PKT_NUM; i++)
+	{
+		start = Sim_GetUs() + 5000;
+		Sim_InjectPkt(HAL_RADIO_916, start, MINIMED_FREQ_HZ, -70, air, airLen);
+		TEST_CHECK_INT(Subg_GetPkt(rx, sizeof(rx), &rxLen, 100, 0), SUBG_RX_OK);
+		Sim_GetStats(HAL_RADIO_916, &st1);
+		rxUs += st1.rxEndUs - start;
+	}
+
+	printf("%u packets: tx %u ms (%llu us in TX), rx %u ms (%llu us on air)\n", AIRTIME_PKT_NUM,
+		   Subg_GetStats()[SUBG_MODE_MINIMED_NAS].txAirtimeMs, (unsigned long long)txUs,
+		   Subg_GetStats()[SUBG_MODE_MINIMED_NAS].rxAirtimeMs, (unsigned long long)rxUs);
+	TEST_CHECK(Subg_GetStats()[SUBG_MODE_MINIMED_NAS].txAirtimeMs >= txUs / 1000);
+	TEST_CHECK(Subg_GetStats()[SUBG_MODE_MINIMED_NAS].rxAirtimeMs + AIRTIME_PKT_NUM / 2 >= rxUs / 1000);
+}
+
+int main(void)
+{
+	Sim_Reset();
+	Subg_Init();
+
+	test_minimed();
+	test_omnipod();
+	test_tx_len();
+	test_rx_deadline();
+	test_airtime();
+
+	return Test_Result("test_sim_txrx");
+}
@@ -0,0 +1,144 @@
+/**
+ *@file test_sync_filter.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief sync word filter on the paired remote: other remotes rejected by the radio, kept frames as sent
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include "test_util.h"
+#include "app_subg.h"
+#include "app_codec.h"
+#include "sx1231_sim.h"
+#include "hal.h"
+
+#define MINIMED_FREQ_HZ		916500000
+#define PKT_RSSI			-70
+#define PKT_NUM				4
+
+//two pumps in range, the one paired with and a neighbour's
+static const uint8_t pairedPkt[] = {0xA7, 0x12, 0x34, 0x56, 0x8D, 0x01, 0x02};
+static const uint8_t otherPkt[] = {0xA7, 0x65, 0x43, 0x21, 0x8D, 0x01, 0x02};
+
+//the config record in RAM and what was last written to flash
+static sSubgSyncFilter_t cfgFilters[SUBG_MODE_NUM];
+static sSubgSyncFilter_t flashFilters[SUBG_MODE_NUM];
+static uint8_t saveCnt = 0;
+
+static uint8_t pairedAir[32];
+static uint16_t pairedAirLen;
+static uint8_t otherAir[32];
+static uint16_t otherAirLen;
+
+static void cfg_save(void)
+{
+	memcpy(flashFilters, cfgFilters, sizeof(flashFilters));
+	saveCnt++;
+}
+
+static uint16_t air_encode(const uint8_t *pPkt, uint16_t len, uint8_t *pAir, uint16_t size)
+{
+	uint16_t airLen;
+
+	airLen = Codec_Encode(CODEC_4B6B, pPkt, len, pAir, size, true);
+	pAir[airLen++] = 0x00;
+	return airLen;
+}
+
+/*one packet on air 5 ms from now, what the receiver makes of it*/
+static eSubgRxStatus_t rx_one(const uint8_t *pAir, uint16_t airLen, uint8_t *pRx, uint16_t *pRxLen)
+{
+	*pRxLen = 0;
+	Sim_InjectPkt(HAL_RADIO_916, Sim_GetUs() + 5000, MINIMED_FREQ_HZ, PKT_RSSI, pAir, airLen);
+	return Subg_GetPkt(pRx, SUBG_RX_MAX_LEN, pRxLen, 50, 0);
+}
+
+/*
+the filter set on the paired pump: the radio drops the neighbour's packets at the
+sync word, the paired one's frame comes out exactly as without a filter
+*/
+static void check_filtered(const char *pName, const uint8_t *pPlain, uint16_t plainLen)
+{
+	uint8_t rx[SUBG_RX_MAX_LEN];
+	uint16_t rxLen;
+	sSimStats_t st0;
+	sSimStats_t st1;
+	uint8_t i;
+
+	printf("%s\n", pName);
+	Sim_GetStats(HAL_RADIO_916, &st0);
+	for(i = 0; i < PKT_NUM; i++)
+	{
+		TEST_CHECK_INT(rx_one(otherAir, otherAirLen, rx, &rxLen), SUBG_RX_TIMEOUT);
+		TEST_CHECK_INT(rx_one(pairedAir, pairedAirLen, rx, &rxLen), SUBG_RX_OK);
+		TEST_CHECK_INT(rxLen, plainLen);
+		TEST_CHECK(memcmp(rx, pPlain, plainLen) == 0);
+	}
+	Sim_GetStats(HAL_RADIO_916, &st1);
+	TEST_CHECK_INT(st1.rxFilterCnt - st0.rxFilterCnt, PKT_NUM);
+	TEST_CHECK_INT(st1.rxPktCnt - st0.rxPktCnt, PKT_NUM);
+}
+
+static void test_sync_filter(void)
+{
+	static const uint8_t hdr[] = {0xA7, 0x12, 0x34, 0x56};
+	uint8_t plain[SUBG_RX_MAX_LEN];
+	uint16_t plainLen;
+	uint8_t rx[SUBG_RX_MAX_LEN];
+	uint16_t rxLen;
+	sSubgSyncFilter_t filter;
+	sSimStats_t st;
+
+	pairedAirLen = air_encode(pairedPkt, sizeof(pairedPkt), pairedAir, sizeof(pairedAir));
+	otherAirLen = air_encode(otherPkt, sizeof(otherPkt), otherAir, sizeof(otherAir));
+	Subg_SetMode(SUBG_MODE_MINIMED_NAS);
+	Subg_SetFreq(MINIMED_FREQ_HZ);
+
+	//no filter: both pumps are heard
+	TEST_CHECK_INT(rx_one(pairedAir, pairedAirLen, plain, &plainLen), SUBG_RX_OK);
+	TEST_CHECK_INT(plainLen, pairedAirLen - 1);
+	TEST_CHECK_INT(rx_one(otherAir, otherAirLen, rx, &rxLen), SUBG_RX_OK);
+	Sim_GetStats(HAL_RADIO_916, &st);
+	TEST_CHECK_INT(st.rxFilterCnt, 0);
+
+	TEST_CHECK(Subg_SetSyncFilterHdr(SUBG_MODE_MINIMED_NAS, hdr, sizeof(hdr)));
+	TEST_CHECK_INT(saveCnt, 1);
+	Subg_GetSyncFilter(SUBG_MODE_MINIMED_NAS, &filter);
+	TEST_CHECK(filter.len > 0);
+	TEST_CHECK(memcmp(filter.bytes, pairedAir, filter.len) == 0);
+	check_filtered("filter set", plain, plainLen);
+
+	//a reboot: the config record comes back from flash
+	memset(cfgFilters, 0, sizeof(cfgFilters));
+	memcpy(cfgFilters, flashFilters, sizeof(cfgFilters));
+	Subg_SyncFilterInit(cfgFilters, cfg_save);
+	Subg_GetSyncFilter(SUBG_MODE_MINIMED_NAS, &filter);
+	TEST_CHECK(filter.len > 0 && memcmp(filter.bytes, pairedAir, filter.len) == 0);
+	check_filtered("filter loaded", plain, plainLen);
+
+	//off again: the neighbour is heard
+	TEST_CHECK(Subg_SetSyncFilter(SUBG_MODE_MINIMED_NAS, hdr, 0));
+	TEST_CHECK_INT(saveCnt, 2);
+	TEST_CHECK_INT(flashFilters[SUBG_MODE_MINIMED_NAS].len, 0);
+	TEST_CHECK_INT(rx_one(otherAir, otherAirLen, rx, &rxLen), SUBG_RX_OK);
+	TEST_CHECK_INT(rxLen, otherAirLen - 1);
+	TEST_CHECK(memcmp(rx, otherAir, rxLen) == 0);
+}
+
+int main(void)
+{
+	Sim_Reset();
+	Subg_Init();
+	Subg_SyncFilterInit(cfgFilters, cfg_save);
+
+	test_sync_filter();
+
+	return Test_Result("test_sync_filter");
+}
@@ -0,0 +1,183 @@
+/**
+ *@file test_temp_comp.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief crystal drift over temperature learned from good packets, kept apart from the remote's own offset
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <stdlib.h>
+#include "test_util.h"
+#include "app_subg.h"
+#include "app_afc.h"
+#include "app_tcomp.h"
+#include "sx1231_sim.h"
+#include "hal.h"
+
+#define OMNIPOD_FREQ_HZ		433910000
+#define POD_ADDRESS			0x1F0E89F0
+#define POD_OFFSET_HZ		3000			//the pod's own crystal, the same at every temperature
+#define POD_RSSI			-70
+#define PKT_LEN				40
+#define PKT_NUM				12				//packets heard per temperature
+#define TEMP_PERIOD_US		61000000		//the die temperature is read once a minute
+#define REF_TEMP_C			25
+#define OFFSET_TOL_HZ		100
+#define CORR_TOL_HZ			300
+
+static sAfcEntry_t afcTable[AFC_REMOTE_NUM];
+static sTcompCurve_t curves[TCOMP_DEV_NUM];
+static uint8_t saveCnt = 0;
+//the AFC's error bound at the reference, it jumps past 1 kHz when drift leaks into the remote's offset
+static uint16_t afcErrRef = 0;
+
+static void config_save(void)
+{
+	saveCnt++;
+}
+
+/*the RFM69's crystal: a parabola around 25 degC, in ppb*/
+static int32_t drift_ppb(int8_t tempC)
+{
+	int32_t dt = tempC - REF_TEMP_C;
+
+	return -35 * dt * dt + 200 * dt;
+}
+
+static int32_t drift_hz(int8_t tempC)
+{
+	return (int32_t)((int64_t)drift_ppb(tempC) * (OMNIPOD_FREQ_HZ / 1000) / 1000000);
+}
+
+/*a minute at tempC, then the pod's packets, the first read of the temperature comes with the first one*/
+static uint8_t visit(int8_t tempC, uint8_t pktNum)
+{
+	uint8_t pkt[PKT_LEN];
+	uint8_t rx[SUBG_RX_MAX_LEN];
+	uint16_t rxLen;
+	uint8_t okCnt = 0;
+	uint8_t i;
+
+	for(i = 0; i < PKT_LEN; i++)
+	{
+		pkt[i] = 0x55 ^ i;
+	}
+	Sim_SetTemp(HAL_RADIO_433, tempC, drift_ppb(tempC));
+	Sim_AdvanceUs(TEMP_PERIOD_US);
+
+	for(i = 0; i < pktNum; i++)
+	{
+		Sim_InjectPkt(HAL_RADIO_433, Sim_GetUs() + 3000, OMNIPOD_FREQ_HZ + POD_OFFSET_HZ, POD_RSSI, pkt, PKT_LEN);
+		rxLen = 0;
+		if(Subg_GetPkt(rx, sizeof(rx), &rxLen, 50, 0) == SUBG_RX_OK)
+		{
+			okCnt++;
+		}
+	}
+	return okCnt;
+}
+
+/*every packet heard, the pod's offset stays put and the correction cancels the drift*/
+static void check_visit(int8_t tempC, uint8_t okCnt)
+{
+	int32_t corrHz = Tcomp_GetCorrHz(RF69_DEV_FREQ433, OMNIPOD_FREQ_HZ);
+
+	printf("%3d degC, drift %6d Hz: %2u/%u packets, pod offset %d Hz, error bound %u Hz, correction %d Hz\n",
+		   tempC, drift_hz(tempC), okCnt, PKT_NUM, Afc_GetOffset(), Afc_GetErrBound(), corrHz);
+	TEST_CHECK_INT(okCnt, PKT_NUM);
+	TEST_CHECK(abs(Afc_GetOffset() - POD_OFFSET_HZ) <= OFFSET_TOL_HZ);
+	TEST_CHECK(afcErrRef == 0 || Afc_GetErrBound() <= afcErrRef);
+	TEST_CHECK(abs(corrHz + drift_hz(tempC)) <= CORR_TOL_HZ);
+	TEST_CHECK(!Subg_NeedRescan());
+}
+
+/*the first temperature is the reference, the pod's offset is learned there*/
+static void test_reference(void)
+{
+	uint8_t okCnt = visit(REF_TEMP_C, PKT_NUM);
+	const sTcompCurve_t *pCurve = Tcomp_GetCurve(RF69_DEV_FREQ433);
+
+	check_visit(REF_TEMP_C, okCnt);
+	afcErrRef = Afc_GetErrBound();
+	TEST_CHECK_INT(pCurve->refBin, (REF_TEMP_C - TCOMP_TEMP_MIN_C) / TCOMP_BIN_C + 1);
+	TEST_CHECK_INT(Tcomp_GetCorrHz(RF69_DEV_FREQ433, OMNIPOD_FREQ_HZ), 0);
+}
+
+/*warm and back: what the AFC measures off the reference goes into the curve, not the pod's entry*/
+static void test_learn(void)
+{
+	const sTcompCurve_t *pCurve = Tcomp_GetCurve(RF69_DEV_FREQ433);
+	uint8_t bin = (55 - TCOMP_TEMP_MIN_C) / TCOMP_BIN_C;
+
+	check_visit(55, visit(55, PKT_NUM));
+	TEST_CHECK(pCurve->bin[bin].sampleCnt > 0);
+	TEST_CHECK(abs(pCurve->bin[bin].corrPpb + drift_ppb(55)) <= CORR_TOL_HZ * 1000 / (OMNIPOD_FREQ_HZ / 1000000));
+
+	check_visit(40, visit(40, PKT_NUM));
+	check_visit(REF_TEMP_C, visit(REF_TEMP_C, PKT_NUM));
+}
+
+/*back at a learned temperature, the correction is in place before the first packet*/
+static void test_recall(void)
+{
+	uint8_t okCnt = visit(55, 1);
+
+	TEST_CHECK_INT(okCnt, 1);
+	TEST_CHECK(abs(Tcomp_GetCorrHz(RF69_DEV_FREQ433, OMNIPOD_FREQ_HZ) + drift_hz(55)) <= CORR_TOL_HZ);
+	TEST_CHECK(Afc_GetErrBound() <= afcErrRef);
+}
+
+/*far from anything learned the model is a guess: a rescan is asked for*/
+static void test_uncertain(void)
+{
+	uint8_t rx[SUBG_RX_MAX_LEN];
+	uint16_t rxLen = 0;
+
+	//nothing on air, the wait only reads the temperature
+	Sim_SetTemp(HAL_RADIO_433, -15, drift_ppb(-15));
+	Sim_AdvanceUs(TEMP_PERIOD_US);
+	TEST_CHECK_INT(Subg_GetPkt(rx, sizeof(rx), &rxLen, 5, 0), SUBG_RX_TIMEOUT);
+
+	printf("-15 degC, nothing learned below 25 degC: uncertain %d\n", Tcomp_IsUncertain(RF69_DEV_FREQ433));
+	TEST_CHECK_INT(Tcomp_GetTemp(RF69_DEV_FREQ433), -15);
+	TEST_CHECK(Tcomp_IsUncertain(RF69_DEV_FREQ433));
+	TEST_CHECK(Subg_NeedRescan());
+}
+
+/*the curve is a few bytes per bin, written when a bin moved, not with every packet*/
+static void test_store(void)
+{
+	printf("curve %u bytes, %u saves\n", (unsigned)sizeof(sTcompCurve_t), saveCnt);
+	TEST_CHECK_INT(sizeof(sTcompCurve_t), 4 + TCOMP_BIN_NUM * sizeof(sTcompBin_t));
+	TEST_CHECK_INT(sizeof(sTcompBin_t), 4);
+	TEST_CHECK(saveCnt > 0 && saveCnt <= 6);
+}
+
+int main(void)
+{
+	sSubgLenPolicy_t policy = {SUBG_LEN_FIXED, PKT_LEN, 0, 0};
+
+	Sim_Reset();
+	Subg_Init();
+	Afc_Init(afcTable, config_save);
+	Tcomp_Init(curves, config_save);
+	Subg_SetMode(SUBG_MODE_OMNIPOD);
+	Subg_SetLenPolicy(SUBG_MODE_OMNIPOD, &policy);
+	Subg_SetFreq(OMNIPOD_FREQ_HZ);
+	Subg_SetRemoteId(POD_ADDRESS);
+
+	test_reference();
+	test_learn();
+	test_recall();
+	test_uncertain();
+	test_store();
+
+	return Test_Result("test_temp_comp");
+}
@@ -0,0 +1,181 @@
+/**
+ *@file test_time_wrap.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief deadlines, elapsed time and the radio timing on an injected clock, across the 32-bit wraps
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include "test_util.h"
+#include "app_subg.h"
+#include "app_time.h"
+#include "sx1231_sim.h"
+#include "hal.h"
+
+#define MINIMED_FREQ_HZ		916500000
+#define OMNIPOD_FREQ_HZ		433910000
+//32-bit us differences (Time_ElapsedUs) and Time_GetMs wrap here; 2^32 ms is a multiple of 2^32 us
+#define US_WRAP				(1ULL << 32)
+#define MS_WRAP_US			((1ULL << 32) * TIME_US_PER_MS)
+//spi traffic around a wait, the simulator charges each clock read and register access
+#define SLACK_US			2000
+
+static uint64_t fakeUs = 0;
+static uint64_t clockOffsetUs = 0;
+
+static uint64_t fake_clock(void)
+{
+	return fakeUs;
+}
+
+//the simulator's time moved to just before a wrap, the radio code sees only this clock
+static uint64_t offset_clock(void)
+{
+	return Hal_ClockUs() + clockOffsetUs;
+}
+
+static void clock_before(uint64_t wrapUs, uint32_t beforeUs)
+{
+	clockOffsetUs = wrapUs - beforeUs - Sim_GetUs();
+	Time_SetClock(offset_clock);
+}
+
+/*deadlines and elapsed time on a clock that only moves when told to*/
+static void test_helpers(void)
+{
+	uint64_t deadline;
+	uint64_t since;
+
+	Time_SetClock(fake_clock);
+
+	fakeUs = 1000;
+	deadline = Time_DeadlineUs(500);
+	fakeUs = 1499;
+	TEST_CHECK(!Time_IsExpired(deadline));
+	fakeUs = 1500;
+	TEST_CHECK(Time_IsExpired(deadline));
+
+	//a deadline across the 32-bit counter wrap
+	fakeUs = US_WRAP - 300;
+	deadline = Time_DeadlineMs(2);
+	since = fakeUs;
+	fakeUs = US_WRAP + 1699;
+	TEST_CHECK(!Time_IsExpired(deadline));
+	TEST_CHECK_INT(Time_ElapsedUs(since), 1999);
+	fakeUs = US_WRAP + 1700;
+	TEST_CHECK(Time_IsExpired(deadline));
+
+	//elapsed saturates after ~71 minutes, a timestamp from the future is 0
+	fakeUs = US_WRAP * 3 + 5;
+	TEST_CHECK_INT(Time_ElapsedUs(US_WRAP + 4), UINT32_MAX);
+	TEST_CHECK_INT(Time_ElapsedUs(US_WRAP * 2 + 7), UINT32_MAX - 1);
+	TEST_CHECK_INT(Time_ElapsedUs(fakeUs + 1), 0);
+
+	//milliseconds are 32 bits: a difference across their wrap is still right
+	fakeUs = MS_WRAP_US - 3000;
+	since = Time_GetMs();
+	fakeUs = MS_WRAP_US + 4000;
+	TEST_CHECK_INT(Time_GetMs(), 4);
+	TEST_CHECK_INT(Time_GetMs() - (uint32_t)since, 7);
+}
+
+/*an rx window that opens before both wraps and times out after them*/
+static void test_rx_timeout(void)
+{
+	uint8_t rx[SUBG_RX_MAX_LEN];
+	uint16_t rxLen = 0;
+	uint64_t start;
+	uint64_t elapsed;
+
+	clock_before(MS_WRAP_US, 50000);
+	Subg_SetMode(SUBG_MODE_MINIMED_NAS);
+	Subg_SetFreq(MINIMED_FREQ_HZ);
+
+	start = Sim_GetUs();
+	TEST_CHECK_INT(Subg_GetPkt(rx, sizeof(rx), &rxLen, 100, 0), SUBG_RX_TIMEOUT);
+	elapsed = Sim_GetUs() - start;
+	printf("100 ms rx window across the wrap: %llu us\n", (unsigned long long)elapsed);
+	TEST_CHECK(elapsed >= 100000 && elapsed < 100000 + SLACK_US);
+	TEST_CHECK(Time_GetMs() < 1000);
+}
+
+/*repeats keep their interval across the wrap*/
+static void test_repeat(void)
+{
+	uint8_t pkt[20];
+	sSimStats_t st;
+	uint32_t txCnt;
+	uint64_t start;
+	uint64_t elapsed;
+	uint64_t airUs;
+
+	memset(pkt, 0xA5, sizeof(pkt));
+	Subg_SetMode(SUBG_MODE_MINIMED_NAS);
+
+	//one packet alone gives its time on air
+	start = Sim_GetUs();
+	TEST_CHECK_INT(Subg_SendPkt(pkt, sizeof(pkt), 0, 0, 0), SUBG_TX_OK);
+	airUs = Sim_GetUs() - start;
+
+	Sim_GetStats(HAL_RADIO_916, &st);
+	txCnt = st.txPktCnt;
+	clock_before(MS_WRAP_US, 400000);
+	start = Sim_GetUs();
+	TEST_CHECK_INT(Subg_SendPkt(pkt, sizeof(pkt), 3, 300, 0), SUBG_TX_OK);
+	elapsed = Sim_GetUs() - start;
+	Sim_GetStats(HAL_RADIO_916, &st);
+
+	printf("4 packets 300 ms apart across the wrap: %llu us, %llu us on air each\n", (unsigned long long)elapsed,
+		   (unsigned long long)airUs);
+	TEST_CHECK_INT(st.txPktCnt, txCnt + 4);
+	TEST_CHECK(elapsed >= 3 * 300000 && elapsed < 3 * 300000 + 4 * airUs + SLACK_US);
+}
+
+/*
+a 2 s preamble extension across the wrap: the old 8-bit tick counter cut it short
+after 255 ticks
+*/
+static void test_preamble_ext(void)
+{
+	uint8_t pkt[20];
+	uint64_t start;
+	uint64_t elapsed;
+	uint64_t airUs;
+
+	memset(pkt, 0x69, sizeof(pkt));
+	Subg_SetMode(SUBG_MODE_OMNIPOD);
+	Subg_SetFreq(OMNIPOD_FREQ_HZ);
+
+	start = Sim_GetUs();
+	TEST_CHECK_INT(Subg_SendPkt(pkt, sizeof(pkt), 0, 0, 0), SUBG_TX_OK);
+	airUs = Sim_GetUs() - start;
+
+	clock_before(MS_WRAP_US, 1000000);
+	start = Sim_GetUs();
+	TEST_CHECK_INT(Subg_SendPkt(pkt, sizeof(pkt), 0, 0, 2000), SUBG_TX_OK);
+	elapsed = Sim_GetUs() - start;
+	printf("2000 ms preamble extension across the wrap: %llu us, %llu us for the packet\n",
+		   (unsigned long long)elapsed, (unsigned long long)airUs);
+	TEST_CHECK(elapsed >= 2000000 && elapsed < 2000000 + airUs + SLACK_US);
+}
+
+int main(void)
+{
+	Sim_Reset();
+	Subg_Init();
+
+	test_helpers();
+	test_rx_timeout();
+	test_repeat();
+	test_preamble_ext();
+
+	Time_SetClock(NULL);
+	return Test_Result("test_time_wrap");
+}
@@ -0,0 +1,134 @@
+/**
+ *@file test_tx_fifo.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief tx fifo underrun and stall recovery on the SX1231 simulator
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include "test_util.h"
+#include "app_subg.h"
+#include "app_time.h"
+#include "sx1231_sim.h"
+#include "hal.h"
+
+#define MINIMED_FREQ_HZ		916500000
+#define TX_ATTEMPTS			3			//first try and TX_RETRY_MAX restarts
+#define LONG_PKT_LEN		200			//~100 ms on air at 16 kbps, three fifos worth
+
+//the cpu is held off (BLE, flash) for holdUs, holdAtUs after the last arm
+static uint64_t holdAtUs = 0;
+static uint32_t holdUs = 0;
+static uint8_t holdCnt = 0;
+
+static uint64_t test_clock(void)
+{
+	if(holdCnt > 0 && Sim_GetUs() >= holdAtUs)
+	{
+		holdCnt--;
+		Sim_AdvanceUs(holdUs);
+		holdAtUs = Sim_GetUs() + 20000;
+	}
+	return Hal_ClockUs();
+}
+
+static void hold_arm(uint8_t cnt, uint32_t us)
+{
+	holdCnt = cnt;
+	holdUs = us;
+	holdAtUs = Sim_GetUs() + 20000;
+}
+
+static void fill(uint8_t *pPkt, uint16_t len)
+{
+	uint16_t i;
+
+	for(i = 0; i < len; i++)
+	{
+		pPkt[i] = (uint8_t)(0x30 + i);
+	}
+}
+
+/*held off once past what the fifo lasts: the broken frame is restarted and goes out whole*/
+static void test_underrun_recovered(void)
+{
+	uint8_t pkt[LONG_PKT_LEN];
+	uint8_t air[SIM_TX_LOG_SIZE];
+	sSimStats_t st;
+
+	fill(pkt, sizeof(pkt));
+	Subg_ClrStats();
+	hold_arm(1, 60000);
+
+	TEST_CHECK_INT(Subg_SendPkt(pkt, sizeof(pkt), 0, 0, 0), SUBG_TX_OK);
+	TEST_CHECK_INT(Subg_GetStats()[SUBG_MODE_MINIMED_NAS].fifoUnderrunCnt, 1);
+	TEST_CHECK_INT(Subg_GetStats()[SUBG_MODE_MINIMED_NAS].txFifoTimeoutCnt, 0);
+
+	Sim_GetStats(HAL_RADIO_916, &st);
+	TEST_CHECK_INT(Sim_GetTxLog(HAL_RADIO_916, air, sizeof(air)), sizeof(pkt) + 1);
+	TEST_CHECK(memcmp(air, pkt, sizeof(pkt)) == 0);
+}
+
+/*held off on every attempt: underrun once the restarts are used up*/
+static void test_underrun_exhausted(void)
+{
+	uint8_t pkt[LONG_PKT_LEN];
+
+	fill(pkt, sizeof(pkt));
+	Subg_ClrStats();
+	hold_arm(TX_ATTEMPTS, 60000);
+
+	TEST_CHECK_INT(Subg_SendPkt(pkt, sizeof(pkt), 0, 0, 0), SUBG_TX_UNDERRUN);
+	TEST_CHECK_INT(Subg_GetTxStatus(), SUBG_TX_UNDERRUN);
+	TEST_CHECK_INT(Subg_GetStats()[SUBG_MODE_MINIMED_NAS].fifoUnderrunCnt, TX_ATTEMPTS);
+	hold_arm(0, 0);
+}
+
+/*
+the transmitter never drains the fifo: a packet that fits it times out in the wait for
+the fifo to empty, a longer one in the wait for room. Each attempt is bounded.
+*/
+static void test_stall(uint16_t len, uint32_t attemptMaxUs)
+{
+	uint8_t pkt[LONG_PKT_LEN];
+	uint64_t start;
+	uint64_t elapsed;
+
+	fill(pkt, sizeof(pkt));
+	Subg_ClrStats();
+	Sim_SetTxStall(HAL_RADIO_916, true);
+
+	start = Sim_GetUs();
+	TEST_CHECK_INT(Subg_SendPkt(pkt, len, 0, 0, 0), SUBG_TX_FIFO_TIMEOUT);
+	elapsed = Sim_GetUs() - start;
+	printf("stall, %u byte packet: gave up after %llu us\n", len, (unsigned long long)elapsed);
+	TEST_CHECK_INT(Subg_GetStats()[SUBG_MODE_MINIMED_NAS].txFifoTimeoutCnt, TX_ATTEMPTS);
+	TEST_CHECK(elapsed < (uint64_t)TX_ATTEMPTS * attemptMaxUs);
+
+	//the radio is usable again once it drains
+	Sim_SetTxStall(HAL_RADIO_916, false);
+	TEST_CHECK_INT(Subg_SendPkt(pkt, len, 0, 0, 0), SUBG_TX_OK);
+}
+
+int main(void)
+{
+	Sim_Reset();
+	Subg_Init();
+	Time_SetClock(test_clock);
+	Subg_SetMode(SUBG_MODE_MINIMED_NAS);
+	Subg_SetFreq(MINIMED_FREQ_HZ);
+
+	test_underrun_recovered();
+	test_underrun_exhausted();
+	test_stall(10, 160000);
+	test_stall(LONG_PKT_LEN, 110000);
+
+	return Test_Result("test_tx_fifo");
+}
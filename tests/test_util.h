@@ -0,0 +1,52 @@
+/**
+ *@file test_util.h
+ *@author Ribin Huang (you@domain.com)
+ *@brief checks for the host tests
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __TEST_UTIL_H__
+#define __TEST_UTIL_H__
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+//one test program per file, a failed check is reported and the program goes on
+static int testFailCnt = 0;
+
+#define TEST_CHECK(cond)	do \
+	{ \
+		if(!(cond)) \
+		{ \
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			testFailCnt++; \
+		} \
+	}while(0)
+
+#define TEST_CHECK_INT(val, expect)	do \
+	{ \
+		long long v_ = (long long)(val); \
+		long long e_ = (long long)(expect); \
+		if(v_ != e_) \
+		{ \
+			printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #val, v_, e_); \
+			testFailCnt++; \
+		} \
+	}while(0)
+
+static inline int Test_Result(const char *name)
+{
+	printf("%s: %s\n", name, (testFailCnt == 0) ? "pass" : "FAIL");
+	return (testFailCnt == 0) ? 0 : 1;
+}
+
+#endif
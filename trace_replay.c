@@ -0,0 +1,173 @@
+/**
+ *@file trace_replay.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief feed a recorded radio trace (app_trace.h) back through the SX1231 simulator
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <string.h>
+
+#include "trace_replay.h"
+#include "app_trace.h"
+
+/*
+A trace holds what the driver read, not what was on air. A packet is rebuilt from
+a run of fifo bytes of one radio, ended by any other record but that radio's RSSI
+reads: the first one gives its strength. It is injected where the first byte was read; the
+few us of polling latency in the capture are kept, so timing is comparable run to run.
+*/
+
+//packets whose trace time is already past are moved to now + lead, later ones keep their spacing
+#define REPLAY_LEAD_US			200
+#define REPLAY_RSSI_DEFAULT		-90
+
+typedef struct
+{
+	eTraceEvt_t evt;
+	uint8_t radio;
+	uint8_t value;
+	uint64_t us;
+}sReplayRec_t;
+
+static bool parse(sReplay_t *pReplay, uint16_t *pPos, sReplayRec_t *pRec)
+{
+	uint16_t pos = *pPos;
+	uint32_t delta = 0;
+	uint8_t shift = 0;
+	uint8_t hdr;
+
+	if(pos >= pReplay->len)
+	{
+		return false;
+	}
+
+	hdr = pReplay->pTrace[pos++];
+	pRec->evt = (eTraceEvt_t)(hdr >> 4);
+	pRec->radio = hdr & 0x0F;
+
+	do
+	{
+		if(pos >= pReplay->len || shift > 28)
+		{
+			return false;
+		}
+		delta |= (uint32_t)(pReplay->pTrace[pos] & 0x7F) << shift;
+		shift += 7;
+	}while(pReplay->pTrace[pos++] & 0x80);
+
+	pRec->value = 0;
+	if(pRec->evt == TRACE_EVT_BYTE || pRec->evt == TRACE_EVT_RSSI)
+	{
+		if(pos >= pReplay->len)
+		{
+			return false;
+		}
+		pRec->value = pReplay->pTrace[pos++];
+	}
+
+	pRec->us = pReplay->traceUs + delta;
+	*pPos = pos;
+	return true;
+}
+
+bool Replay_Init(sReplay_t *pReplay, const uint8_t *pTrace, uint16_t len, uint32_t carrier433Hz, uint32_t carrier916Hz)
+{
+	memset(pReplay, 0, sizeof(sReplay_t));
+
+	if(len < TRACE_HDR_LEN || pTrace[0] != TRACE_MAGIC || pTrace[1] != TRACE_VERSION)
+	{
+		return false;
+	}
+
+	pReplay->pTrace = pTrace;
+	pReplay->len = len;
+	pReplay->pos = TRACE_HDR_LEN;
+	pReplay->shiftUs = (int64_t)Sim_GetUs() + REPLAY_LEAD_US;
+	pReplay->carrierHz[0] = carrier433Hz;
+	pReplay->carrierHz[1] = carrier916Hz;
+
+	return true;
+}
+
+/*
+inject the next packet of the trace into the simulator, to be picked up by the
+rx path under test. Returns its length and radio, 0 at the end of the trace.
+*/
+uint16_t Replay_Next(sReplay_t *pReplay, uint8_t *pRadio)
+{
+	uint8_t data[SIM_PKT_MAX_LEN];
+	sReplayRec_t rec;
+	uint16_t len = 0;
+	uint16_t pos;
+	uint64_t startUs = 0;
+	int16_t rssi = REPLAY_RSSI_DEFAULT;
+	bool rssiSet = false;
+	uint8_t radio = 0;
+
+	//skip to the first byte of the next packet
+	while(1)
+	{
+		if(!parse(pReplay, &pReplay->pos, &rec))
+		{
+			return 0;
+		}
+		pReplay->traceUs = rec.us;
+
+		if(rec.evt == TRACE_EVT_BYTE && rec.radio < SIM_RADIO_NUM)
+		{
+			break;
+		}
+	}
+
+	radio = rec.radio;
+	startUs = rec.us;
+	data[len++] = rec.value;
+
+	//the rest of the run
+	pos = pReplay->pos;
+	while(parse(pReplay, &pos, &rec))
+	{
+		if(rec.evt == TRACE_EVT_RSSI && rec.radio == radio)
+		{
+			if(!rssiSet)
+			{
+				rssi = -(int16_t)rec.value;
+				rssiSet = true;
+			}
+		}
+		else if(rec.evt != TRACE_EVT_BYTE || rec.radio != radio || len >= SIM_PKT_MAX_LEN)
+		{
+			break;
+		}
+		else
+		{
+			data[len++] = rec.value;
+		}
+
+		pReplay->pos = pos;
+		pReplay->traceUs = rec.us;
+	}
+
+	if((int64_t)startUs + pReplay->shiftUs < (int64_t)Sim_GetUs() + REPLAY_LEAD_US)
+	{
+		pReplay->shiftUs = (int64_t)Sim_GetUs() + REPLAY_LEAD_US - (int64_t)startUs;
+	}
+
+	if(!Sim_InjectPkt(radio, (uint64_t)((int64_t)startUs + pReplay->shiftUs), pReplay->carrierHz[radio], rssi, data, len))
+	{
+		return 0;
+	}
+
+	pReplay->pktCnt++;
+	*pRadio = radio;
+	return len;
+}
+
@@ -0,0 +1,45 @@
+/**
+ *@file trace_replay.h
+ *@author Ribin Huang (you@domain.com)
+ *@brief feed a recorded radio trace (app_trace.h) back through the SX1231 simulator
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __TRACE_REPLAY_H__
+#define __TRACE_REPLAY_H__
+#include <stdint.h>
+#include <stdbool.h>
+#include "sx1231_sim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+	const uint8_t *pTrace;
+	uint16_t len;
+	uint16_t pos;				//next record
+	uint64_t traceUs;			//time of the last record parsed, relative to the trace start
+	int64_t shiftUs;			//sim time = trace time + shift
+	uint32_t carrierHz[SIM_RADIO_NUM];
+	uint32_t pktCnt;
+}sReplay_t;
+
+bool Replay_Init(sReplay_t *pReplay, const uint8_t *pTrace, uint16_t len, uint32_t carrier433Hz, uint32_t carrier916Hz);
+uint16_t Replay_Next(sReplay_t *pReplay, uint8_t *pRadio);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+